@@ -20,6 +20,7 @@
 #include "c4BlobStore.h"
 #include "BlobStore.hh"
 #include "Database.hh"
+#include "MappedFile.hh"
 
 
 // This is a no-op class that just serves to make c4BlobStore type-compatible with BlobStore.
@@ -66,6 +67,8 @@ C4BlobStore* c4blob_openStore(C4Slice dirPath,
         BlobStore::Options options = {};
         options.create = (flags & kC4DB_Create) != 0;
         options.writeable = !(flags & kC4DB_ReadOnly);
+        options.sharded = (flags & kC4DB_ShardBlobs) != 0;
+        options.compressed = (flags & kC4DB_CompressBlobs) != 0;
         if (key) {
             options.encryptionAlgorithm = (EncryptionAlgorithm)key->algorithm;
             options.encryptionKey = alloc_slice(key->bytes, sizeof(key->bytes));
@@ -99,6 +102,11 @@ bool c4blob_deleteStore(C4BlobStore* store, C4Error *outError) noexcept {
 }
 
 
+void c4blob_setMaxInlineSize(C4BlobStore* store, size_t maxSize) noexcept {
+    store->setMaxInlineSize(maxSize);
+}
+
+
 int64_t c4blob_getSize(C4BlobStore* store, C4BlobKey key) noexcept {
     try {
         return store->get(asInternal(key)).contentLength();
@@ -115,11 +123,54 @@ C4SliceResult c4blob_getContents(C4BlobStore* store, C4BlobKey key, C4Error* out
 }
 
 
+// Holds a blob's contents: either a mapping of its file, or a copy in memory.
+struct c4BlobMapping : public RefCounted {
+    c4BlobMapping(MappedFile *f)        :file(f), contents(f->contents()) { }
+    c4BlobMapping(alloc_slice d)        :data(d), contents(d) { }
+
+    Retained<MappedFile> const file;
+    alloc_slice const data;
+    slice const contents;
+};
+
+
+C4BlobMapping* c4blob_getContentsMapped(C4BlobStore* store,
+                                        C4BlobKey key,
+                                        C4Slice *outContents,
+                                        C4Error* outError) noexcept
+{
+    try {
+        Blob blob = store->get(asInternal(key));
+        Retained<MappedFile> file = blob.map();
+        Retained<C4BlobMapping> mapping;
+        if (file)
+            mapping = new C4BlobMapping(file);
+        else
+            mapping = new C4BlobMapping(blob.contents());
+        *outContents = mapping->contents;
+        return retain(mapping.get());
+    } catchError(outError)
+    return nullptr;
+}
+
+
+C4BlobMapping* c4blob_retainMapping(C4BlobMapping* mapping) noexcept {
+    return retain(mapping);
+}
+
+
+void c4blob_releaseMapping(C4BlobMapping* mapping) noexcept {
+    release(mapping);
+}
+
+
 C4StringResult c4blob_getFilePath(C4BlobStore* store, C4BlobKey key, C4Error* outError) noexcept {
     try {
-        auto path = store->get(asInternal(key)).path();
+        Blob blob = store->get(asInternal(key));
+        auto path = blob.path();
         if (!path.exists()) {
-            recordError(LiteCoreDomain, kC4ErrorNotFound, outError);
+            recordError(LiteCoreDomain, (blob.exists() ? kC4ErrorUnsupported : kC4ErrorNotFound),
+                        outError);
             return {nullptr, 0};
         } else if (store->isEncrypted()) {
             recordError(LiteCoreDomain, kC4ErrorWrongFormat, outError);
@@ -215,6 +266,20 @@ C4WriteStream* c4blob_openWriteStream(C4BlobStore* store, C4Error* outError) noe
 }
 
 
+C4WriteStream* c4blob_openResumableWriteStream(C4BlobStore* store,
+                                               C4BlobKey key,
+                                               uint64_t *outResumeOffset,
+                                               C4Error* outError) noexcept
+{
+    try {
+        auto stream = new BlobWriteStream(*store, asInternal(key));
+        *outResumeOffset = stream->resumeOffset();
+        return external(stream);
+    } catchError(outError)
+    return nullptr;
+}
+
+
 bool c4stream_write(C4WriteStream* stream, const void *bytes, size_t length, C4Error* outError) noexcept {
     if (length == 0)
         return true;
@@ -242,6 +307,15 @@ bool c4stream_install(C4WriteStream* stream,
 }
 
 
+bool c4stream_suspend(C4WriteStream* stream, C4Error *outError) noexcept {
+    try {
+        asInternal(stream)->suspend();
+        return true;
+    } catchError(outError)
+    return false;
+}
+
+
 void c4stream_closeWriter(C4WriteStream* stream) noexcept {
     if (!stream)
         return;
@@ -145,11 +145,55 @@ bool c4db_deleteAtPath(C4Slice dbPath, C4Error *outError) noexcept {
 }
 
 
+bool c4db_upgradeToVersionVectors(C4String dbPath, const C4DatabaseConfig *config,
+                                  C4Error *outError) noexcept
+{
+    return tryCatch(outError, bind(&Database::upgradeToVersionVectors, toString(dbPath), *config));
+}
+
+
 bool c4db_compact(C4Database* database, C4Error *outError) noexcept {
     return tryCatch(outError, bind(&Database::compact, database));
 }
 
 
+bool c4db_pruneRevisions(C4Database* database, uint32_t batchSize, C4PruneProgress *progress,
+                         C4Error *outError) noexcept
+{
+    if (!c4db_beginTransaction(database, outError))
+        return false;
+    bool ok = tryCatch(outError, [&]{
+        database->pruneRevisions(batchSize, *progress);
+    });
+    return c4db_endTransaction(database, ok, outError) && ok;
+}
+
+
+bool c4db_collectBlobs(C4Database* database, uint32_t batchSize, uint32_t graceSeconds,
+                       C4BlobGCProgress *progress, C4Error *outError) noexcept
+{
+    if (!c4db_beginTransaction(database, outError))
+        return false;
+    bool ok = tryCatch(outError, [&]{
+        database->collectBlobs(batchSize, graceSeconds, *progress);
+    });
+    return c4db_endTransaction(database, ok, outError) && ok;
+}
+
+
+bool c4db_resolveConflicts(C4Database* database, uint32_t batchSize,
+                           C4BulkConflictResolver resolver, void *context,
+                           C4ResolveConflictsProgress *progress, C4Error *outError) noexcept
+{
+    if (!c4db_beginTransaction(database, outError))
+        return false;
+    bool ok = tryCatch(outError, [&]{
+        database->resolveConflicts(batchSize, resolver, context, *progress);
+    });
+    return c4db_endTransaction(database, ok, outError) && ok;
+}
+
+
 bool c4db_rekey(C4Database* database, const C4EncryptionKey *newKey, C4Error *outError) noexcept {
     return tryCatch(outError, bind(&Database::rekey, database, newKey));
 }
@@ -185,6 +229,16 @@ void c4db_setMaxRevTreeDepth(C4Database *database, uint32_t depth) noexcept {
 }
 
 
+bool c4db_setDocumentCacheSize(C4Database *database, size_t maxBytes, C4Error *outError) noexcept {
+    return tryCatch(outError, bind(&Database::setDocumentCacheSize, database, maxBytes));
+}
+
+
+C4DocumentCacheStats c4db_getDocumentCacheStats(C4Database *database) noexcept {
+    return database->documentCacheStats();
+}
+
+
 bool c4db_getUUIDs(C4Database* database, C4UUID *publicUUID, C4UUID *privateUUID,
                    C4Error *outError) noexcept
 {
@@ -275,15 +329,18 @@ C4RawDocument* c4raw_get(C4Database* database,
                          C4Error *outError) noexcept
 {
     return tryCatch<C4RawDocument*>(outError, [&]{
-        Record r = database->getRawDocument(toString(storeName), key);
-        if (!r.exists()) {
+        // Copy straight out of the storage engine's row, instead of via a Record:
+        C4RawDocument *rawDoc = nullptr;
+        database->getRawDocument(toString(storeName), key, [&](const RecordLite &r) {
+            if (r.exists) {
+                rawDoc = new C4RawDocument;
+                rawDoc->key = r.key.copy();
+                rawDoc->meta = r.version.copy();
+                rawDoc->body = r.body.copy();
+            }
+        });
+        if (!rawDoc)
             recordError(LiteCoreDomain, kC4ErrorNotFound, outError);
-            return (C4RawDocument*)nullptr;
-        }
-        auto rawDoc = new C4RawDocument;
-        rawDoc->key = r.key().copy();
-        rawDoc->meta = r.version().copy();
-        rawDoc->body = r.body().copy();
         return rawDoc;
     });
 }
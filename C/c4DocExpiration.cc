@@ -25,6 +25,7 @@
 #include "fleece/slice.hh"
 #include <stdint.h>
 #include <ctime>
+#include <vector>
 
 using namespace fleece;
 
@@ -65,7 +66,15 @@ C4Timestamp c4db_purgeExpiredDocs(C4Database *db, C4Error *outError) C4API {
     int64_t count = -1;
     if (c4db_beginTransaction(db, outError)) {
         try {
-            count = db->defaultKeyStore().expireRecords();
+            vector<alloc_slice> docIDs;
+            count = db->defaultKeyStore().expireRecords([&](slice docID) {
+                db->deleteRevisionBodies(docID);    // (while the doc still exists)
+                docIDs.emplace_back(docID);
+            });
+            for (auto &docID : docIDs) {
+                db->uncacheDocument(docID);
+                db->updateBlobReferences(docID);
+            }
         } catchError(outError);
         if (!c4db_endTransaction(db, (count > 0), outError))
             count = -1;
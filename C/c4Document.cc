@@ -46,7 +46,7 @@ C4Document* c4doc_get(C4Database *database,
                       C4Error *outError) noexcept
 {
     return tryCatch<C4Document*>(outError, [&]{
-        auto doc = database->documentFactory().newDocumentInstance(docID);
+        auto doc = database->getDocument(docID);
         if (mustExist && !asInternal(doc)->exists()) {
             delete doc;
             doc = nullptr;
@@ -280,6 +280,19 @@ C4SliceResult c4doc_getRemoteAncestor(C4Document *doc, C4RemoteID remoteDatabase
 }
 
 
+C4SliceResult c4doc_getRevisionHistory(C4Document *doc,
+                                       unsigned maxRevs,
+                                       const C4String backToRevs[],
+                                       unsigned backToRevsCount) C4API
+{
+    return tryCatch<C4SliceResult>(nullptr, [&]{
+        return C4SliceResult(asInternal(doc)->getSelectedRevHistory(maxRevs,
+                                                                    (const slice*)backToRevs,
+                                                                    backToRevsCount));
+    });
+}
+
+
 bool c4doc_setRemoteAncestor(C4Document *doc, C4RemoteID remoteDatabase, C4Error *outError) C4API {
     return tryCatch<bool>(outError, [&]{
         asInternal(doc)->setRemoteAncestorRevID(remoteDatabase);
@@ -307,6 +320,7 @@ bool c4db_markSynced(C4Database *database, C4String docID, C4SequenceNumber sequ
             if (database->defaultKeyStore().setDocumentFlag(docID, sequence,
                                                             DocumentFlags::kSynced,
                                                             database->transaction())) {
+                database->uncacheDocument(docID);
                 return true;
             }
         }
@@ -566,6 +580,23 @@ C4Document* c4doc_update(C4Document *doc,
 }
 
 
+bool c4doc_save(C4Document *doc,
+                uint32_t maxRevTreeDepth,
+                C4Error *outError) noexcept
+{
+    auto idoc = asInternal(doc);
+    if (!idoc->mustBeInTransaction(outError))
+        return false;
+    try {
+        if (maxRevTreeDepth == 0)
+            maxRevTreeDepth = idoc->database()->maxRevTreeDepth();
+        idoc->save(maxRevTreeDepth);
+        return true;
+    } catchError(outError)
+    return false;
+}
+
+
 bool c4doc_removeRevisionBody(C4Document* doc) noexcept {
     auto idoc = asInternal(doc);
     return idoc->mustBeInTransaction(NULL) && idoc->removeSelectedRevBody();
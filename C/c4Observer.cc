@@ -21,6 +21,7 @@
 #include "Database.hh"
 #include "SequenceTracker.hh"
 #include "InstanceCounted.hh"
+#include "FleeceImpl.hh"
 
 using namespace std::placeholders;
 
@@ -36,6 +37,17 @@ struct c4DatabaseObserver : fleece::InstanceCounted {
                since)
     { }
 
+    c4DatabaseObserver(C4Database *db, ChangeFilter filter, C4SequenceNumber since,
+                       C4DatabaseObserverCallback callback, void *context)
+    :_db(db),
+     _callback(callback),
+     _context(context),
+     _notifier(db->sequenceTracker(),
+               bind(&c4DatabaseObserver::dispatchCallback, this, _1),
+               move(filter),
+               since)
+    { }
+
 
     void dispatchCallback(DatabaseChangeNotifier&) {
         _callback(this, _context);
@@ -62,30 +74,131 @@ C4DatabaseObserver* c4dbobs_create(C4Database *db,
 }
 
 
+namespace {
+    // Adapts a C4DatabaseObserverPredicate to a ChangeFilter::BodyPredicate. Each body is copied
+    // into one buffer that's covered by a single Fleece Scope, so its shared keys resolve without
+    // the cost of registering a new Scope per revision. (This is safe because the tracker calls
+    // the predicate with its mutex held, i.e. never concurrently.)
+    class ObserverPredicate {
+    public:
+        ObserverPredicate(C4DatabaseObserverPredicate predicate, void *context,
+                          fleece::impl::SharedKeys *keys)
+        :_predicate(predicate)
+        ,_context(context)
+        ,_state(make_shared<State>(keys))
+        { }
+
+        bool operator() (slice docID, const alloc_slice &body) {
+            const fleece::impl::Value *root = body.size > 0 ? _state->root(body) : nullptr;
+            return _predicate(docID, (FLDict)(root ? root->asDict() : nullptr), _context);
+        }
+
+    private:
+        struct State {
+            State(fleece::impl::SharedKeys *k)      :keys(k) { }
+
+            const fleece::impl::Value* root(slice body) {
+                if (body.size > buffer.size) {
+                    scope.reset();
+                    buffer = alloc_slice(max(body.size, 2 * buffer.size));
+                    scope.reset(new fleece::impl::Scope(buffer, keys));
+                }
+                memcpy((void*)buffer.buf, body.buf, body.size);
+                return fleece::impl::Value::fromTrustedData(slice(buffer.buf, body.size));
+            }
+
+            Retained<fleece::impl::SharedKeys> keys;
+            alloc_slice buffer;
+            unique_ptr<fleece::impl::Scope> scope;
+        };
+
+        C4DatabaseObserverPredicate _predicate;
+        void *_context;
+        shared_ptr<State> _state;                   // shared, since std::function copies us
+    };
+}
+
+
+C4DatabaseObserver* c4dbobs_createFiltered(C4Database *db,
+                                           const C4DatabaseObserverFilter *c4filter,
+                                           C4DatabaseObserverCallback callback,
+                                           void *context) noexcept
+{
+    return tryCatch<C4DatabaseObserver*>(nullptr, [&]{
+        ChangeFilter filter;
+        filter.docIDPrefix = alloc_slice(c4filter->docIDPrefix);
+        filter.docIDs.reserve(c4filter->docIDCount);
+        for (size_t i = 0; i < c4filter->docIDCount; ++i)
+            filter.docIDs.emplace(c4filter->docIDs[i]);
+        filter.deletedMode = (ChangeFilter::DeletedMode)c4filter->deletedMode;
+        if (c4filter->predicate)
+            filter.bodyPredicate = ObserverPredicate(c4filter->predicate,
+                                                     c4filter->predicateContext,
+                                                     db->documentKeys());
+        lock_guard<mutex> lock(db->sequenceTracker().mutex());
+        return new c4DatabaseObserver(db, move(filter), UINT64_MAX, callback, context);
+    });
+}
+
+
 uint32_t c4dbobs_getChanges(C4DatabaseObserver *obs,
                             C4DatabaseChange outChanges[],
                             uint32_t maxChanges,
                             bool *outExternal) noexcept
 {
-    static_assert(sizeof(C4DatabaseChange) == sizeof(SequenceTracker::Change),
-                  "C4DatabaseChange doesn't match SequenceTracker::Change");
     memset(outChanges, 0, maxChanges * sizeof(C4DatabaseChange));
+    return tryCatch<uint32_t>(nullptr, [&]{
+        // C4DatabaseChange doesn't have the flags, so it can't stand in for a
+        // SequenceTracker::Change the way C4DatabaseChangeWithFlags does (see below.) Instead,
+        // copy the docID and revID alloc_slices into it; c4dbobs_releaseChanges destructs them.
+        C4DatabaseChange *out = outChanges;
+        lock_guard<mutex> lock(obs->_notifier.tracker.mutex());
+        return (uint32_t) obs->_notifier.readChanges(maxChanges, *outExternal,
+                                                     [&](const SequenceTracker::Entry &entry) {
+            new (&out->docID) alloc_slice(entry.docID);
+            new (&out->revID) alloc_slice(entry.revID);
+            out->sequence = entry.sequence;
+            out->bodySize = entry.bodySize;
+            ++out;
+        });
+    });
+}
+
+
+void c4dbobs_releaseChanges(C4DatabaseChange changes[], uint32_t numChanges) noexcept {
+    for (uint32_t i = 0; i < numChanges; ++i) {
+        ((alloc_slice&)changes[i].docID).~alloc_slice();
+        ((alloc_slice&)changes[i].revID).~alloc_slice();
+    }
+}
+
+
+uint32_t c4dbobs_getChangesWithFlags(C4DatabaseObserver *obs,
+                                     C4DatabaseChangeWithFlags outChanges[],
+                                     uint32_t maxChanges,
+                                     bool *outExternal) noexcept
+{
+    static_assert(sizeof(C4DatabaseChangeWithFlags) == sizeof(SequenceTracker::Change),
+                  "C4DatabaseChangeWithFlags doesn't match SequenceTracker::Change");
+    memset(outChanges, 0, maxChanges * sizeof(C4DatabaseChangeWithFlags));
     return tryCatch<uint32_t>(nullptr, [&]{
         lock_guard<mutex> lock(obs->_notifier.tracker.mutex());
         return (uint32_t) obs->_notifier.readChanges((SequenceTracker::Change*)outChanges,
                                                      maxChanges,
                                                      *outExternal);
         // This is slightly sketchy because SequenceTracker::Change contains alloc_slices, whereas
-        // C4DatabaseChange contains slices. The result is that the docID and revID memory will be
-        // temporarily leaked, since the alloc_slice destructors won't be called.
-        // For this purpose we have c4dbobs_releaseChanges(), which does the same sleight of hand
-        // on the array but explicitly destructs each Change object, ensuring its alloc_slices are
-        // destructed and the backing store's ref-count goes back to what it was originally.
+        // C4DatabaseChangeWithFlags contains slices. The result is that the docID and revID
+        // memory will be temporarily leaked, since the alloc_slice destructors won't be called.
+        // For this purpose we have c4dbobs_releaseChangesWithFlags(), which does the same sleight
+        // of hand on the array but explicitly destructs each Change object, ensuring its
+        // alloc_slices are destructed and the backing store's ref-count goes back to what it was.
     });
 }
 
 
-void c4dbobs_releaseChanges(C4DatabaseChange changes[], uint32_t numChanges) noexcept {
+void c4dbobs_releaseChangesWithFlags(C4DatabaseChangeWithFlags changes[],
+                                     uint32_t numChanges) noexcept
+{
     for (uint32_t i = 0; i < numChanges; ++i) {
         auto &change = (SequenceTracker::Change&)changes[i];
         change.~Change();
@@ -134,8 +247,8 @@ C4DocumentObserver* c4docobs_create(C4Database *db,
                                     C4DocumentObserverCallback callback,
                                     void *context) noexcept
 {
+    // (A DocChangeNotifier does its own locking, so the tracker's mutex isn't needed.)
     return tryCatch<C4DocumentObserver*>(nullptr, [&]{
-        lock_guard<mutex> lock(db->sequenceTracker().mutex());
         return new c4DocumentObserver(db, docID, callback, context);
     });
 }
@@ -144,7 +257,6 @@ C4DocumentObserver* c4docobs_create(C4Database *db,
 void c4docobs_free(C4DocumentObserver* obs) noexcept {
     if (obs) {
         Retained<Database> db(obs->_db);        // keep db alive until obs is safely deleted
-        lock_guard<mutex> lock(obs->_notifier.tracker.mutex());
         delete obs;
     }
 }
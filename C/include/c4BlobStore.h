@@ -65,7 +65,11 @@ extern "C" {
         created if necessary.
         Call c4blob_freeStore() when finished using the BlobStore.
         @param dirPath  The filesystem path of the directory holding the attachments.
-        @param flags  Specifies options like create, read-only
+        @param flags  Specifies options like create, read-only. If kC4DB_ShardBlobs is set,
+                    blob files are kept in subdirectories; an existing store opened writeable
+                    is migrated to or from that layout to match the flag. If
+                    kC4DB_CompressBlobs is set, new blobs are compressed when stored, unless
+                    their contents are in an already-compressed format.
         @param encryptionKey  Optional encryption algorithm & key
         @param outError  Error is returned here
         @return  The BlobStore reference, or NULL on error */
@@ -80,6 +84,14 @@ extern "C" {
     /** Deletes the BlobStore's blobs and directory, and (if successful) frees the object. */
     bool c4blob_deleteStore(C4BlobStore* C4NONNULL, C4Error*) C4API;
 
+    /** Sets the maximum size of a blob that's stored inline, in a database in the store's
+        directory, instead of in a file of its own. Small blobs are much cheaper to store and
+        read inline, but an inline blob has no file path (see c4blob_getFilePath.)
+        Zero disables inlining; this is the default for stores opened by c4blob_openStore.
+        A database's store defaults to 4096 bytes. Existing blobs aren't affected.
+        Don't call this while blobs are being written. */
+    void c4blob_setMaxInlineSize(C4BlobStore* C4NONNULL, size_t maxSize) C4API;
+
     /** @} */
 
 
@@ -98,6 +110,34 @@ extern "C" {
     /** Reads the entire contents of a blob into memory. Caller is responsible for freeing it. */
     C4SliceResult c4blob_getContents(C4BlobStore* C4NONNULL, C4BlobKey, C4Error*) C4API;
 
+    /** A reference to the contents of a blob, returned by c4blob_getContentsMapped. */
+    typedef struct c4BlobMapping C4BlobMapping;
+
+    /** Gets the contents of a blob without copying them, by memory-mapping its file.
+        If the blob can't be mapped, because it's encrypted, compressed or stored inline, its
+        contents are read into memory instead, so this call always works if the blob exists.
+        The contents stay valid until the returned mapping is released.
+        The caller MUST not modify or delete the blob while it's mapped. (On Windows, the file
+        can't be deleted while it's mapped, so releasing the mapping promptly matters.)
+        @param store  The blob store.
+        @param key  The key of the blob.
+        @param outContents  On success, will be set to the blob's contents.
+        @param outError  On failure, the error will be stored here.
+        @return  A new reference to the mapping, to be released with c4blob_releaseMapping,
+                 or NULL on failure. */
+    C4BlobMapping* c4blob_getContentsMapped(C4BlobStore* C4NONNULL,
+                                            C4BlobKey key,
+                                            C4Slice *outContents C4NONNULL,
+                                            C4Error *outError) C4API;
+
+    /** Adds a reference to a mapping. */
+    C4BlobMapping* c4blob_retainMapping(C4BlobMapping*) C4API;
+
+    /** Releases a reference to a mapping. When the last reference is released, the contents
+        are unmapped and the slice returned by c4blob_getContentsMapped becomes invalid.
+        (A NULL parameter is allowed.) */
+    void c4blob_releaseMapping(C4BlobMapping*) C4API;
+
     /** Returns the path of the file that stores the blob, if possible. This call may fail with
         error kC4ErrorWrongFormat if the blob is encrypted (in which case the file would be
         unreadable by the caller) or with kC4ErrorUnsupported if for some implementation reason
@@ -177,6 +217,21 @@ extern "C" {
         the store, and then c4stream_closeWriter. */
     C4WriteStream* c4blob_openWriteStream(C4BlobStore* C4NONNULL, C4Error*) C4API;
 
+    /** Opens a write stream for a blob whose key is known in advance, and whose data may
+        arrive over several sessions, like a download on an unreliable connection. Data saved
+        by an earlier session's c4stream_suspend is kept, so only the data after
+        `*outResumeOffset` should be written. Then call c4stream_install as usual, which
+        installs all the data; or c4stream_suspend to save it for a later session.
+        @param store  The blob store.
+        @param key  The key of the blob's data.
+        @param outResumeOffset  On success, set to the number of bytes saved by earlier sessions.
+        @param outError  On failure, the error will be stored here.
+        @return  The stream, or NULL on failure. */
+    C4WriteStream* c4blob_openResumableWriteStream(C4BlobStore* C4NONNULL,
+                                                   C4BlobKey key,
+                                                   uint64_t *outResumeOffset C4NONNULL,
+                                                   C4Error *outError) C4API;
+
     /** Writes data to a stream. */
     bool c4stream_write(C4WriteStream*, const void *bytes, size_t length, C4Error*) C4API;
 
@@ -193,6 +248,12 @@ extern "C" {
                           const C4BlobKey *expectedKey,
                           C4Error*) C4API;
 
+    /** Saves the data written to a stream opened by c4blob_openResumableWriteStream, instead
+        of installing it, so that a later session for the same blob can continue after it.
+        No more data can be written afterwards; the stream still needs to be closed.
+        Saved data that's never resumed is deleted when the database is compacted. */
+    bool c4stream_suspend(C4WriteStream* C4NONNULL, C4Error*) C4API;
+
     /** Closes a blob write-stream. If c4stream_install was not already called (or was called but
         failed), the temporary file will be deleted without adding the blob to the store. 
         (A NULL parameter is allowed, and is a no-op.) */
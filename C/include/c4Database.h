@@ -43,11 +43,14 @@ extern "C" {
         kC4DB_SharedKeys    = 0x10, ///< Enable shared-keys optimization at creation time
         kC4DB_NoUpgrade     = 0x20, ///< Disable upgrading an older-version database
         kC4DB_NonObservable = 0x40, ///< Disable c4DatabaseObserver
+        kC4DB_ShardBlobs    = 0x80, ///< Store blob files in subdirectories by key prefix
+        kC4DB_CompressBlobs = 0x100,///< Compress new blob files, unless already compressed
     };
 
     /** Document versioning system (also determines database storage schema) */
     typedef C4_ENUM(uint32_t, C4DocumentVersioning) {
         kC4RevisionTrees,           ///< Revision trees
+        kC4VersionVectors,          ///< Version vectors (see c4db_upgradeToVersionVectors)
     };
 
     /** Encryption algorithms. */
@@ -138,6 +141,19 @@ extern "C" {
         Returns false, with no error, if the database doesn't exist. */
     bool c4db_deleteAtPath(C4String dbPath, C4Error *outError) C4API;
 
+    /** Converts the revision-tree database at the given path to version vectors, after which it
+        must be opened with kC4VersionVectors. This can't be undone: each document keeps only its
+        current revision (and a conflicting one, if any.) The config supplies the storage engine
+        and encryption key; its versioning and flags are ignored.
+        A revision "N-digest" becomes the version "N@-digest", followed by the versions of the
+        ancestors its tree kept, so peers that upgrade at different revisions of a document still
+        agree on which is newer. But a change made after upgrading conflicts with any revision
+        another peer made before it upgraded, so all peers must be fully synced first.
+        All C4Databases at that path must be closed first, or this fails with kC4ErrorBusy. */
+    bool c4db_upgradeToVersionVectors(C4String dbPath,
+                                      const C4DatabaseConfig *config C4NONNULL,
+                                      C4Error *outError) C4API;
+
 
     /** Changes a database's encryption key (removing encryption if it's NULL.) */
     bool c4db_rekey(C4Database* database C4NONNULL,
@@ -180,6 +196,31 @@ extern "C" {
     /** Configures the number of revisions of a document that are tracked. */
     void c4db_setMaxRevTreeDepth(C4Database *database C4NONNULL, uint32_t maxRevTreeDepth) C4API;
 
+    /** Statistics of a database's document cache; see c4db_setDocumentCacheSize. */
+    typedef struct {
+        uint64_t hits;                  ///< Number of c4doc_get calls satisfied from the cache
+        uint64_t misses;                ///< Number of c4doc_get calls that read the database
+        uint64_t evictions;             ///< Documents removed to stay within the size limit
+        uint64_t invalidations;         ///< Documents removed because they changed
+        uint64_t count;                 ///< Number of documents currently cached
+        uint64_t bytes;                 ///< Approximate size of the cached documents
+        uint64_t maxBytes;              ///< Size limit
+    } C4DocumentCacheStats;
+
+    /** Sets the size limit, in bytes, of the database's document cache, which keeps recently
+        read documents so that c4doc_get can return them without reading and decoding the
+        record. Cached documents are invalidated when they change, including by other
+        C4Database instances on the same file in this process. Changes made by other processes,
+        or by instances opened with kC4DB_NonObservable, are _not_ detected, so don't use the
+        cache in that situation. The default limit is 0, which disables the cache.
+        @return  True on success, false if the database was opened with kC4DB_NonObservable. */
+    bool c4db_setDocumentCacheSize(C4Database *database C4NONNULL,
+                                   size_t maxBytes,
+                                   C4Error *outError) C4API;
+
+    /** Returns the statistics of the database's document cache (all zero if it's disabled.) */
+    C4DocumentCacheStats c4db_getDocumentCacheStats(C4Database *database C4NONNULL) C4API;
+
     typedef struct {
         uint8_t bytes[16];
     } C4UUID;
@@ -199,6 +240,122 @@ extern "C" {
     bool c4db_compact(C4Database* database C4NONNULL, C4Error *outError) C4API;
 
 
+    /** Progress of c4db_pruneRevisions. Zero it before the first call, then pass it unchanged
+        to each following call; it can be saved to resume pruning later. */
+    typedef struct {
+        C4SequenceNumber lastSequence;  ///< Sequence of the last document examined
+        uint64_t docsPruned;            ///< Number of documents changed so far
+        uint64_t revsPruned;            ///< Number of revisions pruned from their trees so far
+        uint64_t bytesReclaimed;        ///< Total decrease in size of the changed documents
+        bool finished;                  ///< Set to true when all documents have been examined
+    } C4PruneProgress;
+
+    /** Applies the database's maximum revision tree depth to existing documents, and discards
+        bodies of non-leaf revisions that are no longer needed, just as saving each document
+        would. (Otherwise documents that don't change keep their old history indefinitely.)
+        Revisions that are the current ones of a remote database are never pruned, and documents
+        don't get new sequence numbers.
+
+        Each call examines the next `batchSize` documents, in sequence order, in its own
+        transaction; call it repeatedly, e.g. on a background thread with its own C4Database,
+        until `progress->finished` is true. Run c4db_compact afterwards to shrink the file.
+        @param database  The database.
+        @param batchSize  Maximum number of documents to examine in this call.
+        @param progress  Tracks progress across calls; see C4PruneProgress.
+        @param outError  On failure, the error will be stored here.
+        @return  True on success, false on failure. */
+    bool c4db_pruneRevisions(C4Database* database C4NONNULL,
+                             uint32_t batchSize,
+                             C4PruneProgress *progress C4NONNULL,
+                             C4Error *outError) C4API;
+
+
+    /** Progress of c4db_collectBlobs. Zero it before the first call of a pass, then pass it
+        unchanged to each following call. */
+    typedef struct {
+        C4SequenceNumber lastSequence;  ///< Internal position in the list of unused blobs
+        uint64_t blobsDeleted;          ///< Number of blobs deleted so far
+        uint64_t bytesDeleted;          ///< Total size of the deleted blobs
+        bool finished;                  ///< Set to true when no more blobs can be deleted yet
+    } C4BlobGCProgress;
+
+    /** Deletes blobs that are no longer referenced by any document, without scanning the
+        documents: the database keeps a count of each blob's references as documents are saved
+        and purged. A blob is only deleted once it's been unreferenced for `graceSeconds`, and
+        its file hasn't been written in that time, so that a blob added just before the
+        document that uses it is saved won't be deleted.
+
+        Each call examines the next `batchSize` unreferenced blobs, in its own transaction; call
+        it repeatedly until `progress->finished` is true. (In a database created by an earlier
+        version, the first call has to scan all documents once to count the references.)
+        c4db_compact also deletes unreferenced blobs, immediately, as well as any stray files
+        in the blob directory.
+        @param database  The database.
+        @param batchSize  Maximum number of blobs to examine in this call.
+        @param graceSeconds  Minimum time a blob must have been unreferenced to be deleted.
+        @param progress  Tracks progress across calls; see C4BlobGCProgress.
+        @param outError  On failure, the error will be stored here.
+        @return  True on success, false on failure. */
+    bool c4db_collectBlobs(C4Database* database C4NONNULL,
+                           uint32_t batchSize,
+                           uint32_t graceSeconds,
+                           C4BlobGCProgress *progress C4NONNULL,
+                           C4Error *outError) C4API;
+
+
+    /** A conflict resolution, returned by a C4BulkConflictResolver. The parameters are the same
+        as those of c4doc_resolveConflict. The slices must remain valid until the resolver is
+        called again or c4db_resolveConflicts returns, whichever comes first. */
+    typedef struct {
+        C4String winningRevID;          ///< Revision that wins the conflict
+        C4String losingRevID;           ///< Revision that loses the conflict
+        C4Slice mergedBody;             ///< Body of the merged revision, or null to use the winner's
+        C4RevisionFlags mergedFlags;    ///< Flags of the merged revision
+    } C4ConflictResolution;
+
+    /** Callback that resolves a conflicted document for c4db_resolveConflicts. The document's
+        current revision is selected; use c4doc_selectNextLeafRevision to find the conflicting
+        one(s). The callback must not free or save the document.
+        @return  True if it filled in the resolution, false to leave the document unresolved. */
+    typedef bool (*C4BulkConflictResolver)(void *context,
+                                           C4Document *doc C4NONNULL,
+                                           C4ConflictResolution *outResolution C4NONNULL);
+
+    /** Progress of c4db_resolveConflicts. Zero it before the first call, then pass it unchanged
+        to each following call. */
+    typedef struct {
+        C4SequenceNumber lastSequence;  ///< Sequence of the last conflicted document examined
+        uint64_t docsResolved;          ///< Number of documents resolved so far
+        uint64_t docsSkipped;           ///< Number of documents the resolver declined so far
+        double secondsElapsed;          ///< Total time spent in c4db_resolveConflicts so far
+        bool finished;                  ///< Set to true when all conflicts have been examined
+    } C4ResolveConflictsProgress;
+
+    /** Resolves many conflicted documents efficiently: the conflicted documents are found using
+        a (partial) index, each is read and decoded just once, and the resolutions are saved in
+        the same transaction. Call this instead of resolving documents one at a time after a
+        replication that created many conflicts.
+
+        Each call examines the next `batchSize` conflicted documents, in sequence order, in its
+        own transaction, calling the resolver for each one (and again while it has other
+        conflicting revisions); call it repeatedly until `progress->finished` is true. Throughput
+        can be computed as `docsResolved / secondsElapsed`.
+        @param database  The database.
+        @param batchSize  Maximum number of documents to examine in this call.
+        @param resolver  Callback that decides how to resolve each document's conflict.
+        @param context  Value passed to the resolver.
+        @param progress  Tracks progress across calls; see C4ResolveConflictsProgress.
+        @param outError  On failure, the error will be stored here. If the resolver returns an
+                    invalid resolution, this call fails and none of its batch is saved.
+        @return  True on success, false on failure. */
+    bool c4db_resolveConflicts(C4Database* database C4NONNULL,
+                               uint32_t batchSize,
+                               C4BulkConflictResolver resolver C4NONNULL,
+                               void *context,
+                               C4ResolveConflictsProgress *progress C4NONNULL,
+                               C4Error *outError) C4API;
+
+
     /** @} */
     /** \name Transactions
         @{ */
@@ -94,7 +94,8 @@ extern "C" {
 
     /** Saves changes to a C4Document.
         Must be called within a transaction.
-        The revision history will be pruned to the maximum depth given. */
+        The revision history will be pruned to the maximum depth given. (Version-vector
+        documents don't keep any history, so they ignore it.) */
     bool c4doc_save(C4Document *doc C4NONNULL,
                     uint32_t maxRevTreeDepth,
                     C4Error *outError) C4API;
@@ -123,7 +124,9 @@ extern "C" {
     bool c4doc_selectCurrentRevision(C4Document* doc C4NONNULL) C4API;
 
     /** Populates the body field of a doc's selected revision,
-        if it was initially loaded without its body. */
+        if it was initially loaded without its body. This is also needed after selecting a
+        non-current revision without `withBody`, since only the current revision's body is
+        stored with the document; others are read on demand. */
     bool c4doc_loadRevisionBody(C4Document* doc C4NONNULL,
                                 C4Error *outError) C4API;
 
@@ -189,13 +192,29 @@ extern "C" {
     C4SliceResult c4doc_getRemoteAncestor(C4Document *doc C4NONNULL,
                                           C4RemoteID remoteDatabase) C4API;
 
+    /** Returns the IDs of the selected revision and its ancestors, newest first, separated by
+        commas. (This is the form the replication protocol uses for revision histories.)
+        It's faster than walking the ancestors with c4doc_selectParentRevision, and doesn't
+        change the selected revision.
+        @param doc  The document.
+        @param maxRevs  The maximum number of revisions to include, counting the selected one.
+        @param backToRevs  If an ancestor's revID appears in this array, the history stops there.
+        @param backToRevsCount  The number of revIDs in `backToRevs`.
+        @return  The history string, which must be released; or a null slice if no revision is
+                 selected. */
+    C4SliceResult c4doc_getRevisionHistory(C4Document *doc C4NONNULL,
+                                           unsigned maxRevs,
+                                           const C4String backToRevs[],
+                                           unsigned backToRevsCount) C4API;
+
     /** Marks the selected revision as current for the given remote database. */
     bool c4doc_setRemoteAncestor(C4Document *doc C4NONNULL,
                                  C4RemoteID remoteDatabase,
                                  C4Error *error) C4API;
 
     /** Given a revision ID, returns its generation number (the decimal number before
-        the hyphen), or zero if it's unparseable. */
+        the hyphen, or before the '@' of a version vector's version), or zero if it's
+        unparseable. */
     unsigned c4rev_getGeneration(C4String revID) C4API;
 
 
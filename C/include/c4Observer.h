@@ -18,7 +18,8 @@
 
 #pragma once
 
-#include "c4Database.h"
+#include "c4Document.h"
+#include "fleece/Fleece.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,16 @@ extern "C" {
         uint32_t bodySize;
     } C4DatabaseChange;
 
+    /** Like C4DatabaseChange, but also has the revision's flags. Returned by
+        `c4dbobs_getChangesWithFlags`. */
+    typedef struct {
+        C4HeapString docID;
+        C4HeapString revID;
+        C4SequenceNumber sequence;
+        uint32_t bodySize;
+        C4RevisionFlags flags;
+    } C4DatabaseChangeWithFlags;
+
     /** A database-observer reference. */
     typedef struct c4DatabaseObserver C4DatabaseObserver;
 
@@ -55,6 +66,49 @@ extern "C" {
                                        C4DatabaseObserverCallback callback C4NONNULL,
                                        void *context) C4API;
 
+    /** Which revisions a filtered database observer sees, based on whether they're deletions. */
+    typedef C4_ENUM(uint8_t, C4ObserverDeletedMode) {
+        kC4ObserveAllRevisions,         ///< Deletions and non-deletions
+        kC4ObserveLiveRevisions,        ///< Only non-deletions
+        kC4ObserveDeletions,            ///< Only deletions
+    };
+
+    /** Callback that decides whether a filtered database observer sees a revision.
+        It's called while the database's change tracker is locked, so it must be fast and must
+        not call back into LiteCore.
+        @param docID  The ID of the changed document.
+        @param body  The revision's body, or NULL if it has none (as with a deletion.)
+        @param context  The `predicateContext` from the filter.
+        @return  True if the observer should see the revision. */
+    typedef bool (*C4DatabaseObserverPredicate)(C4String docID,
+                                                FLDict body,
+                                                void *context);
+
+    /** Restricts the changes a database observer sees. Zero/NULL fields don't restrict anything.
+        Changes that don't pass the filter are skipped without waking up the observer. */
+    typedef struct {
+        C4String docIDPrefix;                   ///< Only docIDs that start with this
+        const C4String *docIDs;                 ///< Only these docIDs
+        size_t docIDCount;                      ///< Number of items in `docIDs`
+        C4ObserverDeletedMode deletedMode;      ///< Deletions, non-deletions, or both
+        C4DatabaseObserverPredicate predicate;  ///< Only revisions whose bodies pass this
+        void *predicateContext;                 ///< Value passed to `predicate`
+    } C4DatabaseObserverFilter;
+
+    /** Creates a new database observer like `c4dbobs_create`, but one that only sees the changes
+        that pass a filter. Its callback isn't called for other changes, and they aren't returned
+        by `c4dbobs_getChanges`. Changes made through other C4Databases on the same file are
+        filtered too.
+        @param database  The database to observer.
+        @param filter  The filter. Its contents are copied, so it needn't remain valid.
+        @param callback  The function to call after the database changes.
+        @param context  An arbitrary value that will be passed to the callback.
+        @return  The new observer reference. */
+    C4DatabaseObserver* c4dbobs_createFiltered(C4Database* database C4NONNULL,
+                                               const C4DatabaseObserverFilter *filter C4NONNULL,
+                                               C4DatabaseObserverCallback callback C4NONNULL,
+                                               void *context) C4API;
+
     /** Identifies which documents have changed since the last time this function was called, or
         since the observer was created. This function effectively "reads" changes from a stream,
         in whatever quantity the caller desires. Once all of the changes have been read, the
@@ -84,6 +138,17 @@ extern "C" {
     void c4dbobs_releaseChanges(C4DatabaseChange changes[],
                                 uint32_t numChanges) C4API;
 
+    /** Same as `c4dbobs_getChanges`, but also returns each revision's flags.
+        You must call `c4dbobs_releaseChangesWithFlags` afterwards. */
+    uint32_t c4dbobs_getChangesWithFlags(C4DatabaseObserver *observer C4NONNULL,
+                                         C4DatabaseChangeWithFlags outChanges[] C4NONNULL,
+                                         uint32_t maxChanges,
+                                         bool *outExternal C4NONNULL) C4API;
+
+    /** Releases the memory used by the structs returned by `c4dbobs_getChangesWithFlags`. */
+    void c4dbobs_releaseChangesWithFlags(C4DatabaseChangeWithFlags changes[],
+                                         uint32_t numChanges) C4API;
+
     /** Stops an observer and frees the resources it's using.
         It is safe to pass NULL to this call. */
     void c4dbobs_free(C4DatabaseObserver*) C4API;
@@ -192,6 +192,8 @@ extern "C" {
         kC4FullTextIndex,      ///< Full-text index
         kC4ArrayIndex,         ///< Index of array values, for use with UNNEST
         kC4PredictiveIndex,    ///< Index of prediction() results (Enterprise Edition only)
+        kC4GeoIndex,           ///< R*Tree index of latitude/longitude, for WITHIN_BOX/WITHIN_RADIUS
+        kC4VectorIndex,        ///< Index of numeric vectors (embeddings), for VECTOR_MATCH
     };
 
 
@@ -234,7 +236,7 @@ extern "C" {
         The name is used to identify the index for later updating or deletion; if an index with the
         same name already exists, it will be replaced unless it has the exact same expressions.
 
-        Currently four types of indexes are supported:
+        Currently six types of indexes are supported:
 
         * Value indexes speed up queries by making it possible to look up property (or expression)
           values without scanning every document. They're just like regular indexes in SQL or N1QL.
@@ -249,6 +251,17 @@ extern "C" {
           (across all documents) as a table in the SQLite database, and creating a SQL index on it.
         * Predictive indexes optimize queries that use the PREDICTION() function, by materializing
           the function's results as a table and creating a SQL index on a result property.
+        * Geospatial indexes optimize the `WITHIN_BOX` and `WITHIN_RADIUS` operators, by storing
+          each document's location in an R*Tree. They take exactly two expressions, the latitude
+          and longitude in degrees, e.g. `[[".loc.lat"], [".loc.lon"]]`. Documents whose
+          coordinates aren't both numbers are left out of the index.
+        * Vector indexes optimize the `VECTOR_MATCH` operator, which finds the documents whose
+          vectors (arrays of numbers, such as embeddings) are nearest a target vector. They take
+          exactly one expression, e.g. `[[".embedding"]]`, and store each document's vector as
+          packed floats so that a search doesn't have to read any document bodies.
+          `VECTOR_MATCH` picks its `maxResults` nearest documents before the rest of the WHERE
+          clause is applied, so combined with other conditions it may return fewer rows than
+          that; pass a larger `maxResults` to compensate.
 
         Note: If some documents are missing the values to be indexed,
         those documents will just be omitted from the index. It's not an error.
@@ -234,6 +234,7 @@ extern "C" {
     #define kC4ReplicatorResetCheckpoint        "reset"     ///< Start over w/o checkpoint (bool)
     #define kC4ReplicatorOptionProgressLevel    "progress"  ///< If >=1, notify on every doc; if >=2, on every attachment (int)
     #define kC4ReplicatorOptionDisableDeltas    "noDeltas"   ///< Disables delta sync (bool)
+    #define kC4ReplicatorOptionMaxBlobFetches   "maxBlobFetches" ///< Max blobs per doc to download at once (int)
 
     // Auth dictionary keys:
     #define kC4ReplicatorAuthType       "type"           ///< Auth type; see below (string)
@@ -19,6 +19,7 @@
 #include "c4Test.hh"
 #include "c4BlobStore.h"
 #include "c4Private.h"
+#include "Benchmark.hh"
 
 using namespace std;
 
@@ -31,23 +32,30 @@ public:
     BlobStoreTest(int option)
     :encrypted(option == 1)
     {
-        C4EncryptionKey crypto, *encryption=nullptr;
         if (encrypted) {
             fprintf(stderr, "        ...encrypted\n");
             INFO("(Encrypted)");
             crypto.algorithm = kC4EncryptionAES256;
             memset(&crypto.bytes, 0xCC, sizeof(crypto.bytes));
-            encryption = &crypto;
         }
+        openStore(kC4DB_Create);
 
+        memset(bogusKey.bytes, 0x55, sizeof(bogusKey.bytes));
+    }
+
+    void openStore(C4DatabaseFlags flags) {
         C4Error error;
         store = c4blob_openStore(TEMPDIR("cbl_blob_test" + kPathSeparator),
-                                 kC4DB_Create,
-                                 encryption,
+                                 flags,
+                                 (encrypted ? &crypto : nullptr),
                                  &error);
         REQUIRE(store != nullptr);
+    }
 
-        memset(bogusKey.bytes, 0x55, sizeof(bogusKey.bytes));
+    void reopenStore(C4DatabaseFlags flags) {
+        c4blob_freeStore(store);
+        store = nullptr;
+        openStore(flags);
     }
 
     ~BlobStoreTest() {
@@ -57,6 +65,7 @@ public:
 
     C4BlobStore *store {nullptr};
     const bool encrypted;
+    C4EncryptionKey crypto;
 
     C4BlobKey bogusKey;
 };
@@ -332,3 +341,371 @@ N_WAY_TEST_CASE_METHOD(BlobStoreTest, "write blob and cancel", "[blob][Encryptio
 
     c4stream_closeWriter(stream);
 }
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "inline blobs", "[blob][Encryption][C]") {
+    c4blob_setMaxInlineSize(store, 100);
+
+    // A small blob is stored inline:
+    string blob = "This is a blob to store in the store!";
+    C4BlobKey key;
+    C4Error error;
+    REQUIRE(c4blob_create(store, {blob.data(), blob.size()}, nullptr, &key, &error));
+    CHECK(c4blob_getSize(store, key) == blob.size());
+
+    auto gotBlob = c4blob_getContents(store, key, &error);
+    REQUIRE(gotBlob.buf != nullptr);
+    CHECK(string((char*)gotBlob.buf, gotBlob.size) == blob);
+    c4slice_free(gotBlob);
+
+    auto stream = c4blob_openReadStream(store, key, &error);
+    REQUIRE(stream);
+    char buf[100];
+    REQUIRE(c4stream_seek(stream, 10, &error));
+    REQUIRE(c4stream_read(stream, buf, 4, &error) == 4);
+    CHECK(memcmp(buf, "blob", 4) == 0);
+    CHECK(c4stream_getLength(stream, &error) == blob.size());
+    c4stream_close(stream);
+
+    C4SliceResult p = c4blob_getFilePath(store, key, &error);
+    CHECK(p.buf == nullptr);
+    CHECK(error.code == kC4ErrorUnsupported);
+
+    if (encrypted) {
+        // The database file isn't encrypted, but the blob's contents are:
+        reopenStore(kC4DB_Create);          // (closing the database checkpoints it)
+        string dbPath = TempDir() + "cbl_blob_test" + kPathSeparator + "inline_blobs.sqlite3";
+        FILE *f = fopen(dbPath.c_str(), "rb");
+        REQUIRE(f);
+        string data;
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            data.append(chunk, n);
+        fclose(f);
+        CHECK(data.find(blob) == string::npos);
+        CHECK(c4blob_getSize(store, key) == blob.size());
+    }
+
+    // A larger blob is stored as a file:
+    string bigBlob(1000, '*');
+    C4BlobKey bigKey;
+    REQUIRE(c4blob_create(store, {bigBlob.data(), bigBlob.size()}, nullptr, &bigKey, &error));
+    gotBlob = c4blob_getContents(store, bigKey, &error);
+    CHECK(string((char*)gotBlob.buf, gotBlob.size) == bigBlob);
+    c4slice_free(gotBlob);
+    if (!encrypted) {
+        p = c4blob_getFilePath(store, bigKey, &error);
+        CHECK(p.buf != nullptr);
+        c4slice_free(p);
+    }
+
+    // Deleting the inline blob:
+    REQUIRE(c4blob_delete(store, key, &error));
+    CHECK(c4blob_getSize(store, key) == -1);
+    CHECK(c4blob_getSize(store, bigKey) >= (int64_t)bigBlob.size());
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "sharded blob store", "[blob][Encryption][C]") {
+    vector<C4BlobKey> keys;
+    vector<string> blobs;
+    C4Error error;
+    for (int i = 0; i < 20; i++) {
+        blobs.push_back("This is blob #" + to_string(i));
+        C4BlobKey key;
+        REQUIRE(c4blob_create(store, {blobs[i].data(), blobs[i].size()}, nullptr, &key, &error));
+        keys.push_back(key);
+    }
+
+    auto checkBlobs = [&](bool sharded) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto contents = c4blob_getContents(store, keys[i], &error);
+            REQUIRE(contents.buf != nullptr);
+            CHECK(string((char*)contents.buf, contents.size) == blobs[i]);
+            c4slice_free(contents);
+            if (!encrypted) {
+                C4SliceResult p = c4blob_getFilePath(store, keys[i], &error);
+                REQUIRE(p.buf != nullptr);
+                string path((char*)p.buf, p.size);
+                c4slice_free(p);
+                char shard[4];
+                sprintf(shard, "%02x", keys[i].bytes[0]);
+                string shardDir = string(kPathSeparator) + shard + kPathSeparator;
+                CHECK((path.find(shardDir) != string::npos) == sharded);
+            }
+        }
+    };
+
+    // Only a sharded store has a manifest:
+    auto manifestExists = [&]() {
+        string path = TempDir() + "cbl_blob_test" + kPathSeparator + "blob_manifest.sqlite3";
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f)
+            fclose(f);
+        return f != nullptr;
+    };
+    CHECK(!manifestExists());
+
+    // Migrate the flat store to the sharded layout, and add a blob to it:
+    reopenStore(kC4DB_Create | kC4DB_ShardBlobs);
+    CHECK(manifestExists());
+    checkBlobs(true);
+    blobs.push_back("This blob was added to a sharded store");
+    C4BlobKey key;
+    REQUIRE(c4blob_create(store, {blobs.back().data(), blobs.back().size()}, nullptr, &key, &error));
+    keys.push_back(key);
+    checkBlobs(true);
+
+    // Migrate it back:
+    reopenStore(kC4DB_Create);
+    CHECK(!manifestExists());
+    checkBlobs(false);
+
+    REQUIRE(c4blob_delete(store, keys[0], &error));
+    CHECK(c4blob_getSize(store, keys[0]) == -1);
+}
+
+
+// Writes a blob of `size` bytes, where each byte's value is its position mod 251.
+static C4BlobKey writePatternBlob(C4BlobStore *store, size_t size, size_t chunkSize) {
+    C4Error error;
+    C4WriteStream *stream = c4blob_openWriteStream(store, &error);
+    REQUIRE(stream);
+    vector<uint8_t> chunk(chunkSize);
+    for (size_t pos = 0; pos < size; pos += chunkSize) {
+        size_t n = min(chunkSize, size - pos);
+        for (size_t i = 0; i < n; i++)
+            chunk[i] = (uint8_t)((pos + i) % 251);
+        REQUIRE(c4stream_write(stream, chunk.data(), n, &error));
+    }
+    C4BlobKey key = c4stream_computeBlobKey(stream);
+    REQUIRE(c4stream_install(stream, nullptr, &error));
+    c4stream_closeWriter(stream);
+    return key;
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "read blob in bulk", "[blob][Encryption][C]") {
+    // Big enough that large reads decrypt many bulk runs of blocks:
+    static const size_t kBlobSize = 3 * 1024 * 1024 + 1000;
+    C4BlobKey key = writePatternBlob(store, kBlobSize, 100000);
+
+    C4Error error;
+    C4ReadStream *reader = c4blob_openReadStream(store, key, &error);
+    REQUIRE(reader);
+    CHECK(c4stream_getLength(reader, &error) == kBlobSize);
+    vector<uint8_t> buf(1024 * 1024 + 123);
+    size_t pos = 0, bytesRead;
+    while ((bytesRead = c4stream_read(reader, buf.data(), buf.size(), &error)) > 0) {
+        for (size_t i = 0; i < bytesRead; i++) {
+            if (buf[i] != (uint8_t)((pos + i) % 251))
+                FAIL("Wrong byte at offset " << (pos + i));
+        }
+        pos += bytesRead;
+    }
+    CHECK(error.code == 0);
+    CHECK(pos == kBlobSize);
+
+    // Seek back after bulk reads, including into the last block that was read:
+    size_t offsets[3] = {0, 2 * 1024 * 1024 - 10, kBlobSize - 500};
+    for (size_t offset : offsets) {
+        REQUIRE(c4stream_seek(reader, offset, &error));
+        REQUIRE(c4stream_read(reader, buf.data(), 20, &error) == 20);
+        for (size_t i = 0; i < 20; i++)
+            CHECK(buf[i] == (uint8_t)((offset + i) % 251));
+    }
+    c4stream_close(reader);
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "mapped blob contents", "[blob][Encryption][C]") {
+    c4blob_setMaxInlineSize(store, 100);
+    static const size_t kBlobSize = 300 * 1000;
+    C4BlobKey key = writePatternBlob(store, kBlobSize, 10000);
+    string small = "tiny inline blob";
+    C4BlobKey smallKey;
+    C4Error error;
+    REQUIRE(c4blob_create(store, {small.data(), small.size()}, nullptr, &smallKey, &error));
+
+    C4Slice contents;
+    C4BlobMapping *mapping = c4blob_getContentsMapped(store, key, &contents, &error);
+    REQUIRE(mapping);
+    REQUIRE(contents.size == kBlobSize);
+    for (size_t i = 0; i < kBlobSize; i++) {
+        if (((const uint8_t*)contents.buf)[i] != (uint8_t)(i % 251))
+            FAIL("Wrong byte at offset " << i);
+    }
+    // The contents stay valid as long as any reference remains:
+    CHECK(c4blob_retainMapping(mapping) == mapping);
+    c4blob_releaseMapping(mapping);
+    CHECK(((const uint8_t*)contents.buf)[kBlobSize - 1] == (uint8_t)((kBlobSize - 1) % 251));
+    c4blob_releaseMapping(mapping);
+
+    // Inline blobs fall back to a copy:
+    mapping = c4blob_getContentsMapped(store, smallKey, &contents, &error);
+    REQUIRE(mapping);
+    CHECK(string((const char*)contents.buf, contents.size) == small);
+    c4blob_releaseMapping(mapping);
+
+    mapping = c4blob_getContentsMapped(store, bogusKey, &contents, &error);
+    CHECK(mapping == nullptr);
+    CHECK(error.domain == LiteCoreDomain);
+    CHECK(error.code == kC4ErrorNotFound);
+    c4blob_releaseMapping(nullptr);
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "compressed blobs", "[blob][Encryption][C]") {
+    reopenStore(kC4DB_Create | kC4DB_CompressBlobs);
+    C4Error error;
+
+    // Compressible data is compressed, so it has no file path, but reads back the same:
+    string text;
+    for (int i = 0; i < 2000; i++)
+        text += "{\"name\": \"item " + to_string(i) + "\", \"tags\": [\"blob\", \"test\"]}\n";
+    C4BlobKey key;
+    REQUIRE(c4blob_create(store, {text.data(), text.size()}, nullptr, &key, &error));
+    CHECK(memcmp(c4blob_computeKey({text.data(), text.size()}).bytes, key.bytes, 20) == 0);
+    CHECK(c4blob_getSize(store, key) == (int64_t)text.size());
+    C4SliceResult contents = c4blob_getContents(store, key, &error);
+    CHECK(string((char*)contents.buf, contents.size) == text);
+    c4slice_free(contents);
+    C4SliceResult p = c4blob_getFilePath(store, key, &error);
+    CHECK(p.buf == nullptr);
+    CHECK(error.code == kC4ErrorUnsupported);
+
+    // Seek forwards and backwards in the compressed stream:
+    C4ReadStream *reader = c4blob_openReadStream(store, key, &error);
+    REQUIRE(reader);
+    CHECK(c4stream_getLength(reader, &error) == (int64_t)text.size());
+    char buf[20];
+    size_t offsets[3] = {text.size() / 2, 10, text.size() - 20};
+    for (size_t offset : offsets) {
+        REQUIRE(c4stream_seek(reader, offset, &error));
+        REQUIRE(c4stream_read(reader, buf, sizeof(buf), &error) == sizeof(buf));
+        CHECK(string(buf, sizeof(buf)) == text.substr(offset, sizeof(buf)));
+    }
+    c4stream_close(reader);
+
+    // A large blob written in pieces:
+    static const size_t kBlobSize = 1024 * 1024 + 1000;
+    C4BlobKey bigKey = writePatternBlob(store, kBlobSize, 100000);
+    CHECK(c4blob_getSize(store, bigKey) == (int64_t)kBlobSize);
+    contents = c4blob_getContents(store, bigKey, &error);
+    REQUIRE(contents.size == kBlobSize);
+    for (size_t i = 0; i < kBlobSize; i++) {
+        if (((const uint8_t*)contents.buf)[i] != (uint8_t)(i % 251))
+            FAIL("Wrong byte at offset " << i);
+    }
+    c4slice_free(contents);
+
+    // Data that's already compressed, like a JPEG, is stored as is:
+    string jpeg = "\xFF\xD8\xFF\xE0" + string(10000, 'J');
+    C4BlobKey jpegKey;
+    REQUIRE(c4blob_create(store, {jpeg.data(), jpeg.size()}, nullptr, &jpegKey, &error));
+    CHECK(c4blob_getSize(store, jpegKey) >= (int64_t)jpeg.size());
+    if (!encrypted) {
+        p = c4blob_getFilePath(store, jpegKey, &error);
+        CHECK(p.buf != nullptr);
+        c4slice_free(p);
+    }
+
+    REQUIRE(c4blob_delete(store, key, &error));
+    CHECK(c4blob_getSize(store, key) == -1);
+    CHECK(c4blob_getContents(store, key, &error).buf == nullptr);
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "resumable blob writes", "[blob][Encryption][C][!throws]") {
+    string data;
+    for (int i = 0; i < 10000; i++)
+        data += "Line " + to_string(i) + " of a blob downloaded in pieces\n";
+    C4BlobKey key = c4blob_computeKey({data.data(), data.size()});
+    C4Error error;
+
+    // Write the blob over three sessions, suspending the first two:
+    size_t splits[3] = {30000, 70000, data.size()};
+    uint64_t offset = 0;
+    for (size_t end : splits) {
+        uint64_t resumeOffset = 12345;
+        C4WriteStream *stream = c4blob_openResumableWriteStream(store, key, &resumeOffset, &error);
+        REQUIRE(stream);
+        CHECK(resumeOffset == offset);
+        REQUIRE(c4stream_write(stream, &data[offset], end - offset, &error));
+        if (end < data.size())
+            REQUIRE(c4stream_suspend(stream, &error));
+        else
+            REQUIRE(c4stream_install(stream, nullptr, &error));
+        c4stream_closeWriter(stream);
+        CHECK((c4blob_getSize(store, key) >= 0) == (end == data.size()));
+        offset = end;
+    }
+    C4SliceResult contents = c4blob_getContents(store, key, &error);
+    CHECK(string((char*)contents.buf, contents.size) == data);
+    c4slice_free(contents);
+
+    // The saved data was deleted when the blob was installed:
+    C4WriteStream *stream = c4blob_openResumableWriteStream(store, key, &offset, &error);
+    REQUIRE(stream);
+    CHECK(offset == 0);
+    c4stream_closeWriter(stream);
+
+    // If the saved data is wrong, installing fails, and the next session starts over:
+    string other = data + "!";
+    C4BlobKey otherKey = c4blob_computeKey({other.data(), other.size()});
+    stream = c4blob_openResumableWriteStream(store, otherKey, &offset, &error);
+    REQUIRE(stream);
+    REQUIRE(c4stream_write(stream, "Bogus", 5, &error));
+    REQUIRE(c4stream_suspend(stream, &error));
+    c4stream_closeWriter(stream);
+
+    stream = c4blob_openResumableWriteStream(store, otherKey, &offset, &error);
+    REQUIRE(stream);
+    CHECK(offset == 5);
+    REQUIRE(c4stream_write(stream, &other[5], other.size() - 5, &error));
+    {
+        ExpectingExceptions x;
+        CHECK(!c4stream_install(stream, nullptr, &error));
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorCorruptData);
+    }
+    c4stream_closeWriter(stream);
+    CHECK(c4blob_getSize(store, otherKey) == -1);
+
+    stream = c4blob_openResumableWriteStream(store, otherKey, &offset, &error);
+    REQUIRE(stream);
+    CHECK(offset == 0);
+    c4stream_closeWriter(stream);
+}
+
+
+N_WAY_TEST_CASE_METHOD(BlobStoreTest, "blob stream throughput", "[blob][Encryption][Perf][C][.slow]") {
+    static const size_t kBlobSize = 64 * 1024 * 1024, kChunkSize = 1024 * 1024;
+    static const double kMB = 1024.0 * 1024.0;
+    C4BlobKey key;
+    {
+        fleece::Stopwatch st;
+        key = writePatternBlob(store, kBlobSize, kChunkSize);
+        double elapsed = st.elapsed();
+        C4Log("Writing %.0f MB in %zu-byte chunks took %.3f sec (%.0f MB/sec)",
+              kBlobSize / kMB, kChunkSize, elapsed, kBlobSize / kMB / elapsed);
+    }
+
+    size_t readSizes[3] = {4096, 64 * 1024, kChunkSize};
+    for (size_t readSize : readSizes) {
+        C4Error error;
+        vector<uint8_t> buf(readSize);
+        fleece::Stopwatch st;
+        C4ReadStream *reader = c4blob_openReadStream(store, key, &error);
+        REQUIRE(reader);
+        size_t total = 0, bytesRead;
+        while ((bytesRead = c4stream_read(reader, buf.data(), readSize, &error)) > 0)
+            total += bytesRead;
+        c4stream_close(reader);
+        double elapsed = st.elapsed();
+        CHECK(total == kBlobSize);
+        C4Log("Reading %.0f MB in %zu-byte chunks took %.3f sec (%.0f MB/sec)",
+              kBlobSize / kMB, readSize, elapsed, kBlobSize / kMB / elapsed);
+    }
+}
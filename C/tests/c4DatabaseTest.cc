@@ -260,6 +260,52 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Rekey", "[Database][Encryption]
     REQUIRE(memcmp(c4db_getConfig(db)->encryptionKey.bytes, newKey.bytes, 32) == 0);
     reopenDB();
 }
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Rekey Resumes Copying Blobs", "[Database][Encryption][blob][C]") {
+    // Add blobs of various sizes, inline and not:
+    C4Error error;
+    auto blobStore = c4db_getBlobStore(db, &error);
+    REQUIRE(blobStore);
+    vector<C4BlobKey> keys;
+    vector<string> blobs;
+    for (int i = 0; i < 100; i++) {
+        blobs.push_back(string(i * 97, 'a' + (i % 26)) + to_string(i));
+        C4BlobKey key;
+        REQUIRE(c4blob_create(blobStore, {blobs[i].data(), blobs[i].size()}, nullptr,
+                              &key, &error));
+        keys.push_back(key);
+    }
+
+    C4EncryptionKey newKey = {kC4EncryptionNone, {}}, *newKeyPtr = nullptr;
+    if (c4db_getConfig(db)->encryptionKey.algorithm == kC4EncryptionNone) {
+        newKey.algorithm = kC4EncryptionAES256;
+        memcpy(newKey.bytes, "a different key than default....", kC4EncryptionKeySizeAES256);
+        newKeyPtr = &newKey;
+    }
+
+    // Simulate an interrupted rekey, which copied some of the blobs:
+    C4SliceResult dbPath = c4db_getPath(db);
+    string tempPath = string((char*)dbPath.buf, dbPath.size) + "Attachments_temp" + kPathSeparator;
+    c4slice_free(dbPath);
+    C4BlobStore *tempStore = c4blob_openStore(c4str(tempPath.c_str()), kC4DB_Create, newKeyPtr,
+                                              &error);
+    REQUIRE(tempStore);
+    for (int i = 0; i < 30; i++) {
+        REQUIRE(c4blob_create(tempStore, {blobs[i].data(), blobs[i].size()}, nullptr,
+                              nullptr, &error));
+    }
+    c4blob_freeStore(tempStore);
+
+    REQUIRE(c4db_rekey(db, newKeyPtr, &error));
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        C4SliceResult contents = c4blob_getContents(blobStore, keys[i], &error);
+        CHECK(string((char*)contents.buf, contents.size) == blobs[i]);
+        c4slice_free(contents);
+    }
+    reopenDB();
+}
 #endif
 
 
@@ -550,6 +596,565 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact", "[Database][C]")
     REQUIRE(c4blob_getSize(store, key3) == -1);
 }
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Inline Blobs In Transaction", "[Database][C]")
+{
+    C4Error err;
+    C4BlobStore *store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+    string small = "This blob is small enough to be stored inline";
+    C4BlobKey key1, key2;
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4blob_create(store, c4str(small.c_str()), nullptr, &key1, &err));
+        CHECK(c4blob_getSize(store, key1) == (int64_t)small.size());
+    }
+    CHECK(c4blob_getSize(store, key1) == (int64_t)small.size());
+
+    // Blobs are kept even if the transaction is aborted, as blob files would be:
+    small += "!";
+    REQUIRE(c4db_beginTransaction(db, &err));
+    REQUIRE(c4blob_create(store, c4str(small.c_str()), nullptr, &key2, &err));
+    REQUIRE(c4db_endTransaction(db, false, &err));
+    CHECK(c4blob_getSize(store, key2) == (int64_t)small.size());
+
+    reopenDB();
+    store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+    CHECK(c4blob_getSize(store, key1) == (int64_t)small.size() - 1);
+    CHECK(c4blob_getSize(store, key2) == (int64_t)small.size());
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Collect Blobs", "[Database][C]")
+{
+    C4Error err;
+    C4Slice doc1ID = C4STR("doc001");
+    C4Slice doc2ID = C4STR("doc002");
+    C4Slice doc3ID = C4STR("doc003");
+    C4BlobKey key1, key2;
+    {
+        TransactionHelper t(db);
+        vector<string> atts = {"This is the first attachment"};
+        key1 = addDocWithAttachments(doc1ID, atts, "text/plain")[0];
+        addDocWithAttachments(doc2ID, atts, "text/plain");
+        atts = {"This is the second attachment"};
+        key2 = addDocWithAttachments(doc3ID, atts, "text/plain")[0];
+    }
+    C4BlobStore* store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+
+    // Nothing is unreferenced yet:
+    C4BlobGCProgress progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.blobsDeleted == 0);
+
+    // The first blob is still used by doc002:
+    createRev(doc1ID, kRev2ID, kC4SliceNull, kRevDeleted);
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(progress.blobsDeleted == 0);
+    CHECK(c4blob_getSize(store, key1) > 0);
+
+    // Purging doc002 leaves it unreferenced, but it's within the grace period:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc2ID, &err));
+    }
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 3600, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.blobsDeleted == 0);
+    CHECK(c4blob_getSize(store, key1) > 0);
+
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.blobsDeleted == 1);
+    CHECK(progress.bytesDeleted > 0);
+    CHECK(c4blob_getSize(store, key1) == -1);
+    CHECK(c4blob_getSize(store, key2) > 0);
+
+    // Deleting doc003 frees the second blob; a batch of 1 reaches it:
+    createRev(doc3ID, kRev2ID, kC4SliceNull, kRevDeleted);
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 1, 0, &progress, &err));
+    CHECK(progress.blobsDeleted == 1);
+    CHECK(c4blob_getSize(store, key2) == -1);
+    while (!progress.finished)
+        REQUIRE(c4db_collectBlobs(db, 1, 0, &progress, &err));
+    CHECK(progress.blobsDeleted == 1);
+
+    // A blob that was never referenced is left for c4db_compact:
+    C4BlobKey key3;
+    REQUIRE(c4blob_create(store, c4str("This attachment is never used"), nullptr, &key3, &err));
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(c4blob_getSize(store, key3) > 0);
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key3) == -1);
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Collect Blobs After Reopen", "[Database][C]")
+{
+    C4Error err;
+    C4Slice doc1ID = C4STR("doc001");
+    C4Slice doc2ID = C4STR("doc002");
+    vector<string> atts = {"This is the first attachment"};
+    C4BlobKey key1;
+    {
+        TransactionHelper t(db);
+        key1 = addDocWithAttachments(doc1ID, atts, "text/plain")[0];
+    }
+    // Deleting doc001 lists the blob as unused:
+    createRev(doc1ID, kRev2ID, kC4SliceNull, kRevDeleted);
+
+    // A new connection references it again:
+    reopenDB();
+    {
+        TransactionHelper t(db);
+        addDocWithAttachments(doc2ID, atts, "text/plain");
+    }
+    C4BlobStore* store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+
+    C4BlobGCProgress progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.blobsDeleted == 0);
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key1) > 0);
+
+    // Once doc002 is deleted too, the blob is collected:
+    createRev(doc2ID, kRev2ID, kC4SliceNull, kRevDeleted);
+    progress = {};
+    REQUIRE(c4db_collectBlobs(db, 100, 0, &progress, &err));
+    CHECK(progress.blobsDeleted == 1);
+    CHECK(c4blob_getSize(store, key1) == -1);
+}
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Prune Revisions", "[Database][C]") {
+    static const unsigned kNumDocs = 10, kNumRevs = 20;
+    C4Error err;
+    C4PruneProgress progress = {};
+    if (!isRevTrees()) {
+        REQUIRE(c4db_pruneRevisions(db, 100, &progress, &err));
+        CHECK(progress.finished);
+        return;
+    }
+
+    auto revIDFor = [](unsigned gen) {
+        char revID[20];
+        sprintf(revID, "%u-%08x", gen, gen);
+        return string(revID);
+    };
+    for (unsigned d = 0; d < kNumDocs; ++d) {
+        char docID[20];
+        sprintf(docID, "doc-%03u", d);
+        for (unsigned gen = 1; gen <= kNumRevs; ++gen)
+            createRev(c4str(docID), c4str(revIDFor(gen).c_str()), kFleeceBody);
+    }
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    // Pin an old revision of doc-000 as the current one on a remote:
+    {
+        TransactionHelper t(db);
+        C4Document *doc = c4doc_get(db, C4STR("doc-000"), true, &err);
+        REQUIRE(doc);
+        REQUIRE(c4doc_selectRevision(doc, c4str(revIDFor(10).c_str()), false, &err));
+        REQUIRE(c4doc_setRemoteAncestor(doc, 1, &err));
+        REQUIRE(c4doc_save(doc, 0, &err));
+        c4doc_free(doc);
+    }
+
+    // Lowering the max depth doesn't affect existing docs until they're pruned:
+    c4db_setMaxRevTreeDepth(db, 5);
+    auto historyDepth = [&](C4Slice docID) {
+        C4Document *doc = c4doc_get(db, docID, true, &err);
+        REQUIRE(doc);
+        unsigned depth = 0;
+        do {
+            ++depth;
+        } while (c4doc_selectParentRevision(doc));
+        c4doc_free(doc);
+        return depth;
+    };
+    CHECK(historyDepth(C4STR("doc-001")) == kNumRevs);
+
+    unsigned calls = 0;
+    while (!progress.finished) {
+        REQUIRE(c4db_pruneRevisions(db, 3, &progress, &err));
+        ++calls;
+    }
+    CHECK(calls == 4);
+    CHECK(progress.lastSequence == lastSeq);
+    CHECK(progress.docsPruned == kNumDocs);
+    CHECK(progress.revsPruned == kNumDocs * (kNumRevs - 5) - 1);
+    CHECK(progress.bytesReclaimed > 0);
+    CHECK(c4db_getLastSequence(db) == lastSeq);         // no new sequences
+
+    CHECK(historyDepth(C4STR("doc-000")) == 5);
+    CHECK(historyDepth(C4STR("doc-001")) == 5);
+    {
+        // The remote's revision survived:
+        C4Document *doc = c4doc_get(db, C4STR("doc-000"), true, &err);
+        REQUIRE(doc);
+        C4SliceResult remoteRev = c4doc_getRemoteAncestor(doc, 1);
+        CHECK(string((const char*)remoteRev.buf, remoteRev.size) == revIDFor(10));
+        CHECK(c4doc_selectRevision(doc, {remoteRev.buf, remoteRev.size}, false, &err));
+        c4slice_free(remoteRev);
+        c4doc_free(doc);
+    }
+
+    // Running it again finds nothing to do:
+    progress = {};
+    REQUIRE(c4db_pruneRevisions(db, 100, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.docsPruned == 0);
+    CHECK(progress.bytesReclaimed == 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Document Cache", "[Database][C]") {
+    C4Error err;
+    C4Slice docID = C4STR("doc");
+    createRev(docID, kRevID, kFleeceBody);
+    CHECK(c4db_getDocumentCacheStats(db).maxBytes == 0);
+    REQUIRE(c4db_setDocumentCacheSize(db, 100000, &err));
+
+    auto getRevID = [&](C4Database *inDB) {
+        C4Document *doc = c4doc_get(inDB, docID, false, &err);
+        REQUIRE(doc);
+        string revID = toString(doc->revID);
+        c4doc_free(doc);
+        return revID;
+    };
+
+    CHECK(getRevID(db) == toString(kRevID));
+    CHECK(getRevID(db) == toString(kRevID));
+    C4DocumentCacheStats stats = c4db_getDocumentCacheStats(db);
+    CHECK(stats.misses == 1);
+    CHECK(stats.hits == 1);
+    CHECK(stats.count == 1);
+    CHECK(stats.bytes > 0);
+    CHECK(stats.maxBytes == 100000);
+
+    // A change invalidates the cached doc:
+    createRev(docID, kRev2ID, kFleeceBody);
+    CHECK(c4db_getDocumentCacheStats(db).invalidations == 1);
+    CHECK(getRevID(db) == toString(kRev2ID));
+    CHECK(getRevID(db) == toString(kRev2ID));
+    CHECK(c4db_getDocumentCacheStats(db).hits == 3);   // (createRev got it too)
+
+    // So does a change made by another instance:
+    C4Database *db2 = c4db_openAgain(db, &err);
+    REQUIRE(db2);
+    createRev(db2, docID, kRev3ID, kFleeceBody);
+    CHECK(getRevID(db) == toString(kRev3ID));
+    CHECK(getRevID(db) == toString(kRev3ID));
+
+    // ...and a purge, which doesn't create a sequence:
+    {
+        TransactionHelper t(db2);
+        REQUIRE(c4db_purgeDoc(db2, docID, &err));
+    }
+    CHECK(c4doc_get(db, docID, true, &err) == nullptr);
+    CHECK(err.code == kC4ErrorNotFound);
+    c4db_free(db2);
+
+    // Least recently used docs are evicted to stay within the size limit:
+    REQUIRE(c4db_setDocumentCacheSize(db, 5000, &err));
+    for (int i = 0; i < 100; ++i) {
+        char id[20];
+        sprintf(id, "doc-%03d", i);
+        createRev(c4str(id), kRevID, kFleeceBody);
+        c4doc_free(c4doc_get(db, c4str(id), true, &err));
+    }
+    stats = c4db_getDocumentCacheStats(db);
+    CHECK(stats.evictions > 0);
+    CHECK(stats.count < 100);
+    CHECK(stats.bytes <= stats.maxBytes);
+
+    REQUIRE(c4db_setDocumentCacheSize(db, 0, &err));
+    CHECK(c4db_getDocumentCacheStats(db).count == 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Resolve Conflicts", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+    static const unsigned kNumDocs = 20;
+    C4Error err;
+    for (unsigned d = 0; d < kNumDocs; ++d) {
+        char docID[20];
+        sprintf(docID, "doc-%03u", d);
+        createRev(c4str(docID), kRevID, kFleeceBody);
+        createRev(c4str(docID), kRev2ID, kFleeceBody);
+        if (d % 2 == 0) {
+            createConflictingRev(db, c4str(docID), kRevID, C4STR("2-aaaaaaaa"), kEmptyFleeceBody);
+            if (d % 4 == 0)
+                createConflictingRev(db, c4str(docID), kRevID, C4STR("2-bbbbbbbb"),
+                                     kEmptyFleeceBody);
+        }
+    }
+    CHECK(c4db_getDocumentCount(db) == kNumDocs);
+
+    struct Context {
+        unsigned calls = 0;
+        C4Slice mergedBody;
+    } context;
+    context.mergedBody = kEmptyFleeceBody;
+    auto resolver = [](void *ctx, C4Document *doc, C4ConflictResolution *resolution) -> bool {
+        auto context = (Context*)ctx;
+        ++context->calls;
+        if (slice(doc->docID) == "doc-002"_sl)
+            return false;               // leave this one alone
+        CHECK((doc->flags & kDocConflicted) != 0);
+        resolution->winningRevID = doc->selectedRev.revID;
+        REQUIRE(c4doc_selectNextLeafRevision(doc, false, false, nullptr));
+        resolution->losingRevID = doc->selectedRev.revID;
+        resolution->mergedBody = context->mergedBody;
+        return true;
+    };
+
+    C4ResolveConflictsProgress progress = {};
+    unsigned calls = 0;
+    while (!progress.finished) {
+        REQUIRE(c4db_resolveConflicts(db, 4, resolver, &context, &progress, &err));
+        ++calls;
+    }
+    CHECK(calls == 3);
+    CHECK(progress.docsResolved == kNumDocs / 2 - 1);
+    CHECK(progress.docsSkipped == 1);
+    CHECK(context.calls == kNumDocs / 2 + kNumDocs / 4);   // some docs have 2 conflicts
+    CHECK(progress.secondsElapsed > 0.0);
+
+    for (unsigned d = 0; d < kNumDocs; d += 2) {
+        char docID[20];
+        sprintf(docID, "doc-%03u", d);
+        C4Document *doc = c4doc_get(db, c4str(docID), true, &err);
+        REQUIRE(doc);
+        INFO("Doc " << docID);
+        CHECK(((doc->flags & kDocConflicted) != 0) == (d == 2));
+        if (d != 2) {
+            CHECK(c4rev_getGeneration(doc->revID) == (d % 4 == 0 ? 4 : 3));
+            CHECK(!c4doc_selectNextLeafRevision(doc, false, false, nullptr));
+        }
+        c4doc_free(doc);
+    }
+
+    // Running it again only finds the one that was skipped:
+    progress = {};
+    context.calls = 0;
+    REQUIRE(c4db_resolveConflicts(db, 100, resolver, &context, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.docsResolved == 0);
+    CHECK(progress.docsSkipped == 1);
+    CHECK(context.calls == 1);
+}
+
+
+TEST_CASE_METHOD(C4DatabaseTest, "Database Resolve Conflicts Version Vectors", "[Database][C]") {
+    // Recreate the database with version vectors:
+    C4Error err;
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    REQUIRE(c4db_delete(db, &err));
+    c4db_free(db);
+    config.versioning = kC4VersionVectors;
+    config.flags |= kC4DB_Create;
+    db = c4db_open(databasePath(), &config, &err);
+    REQUIRE(db);
+
+    static const unsigned kNumDocs = 10;
+    for (unsigned d = 0; d < kNumDocs; ++d) {
+        char docID[20];
+        sprintf(docID, "doc-%03u", d);
+        TransactionHelper t(db);
+        createConflictingRev(db, c4str(docID), kC4SliceNull, C4STR("1@aaaaaaaa"), kFleeceBody);
+        if (d % 2 == 0)
+            createConflictingRev(db, c4str(docID), kC4SliceNull, C4STR("1@bbbbbbbb"),
+                                 kEmptyFleeceBody);
+    }
+
+    unsigned calls = 0;
+    auto resolver = [](void *ctx, C4Document *doc, C4ConflictResolution *resolution) -> bool {
+        ++*(unsigned*)ctx;
+        CHECK((doc->flags & kDocConflicted) != 0);
+        resolution->winningRevID = doc->selectedRev.revID;
+        REQUIRE(c4doc_selectNextLeafRevision(doc, false, false, nullptr));
+        CHECK(doc->selectedRev.revID == C4STR("1@bbbbbbbb"));
+        resolution->losingRevID = doc->selectedRev.revID;
+        return true;
+    };
+    C4ResolveConflictsProgress progress = {};
+    REQUIRE(c4db_resolveConflicts(db, 100, resolver, &calls, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.docsResolved == kNumDocs / 2);
+    CHECK(progress.docsSkipped == 0);
+    CHECK(calls == kNumDocs / 2);
+
+    for (unsigned d = 0; d < kNumDocs; d += 2) {
+        char docID[20];
+        sprintf(docID, "doc-%03u", d);
+        INFO("Doc " << docID);
+        C4Document *doc = c4doc_get(db, c4str(docID), true, &err);
+        REQUIRE(doc);
+        CHECK((doc->flags & kDocConflicted) == 0);
+        CHECK(!c4doc_selectNextLeafRevision(doc, false, false, nullptr));
+        // The merged vector includes both versions:
+        C4SliceResult history = c4doc_getRevisionHistory(doc, 100, nullptr, 0);
+        string merged = toString((C4Slice)history);
+        CHECK(merged.find("1@aaaaaaaa") != string::npos);
+        CHECK(merged.find("1@bbbbbbbb") != string::npos);
+        c4slice_free(history);
+        c4doc_free(doc);
+        // ...and the conflicting revision is gone from the conflict store:
+        CHECK(!c4raw_get(db, C4STR("default_conflicts"), c4str(docID), &err));
+    }
+
+    // Running it again finds nothing:
+    progress = {};
+    calls = 0;
+    REQUIRE(c4db_resolveConflicts(db, 100, resolver, &calls, &progress, &err));
+    CHECK(progress.finished);
+    CHECK(progress.docsResolved == 0);
+    CHECK(calls == 0);
+}
+
+
+TEST_CASE_METHOD(C4DatabaseTest, "Database Upgrade To Version Vectors", "[Database][C]") {
+    C4Error err;
+    createRev(C4STR("doc1"), C4STR("1-abcd"), kFleeceBody);
+    createRev(C4STR("doc1"), C4STR("2-c001d00d"), kFleeceBody);
+    createRev(C4STR("doc2"), C4STR("1-abcd"), kFleeceBody);
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    // Opening it with version vectors fails until it's been upgraded:
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.versioning = kC4VersionVectors;
+    {
+        ExpectingExceptions x;
+        CHECK(!c4db_open(databasePath(), &config, &err));
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorWrongFormat);
+
+        // ...which can't happen while it's open:
+        CHECK(!c4db_upgradeToVersionVectors(databasePath(), &config, &err));
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorBusy);
+    }
+
+    // Upgrading converts the documents, keeping their sequences:
+    REQUIRE(c4db_close(db, &err));
+    c4db_free(db);
+    db = nullptr;
+    REQUIRE(c4db_upgradeToVersionVectors(databasePath(), &config, &err));
+    db = c4db_open(databasePath(), &config, &err);
+    REQUIRE(db);
+    CHECK(c4db_getDocumentCount(db) == 2);
+    CHECK(c4db_getLastSequence(db) == lastSeq);
+
+    C4Document *doc = c4doc_get(db, C4STR("doc1"), true, &err);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("2@-c001d00d"));
+    CHECK(doc->sequence == 2);
+    CHECK(c4doc_loadRevisionBody(doc, &err));
+    CHECK(doc->selectedRev.body == kFleeceBody);
+    c4doc_free(doc);
+
+    // A new revision adds this database's own version to the vector:
+    string revID = createNewRev(db, C4STR("doc1"), kFleeceBody);
+    CHECK(revID.substr(0, 2) == "1@");
+    string myVersion = revID;
+    doc = c4doc_get(db, C4STR("doc1"), true, &err);
+    REQUIRE(doc);
+    C4SliceResult history = c4doc_getRevisionHistory(doc, 100, nullptr, 0);
+    CHECK(toString((C4Slice)history) == myVersion + ",2@-c001d00d,1@-abcd");
+    c4slice_free(history);
+    c4doc_free(doc);
+
+    {
+        // A revision from another peer that hasn't seen mine is a conflict:
+        TransactionHelper t(db);
+        C4Slice vector[2] = {C4STR("1@feedface"), C4STR("2@-c001d00d")};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.allowConflict = true;
+        rq.docID = C4STR("doc1");
+        rq.history = vector;
+        rq.historyCount = 2;
+        rq.body = kEmptyFleeceBody;
+        rq.save = true;
+        doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        CHECK((doc->flags & kDocConflicted) != 0);
+        CHECK(doc->revID == c4str(myVersion.c_str()));
+        CHECK(doc->selectedRev.revID == C4STR("1@feedface"));
+
+        // Putting an older revision is a no-op:
+        C4Slice oldVector[1] = {C4STR("1@-abcd")};
+        rq.history = oldVector;
+        rq.historyCount = 1;
+        C4Document *doc2 = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc2);
+        CHECK(doc2->revID == c4str(myVersion.c_str()));
+        c4doc_free(doc2);
+
+        // Resolving the conflict merges the vectors:
+        REQUIRE(c4doc_resolveConflict(doc, c4str(myVersion.c_str()), C4STR("1@feedface"),
+                                      kC4SliceNull, 0, &err));
+        REQUIRE(c4doc_save(doc, 0, &err));
+        CHECK((doc->flags & kDocConflicted) == 0);
+        CHECK(slice(doc->revID).hasPrefix("2@"_sl));
+        c4doc_free(doc);
+    }
+    doc = c4doc_get(db, C4STR("doc1"), true, &err);
+    REQUIRE(doc);
+    CHECK((doc->flags & kDocConflicted) == 0);
+    history = c4doc_getRevisionHistory(doc, 100, nullptr, 0);
+    string merged = toString((C4Slice)history);
+    CHECK(merged.find("2@-c001d00d") != string::npos);
+    CHECK(merged.find("1@feedface") != string::npos);
+    c4slice_free(history);
+    CHECK(!c4doc_selectNextRevision(doc));
+    c4doc_free(doc);
+
+    {
+        // A peer that upgraded at a later revision of doc2 isn't in conflict, since the
+        // upgraded vectors keep the rev tree's ancestry:
+        TransactionHelper t(db);
+        C4Slice vector[2] = {C4STR("2@-beef"), C4STR("1@-abcd")};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.allowConflict = true;
+        rq.docID = C4STR("doc2");
+        rq.history = vector;
+        rq.historyCount = 2;
+        rq.body = kFleeceBody;
+        rq.save = true;
+        doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        CHECK((doc->flags & kDocConflicted) == 0);
+        CHECK(doc->revID == C4STR("2@-beef"));
+        c4doc_free(doc);
+    }
+
+    // The database can't go back to rev trees:
+    REQUIRE(c4db_close(db, &err));
+    c4db_free(db);
+    db = nullptr;
+    config.versioning = kC4RevisionTrees;
+    {
+        ExpectingExceptions x;
+        CHECK(!c4db_open(databasePath(), &config, &err));
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorWrongFormat);
+    }
+    config.versioning = kC4VersionVectors;
+    db = c4db_open(databasePath(), &config, &err);
+    REQUIRE(db);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database copy", "[Database][C]") {
     C4Slice doc1ID = C4STR("doc001");
     C4Slice doc2ID = C4STR("doc002");
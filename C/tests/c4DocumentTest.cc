@@ -227,6 +227,180 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document CreateMultipleRevisions", "[Database][C
     c4doc_free(doc);
 }
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document Lazy Rev Tree", "[Database][C]") {
+    // A doc read with c4doc_get has its current revision available before its revision tree is
+    // decoded; check that everything that needs the tree still finds it.
+    if (!isRevTrees())
+        return;
+    const auto kFleeceBody2 = json2fleece("{'ok':'go'}");
+    const auto kFleeceBody3 = json2fleece("{'ubu':'roi'}");
+    createRev(kDocID, kRevID, kFleeceBody);
+    createRev(kDocID, kRev2ID, kFleeceBody2, kRevKeepBody);
+    createRev(kDocID, kRev3ID, kFleeceBody3);
+
+    C4Error error;
+    C4Document *doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc != nullptr);
+    CHECK(doc->flags == kDocExists);
+    CHECK(doc->revID == kRev3ID);
+    CHECK(doc->sequence == (C4SequenceNumber)3);
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(doc->selectedRev.sequence == (C4SequenceNumber)3);
+    CHECK(doc->selectedRev.flags == kRevLeaf);
+    CHECK(doc->selectedRev.body == kFleeceBody3);
+    CHECK(c4doc_hasRevisionBody(doc));
+    CHECK(c4doc_loadRevisionBody(doc, &error));
+
+    // A second instance, which will be out of date after the update below:
+    C4Document *copy = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(copy);
+    CHECK(c4doc_selectRevision(copy, kRev3ID, true, &error));
+    CHECK(copy->selectedRev.body == kFleeceBody3);
+
+    // Walk the history:
+    REQUIRE(c4doc_selectParentRevision(doc));
+    CHECK(doc->selectedRev.revID == kRev2ID);
+    CHECK(doc->selectedRev.flags == kRevKeepBody);
+    CHECK(doc->selectedRev.body == kFleeceBody2);
+    REQUIRE(c4doc_selectParentRevision(doc));
+    CHECK(doc->selectedRev.revID == kRevID);
+    CHECK(!c4doc_selectParentRevision(doc));
+    CHECK(c4doc_selectCurrentRevision(doc));
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(c4doc_selectNextRevision(doc));
+    CHECK(doc->selectedRev.revID == kRev2ID);
+    c4doc_free(doc);
+
+    // Select an older revision by ID:
+    doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    CHECK(c4doc_selectRevision(doc, kRevID, false, &error));
+    CHECK(doc->selectedRev.revID == kRevID);
+    c4doc_free(doc);
+
+    // Update a doc that hasn't decoded its tree yet:
+    {
+        TransactionHelper t(db);
+        doc = c4doc_get(db, kDocID, true, &error);
+        REQUIRE(doc);
+        auto updatedDoc = c4doc_update(doc, json2fleece("{'ok':'again'}"), 0, &error);
+        REQUIRE(updatedDoc);
+        CHECK(c4rev_getGeneration(updatedDoc->revID) == 4);
+        REQUIRE(c4doc_selectParentRevision(updatedDoc));
+        CHECK(updatedDoc->selectedRev.revID == kRev3ID);
+        c4doc_free(updatedDoc);
+        c4doc_free(doc);
+    }
+
+    // The copy is now out of date, so updating it is a conflict:
+    {
+        TransactionHelper t(db);
+        CHECK(c4doc_update(copy, json2fleece("{'ok':'no way'}"), 0, &error) == nullptr);
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorConflict);
+    }
+    c4doc_free(copy);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "Document External Revision Bodies", "[Database][C]") {
+    // Only the current revision's body is stored in the rev tree; others are stored separately.
+    if (!isRevTrees())
+        return;
+    const auto kFleeceBody2 = json2fleece("{'ok':'go'}");
+    const auto kFleeceBody3 = json2fleece("{'ubu':'roi'}");
+    const auto kConflictBody = json2fleece("{'conflict':true}");
+    createRev(kDocID, kRevID, kFleeceBody);
+    createRev(kDocID, kRev2ID, kFleeceBody2);
+    createRev(kDocID, kRev3ID, kFleeceBody3);
+    C4Slice kConflictRevID = C4STR("3-cccccc");
+    {
+        // "Pull" a conflicting revision:
+        TransactionHelper t(db);
+        C4Slice history[2] = {kConflictRevID, kRev2ID};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.docID = kDocID;
+        rq.history = history;
+        rq.historyCount = 2;
+        rq.body = kConflictBody;
+        rq.save = true;
+        rq.remoteDBID = 1;
+        C4Error err;
+        auto doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        c4doc_free(doc);
+    }
+
+    C4Error error;
+    const C4Slice kBodyStore = C4STR("default_revbodies");
+    std::string conflictKey = std::string((char*)kDocID.buf, kDocID.size) + "\x1F" "3-cccccc";
+    C4RawDocument *raw = c4raw_get(db, kBodyStore, c4str(conflictKey.c_str()), &error);
+    REQUIRE(raw);
+    CHECK(raw->body == kConflictBody);
+    c4raw_free(raw);
+
+    // The conflict's body is read only when it's asked for:
+    C4Document *doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(doc->selectedRev.body == kFleeceBody3);
+    REQUIRE(c4doc_selectRevision(doc, kConflictRevID, false, &error));
+    CHECK(c4doc_hasRevisionBody(doc));
+    CHECK(doc->selectedRev.body == kConflictBody);
+    REQUIRE(c4doc_selectParentRevision(doc));
+    CHECK(doc->selectedRev.revID == kRev2ID);
+    REQUIRE(c4doc_selectRevision(doc, kConflictRevID, true, &error));
+    CHECK(doc->selectedRev.body == kConflictBody);
+    REQUIRE(c4doc_selectCurrentRevision(doc));
+    REQUIRE(c4doc_selectNextLeafRevision(doc, true, true, &error));
+    CHECK(doc->selectedRev.revID == kConflictRevID);
+    CHECK(doc->selectedRev.body == kConflictBody);
+
+    // Resolving the conflict in favor of the conflicting rev moves its body back inline:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_resolveConflict(doc, kConflictRevID, kRev3ID, kC4SliceNull, 0, &error));
+        REQUIRE(c4doc_save(doc, 0, &error));
+    }
+    c4doc_free(doc);
+    doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kConflictRevID);
+    CHECK(doc->selectedRev.body == kConflictBody);
+    c4doc_free(doc);
+    raw = c4raw_get(db, kBodyStore, c4str(conflictKey.c_str()), &error);
+    CHECK(!raw);
+
+    // Purging a document deletes its stored bodies:
+    const auto kOtherDocID = C4STR("other");
+    createRev(kOtherDocID, kRevID, kFleeceBody, kRevKeepBody);
+    createRev(kOtherDocID, kRev2ID, kFleeceBody2);
+    std::string otherKey = "other\x1F" + std::string((char*)kRevID.buf, kRevID.size);
+    raw = c4raw_get(db, kBodyStore, c4str(otherKey.c_str()), &error);
+    REQUIRE(raw);
+    CHECK(raw->body == kFleeceBody);
+    c4raw_free(raw);
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, kOtherDocID, &error));
+    }
+    raw = c4raw_get(db, kBodyStore, c4str(otherKey.c_str()), &error);
+    CHECK(!raw);
+
+    // So does expiring it:
+    createRev(kOtherDocID, kRevID, kFleeceBody, kRevKeepBody);
+    createRev(kOtherDocID, kRev2ID, kFleeceBody2);
+    raw = c4raw_get(db, kBodyStore, c4str(otherKey.c_str()), &error);
+    REQUIRE(raw);
+    c4raw_free(raw);
+    REQUIRE(c4doc_setExpiration(db, kOtherDocID, c4_now() - 1000, &error));
+    CHECK(c4db_purgeExpiredDocs(db, &error) == 1);
+    raw = c4raw_get(db, kBodyStore, c4str(otherKey.c_str()), &error);
+    CHECK(!raw);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Purge", "[Database][C]") {
     const auto kFleeceBody2 = json2fleece("{'ok':'go'}");
     const auto kFleeceBody3 = json2fleece("{'ubu':'roi'}");
@@ -339,6 +513,40 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document maxRevTreeDepth", "[Database][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document GetRevisionHistory", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+    static const C4Slice kRev4ID = C4STR("4-b0b0cafe");
+    createRev(kDocID, kRevID, kFleeceBody);
+    createRev(kDocID, kRev2ID, kFleeceBody);
+    createRev(kDocID, kRev3ID, kFleeceBody);
+    createRev(kDocID, kRev4ID, kFleeceBody);
+
+    C4Error error;
+    C4Document *doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    auto history = [&](unsigned maxRevs, vector<C4String> backTo) {
+        C4SliceResult result = c4doc_getRevisionHistory(doc, maxRevs,
+                                                        backTo.data(), unsigned(backTo.size()));
+        string str = toString({result.buf, result.size});
+        c4slice_free(result);
+        return str;
+    };
+
+    CHECK(history(100, {}) == "4-b0b0cafe,3-deadbeef,2-c001d00d,1-abcd");
+    CHECK(history(2, {}) == "4-b0b0cafe,3-deadbeef");
+    CHECK(history(100, {kRev2ID}) == "4-b0b0cafe,3-deadbeef,2-c001d00d");
+    CHECK(history(100, {kRevID, kRev3ID}) == "4-b0b0cafe,3-deadbeef");
+    CHECK(history(100, {kRev4ID}) == "4-b0b0cafe,3-deadbeef,2-c001d00d,1-abcd");
+    CHECK(doc->selectedRev.revID == kRev4ID);      // selection is unchanged
+
+    REQUIRE(c4doc_selectRevision(doc, kRev2ID, false, &error));
+    CHECK(history(100, {}) == "2-c001d00d,1-abcd");
+    CHECK(doc->selectedRev.revID == kRev2ID);
+    c4doc_free(doc);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document GetForPut", "[Database][C]") {
     C4Error error;
     TransactionHelper t(db);
@@ -152,3 +152,93 @@ TEST_CASE_METHOD(C4ObserverTest, "Multi-DB Observer", "[Observer][C]") {
     c4db_close(otherdb, NULL);
     c4db_free(otherdb);
 }
+
+
+static bool okPredicate(C4String docID, FLDict body, void *context) {
+    ++*(unsigned*)context;
+    return FLValue_AsBool(FLDict_Get(body, C4STR("ok")));
+}
+
+
+TEST_CASE_METHOD(C4ObserverTest, "Filtered DB Observer", "[Observer][C]") {
+    alloc_slice okBody = json2fleece("{ok:true}");
+    alloc_slice notOKBody = json2fleece("{ok:false}");
+    unsigned predicateCalls = 0;
+
+    C4DatabaseObserverFilter filter = {};
+    SECTION("Prefix, live revisions and predicate") {
+        filter.docIDPrefix = C4STR("user:");
+        filter.deletedMode = kC4ObserveLiveRevisions;
+        filter.predicate = okPredicate;
+        filter.predicateContext = &predicateCalls;
+        dbObserver = c4dbobs_createFiltered(db, &filter, dbObserverCallback, this);
+        REQUIRE(dbObserver);
+
+        createRev(C4STR("other"), C4STR("1-00"), okBody);
+        createRev(C4STR("user:B"), C4STR("1-bb"), notOKBody);
+        CHECK(dbCallbackCalls == 0);
+        createRev(C4STR("user:A"), C4STR("1-aa"), okBody);
+        CHECK(dbCallbackCalls == 1);
+        createRev(C4STR("user:C"), C4STR("1-cc"), okBody);
+        CHECK(dbCallbackCalls == 1);
+        CHECK(predicateCalls >= 3);         // (called again when changes are read)
+
+        C4DatabaseChangeWithFlags changes[10];
+        bool external;
+        REQUIRE(c4dbobs_getChangesWithFlags(dbObserver, changes, 10, &external) == 2);
+        CHECK(changes[0].docID == C4STR("user:A"));
+        CHECK((changes[0].flags & kRevDeleted) == 0);
+        CHECK(changes[1].docID == C4STR("user:C"));
+        c4dbobs_releaseChangesWithFlags(changes, 2);
+
+        createRev(C4STR("user:A"), C4STR("2-aa"), kEmptyFleeceBody, kRevDeleted);
+        CHECK(dbCallbackCalls == 1);
+        createRev(C4STR("user:D"), C4STR("1-dd"), okBody);
+        CHECK(dbCallbackCalls == 2);
+        checkChanges({"user:D"}, {"1-dd"});
+    }
+    SECTION("DocIDs and deletions") {
+        C4String docIDs[2] = {C4STR("B"), C4STR("C")};
+        filter.docIDs = docIDs;
+        filter.docIDCount = 2;
+        filter.deletedMode = kC4ObserveDeletions;
+        dbObserver = c4dbobs_createFiltered(db, &filter, dbObserverCallback, this);
+        REQUIRE(dbObserver);
+
+        createRev(C4STR("A"), C4STR("1-aa"), kFleeceBody);
+        createRev(C4STR("B"), C4STR("1-bb"), kFleeceBody);
+        CHECK(dbCallbackCalls == 0);
+        createRev(C4STR("A"), C4STR("2-aa"), kEmptyFleeceBody, kRevDeleted);
+        CHECK(dbCallbackCalls == 0);
+        createRev(C4STR("B"), C4STR("2-bb"), kEmptyFleeceBody, kRevDeleted);
+        CHECK(dbCallbackCalls == 1);
+
+        C4DatabaseChangeWithFlags changes[10];
+        bool external;
+        REQUIRE(c4dbobs_getChangesWithFlags(dbObserver, changes, 10, &external) == 1);
+        CHECK(changes[0].docID == C4STR("B"));
+        CHECK(changes[0].revID == C4STR("2-bb"));
+        CHECK((changes[0].flags & kRevDeleted) != 0);
+        c4dbobs_releaseChangesWithFlags(changes, 1);
+    }
+    SECTION("Predicate on external changes") {
+        filter.predicate = okPredicate;
+        filter.predicateContext = &predicateCalls;
+        dbObserver = c4dbobs_createFiltered(db, &filter, dbObserverCallback, this);
+        REQUIRE(dbObserver);
+
+        C4Database* otherdb = c4db_open(databasePath(), c4db_getConfig(db), nullptr);
+        REQUIRE(otherdb);
+        {
+            TransactionHelper t(otherdb);
+            createRev(otherdb, C4STR("A"), C4STR("1-aa"), notOKBody);
+            createRev(otherdb, C4STR("B"), C4STR("1-bb"), okBody);
+        }
+
+        CHECK(dbCallbackCalls == 1);
+        checkChanges({"B"}, {"1-bb"}, true);
+
+        c4db_close(otherdb, NULL);
+        c4db_free(otherdb);
+    }
+}
@@ -231,7 +231,7 @@ _versioning(kC4RevisionTrees)
     if (config.flags != sLastConfig.flags || config.versioning != sLastConfig.versioning) {
         fprintf(stderr, "            %s, %s\n",
                 config.storageEngine,
-                (config.versioning==kC4RevisionTrees ? "rev-trees" : "?unknown versioning?"));
+                (config.versioning==kC4RevisionTrees ? "rev-trees" : "version-vectors"));
         sLastConfig = config;
     }
 
@@ -0,0 +1,80 @@
+//
+// BlobDatabase.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BlobDatabase.hh"
+#include "Logging.hh"
+#include "SQLiteDataFile.hh"
+#include "KeyStore.hh"
+
+namespace litecore {
+    using namespace std;
+
+
+    BlobDatabase::BlobDatabase(const FilePath &dir, const char *fileName, bool writeable)
+    :_path(dir, fileName)
+    ,_writeable(writeable)
+    { }
+
+
+    BlobDatabase::~BlobDatabase() {
+        try {
+            close();
+        } catch (...) {
+            // destructor is not allowed to throw exceptions
+            Warn("BlobDatabase: unable to close %s", _path.path().c_str());
+        }
+    }
+
+
+    void BlobDatabase::close() {
+        lock_guard<mutex> lock(_mutex);
+        if (_db) {
+            _db->close();
+            _db.reset();
+        }
+    }
+
+
+    void BlobDatabase::deleteFile() {
+        close();
+        lock_guard<mutex> lock(_mutex);
+        SQLiteDataFile::sqliteFactory().deleteFile(_path);
+    }
+
+
+    KeyStore* BlobDatabase::store(bool create) {
+        if (!_db) {
+            if (!_path.exists() && !(create && _writeable))
+                return nullptr;
+            DataFile::Options options { };
+            options.create = options.writeable = _writeable;
+            _db.reset(SQLiteDataFile::sqliteFactory().openFile(_path, &options));
+        }
+        return &_db->defaultKeyStore();
+    }
+
+
+    // Each write is committed right away, so the file is never left locked while the owning
+    // Database's transaction goes on; other connections write blobs too.
+    void BlobDatabase::write(fleece::function_ref<void(Transaction&)> fn) {
+        Transaction t(*_db);
+        fn(t);
+        t.commit();
+    }
+
+}
@@ -0,0 +1,68 @@
+//
+// BlobDatabase.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "FilePath.hh"
+#include "function_ref.hh"
+#include <memory>
+#include <mutex>
+
+namespace litecore {
+    class DataFile;
+    class KeyStore;
+    class Transaction;
+
+
+    /** Base class of the small SQLite databases a BlobStore keeps in its directory.
+        The database is opened when first needed, and only created when something is written.
+        It's never encrypted, since SQLite encryption isn't available in every build; a subclass
+        that stores secrets has to encrypt them itself.
+        This class is thread-safe. */
+    class BlobDatabase {
+    public:
+        /** Returns false if the database file hasn't been created. */
+        bool exists() const                         {return _path.exists();}
+
+        /** Closes the database; it's reopened when next needed.
+            Must be called before the directory is moved or deleted. */
+        void close();
+
+        /** Closes and deletes the database file. */
+        void deleteFile();
+
+    protected:
+        BlobDatabase(const FilePath &dir, const char *fileName, bool writeable);
+        ~BlobDatabase();
+
+        /** Opens the database if necessary and returns its default KeyStore. If the file doesn't
+            exist yet, it's only created if `create` is true; otherwise returns nullptr.
+            Must be called with the mutex locked. */
+        KeyStore* store(bool create);
+
+        /** Calls the function with a new transaction, which is committed when it returns.
+            Must be called with the mutex locked, after `store`. */
+        void write(fleece::function_ref<void(Transaction&)>);
+
+        FilePath const                  _path;
+        bool const                      _writeable;
+        std::mutex                      _mutex;
+        std::unique_ptr<DataFile>       _db;
+    };
+
+}
@@ -0,0 +1,184 @@
+//
+// BlobManifest.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BlobManifest.hh"
+#include "BlobStore.hh"
+#include "Error.hh"
+#include "DataFile.hh"
+#include "KeyStore.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+
+namespace litecore {
+    using namespace std;
+
+
+    const char* const BlobManifest::kFileName = "blob_manifest.sqlite3";
+
+    // Keys in the info store:
+    static const char* const kCountKey   = "count";
+    static const char* const kSizeKey    = "size";
+    static const char* const kShardedKey = "sharded";
+
+    // An entry's record has the size as its body, and these flags as its one-byte version:
+    static const uint8_t kEncryptedFlag = 0x01, kInlineFlag = 0x02;
+
+
+    static BlobManifest::Entry entryFromRecord(slice version, uint64_t size) {
+        uint8_t flags = version.size > 0 ? version[0] : 0;
+        return {(int64_t)size, (flags & kEncryptedFlag) != 0, (flags & kInlineFlag) != 0};
+    }
+
+    static Record recordFromEntry(const blobKey &key, const BlobManifest::Entry &entry) {
+        uint8_t flags = (entry.encrypted ? kEncryptedFlag : 0) | (entry.isInline ? kInlineFlag : 0);
+        Record rec((slice)key);
+        rec.setVersion(alloc_slice(&flags, 1));
+        rec.setBodyAsUInt((uint64_t)entry.size);
+        return rec;
+    }
+
+
+    BlobManifest::BlobManifest(const FilePath &dir, bool writeable)
+    :BlobDatabase(dir, kFileName, writeable)
+    { }
+
+
+    KeyStore& BlobManifest::infoStore() {
+        return _db->getKeyStore(DataFile::kInfoKeyStoreName);
+    }
+
+
+    void BlobManifest::adjustTotals(int64_t countDelta, int64_t sizeDelta, Transaction &t) {
+        KeyStore &info = infoStore();
+        Record count = info.get(slice(kCountKey));
+        count.setBodyAsUInt(count.bodyAsUInt() + countDelta);
+        info.write(count, t);
+        Record size = info.get(slice(kSizeKey));
+        size.setBodyAsUInt(size.bodyAsUInt() + sizeDelta);
+        info.write(size, t);
+    }
+
+
+    bool BlobManifest::isSharded() {
+        lock_guard<mutex> lock(_mutex);
+        return store(false) && infoStore().get(slice(kShardedKey)).bodyAsUInt() != 0;
+    }
+
+
+    void BlobManifest::add(const blobKey &key, const Entry &entry) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(true);
+        if (!blobs)
+            error::_throw(error::NotWriteable);
+        write([&](Transaction &t) {
+            Record rec = blobs->get(key);
+            int64_t countDelta = 1, sizeDelta = entry.size;
+            if (rec.exists()) {
+                countDelta = 0;                 // (replacing an entry left behind by a crash)
+                sizeDelta -= rec.bodyAsUInt();
+            }
+            Record newRec = recordFromEntry(key, entry);
+            blobs->write(newRec, t);
+            adjustTotals(countDelta, sizeDelta, t);
+        });
+    }
+
+
+    void BlobManifest::remove(const blobKey &key) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        if (!blobs || !_writeable)
+            return;
+        write([&](Transaction &t) {
+            Record rec = blobs->get(key);
+            if (rec.exists()) {
+                blobs->del(key, t);
+                adjustTotals(-1, -(int64_t)rec.bodyAsUInt(), t);
+            }
+        });
+    }
+
+
+    void BlobManifest::forEach(fleece::function_ref<void(const blobKey&, const Entry&)> callback) {
+        vector<pair<blobKey,Entry>> entries;
+        {
+            lock_guard<mutex> lock(_mutex);
+            KeyStore *blobs = store(false);
+            if (!blobs)
+                return;
+            RecordEnumerator e(*blobs);
+            while (e.next())
+                entries.emplace_back(blobKey(e->key()), entryFromRecord(e->version(),
+                                                                        e->bodyAsUInt()));
+        }
+        // (The mutex is unlocked so the callback can call back into this object.)
+        for (auto &entry : entries)
+            callback(entry.first, entry.second);
+    }
+
+
+    uint64_t BlobManifest::count() {
+        lock_guard<mutex> lock(_mutex);
+        return store(false) ? infoStore().get(slice(kCountKey)).bodyAsUInt() : 0;
+    }
+
+
+    uint64_t BlobManifest::totalSize() {
+        lock_guard<mutex> lock(_mutex);
+        return store(false) ? infoStore().get(slice(kSizeKey)).bodyAsUInt() : 0;
+    }
+
+
+    void BlobManifest::rebuild(const vector<pair<blobKey,Entry>> &entries, bool sharded) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(true);
+        if (!blobs)
+            error::_throw(error::NotWriteable);
+        write([&](Transaction &t) {
+            // (KeyStore::erase can't be used inside a transaction.)
+            vector<alloc_slice> oldKeys;
+            {
+                RecordEnumerator::Options options;
+                options.contentOptions = kMetaOnly;
+                RecordEnumerator e(*blobs, options);
+                while (e.next())
+                    oldKeys.emplace_back(e->key());
+            }
+            for (auto &key : oldKeys)
+                blobs->del(key, t);
+
+            uint64_t totalSize = 0;
+            for (auto &entry : entries) {
+                Record rec = recordFromEntry(entry.first, entry.second);
+                blobs->write(rec, t);
+                totalSize += entry.second.size;
+            }
+            KeyStore &info = infoStore();
+            Record count((slice(kCountKey)));
+            count.setBodyAsUInt(entries.size());
+            info.write(count, t);
+            Record size((slice(kSizeKey)));
+            size.setBodyAsUInt(totalSize);
+            info.write(size, t);
+            Record shardedFlag((slice(kShardedKey)));
+            shardedFlag.setBodyAsUInt(sharded);
+            info.write(shardedFlag, t);
+        });
+    }
+
+}
@@ -0,0 +1,73 @@
+//
+// BlobManifest.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "BlobDatabase.hh"
+#include <utility>
+#include <vector>
+
+namespace litecore {
+    struct blobKey;
+
+
+    /** A persistent list of the blobs in a sharded BlobStore, so they can be listed and counted
+        without reading 256 directories. It's a SQLite database in the store's directory, holding
+        a record per blob, plus the running count and total size. A store in the flat layout
+        has no manifest; it's created when the store is migrated to the sharded layout, and
+        deleted if it's migrated back.
+        Entries are added before a blob is stored and removed after it's deleted, so the
+        manifest may list a blob that doesn't exist (after a crash) but never omits one.
+        This class is thread-safe. */
+    class BlobManifest : public BlobDatabase {
+    public:
+        /** The name of the database file in the BlobStore's directory. */
+        static const char* const kFileName;
+
+        struct Entry {
+            int64_t size;           ///< Size of the file, including any encryption overhead,
+                                    ///< or of an inline blob's contents
+            bool    encrypted;      ///< Is the blob encrypted?
+            bool    isInline;       ///< Is the blob in the InlineBlobStore, not a file?
+        };
+
+        BlobManifest(const FilePath &dir, bool writeable);
+
+        /** True if the store's blob files are all in subdirectories named by key prefix, as
+            recorded by `rebuild`. A manifest that exists but isn't sharded is left by an
+            interrupted migration. */
+        bool isSharded();
+
+        void add(const blobKey&, const Entry&);
+        void remove(const blobKey&);
+
+        /** Calls the function with every entry. The function may remove entries. */
+        void forEach(fleece::function_ref<void(const blobKey&, const Entry&)>);
+
+        uint64_t count();
+        uint64_t totalSize();
+
+        /** Replaces the entire contents of the manifest, creating it if necessary, and records
+            whether the store is sharded. */
+        void rebuild(const std::vector<std::pair<blobKey,Entry>>&, bool sharded);
+
+    private:
+        KeyStore& infoStore();
+        void adjustTotals(int64_t countDelta, int64_t sizeDelta, Transaction&);
+    };
+
+}
@@ -17,14 +17,25 @@
 //.
 
 #include "BlobStore.hh"
+#include "BlobManifest.hh"
+#include "InlineBlobStore.hh"
 #include "FilePath.hh"
 #include "Error.hh"
+#include "CompressedStream.hh"
 #include "EncryptedStream.hh"
 #include "Logging.hh"
+#include "MappedFile.hh"
 #include "StringUtil.hh"
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace litecore {
     using namespace std;
@@ -33,6 +44,14 @@ namespace litecore {
     LogDomain BlobLog("Blob");
 
 
+    // Size of the buffer used to copy a blob's data. Large reads and writes amortize the
+    // per-call overhead of the file and encryption streams.
+    static constexpr size_t kCopyBufferSize = 1024 * 1024;
+
+    // Subdirectory where suspended BlobWriteStreams save their data.
+    static const char* const kPartialDirName = "partial";
+
+
 #pragma mark - BLOBKEY:
 
 
@@ -76,16 +95,21 @@ namespace litecore {
     }
 
 
-    string blobKey::filename() const {
+    string blobKey::filename(bool compressed) const {
         string str = slice(bytes, sizeof(bytes)).base64String();
         replace(str.begin(), str.end(), '/', '_');
-        return str + ".blob";
+        return str + (compressed ? ".blobz" : ".blob");
     }
 
 
-    bool blobKey::readFromFilename(string filename) {
+    bool blobKey::readFromFilename(string filename, bool *outCompressed) {
+        bool compressed = hasSuffix(filename, ".blobz");
+        if (compressed)
+            filename.resize(filename.size() - 1);
         if (!hasSuffix(filename, ".blob"))
             return false;
+        if (outCompressed)
+            *outCompressed = compressed;
         filename.resize(filename.size() - 5);
         replace(filename.begin(), filename.end(), '_', '/');
         return readFromBase64(slice(filename), false);
@@ -110,54 +134,185 @@ namespace litecore {
     
     
     Blob::Blob(const BlobStore &store, const blobKey &key)
-    :_path(store.dir(), key.filename()),
+    :_path(store.blobPath(key, store._sharded)),
+     _compressedPath(store.blobPath(key, store._sharded, true)),
      _key(key),
      _store(store)
     { }
 
 
+    // A blob's file is checked first, so that large blobs cost no more than they used to; if
+    // there's no file, the blob may be compressed, or inline.
+
+
+    bool Blob::exists() const {
+        return _path.exists() || _compressedPath.exists() || isInline();
+    }
+
+
+    bool Blob::isInline() const {
+        return _store._inline->get(_key, nullptr);
+    }
+
+
+    bool Blob::isCompressed() const {
+        return !_path.exists() && _compressedPath.exists();
+    }
+
+
     int64_t Blob::contentLength() const {
         int64_t length = path().dataSize();
-        if (length >= 0 && _store.options().encryptionAlgorithm != kNoEncryption)
+        if (length < 0) {
+            if (_compressedPath.exists())
+                return read()->getLength();         // (reads the length from the file's trailer)
+            return _store._inline->size(_key);      // (which is exact, even if encrypted)
+        }
+        if (_store.options().encryptionAlgorithm != kNoEncryption)
             length -= EncryptedReadStream::kFileSizeOverhead;
         return length;
     }
 
 
+    time_t Blob::lastModified() const {
+        time_t modified = _path.lastModified();
+        if (modified < 0)
+            modified = _compressedPath.lastModified();
+        if (modified < 0 && !_store._inline->get(_key, nullptr, &modified))
+            modified = -1;
+        return modified;
+    }
+
+
+    alloc_slice Blob::contents() const {
+        alloc_slice data;
+        if (!_path.exists() && _store._inline->get(_key, &data))
+            return data;
+        return read()->readAll();
+    }
+
 
     unique_ptr<SeekableReadStream> Blob::read() const {
-        SeekableReadStream *reader = new FileReadStream(_path);
-        auto &options = _store.options();
-        if (options.encryptionAlgorithm != kNoEncryption) {
-            reader = new EncryptedReadStream(shared_ptr<SeekableReadStream>(reader),
-                                             options.encryptionAlgorithm,
-                                             options.encryptionKey);
+        bool compressed = false;
+        if (!_path.exists()) {
+            compressed = _compressedPath.exists();
+            alloc_slice data;
+            if (!compressed && _store._inline->get(_key, &data))
+                return unique_ptr<SeekableReadStream>{new SliceReadStream(data)};
         }
-        return unique_ptr<SeekableReadStream>{reader};
+        return _store.openFile(compressed ? _compressedPath : _path, compressed);
+    }
+
+
+    Retained<MappedFile> Blob::map() const {
+        if (!_path.exists()) {
+            if (!_compressedPath.exists() && !isInline())
+                error::_throw(error::NotFound);
+            return nullptr;
+        }
+        if (_store.isEncrypted())
+            return nullptr;
+        return new MappedFile(_path);
+    }
+
+
+    void Blob::del() {
+        _path.del();
+        _compressedPath.del();
+        _store._inline->del(_key);
+        if (_store._sharded)
+            _store._manifest->remove(_key);
     }
 
 
 #pragma mark - BLOB WRITING:
 
 
+    // Data is buffered in memory until it's too big to be stored inline, or, if the store
+    // compresses blobs, until there's enough of it to be worth compressing; only then is the
+    // temporary file created.
     BlobWriteStream::BlobWriteStream(BlobStore &store)
     :_store(store)
     {
+        sha1_begin(&_sha1ctx);
+    }
+
+
+    // The data saved by earlier sessions is used if it's contiguous from the start of the blob;
+    // any other segments are useless, so they're deleted.
+    BlobWriteStream::BlobWriteStream(BlobStore &store, const blobKey &resumeKey)
+    :BlobWriteStream(store)
+    {
+        _resumable = true;
+        _resumeKey = resumeKey;
+        struct Segment {uint64_t offset; FilePath path; bool compressed;};
+        vector<Segment> found;
+        _store.forEachPartialSegment(resumeKey, [&](uint64_t offset, const FilePath &path,
+                                                    bool compressed) {
+            found.push_back({offset, path, compressed});
+        });
+        sort(found.begin(), found.end(), [](const Segment &a, const Segment &b) {
+            return a.offset < b.offset;
+        });
+        for (auto &segment : found) {
+            uint64_t length = 0;
+            if (segment.offset == _resumeOffset) {
+                try {
+                    length = _store.openFile(segment.path, segment.compressed)->getLength();
+                } catch (const exception&) { }
+            }
+            if (length > 0) {
+                _segments.emplace_back(segment.path, segment.compressed);
+                _resumeOffset += length;
+            } else {
+                segment.path.del();
+            }
+        }
+        if (_resumeOffset > 0)
+            LogVerbose(BlobLog, "Resuming blob %s after %llu saved bytes",
+                       resumeKey.base64String().c_str(), (unsigned long long)_resumeOffset);
+    }
+
+
+    static size_t bufferLimit(const BlobStore::Options &options) {
+        if (options.compressed)
+            return max(options.maxInlineSize, BlobStore::kMinCompressedSize);
+        return options.maxInlineSize;
+    }
+
+
+    // `nextData` is what's about to be written after the buffer. The first bytes of the two
+    // decide whether the file is compressed.
+    void BlobWriteStream::openFile(slice nextData) {
+        auto &options = _store.options();
+        if (options.compressed
+                && _buffer.size() + nextData.size >= BlobStore::kMinCompressedSize) {
+            string header = _buffer.substr(0, CompressedWriteStream::kSniffLength);
+            header.append((const char*)nextData.buf,
+                          min(nextData.size, CompressedWriteStream::kSniffLength - header.size()));
+            _compressed = CompressedWriteStream::looksCompressible(slice(header));
+        }
+
         FILE *file;
-        _tmpPath = store.dir()["incoming_"].mkTempFile(&file);
+        _tmpPath = _store.dir()["incoming_"].mkTempFile(&file);
+        _inFile = true;
         _writer = shared_ptr<WriteStream> {new FileWriteStream(file)};
-        auto &options = _store.options();
         if (options.encryptionAlgorithm != kNoEncryption) {
             _writer = make_shared<EncryptedWriteStream>(_writer,
                                                         options.encryptionAlgorithm,
                                                         options.encryptionKey);
         }
-        sha1_begin(&_sha1ctx);
+        if (_compressed)
+            _writer = make_shared<CompressedWriteStream>(_writer);
+        if (!_buffer.empty()) {
+            _writer->write(slice(_buffer));
+            _buffer.clear();
+            _buffer.shrink_to_fit();
+        }
     }
 
 
     BlobWriteStream::~BlobWriteStream() {
-        if (!_installed) {
+        if (!_installed && _inFile) {
             try {
                 _tmpPath.del();
             } catch (...) {
@@ -170,8 +325,14 @@ namespace litecore {
 
 
     void BlobWriteStream::write(slice data) {
-        Assert(!_computedKey, "Attempted to write after computing digest");
-        _writer->write(data);
+        Assert(!_computedKey && !_suspended,
+               "Attempted to write after computing digest or suspending");
+        if (!_inFile && _buffer.size() + data.size > bufferLimit(_store.options()))
+            openFile(data);
+        if (_inFile)
+            _writer->write(data);
+        else
+            _buffer.append((const char*)data.buf, data.size);
         sha1_add(&_sha1ctx, data.buf, data.size);
     }
 
@@ -192,24 +353,105 @@ namespace litecore {
 
 
     Blob BlobWriteStream::install(const blobKey *expectedKey) {
+        if (_resumable) {
+            if (!_segments.empty())
+                return installSegments(expectedKey);
+            if (!expectedKey)
+                expectedKey = &_resumeKey;
+        }
         close();
         auto key = computeKey();
         if (expectedKey && *expectedKey != key)
             error::_throw(error::CorruptData);
+        if (!_inFile && (_buffer.empty() || _buffer.size() > _store.options().maxInlineSize)) {
+            // An empty blob is still stored as a file, as is one too big to be inline that was
+            // only buffered to be checked for compressibility:
+            openFile(nullslice);
+            close();
+        }
         Blob blob(_store, key);
-        _tmpPath.setReadOnly(true);
-        _tmpPath.moveTo(blob.path());
+        if (_store._sharded) {
+            // The manifest entry is added first, so a crash can't leave a blob it doesn't list:
+            int64_t size = _inFile ? _tmpPath.dataSize() : (int64_t)_buffer.size();
+            _store._manifest->add(key, {size, _store.isEncrypted(), !_inFile});
+        }
+        if (_inFile) {
+            FilePath path = _compressed ? blob._compressedPath : blob._path;
+            if (_store._sharded)
+                path.dir().mkdir();
+            _tmpPath.setReadOnly(true);
+            _tmpPath.moveTo(path);
+            // The same blob might have been stored before with the opposite compression:
+            (_compressed ? blob._path : blob._compressedPath).del();
+        } else {
+            _store._inline->put(key, slice(_buffer));
+        }
         _installed = true;
         return blob;
     }
     
+    void BlobWriteStream::suspend() {
+        Assert(_resumable, "Only a BlobWriteStream with a resume key can be suspended");
+        if (_suspended)
+            return;
+        _suspended = true;
+        if (!_inFile && _buffer.empty())
+            return;                         // (nothing to save)
+        if (!_inFile)
+            openFile(nullslice);
+        close();
+        FilePath segment = _store.partialSegmentPath(_resumeKey, _resumeOffset, _compressed);
+        segment.dir().mkdir();
+        _tmpPath.moveTo(segment);
+        _segments.emplace_back(segment, _compressed);
+    }
+
+
+    // Joins the saved data, including this session's, into the blob, then deletes it.
+    Blob BlobWriteStream::installSegments(const blobKey *expectedKey) {
+        suspend();
+        if (!expectedKey)
+            expectedKey = &_resumeKey;
+        try {
+            BlobWriteStream joined(_store);
+            unique_ptr<uint8_t[]> buffer(new uint8_t[kCopyBufferSize]);
+            for (auto &segment : _segments) {
+                auto reader = _store.openFile(segment.first, segment.second);
+                size_t bytesRead;
+                while ((bytesRead = reader->read(buffer.get(), kCopyBufferSize)) > 0)
+                    joined.write(slice(buffer.get(), bytesRead));
+            }
+            Blob blob = joined.install(expectedKey);
+            deleteSegments();
+            _installed = true;
+            return blob;
+        } catch (...) {
+            // The saved data is bad, so the next session will have to start over. (Or another
+            // stream for the same blob installed it first, and deleted the data.)
+            deleteSegments();
+            if (_store.has(*expectedKey))
+                return _store.get(*expectedKey);
+            throw;
+        }
+    }
+
+
+    void BlobWriteStream::deleteSegments() {
+        for (auto &segment : _segments)
+            segment.first.del();
+        _segments.clear();
+    }
+
+    
 #pragma mark - DELETING:
     
     void BlobStore::deleteAllExcept(const unordered_set<string> &inUse) {
-        _dir.forEachFile([&inUse](const FilePath &path) {
-            if(find(inUse.cbegin(), inUse.cend(), path.fileName()) == inUse.cend()) {
-                path.del();
-            }
+        forEachBlob([&](const blobKey &key) {
+            if (inUse.find(key.filename()) == inUse.end())
+                get(key).del();
+        });
+        forEachStrayFile([](const FilePath &path) {
+            path.del();
         });
     }
 
@@ -219,6 +461,10 @@ namespace litecore {
 
     const BlobStore::Options BlobStore::Options::defaults = {true, true};
 
+    constexpr size_t BlobStore::kDefaultMaxInlineSize;
+    constexpr size_t BlobStore::kMinCompressedSize;
+    constexpr int64_t Blob::kMinMappedReadSize;
+
 
     BlobStore::BlobStore(const FilePath &dir, const Options *options)
     :_dir(dir),
@@ -231,6 +477,225 @@ namespace litecore {
                 error::_throw(error::NotFound);
             _dir.mkdir();
         }
+        openDatabases();
+        // (A flat store has no manifest, unless a migration was interrupted.)
+        if (_options.writeable && (_sharded != _options.sharded
+                                   || _manifest->exists() != _options.sharded))
+            migrate();
+    }
+
+
+    BlobStore::~BlobStore() = default;
+
+
+    void BlobStore::openDatabases() {
+        _inline.reset(new InlineBlobStore(_dir, _options.encryptionAlgorithm,
+                                          _options.encryptionKey, _options.writeable));
+        _manifest.reset(new BlobManifest(_dir, _options.writeable));
+        _sharded = _manifest->isSharded();
+    }
+
+
+    // The shard directory of a blob is the hex form of its key's first byte.
+    FilePath BlobStore::blobPath(const blobKey &key, bool sharded, bool compressed) const {
+        if (sharded)
+            return _dir.subdirectoryNamed(key.hexString().substr(0, 2))[key.filename(compressed)];
+        else
+            return FilePath(_dir, key.filename(compressed));
+    }
+
+
+    // Lists the blob files in the directory and its shards, whatever the current layout is.
+    void BlobStore::forEachBlobFile(function_ref<void(const blobKey&,
+                                                      const FilePath&)> callback) const
+    {
+        _dir.forEachFile([&](const FilePath &path) {
+            blobKey key;
+            if (path.isDir()) {
+                if (path.fileOrDirName().size() == 2) {
+                    path.forEachFile([&](const FilePath &shardPath) {
+                        if (key.readFromFilename(shardPath.fileName()))
+                            callback(key, shardPath);
+                    });
+                }
+            } else if (key.readFromFilename(path.fileName())) {
+                callback(key, path);
+            }
+        });
+    }
+
+
+    // Moves every blob file into the layout given by the options. A sharded store's manifest is
+    // rebuilt, and a flat store's is deleted. The manifest exists throughout, so that if this is
+    // interrupted, the next writeable open migrates the store again.
+    void BlobStore::migrate() {
+        bool encrypted = isEncrypted();
+        if (_options.sharded && !_manifest->exists())
+            _manifest->rebuild({}, false);
+        vector<pair<blobKey,FilePath>> files;
+        forEachBlobFile([&](const blobKey &key, const FilePath &path) {
+            files.emplace_back(key, path);
+        });
+
+        vector<pair<blobKey,BlobManifest::Entry>> entries;
+        entries.reserve(files.size());
+        unordered_set<string> moved;
+        for (auto &file : files) {
+            bool compressed = hasSuffix(file.second.fileName(), ".blobz");
+            FilePath dst = blobPath(file.first, _options.sharded, compressed);
+            if (!moved.insert(file.first.filename()).second) {
+                // A duplicate left behind by an interrupted migration, or a copy of the same
+                // blob with the opposite compression:
+                if (dst.path() != file.second.path())
+                    file.second.del();
+                continue;
+            }
+            if (dst.path() != file.second.path()) {
+                dst.dir().mkdir();
+                file.second.moveTo(dst);
+            }
+            entries.push_back({file.first, {dst.dataSize(), encrypted, false}});
+        }
+        _inline->forEach([&](const blobKey &key) {
+            entries.push_back({key, {_inline->size(key), encrypted, true}});
+        });
+
+        if (!_options.sharded) {
+            _dir.forEachFile([](const FilePath &path) {
+                if (path.isDir() && path.fileOrDirName().size() == 2) {
+                    bool empty = true;
+                    path.forEachFile([&](const FilePath&) {empty = false;});
+                    if (empty)
+                        path.del();
+                }
+            });
+        }
+        if (_options.sharded)
+            _manifest->rebuild(entries, true);
+        else
+            _manifest->deleteFile();
+        _sharded = _options.sharded;
+        if (!files.empty())
+            LogTo(BlobLog, "Migrated blob store %s to %s layout (%zu files)",
+                  _dir.path().c_str(), (_sharded ? "sharded" : "flat"), files.size());
+    }
+
+
+    uint64_t BlobStore::count() const {
+        if (_sharded)
+            return _manifest->count();
+        // A flat store has to be listed:
+        uint64_t count = 0;
+        forEachBlob([&](const blobKey&) {++count;});
+        return count;
+    }
+
+
+    uint64_t BlobStore::totalSize() const {
+        if (_sharded)
+            return _manifest->totalSize();
+        uint64_t size = 0;
+        forEachBlobFile([&](const blobKey&, const FilePath &path) {
+            size += path.dataSize();
+        });
+        return size + _inline->totalSize();
+    }
+
+
+    void BlobStore::forEachBlob(function_ref<void(const blobKey&)> callback) const {
+        if (_sharded) {
+            _manifest->forEach([&](const blobKey &key, const BlobManifest::Entry&) {
+                callback(key);
+            });
+        } else {
+            forEachBlobFile([&](const blobKey &key, const FilePath&) {
+                callback(key);
+            });
+            _inline->forEach(callback);
+        }
+    }
+
+
+    void BlobStore::forEachStrayFile(function_ref<void(const FilePath&)> callback) const {
+        _dir.forEachFile([&](const FilePath &path) {
+            blobKey key;
+            if (path.isDir()) {
+                // Data saved by suspended writers counts, so that abandoned data is cleaned up:
+                if (path.fileOrDirName() == kPartialDirName) {
+                    path.forEachFile([&](const FilePath &segment) {
+                        if (!segment.isDir())
+                            callback(segment);
+                    });
+                }
+                return;
+            }
+            if (key.readFromFilename(path.fileName())
+                    || hasPrefix(path.fileName(), InlineBlobStore::kFileName)
+                    || hasPrefix(path.fileName(), BlobManifest::kFileName))
+                return;
+            callback(path);
+        });
+    }
+
+
+    // A partial blob's saved data is in segment files named "<offset>_<blob filename>".
+    FilePath BlobStore::partialSegmentPath(const blobKey &key, uint64_t offset,
+                                           bool compressed) const
+    {
+        return _dir.subdirectoryNamed(kPartialDirName)[to_string((unsigned long long)offset)
+                                                       + "_" + key.filename(compressed)];
+    }
+
+
+    void BlobStore::forEachPartialSegment(const blobKey &key,
+                                          function_ref<void(uint64_t, const FilePath&,
+                                                            bool)> callback) const
+    {
+        FilePath partialDir = _dir.subdirectoryNamed(kPartialDirName);
+        if (!partialDir.existsAsDir())
+            return;
+        string plainName = key.filename(false), compressedName = key.filename(true);
+        partialDir.forEachFile([&](const FilePath &path) {
+            string name = path.fileName();
+            size_t sep = name.find('_');
+            if (sep == string::npos || sep == 0)
+                return;
+            string blobName = name.substr(sep + 1);
+            bool compressed = (blobName == compressedName);
+            if (compressed || blobName == plainName)
+                callback(strtoull(name.c_str(), nullptr, 10), path, compressed);
+        });
+    }
+
+
+    // Opens a stream that reads a blob file, or a partial blob's segment file.
+    unique_ptr<SeekableReadStream> BlobStore::openFile(const FilePath &path,
+                                                       bool compressed) const
+    {
+        SeekableReadStream *reader;
+        if (!isEncrypted() && path.dataSize() >= Blob::kMinMappedReadSize) {
+            // Large files are mapped, to avoid a read syscall per buffer:
+            Retained<MappedFile> mapped = new MappedFile(path);
+            reader = new MappedFileReadStream(mapped);
+        } else {
+            reader = new FileReadStream(path);
+            if (isEncrypted()) {
+                reader = new EncryptedReadStream(shared_ptr<SeekableReadStream>(reader),
+                                                 _options.encryptionAlgorithm,
+                                                 _options.encryptionKey);
+            }
+        }
+        // A compressed file was compressed before it was encrypted, so it's decompressed last:
+        if (compressed)
+            reader = new CompressedReadStream(shared_ptr<SeekableReadStream>(reader));
+        return unique_ptr<SeekableReadStream>{reader};
+    }
+
+
+    void BlobStore::deleteStore() {
+        _inline->close();
+        _manifest->close();
+        _dir.delRecursive();
     }
 
 
@@ -241,27 +706,120 @@ namespace litecore {
     }
 
 
-    void BlobStore::copyBlobsTo(BlobStore &toStore) {
-        _dir.forEachFile([&](const FilePath &path) {
-            blobKey key;
-            if (!key.readFromFilename(path.fileName()))
-                return;
-            Blob srcBlob(*this, key);
-            auto src = srcBlob.read();
-            BlobWriteStream dst(toStore);
-            uint8_t buffer[4096];
+#pragma mark - COPYING:
+
+
+    // Returns true if the blob exists and its contents match its digest. A blob left by an
+    // interrupted copy is either absent or complete, but it may have been written with a
+    // different encryption key, in which case it won't decrypt correctly.
+    static bool blobIsIntact(const Blob &blob, uint8_t *buffer) {
+        if (!blob.exists())
+            return false;
+        try {
+            auto stream = blob.read();
+            sha1Context ctx;
+            sha1_begin(&ctx);
             size_t bytesRead;
-            while ((bytesRead = src->read(buffer, sizeof(buffer))) > 0) {
-                dst.write(slice(buffer, bytesRead));
-            }
-            dst.install(&key);
+            while ((bytesRead = stream->read(buffer, kCopyBufferSize)) > 0)
+                sha1_add(&ctx, buffer, bytesRead);
+            blobKey digest;
+            sha1_end(&ctx, &digest.bytes);
+            return digest == blob.key();
+        } catch (const exception&) {
+            return false;
+        }
+    }
+
+
+    // Copies one blob, returning its size, or -1 if it was skipped.
+    static int64_t copyBlob(const Blob &srcBlob, BlobStore &toStore, uint8_t *buffer) {
+        Blob dstBlob = toStore.get(srcBlob.key());
+        if (blobIsIntact(dstBlob, buffer) || !srcBlob.exists())
+            return -1;
+        if (dstBlob.exists())
+            dstBlob.del();
+        auto src = srcBlob.read();
+        BlobWriteStream dst(toStore);
+        int64_t size = 0;
+        size_t bytesRead;
+        while ((bytesRead = src->read(buffer, kCopyBufferSize)) > 0) {
+            dst.write(slice(buffer, bytesRead));
+            size += bytesRead;
+        }
+        auto key = srcBlob.key();
+        dst.install(&key);
+        return size;
+    }
+
+
+    void BlobStore::copyBlobsTo(BlobStore &toStore, const CopyProgressCallback &callback) {
+        vector<blobKey> keys;
+        forEachBlob([&](const blobKey &key) {
+            keys.push_back(key);
         });
+
+        CopyProgress progress = {0, 0, keys.size(), 0};
+        atomic<size_t> nextKey {0};
+        atomic<bool> failed {false};
+        exception_ptr firstError;
+        mutex progressMutex;
+
+        // Each worker claims the next uncopied blob until they're all gone or one fails:
+        auto worker = [&]() {
+            try {
+                unique_ptr<uint8_t[]> buffer(new uint8_t[kCopyBufferSize]);
+                size_t i;
+                while (!failed && (i = nextKey++) < keys.size()) {
+                    int64_t size = copyBlob(get(keys[i]), toStore, buffer.get());
+                    lock_guard<mutex> lock(progressMutex);
+                    if (size >= 0) {
+                        ++progress.blobsCopied;
+                        progress.bytesCopied += size;
+                    } else {
+                        ++progress.blobsSkipped;
+                    }
+                    if (callback)
+                        callback(progress);
+                }
+            } catch (...) {
+                lock_guard<mutex> lock(progressMutex);
+                if (!firstError)
+                    firstError = current_exception();
+                failed = true;
+            }
+        };
+
+        size_t nThreads = min(max(thread::hardware_concurrency(), 1u), (unsigned)keys.size());
+        vector<thread> threads;
+        try {
+            for (size_t i = 1; i < nThreads; ++i)
+                threads.emplace_back(worker);
+        } catch (...) {
+            failed = true;
+            for (auto &t : threads)
+                t.join();
+            throw;
+        }
+        worker();                           // The calling thread is a worker too
+        for (auto &t : threads)
+            t.join();
+        if (firstError)
+            rethrow_exception(firstError);
+        LogTo(BlobLog, "Copied %llu blobs (%llu bytes) to %s, skipped %llu, using %zu threads",
+              (unsigned long long)progress.blobsCopied, (unsigned long long)progress.bytesCopied,
+              toStore.dir().path().c_str(), (unsigned long long)progress.blobsSkipped,
+              nThreads);
     }
 
 
     void BlobStore::moveTo(BlobStore &toStore) {
+        _inline->close();
+        _manifest->close();
+        toStore._inline->close();
+        toStore._manifest->close();
         _dir.moveToReplacingDir(toStore.dir(), true);
         toStore._options = _options;
+        toStore.openDatabases();
     }
 
 }
@@ -21,15 +21,24 @@
 #include "FilePath.hh"
 #include "Stream.hh"
 #include "SecureDigest.hh"
+#include "function_ref.hh"
+#include <ctime>
+#include <functional>
+#include <memory>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #if !SECURE_DIGEST_AVAILABLE
 #error No SHA digest API configured (See SecureDigest.hh)
 #endif
 
 namespace litecore {
+    class BlobManifest;
     class BlobStore;
     class FilePath;
+    class InlineBlobStore;
+    class MappedFile;
 
 
     /** A raw SHA-1 digest used as the unique identifier of a blob. */
@@ -41,12 +50,12 @@ namespace litecore {
         blobKey(const std::string &base64);
 
         bool readFromBase64(slice base64, bool prefixed =true);
-        bool readFromFilename(std::string filename);
+        bool readFromFilename(std::string filename, bool *outCompressed =nullptr);
 
         operator slice() const          {return slice(bytes, sizeof(bytes));}
         std::string hexString() const   {return operator slice().hexString();}
         std::string base64String() const;
-        std::string filename() const;
+        std::string filename(bool compressed =false) const;
 
         bool operator== (const blobKey &k) const {
             return 0 == memcmp(bytes, k.bytes, sizeof(bytes));
@@ -59,20 +68,38 @@ namespace litecore {
     };
 
 
-    /** Represents a blob stored in a BlobStore. This class is thread-safe. */
+    /** Represents a blob stored in a BlobStore. Small blobs may be stored inline, in the
+        store's database instead of in files of their own, and files may be compressed.
+        The key, and the length and contents read from a Blob, are always those of the
+        uncompressed data. This class is thread-safe. */
     class Blob {
     public:
-        bool exists() const             {return _path.exists();}
+        bool exists() const;
 
         blobKey key() const             {return _key;}
+        /** The path of the blob's file. If the blob is inline or compressed, the file doesn't
+            exist. */
         FilePath path() const           {return _path;}
-        int64_t contentLength() const;      // An overestimate, if blob is encrypted
+        bool isInline() const;
+        bool isCompressed() const;
+        int64_t contentLength() const;      // An overestimate, if blob is encrypted & uncompressed
 
-        alloc_slice contents() const    {return read()->readAll();}
+        alloc_slice contents() const;
 
         std::unique_ptr<SeekableReadStream> read() const;
 
-        void del()                      {_path.del();}
+        /** Memory-maps the blob's file, so its contents can be read without copying.
+            Returns null if the blob can't be mapped because it's encrypted, compressed or inline.
+            Throws NotFound if the blob doesn't exist. */
+        Retained<MappedFile> map() const;
+
+        /** Unencrypted blob files at least this large are read through a memory mapping. */
+        static constexpr int64_t kMinMappedReadSize = 256 * 1024;
+
+        /** The time the blob was added to the store, or -1 if it doesn't exist. */
+        time_t lastModified() const;
+
+        void del();
 
     private:
         friend class BlobStore;
@@ -81,6 +108,7 @@ namespace litecore {
         Blob(const BlobStore&, const blobKey&);
 
         const FilePath _path;
+        const FilePath _compressedPath;
         const blobKey _key;
         const BlobStore &_store;
     };
@@ -90,8 +118,18 @@ namespace litecore {
     class BlobWriteStream : public WriteStream {
     public:
         BlobWriteStream(BlobStore&);
+
+        /** Creates a stream for a blob whose key is known in advance, and whose data may be
+            written over several sessions, like a download that can be interrupted. The data
+            saved by earlier sessions' `suspend` calls is kept, so only the data after
+            `resumeOffset` should be written. `install` then installs all of it. */
+        BlobWriteStream(BlobStore&, const blobKey &resumeKey);
+
         ~BlobWriteStream();
 
+        /** The number of bytes saved by earlier sessions, which this one continues after. */
+        uint64_t resumeOffset() const           {return _resumeOffset;}
+
         void write(slice) override;
         void close() override;
 
@@ -105,31 +143,63 @@ namespace litecore {
             a CorruptData exception is thrown. */
         Blob install(const blobKey *expectedKey =nullptr);
 
+        /** Saves the data written so far in the store's directory, instead of installing it,
+            so that a later stream with the same resume key can continue after it.
+            Only a stream created with a resume key can be suspended.
+            No more data can be written after this is called. */
+        void suspend();
+
     private:
+        void openFile(slice nextData);
+        Blob installSegments(const blobKey *expectedKey);
+        void deleteSegments();
+
         BlobStore &_store;
         FilePath _tmpPath;
         std::shared_ptr<WriteStream> _writer;
+        std::string _buffer;                // Data of a blob small enough to be inline
         sha1Context _sha1ctx;
         blobKey _key;
+        bool _inFile {false};               // Has data been written to _tmpPath?
+        bool _compressed {false};           // Is _tmpPath compressed?
         bool _computedKey {false};
         bool _installed {false};
+        bool _resumable {false};            // Was I created with a resume key?
+        bool _suspended {false};
+        blobKey _resumeKey;
+        uint64_t _resumeOffset {0};         // Total length of _segments' data
+        std::vector<std::pair<FilePath,bool>> _segments;    // Saved data, & whether compressed
     };
 
 
     /** Manages a content-addressable store of binary blobs, stored as files in a directory.
+        The files may be spread across subdirectories named by the first byte of the key (in
+        hex), to keep directories small; then a manifest lists every blob, so the store can be
+        enumerated and counted without listing all those directories.
         This class is thread-safe. */
     class BlobStore {
     public:
         struct Options {
             bool create         :1;     ///< Should the store be created if it doesn't exist?
             bool writeable      :1;     ///< If false, opened read-only
+            bool sharded        :1;     ///< Put files in subdirectories by key prefix?
+            bool compressed     :1;     ///< Compress files whose contents look compressible?
             EncryptionAlgorithm encryptionAlgorithm;
             alloc_slice encryptionKey;
+            size_t maxInlineSize;           ///< Blobs up to this size are stored inline
             
             static const Options defaults;
         };
 
+        /** The maximum inline blob size a Database uses for its BlobStore. */
+        static constexpr size_t kDefaultMaxInlineSize = 4096;
+
+        /** If `Options::compressed` is set, blobs at least this large are compressed, unless
+            their first bytes show they're in an already-compressed format like JPEG or ZIP. */
+        static constexpr size_t kMinCompressedSize = 512;
+
         BlobStore(const FilePath &dir, const Options* =nullptr);
+        ~BlobStore();
 
         const FilePath& dir() const                 {return _dir;}
         const Options& options() const              {return _options;}
@@ -138,9 +208,27 @@ namespace litecore {
         uint64_t count() const;
         uint64_t totalSize() const;
 
-        void deleteStore()                          {_dir.delRecursive();}
+        /** Sets the size limit of blobs stored inline, in a database, instead of as files.
+            Zero disables inlining. This only affects new blobs; existing ones stay where they
+            are. Don't call this while blobs are being written. */
+        void setMaxInlineSize(size_t size)          {_options.maxInlineSize = size;}
+
+        void deleteStore();
         void deleteAllExcept(const std::unordered_set<std::string>& inUse);
 
+        /** Calls the function with the key of every blob, inline or not. The function may
+            delete blobs. */
+        void forEachBlob(fleece::function_ref<void(const blobKey&)>) const;
+
+        /** Calls the function for every file in the directory that isn't part of the store,
+            like a temporary file abandoned by a crash, or data saved by a suspended
+            BlobWriteStream. */
+        void forEachStrayFile(fleece::function_ref<void(const FilePath&)>) const;
+
+        /** True if blob files are in subdirectories. When a writeable store is opened, it's
+            migrated to the layout given by `Options::sharded`. */
+        bool isSharded() const                      {return _sharded;}
+
         bool has(const blobKey &key) const          {return get(key).exists();}
 
         const Blob get(const blobKey &key) const    {return Blob(*this, key);}
@@ -148,12 +236,42 @@ namespace litecore {
 
         Blob put(slice data, const blobKey *expectedKey =nullptr);
 
-        void copyBlobsTo(BlobStore &toStore);       // Copy my blobs into toStore
+        struct CopyProgress {
+            uint64_t blobsCopied;       ///< Number of blobs copied so far
+            uint64_t blobsSkipped;      ///< Number already in the destination, or missing
+            uint64_t blobsTotal;        ///< Total number of blobs to copy
+            uint64_t bytesCopied;       ///< Total size of the blobs copied so far
+        };
+        using CopyProgressCallback = std::function<void(const CopyProgress&)>;
+
+        /** Copies my blobs into toStore, re-encrypting them if its key differs. Blobs toStore
+            already has intact are skipped, so an interrupted copy can be resumed.
+            Blobs are copied in parallel, on up to one thread per CPU core. The callback is called
+            after each blob, on any of those threads but never concurrently. */
+        void copyBlobsTo(BlobStore &toStore, const CopyProgressCallback& =nullptr);
+
         void moveTo(BlobStore &toStore);            // Replace toStore's dir & options
 
     private:
+        friend class Blob;
+        friend class BlobWriteStream;
+
+        void openDatabases();
+        FilePath blobPath(const blobKey&, bool sharded, bool compressed =false) const;
+        std::unique_ptr<SeekableReadStream> openFile(const FilePath&, bool compressed) const;
+        FilePath partialSegmentPath(const blobKey&, uint64_t offset, bool compressed) const;
+        void forEachPartialSegment(const blobKey&,
+                                   fleece::function_ref<void(uint64_t offset,
+                                                             const FilePath&,
+                                                             bool compressed)>) const;
+        void forEachBlobFile(fleece::function_ref<void(const blobKey&, const FilePath&)>) const;
+        void migrate();
+
         FilePath const  _dir;                           // Location
         Options         _options;                       // Option/capability flags
+        bool            _sharded {false};               // Current layout of files
+        std::unique_ptr<InlineBlobStore> _inline;       // Database of small blobs
+        std::unique_ptr<BlobManifest> _manifest;        // List of all blobs
     };
 
 }
@@ -0,0 +1,183 @@
+//
+// InlineBlobStore.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "InlineBlobStore.hh"
+#include "BlobStore.hh"
+#include "EncryptedStream.hh"
+#include "Error.hh"
+#include "DataFile.hh"
+#include "KeyStore.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace litecore {
+    using namespace std;
+
+
+    const char* const InlineBlobStore::kFileName = "inline_blobs.sqlite3";
+
+
+    InlineBlobStore::InlineBlobStore(const FilePath &dir,
+                                     EncryptionAlgorithm algorithm, slice encryptionKey,
+                                     bool writeable)
+    :BlobDatabase(dir, kFileName, writeable)
+    ,_encryptionAlgorithm(algorithm)
+    ,_encryptionKey(encryptionKey)
+    { }
+
+
+    // Contents are encrypted like a blob file's, with a random nonce per blob, so the database
+    // itself needn't be.
+    alloc_slice InlineBlobStore::encrypt(slice contents) const {
+        auto output = make_shared<StringWriteStream>();
+        EncryptedWriteStream writer(output, _encryptionAlgorithm, _encryptionKey);
+        writer.write(contents);
+        writer.close();
+        return alloc_slice(output->data());
+    }
+
+
+    alloc_slice InlineBlobStore::decrypt(slice stored) const {
+        EncryptedReadStream reader(make_shared<SliceReadStream>(alloc_slice(stored)),
+                                   _encryptionAlgorithm, _encryptionKey);
+        return reader.readAll();
+    }
+
+
+    bool InlineBlobStore::get(const blobKey &key, alloc_slice *outContents, time_t *outAddedTime) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        if (!blobs)
+            return false;
+        bool found = false;
+        blobs->get(key, (outContents ? kDefaultContent : kMetaOnly), [&](const RecordLite &rec) {
+            found = rec.exists;
+            if (found) {
+                if (outContents) {
+                    if (_encryptionAlgorithm != kNoEncryption)
+                        *outContents = decrypt(rec.body);
+                    else
+                        *outContents = alloc_slice(rec.body);
+                }
+                if (outAddedTime)
+                    *outAddedTime = (time_t)strtoll(string(rec.version).c_str(), nullptr, 10);
+            }
+        });
+        return found;
+    }
+
+
+    int64_t InlineBlobStore::size(const blobKey &key) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        if (!blobs)
+            return -1;
+        bool encrypted = (_encryptionAlgorithm != kNoEncryption);
+        int64_t size = -1;
+        blobs->get(key, (encrypted ? kDefaultContent : kMetaOnly), [&](const RecordLite &rec) {
+            if (!rec.exists)
+                return;
+            if (encrypted) {
+                // The exact length is only known by decrypting the final block:
+                EncryptedReadStream reader(make_shared<SliceReadStream>(alloc_slice(rec.body)),
+                                           _encryptionAlgorithm, _encryptionKey);
+                size = (int64_t)reader.getLength();
+            } else {
+                size = rec.bodySize;
+            }
+        });
+        return size;
+    }
+
+
+    void InlineBlobStore::put(const blobKey &key, slice contents) {
+        alloc_slice encrypted;
+        if (_encryptionAlgorithm != kNoEncryption) {
+            encrypted = encrypt(contents);
+            contents = encrypted;
+        }
+        string added = to_string((long long)time(nullptr));
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(true);
+        if (!blobs)
+            error::_throw(error::NotWriteable);
+        write([&](Transaction &t) {
+            blobs->set(key, slice(added), contents, DocumentFlags::kNone, t);
+        });
+    }
+
+
+    bool InlineBlobStore::del(const blobKey &key) {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        if (!blobs)
+            return false;
+        bool deleted = false;
+        write([&](Transaction &t) {
+            deleted = blobs->del(key, t);
+        });
+        return deleted;
+    }
+
+
+    void InlineBlobStore::forEach(fleece::function_ref<void(const blobKey&)> callback) {
+        vector<blobKey> keys;
+        {
+            lock_guard<mutex> lock(_mutex);
+            KeyStore *blobs = store(false);
+            if (!blobs)
+                return;
+            RecordEnumerator::Options options;
+            options.contentOptions = kMetaOnly;
+            RecordEnumerator e(*blobs, options);
+            while (e.next())
+                keys.emplace_back(e->key());
+        }
+        // (The mutex is unlocked so the callback can call back into this object.)
+        for (auto &key : keys)
+            callback(key);
+    }
+
+
+    uint64_t InlineBlobStore::count() {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        return blobs ? blobs->recordCount() : 0;
+    }
+
+
+    // (This is the stored size, which, like that of a blob file, includes any encryption
+    // overhead.)
+    uint64_t InlineBlobStore::totalSize() {
+        lock_guard<mutex> lock(_mutex);
+        KeyStore *blobs = store(false);
+        if (!blobs)
+            return 0;
+        uint64_t total = 0;
+        RecordEnumerator::Options options;
+        options.contentOptions = kMetaOnly;
+        RecordEnumerator e(*blobs, options);
+        while (e.next())
+            total += e->bodySize();
+        return total;
+    }
+
+}
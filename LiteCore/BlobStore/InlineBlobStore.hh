@@ -0,0 +1,65 @@
+//
+// InlineBlobStore.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "BlobDatabase.hh"
+#include <ctime>
+
+namespace litecore {
+    struct blobKey;
+
+
+    /** Holds a BlobStore's small blobs, which would waste an inode and several syscalls apiece
+        as files. They're records in a SQLite database in the store's directory, keyed by the
+        raw digest, with the time they were added as the version. The database is only created
+        when the first blob is added. If the BlobStore is encrypted, each blob's contents are
+        encrypted with its key, the same way as a blob file's.
+        This class is thread-safe. */
+    class InlineBlobStore : public BlobDatabase {
+    public:
+        /** The name of the database file in the BlobStore's directory. */
+        static const char* const kFileName;
+
+        InlineBlobStore(const FilePath &dir,
+                        EncryptionAlgorithm, slice encryptionKey,
+                        bool writeable);
+
+        /** Reads a blob's contents and/or the time it was added; returns false if it's missing. */
+        bool get(const blobKey&, alloc_slice *outContents, time_t *outAddedTime =nullptr);
+
+        /** Returns a blob's size, or -1 if it's missing. */
+        int64_t size(const blobKey&);
+
+        void put(const blobKey&, slice contents);
+        bool del(const blobKey&);
+
+        /** Calls the function with the key of every blob. The function may delete blobs. */
+        void forEach(fleece::function_ref<void(const blobKey&)>);
+
+        uint64_t count();
+        uint64_t totalSize();
+
+    private:
+        alloc_slice encrypt(slice contents) const;
+        alloc_slice decrypt(slice stored) const;
+
+        EncryptionAlgorithm const   _encryptionAlgorithm;
+        alloc_slice const           _encryptionKey;
+    };
+
+}
@@ -21,7 +21,9 @@
 #include "Logging.hh"
 #include "PlatformIO.hh"
 #include <errno.h>
+#include <algorithm>
 #include <memory>
+#include <string.h>
 
 namespace litecore {
     using namespace std;
@@ -104,6 +106,20 @@ namespace litecore {
 
 
 
+    void SliceReadStream::seek(uint64_t pos) {
+        _pos = (size_t)min(pos, (uint64_t)_data.size);
+    }
+
+
+    size_t SliceReadStream::read(void *dst, size_t count) {
+        count = min(count, _data.size - _pos);
+        memcpy(dst, (const uint8_t*)_data.buf + _pos, count);
+        _pos += count;
+        return count;
+    }
+
+
+
     void FileWriteStream::write(slice data) {
 		if(_file) {
 			if (fwrite(data.buf, 1, data.size, _file) < data.size)
@@ -0,0 +1,318 @@
+//
+// BlobReferences.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BlobReferences.hh"
+#include "DataFile.hh"
+#include "KeyStore.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include <algorithm>
+#include <cstring>
+
+namespace c4Internal {
+    using namespace std;
+
+
+    static const char* const kRefsStoreName   = "blob_refs";
+    static const char* const kCountsStoreName = "blob_counts";
+    static const char* const kUnusedStoreName = "blob_unused";
+
+    // Key in the info store of the flag saying the references cover every document:
+    static const char* const kCompleteKey = "blobRefsComplete";
+
+
+    static bool keyLess(const blobKey &a, const blobKey &b) {
+        return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) < 0;
+    }
+
+
+    // A `blob_refs` record's body is simply the concatenated raw keys, in sorted order.
+    static vector<blobKey> decodeKeys(slice body) {
+        vector<blobKey> keys;
+        keys.reserve(body.size / sizeof(blobKey::bytes));
+        while (body.size >= sizeof(blobKey::bytes)) {
+            keys.emplace_back(slice(body.buf, sizeof(blobKey::bytes)));
+            body.moveStart(sizeof(blobKey::bytes));
+        }
+        return keys;
+    }
+
+    static alloc_slice encodeKeys(const vector<blobKey> &keys) {
+        alloc_slice body(keys.size() * sizeof(blobKey::bytes));
+        auto dst = (uint8_t*)body.buf;
+        for (auto &key : keys) {
+            memcpy(dst, key.bytes, sizeof(key.bytes));
+            dst += sizeof(key.bytes);
+        }
+        return body;
+    }
+
+
+    BlobReferences::BlobReferences(DataFile &dataFile)
+    :_dataFile(dataFile)
+    { }
+
+
+    void BlobReferences::createStores() {
+        (void)refsStore();
+        (void)countsStore();
+        (void)unusedStore();
+    }
+
+
+    // Returns a KeyStore only if it's already been created, which a read-only database can't
+    // do. (KeyStores are never deleted, so a `true` can be remembered.)
+    KeyStore* BlobReferences::existingStore(const char *name, bool &exists) {
+        if (!exists)
+            exists = _dataFile.keyStoreExists(name);
+        if (!exists)
+            return nullptr;
+        else if (strcmp(name, kUnusedStoreName) == 0)
+            return &unusedStore();
+        else
+            return &_dataFile.getKeyStore(name, KeyStore::Capabilities::defaults);
+    }
+
+    KeyStore& BlobReferences::refsStore() {
+        _refsExist = true;
+        return _dataFile.getKeyStore(kRefsStoreName, KeyStore::Capabilities::defaults);
+    }
+
+    KeyStore& BlobReferences::countsStore() {
+        _countsExist = true;
+        return _dataFile.getKeyStore(kCountsStoreName, KeyStore::Capabilities::defaults);
+    }
+
+    // The unused-blob store has sequences, so it can be enumerated in the order the blobs became
+    // unused, and so a GC pass can resume where it left off.
+    KeyStore& BlobReferences::unusedStore() {
+        _unusedExist = true;
+        return _dataFile.getKeyStore(kUnusedStoreName);
+    }
+
+
+#pragma mark - REFERENCES:
+
+
+    void BlobReferences::setDocumentBlobs(slice docID, vector<blobKey> blobs, Transaction &t) {
+        sort(blobs.begin(), blobs.end(), keyLess);
+        blobs.erase(unique(blobs.begin(), blobs.end()), blobs.end());
+
+        vector<blobKey> oldBlobs;
+        KeyStore *refs = existingStore(kRefsStoreName, _refsExist);
+        if (refs) {
+            refs->get(docID, kDefaultContent, [&](const RecordLite &rec) {
+                if (rec.exists)
+                    oldBlobs = decodeKeys(rec.body);
+            });
+        }
+        if (blobs == oldBlobs)
+            return;                 // The common case: no change, or a doc with no blobs
+
+        for (auto &key : blobs) {
+            if (!binary_search(oldBlobs.begin(), oldBlobs.end(), key, keyLess))
+                addRef(key, t);
+        }
+        for (auto &key : oldBlobs) {
+            if (!binary_search(blobs.begin(), blobs.end(), key, keyLess))
+                removeRef(key, t);
+        }
+        if (blobs.empty())
+            refs->del(docID, t);
+        else
+            refsStore().set(docID, encodeKeys(blobs), t);
+    }
+
+
+    uint64_t BlobReferences::refCount(const blobKey &key) {
+        KeyStore *counts = existingStore(kCountsStoreName, _countsExist);
+        return counts ? counts->get(key).bodyAsUInt() : 0;
+    }
+
+
+    void BlobReferences::addRef(const blobKey &key, Transaction &t) {
+        KeyStore &counts = countsStore();
+        Record rec = counts.get(key);
+        uint64_t count = rec.bodyAsUInt();
+        if (count == 0) {
+            // It's back in use. (It may have been listed as unused by an earlier session.)
+            if (KeyStore *unused = existingStore(kUnusedStoreName, _unusedExist))
+                unused->del(key, t);
+        }
+        rec.setBodyAsUInt(count + 1);
+        counts.write(rec, t);
+    }
+
+
+    void BlobReferences::removeRef(const blobKey &key, Transaction &t) {
+        KeyStore &counts = countsStore();
+        Record rec = counts.get(key);
+        uint64_t count = rec.bodyAsUInt();
+        if (count > 1) {
+            rec.setBodyAsUInt(count - 1);
+            counts.write(rec, t);
+        } else {
+            if (rec.exists())
+                counts.del(key, t);
+            Record unused((slice)key);
+            unused.setBodyAsUInt((uint64_t)time(nullptr));
+            unusedStore().write(unused, t);
+        }
+    }
+
+
+#pragma mark - MAINTENANCE:
+
+
+    bool BlobReferences::isComplete() {
+        return _dataFile.getKeyStore(DataFile::kInfoKeyStoreName).get(slice(kCompleteKey))
+                                                                  .bodyAsUInt() != 0;
+    }
+
+
+    void BlobReferences::markComplete(Transaction &t) {
+        Record flag((slice(kCompleteKey)));
+        flag.setBodyAsUInt(1);
+        _dataFile.getKeyStore(DataFile::kInfoKeyStoreName).write(flag, t);
+    }
+
+
+    void BlobReferences::reset(Transaction &t) {
+        // (KeyStore::erase can't be used inside a transaction.)
+        bool *exists[3] = {&_refsExist, &_countsExist, &_unusedExist};
+        const char* names[3] = {kRefsStoreName, kCountsStoreName, kUnusedStoreName};
+        for (int i = 0; i < 3; ++i) {
+            KeyStore *store = existingStore(names[i], *exists[i]);
+            if (!store)
+                continue;
+            vector<alloc_slice> keys;
+            {
+                RecordEnumerator::Options options;
+                options.contentOptions = kMetaOnly;
+                RecordEnumerator e(*store, options);
+                while (e.next())
+                    keys.emplace_back(e->key());
+            }
+            for (auto &key : keys)
+                store->del(key, t);
+        }
+        markComplete(t);
+    }
+
+
+    unsigned BlobReferences::removeMissingDocuments(fleece::function_ref<bool(slice)> exists,
+                                                    Transaction &t)
+    {
+        KeyStore *refs = existingStore(kRefsStoreName, _refsExist);
+        if (!refs)
+            return 0;
+        vector<alloc_slice> missing;
+        {
+            RecordEnumerator::Options options;
+            options.contentOptions = kMetaOnly;
+            RecordEnumerator e(*refs, options);
+            while (e.next()) {
+                if (!exists(e->key()))
+                    missing.emplace_back(e->key());
+            }
+        }
+        for (auto &docID : missing)
+            setDocumentBlobs(docID, {}, t);
+        return (unsigned)missing.size();
+    }
+
+
+#pragma mark - DELETING BLOBS:
+
+
+    void BlobReferences::deleteUnused(BlobStore &blobStore, time_t graceSeconds,
+                                      unsigned batchSize, C4BlobGCProgress &progress,
+                                      Transaction &t)
+    {
+        KeyStore *unused = existingStore(kUnusedStoreName, _unusedExist);
+        if (!unused) {
+            progress.finished = true;
+            return;
+        }
+        time_t now = time(nullptr);
+        vector<alloc_slice> doomed;
+        bool finished = true;
+        {
+            RecordEnumerator e(*unused, progress.lastSequence);
+            while (e.next()) {
+                if (doomed.size() >= batchSize) {
+                    finished = false;
+                    break;
+                }
+                // Entries are in the order the blobs became unused, so stop at the first one
+                // that's still in its grace period:
+                if (now - (time_t)e->bodyAsUInt() < graceSeconds)
+                    break;
+                progress.lastSequence = e->sequence();
+                doomed.emplace_back(e->key());
+            }
+        }
+
+        for (auto &keyData : doomed) {
+            blobKey key((slice)keyData);
+            if (refCount(key) > 0) {
+                unused->del(keyData, t);    // Stale entry; the blob has been referenced again
+                continue;
+            }
+            Blob blob = blobStore.get(key);
+            if (graceSeconds > 0 && now - blob.lastModified() < graceSeconds)
+                continue;           // Re-added recently; it's probably about to be used again
+            int64_t size = blob.contentLength();
+            if (size >= 0) {
+                blob.del();
+                ++progress.blobsDeleted;
+                progress.bytesDeleted += size;
+            }
+            unused->del(keyData, t);
+        }
+        progress.finished = finished;
+    }
+
+
+    unsigned BlobReferences::deleteUntracked(BlobStore &blobStore, time_t graceSeconds,
+                                             Transaction &t)
+    {
+        time_t now = time(nullptr);
+        unsigned deleted = 0;
+        blobStore.forEachBlob([&](const blobKey &key) {
+            if (refCount(key) > 0)
+                return;
+            Blob blob = blobStore.get(key);
+            if (graceSeconds > 0 && now - blob.lastModified() < graceSeconds)
+                return;
+            blob.del();
+            ++deleted;
+            if (KeyStore *unused = existingStore(kUnusedStoreName, _unusedExist))
+                unused->del(key, t);
+        });
+        // Also clean up files that aren't blobs, like temporary files left by a crash:
+        blobStore.forEachStrayFile([&](const FilePath &path) {
+            if (graceSeconds > 0 && now - path.lastModified() < graceSeconds)
+                return;
+            path.del();
+            ++deleted;
+        });
+        return deleted;
+    }
+
+}
@@ -0,0 +1,104 @@
+//
+// BlobReferences.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "BlobStore.hh"
+#include "c4Database.h"
+#include "function_ref.hh"
+#include <ctime>
+#include <vector>
+
+namespace litecore {
+    class DataFile;
+    class KeyStore;
+    class Transaction;
+}
+
+namespace c4Internal {
+    using namespace litecore;
+
+
+    /** Persistent reference counts of the blobs used by a database's documents, which let
+        unused blobs be found without decoding every document.
+        The state lives in three KeyStores in the database file, so it's shared by every
+        connection and changes atomically with the documents:
+        - `blob_refs` maps each docID to the keys of the blobs its stored revisions reference;
+        - `blob_counts` maps each referenced blob's key to the number of documents using it;
+        - `blob_unused` lists blobs whose count has dropped to zero, with the time it happened,
+          in that order (by sequence), until they're deleted.
+        The stores are created when a writable database is opened, so that saving a document
+        doesn't have to check whether they exist. All changes must be made inside a
+        transaction. */
+    class BlobReferences {
+    public:
+        explicit BlobReferences(DataFile&);
+
+        /** Creates the KeyStores if they don't exist yet. Called when a database is opened
+            writeable; a read-only database checks for them when they're first used. */
+        void createStores();
+
+        /** Records the set of blobs that a document's revisions reference; an empty set means
+            the document is gone or has no blobs. Adjusts the counts of the blobs it gained or
+            lost. */
+        void setDocumentBlobs(slice docID, std::vector<blobKey> blobs, Transaction&);
+
+        /** Returns the number of documents that reference a blob. */
+        uint64_t refCount(const blobKey&);
+
+        /** Returns true if the references cover every document. This is false in a database
+            created before references were tracked, until `reset` is called. */
+        bool isComplete();
+
+        /** Deletes all references and marks them as complete. The caller must then call
+            `setDocumentBlobs` for every document that has blobs, in the same transaction. */
+        void reset(Transaction&);
+
+        /** Marks the references of a newly created, empty, database as complete. */
+        void markComplete(Transaction&);
+
+        /** Removes the references of documents that have disappeared without being saved,
+            as determined by the `exists` callback. Returns the number of documents removed. */
+        unsigned removeMissingDocuments(fleece::function_ref<bool(slice docID)> exists,
+                                        Transaction&);
+
+        /** Deletes blobs that have been unreferenced for at least `graceSeconds`, examining at
+            most `batchSize` of them, resuming after `progress.lastSequence`. Sets
+            `progress.finished` once it reaches the last such blob. */
+        void deleteUnused(BlobStore&, time_t graceSeconds, unsigned batchSize,
+                          C4BlobGCProgress &progress, Transaction&);
+
+        /** Deletes blobs in the BlobStore that have no references at all, and other stray
+            files, that are at least `graceSeconds` old. This finds blobs that were never
+            referenced, or that were left behind by a database that didn't track references, but
+            it has to list the whole store. Returns the number of blobs and files deleted. */
+        unsigned deleteUntracked(BlobStore&, time_t graceSeconds, Transaction&);
+
+    private:
+        KeyStore* existingStore(const char *name, bool &exists);
+        KeyStore& refsStore();
+        KeyStore& countsStore();
+        KeyStore& unusedStore();
+        void addRef(const blobKey&, Transaction&);
+        void removeRef(const blobKey&, Transaction&);
+
+        DataFile&   _dataFile;
+        bool        _refsExist {false}, _countsExist {false}, _unusedExist {false};
+    };
+
+}
@@ -17,7 +17,9 @@
 //
 
 #include "Database.hh"
+#include "BlobReferences.hh"
 #include "Document.hh"
+#include "DocumentCache.hh"
 #include "c4Internal.hh"
 #include "c4Document.h"
 #include "c4Document+Fleece.h"
@@ -27,8 +29,12 @@
 #include "FleeceImpl.hh"
 #include "BlobStore.hh"
 #include "Upgrader.hh"
+#include "VersionedDocument.hh"
 #include "SecureRandomize.hh"
+#include "Stopwatch.hh"
 #include "make_unique.h"
+#include <algorithm>
+#include <climits>
 #include <functional>
 
 namespace litecore { namespace constants
@@ -125,6 +131,9 @@ namespace c4Internal {
             case kC4RevisionTrees:
                 options.fleeceAccessor = TreeDocumentFactory::fleeceAccessor();
                 break;
+            case kC4VersionVectors:
+                options.fleeceAccessor = nullptr;   // Record body is the current revision's
+                break;
             default:
                 error::_throw(error::InvalidParameter);
         }
@@ -160,18 +169,30 @@ namespace c4Internal {
                      inConfig, true))
     ,config(inConfig)
     ,_encoder(new fleece::impl::Encoder())
+    ,_blobReferences(new BlobReferences(*_db))
     {
         if (config.flags & kC4DB_SharedKeys)
             _encoder->setSharedKeys(documentKeys());
-        if (!(config.flags & kC4DB_NonObservable))
+        if (!(config.flags & kC4DB_NonObservable)) {
             _sequenceTracker.reset(new SequenceTracker());
+            // (Filtered observers need the bodies of changes made through other instances.)
+            auto count = _db->addSharedObject("BodyPredicateCount",
+                                              new SequenceTracker::BodyPredicateCount);
+            _sequenceTracker->shareBodyPredicateCount((SequenceTracker::BodyPredicateCount*)
+                                                      count.get());
+        }
 
         // Validate that the versioning matches what's used in the database:
         auto &info = _db->getKeyStore(DataFile::kInfoKeyStoreName);
         Record doc = info.get(slice("versioning"));
         if (doc.exists()) {
-            if (doc.bodyAsUInt() != (uint64_t)config.versioning)
+            auto versioning = (C4DocumentVersioning)doc.bodyAsUInt();
+            if (versioning != config.versioning) {
+                if (versioning == kC4RevisionTrees)
+                    error::_throw(error::WrongFormat, "Database uses revision trees; "
+                                  "call c4db_upgradeToVersionVectors to convert it");
                 error::_throw(error::WrongFormat);
+            }
         } else if (config.flags & kC4DB_Create) {
             // First-time initialization:
             doc.setBodyAsUInt((uint64_t)config.versioning);
@@ -179,17 +200,18 @@ namespace c4Internal {
             info.write(doc, t);
             (void)generateUUID(kPublicUUIDKey, t);
             (void)generateUUID(kPrivateUUIDKey, t);
+            _blobReferences->markComplete(t);       // (there are no documents to scan)
             t.commit();
         } else if (config.versioning != kC4RevisionTrees) {
             error::_throw(error::WrongFormat);
         }
+        if (!(config.flags & kC4DB_ReadOnly))
+            _blobReferences->createStores();
         _db->setOwner(this);
 
         DocumentFactory* factory;
         switch (config.versioning) {
-#if ENABLE_VERSION_VECTORS
             case kC4VersionVectors: factory = new VectorDocumentFactory(this); break;
-#endif
             case kC4RevisionTrees:  factory = new TreeDocumentFactory(this); break;
             default:                error::_throw(error::InvalidParameter);
         }
@@ -204,6 +226,38 @@ namespace c4Internal {
     }
 
 
+    // Converts a rev-tree database to version vectors. This is one-way: the documents lose
+    // their non-current revisions.
+    /*static*/ void Database::upgradeToVersionVectors(const string &path,
+                                                      C4DatabaseConfig config)
+    {
+        config.versioning = kC4RevisionTrees;
+        config.flags = (config.flags & ~(kC4DB_Create | kC4DB_ReadOnly)) | kC4DB_NonObservable;
+        Retained<Database> db = new Database(path, config);
+        db->_upgradeToVersionVectors();
+        db->close();
+    }
+
+
+    void Database::_upgradeToVersionVectors() {
+        // Other connections would go on treating the documents as rev trees:
+        size_t otherConnections = 0;
+        _db->forOtherDataFiles([&](DataFile*) {++otherConnections;});
+        if (otherConnections > 0)
+            error::_throw(error::Busy, "Can't upgrade to version vectors while other "
+                          "connections to the database are open");
+
+        LogTo(DBLog, "Upgrading database from revision trees to version vectors...");
+        Transaction t(*_db);
+        unsigned count = VectorDocumentFactory::upgradeRevTrees(defaultKeyStore(), t);
+        Record doc(slice("versioning"));
+        doc.setBodyAsUInt((uint64_t)kC4VersionVectors);
+        _db->getKeyStore(DataFile::kInfoKeyStoreName).write(doc, t);
+        t.commit();
+        LogTo(DBLog, "Upgraded %u documents to version vectors", count);
+    }
+
+
     Database::~Database() {
         Assert(_transactionLevel == 0,
                "Database being dealloced while in a transaction");
@@ -215,6 +269,8 @@ namespace c4Internal {
 
     void Database::close() {
         mustNotBeInTransaction();
+        if (_documentCache)
+            _documentCache->clear();
         _db->close();
     }
 
@@ -261,57 +317,212 @@ namespace c4Internal {
         return factory->deleteFile(path);
     }
 
-    unordered_set<string> Database::collectBlobs() {
+    // Returns the keys of the blobs referenced by all the stored revisions of a document.
+    vector<blobKey> Database::findBlobReferences(const Record &rec) {
+        vector<blobKey> blobs;
+        unique_ptr<Document> doc(documentFactory().newDocumentInstance(rec));
+        doc->selectCurrentRevision();
+        do {
+            if(!doc->loadSelectedRevBody()) {
+                continue;
+            }
+
+            Retained<Doc> fleeceDoc = doc->fleeceDoc();
+            Document::findBlobKeys(fleeceDoc->asDict(), blobs);
+        } while(doc->selectNextRevision());
+        return blobs;
+    }
+
+
+    void Database::deleteRevisionBodies(slice docID) {
+        if (config.versioning != kC4RevisionTrees || !_db->canStoreExternalRevisionBodies())
+            return;
+        VersionedDocument doc(defaultKeyStore(), docID);
+        doc.deleteExternalBodies(transaction());
+    }
+
+
+    void Database::updateBlobReferences(slice docID) {
+        // Most documents have no blobs, which the flags show without reading the body:
+        bool hasBlobs = false;
+        defaultKeyStore().get(docID, kMetaOnly, [&](const RecordLite &rec) {
+            hasBlobs = rec.exists && (rec.flags & DocumentFlags::kHasAttachments);
+        });
+        vector<blobKey> blobs;
+        if (hasBlobs) {
+            Record rec = defaultKeyStore().get(docID);
+            blobs = findBlobReferences(rec);
+        }
+        updateBlobReferences(docID, move(blobs));
+    }
+
+
+    void Database::updateBlobReferences(slice docID, vector<blobKey> blobs) {
+        _blobReferences->setDocumentBlobs(docID, move(blobs), transaction());
+    }
+
+
+    // Scans every document for blobs, replacing all references. This is done once, in a database
+    // created before references were tracked.
+    void Database::rebuildBlobReferences(Transaction &t) {
+        LogTo(DBLog, "Building blob reference counts...");
+        _blobReferences->reset(t);
         RecordEnumerator::Options options;
         options.onlyBlobs = true;
         RecordEnumerator e(defaultKeyStore(), options);
-        unordered_set<string> usedDigests;
+        unsigned count = 0;
         while (e.next()) {
-            auto doc = documentFactory().newDocumentInstance(*e);
-            doc->selectCurrentRevision();
-            do {
-                if(!doc->loadSelectedRevBody()) {
-                    continue;
-                }
+            _blobReferences->setDocumentBlobs(e->key(), findBlobReferences(*e), t);
+            ++count;
+        }
+        LogTo(DBLog, "Found blobs in %u documents", count);
+    }
 
-                Retained<Doc> fleeceDoc = doc->fleeceDoc();
-                const Dict* body = fleeceDoc->asDict();
 
-                // Iterate over blobs:
-                Document::findBlobReferences(body, [&](const Dict *blob) {
-                    blobKey key;
-                    if (Document::dictIsBlob(blob, key))    // get the key
-                        usedDigests.insert(key.filename());
-                    return true;
-                });
-
-                // Now look for old-style _attachments:
-                auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
-                if (attachments) {
-                    blobKey key;
-                    for (Dict::iterator i(attachments->asDict()); i; ++i) {
-                        auto att = i.value()->asDict();
-                        if (att) {
-                            const Value* digest = att->get("digest"_sl);
-                            if (digest && key.readFromBase64(digest->asString())) {
-                                usedDigests.insert(key.filename());
-                            }
-                        }
-                    }
-                }
-            } while(doc->selectNextRevision());
-            
-            delete doc;
-        }
-        
-        return usedDigests;
+    void Database::collectBlobs(unsigned batchSize, unsigned graceSeconds,
+                                C4BlobGCProgress &progress)
+    {
+        Transaction &t = transaction();
+        if (progress.lastSequence == 0 && !_blobReferences->isComplete())
+            rebuildBlobReferences(t);
+        _blobReferences->deleteUnused(*blobStore(), graceSeconds, batchSize, progress, t);
     }
 
     void Database::compact() {
         mustNotBeInTransaction();
+        if (config.versioning == kC4VersionVectors) {
+            // Conflicting revisions of version-vector docs outlive expired docs:
+            Transaction t(*_db);
+            unsigned n = VectorDocumentFactory::deleteOrphanedConflicts(defaultKeyStore(), t);
+            t.commit();
+            if (n > 0)
+                LogTo(DBLog, "Deleted %u orphaned conflicting revisions", n);
+        }
         dataFile()->compact();
-        unordered_set<string> digestsInUse = collectBlobs();
-        blobStore()->deleteAllExcept(digestsInUse);
+
+        // Delete blobs that aren't referenced by any document:
+        Transaction t(*_db);
+        if (!_blobReferences->isComplete()) {
+            rebuildBlobReferences(t);
+        } else {
+            // Expiration, and some upgrades, delete documents without updating references:
+            KeyStore &store = defaultKeyStore();
+            unsigned n = _blobReferences->removeMissingDocuments([&](slice docID) {
+                bool exists = false;
+                store.get(docID, kMetaOnly, [&](const RecordLite &rec) {exists = rec.exists;});
+                return exists;
+            }, t);
+            if (n > 0)
+                LogTo(DBLog, "Removed blob references of %u missing documents", n);
+        }
+        C4BlobGCProgress progress = {};
+        _blobReferences->deleteUnused(*blobStore(), 0, UINT_MAX, progress, t);
+        unsigned n = _blobReferences->deleteUntracked(*blobStore(), 0, t);
+        t.commit();
+        LogTo(DBLog, "Deleted %llu unused and %u untracked blobs",
+              (unsigned long long)progress.blobsDeleted, n);
+    }
+
+
+    void Database::pruneRevisions(unsigned batchSize, C4PruneProgress &progress) {
+        if (config.versioning != kC4RevisionTrees || batchSize == 0) {
+            progress.finished = (config.versioning != kC4RevisionTrees);
+            return;
+        }
+        KeyStore &store = defaultKeyStore();
+        unsigned maxDepth = maxRevTreeDepth();
+
+        // Read the batch first, so that saving doesn't disturb the enumerator:
+        vector<Record> batch;
+        {
+            RecordEnumerator::Options options;
+            options.includeDeleted = true;
+            RecordEnumerator e(store, progress.lastSequence, options);
+            while (batch.size() < batchSize && e.next())
+                batch.push_back(e.record());
+        }
+        progress.finished = (batch.size() < batchSize);
+
+        Transaction &t = transaction();
+        for (auto &rec : batch) {
+            progress.lastSequence = rec.sequence();
+            VersionedDocument doc(store, rec);
+            unsigned nPruned = doc.prune(maxDepth);
+            doc.removeNonLeafBodies();
+            // Saving only rewrites the tree; it won't bump the sequence since no revs were added.
+            // A conflict means the doc was just updated, which pruned it anyway.
+            if (!doc.changed() || doc.save(t) == VersionedDocument::kConflict)
+                continue;
+            uncacheDocument(rec.key());
+            updateBlobReferences(rec.key());    // (bodies of pruned revisions may have had blobs)
+            size_t newSize = 0;
+            store.get(rec.key(), kMetaOnly, [&](const RecordLite &saved) {
+                newSize = saved.bodySize;
+            });
+            if (newSize < rec.bodySize())
+                progress.bytesReclaimed += rec.bodySize() - newSize;
+            progress.revsPruned += nPruned;
+            ++progress.docsPruned;
+        }
+        LogVerbose(DBLog, "Examined %u docs for pruning, through sequence %llu",
+                   unsigned(batch.size()), (unsigned long long)progress.lastSequence);
+    }
+
+
+    void Database::resolveConflicts(unsigned batchSize, C4BulkConflictResolver resolver,
+                                    void *context, C4ResolveConflictsProgress &progress)
+    {
+        // A document with more conflicting branches than this is left for the next batch:
+        static constexpr unsigned kMaxResolutionsPerDoc = 100;
+
+        Stopwatch st;
+        KeyStore &store = defaultKeyStore();
+
+        // Read the batch first, so that saving doesn't disturb the enumerator. The conflicts
+        // index makes this proportional to the number of conflicts, not the number of docs.
+        // Resolved docs get new sequences but are no longer conflicted, so they won't be seen
+        // again; declined ones keep their sequences, which are behind progress.lastSequence.
+        vector<Record> batch;
+        {
+            RecordEnumerator::Options options;
+            options.includeDeleted = true;
+            options.onlyConflicts = true;
+            RecordEnumerator e(store, progress.lastSequence, options);
+            while (batch.size() < batchSize && e.next())
+                batch.push_back(e.record());
+        }
+        progress.finished = (batch.size() < batchSize);
+
+        unsigned resolved = 0;
+        for (auto &rec : batch) {
+            progress.lastSequence = rec.sequence();
+            // Creating the Document from the Record we already have saves reading it again:
+            unique_ptr<Document> doc(documentFactory().newDocumentInstance(rec));
+            bool changed = false;
+            for (unsigned n = 0; n < kMaxResolutionsPerDoc; ++n) {
+                doc->selectCurrentRevision();
+                if (changed && !doc->selectNextLeafRevision(false))
+                    break;                  // no more conflicting revisions
+                doc->selectCurrentRevision();
+                C4ConflictResolution resolution = { };
+                if (!resolver(context, doc.get(), &resolution))
+                    break;
+                doc->resolveConflict(resolution.winningRevID, resolution.losingRevID,
+                                     resolution.mergedBody, resolution.mergedFlags);
+                changed = true;
+            }
+            if (changed && doc->save(maxRevTreeDepth()))
+                ++resolved;
+            else
+                ++progress.docsSkipped;     // declined, or updated since it was read
+        }
+        progress.docsResolved += resolved;
+
+        double elapsed = st.elapsed();
+        progress.secondsElapsed += elapsed;
+        if (resolved > 0)
+            LogTo(DBLog, "Resolved %u of %u conflicted docs in %.3f sec (%.0f docs/sec)",
+                  resolved, unsigned(batch.size()), elapsed, resolved / elapsed);
     }
 
 
@@ -323,20 +534,32 @@ namespace c4Internal {
 
         mustNotBeInTransaction();
 
-        // Create a new BlobStore and copy/rekey the blobs into it:
+        // Create a new BlobStore and copy/rekey the blobs into it. If a previous rekey was
+        // interrupted, its store is reused and the blobs it already copied are skipped; but if
+        // that store has a different key it can't be opened, so start over.
         BlobStore *realBlobStore = blobStore();
-        path().subdirectoryNamed("Attachments_temp").delRecursive();
-        auto newStore = createBlobStore("Attachments_temp", *newKey);
+        unique_ptr<BlobStore> newStore;
         try {
-            realBlobStore->copyBlobsTo(*newStore);
-
-            // Rekey the database itself:
-            dataFile()->rekey((EncryptionAlgorithm)newKey->algorithm,
-                              slice(newKey->bytes, kEncryptionKeySize[newKey->algorithm]));
-        } catch (...) {
-            newStore->deleteStore();
-            throw;
+            newStore = createBlobStore("Attachments_temp", *newKey);
+        } catch (const exception&) {
+            path().subdirectoryNamed("Attachments_temp").delRecursive();
+            newStore = createBlobStore("Attachments_temp", *newKey);
         }
+        // (On failure the new store is left in place, so a retry can resume copying.)
+        uint64_t nextLog = 0;
+        realBlobStore->copyBlobsTo(*newStore, [&](const BlobStore::CopyProgress &p) {
+            uint64_t done = p.blobsCopied + p.blobsSkipped;
+            if (done >= nextLog || done == p.blobsTotal) {
+                LogTo(DBLog, "Rekeying blobs: %llu of %llu (%llu MB)",
+                      (unsigned long long)done, (unsigned long long)p.blobsTotal,
+                      (unsigned long long)(p.bytesCopied >> 20));
+                nextLog = done + max(p.blobsTotal / 10, (uint64_t)1);
+            }
+        });
+
+        // Rekey the database itself:
+        dataFile()->rekey((EncryptionAlgorithm)newKey->algorithm,
+                          slice(newKey->bytes, kEncryptionKeySize[newKey->algorithm]));
 
         ((C4DatabaseConfig&)config).encryptionKey = *newKey;
 
@@ -401,6 +624,9 @@ namespace c4Internal {
         FilePath blobStorePath = path().subdirectoryNamed(dirname);
         auto options = BlobStore::Options::defaults;
         options.create = options.writeable = (config.flags & kC4DB_ReadOnly) == 0;
+        options.sharded = (config.flags & kC4DB_ShardBlobs) != 0;
+        options.compressed = (config.flags & kC4DB_CompressBlobs) != 0;
+        options.maxInlineSize = BlobStore::kDefaultMaxInlineSize;
         options.encryptionAlgorithm =(EncryptionAlgorithm)encryptionKey.algorithm;
         if (options.encryptionAlgorithm != kNoEncryption) {
             options.encryptionKey = alloc_slice(encryptionKey.bytes, sizeof(encryptionKey.bytes));
@@ -416,6 +642,87 @@ namespace c4Internal {
     }
 
 
+#pragma mark - DOCUMENT CACHE:
+
+
+    Document* Database::getDocument(C4Slice docID) {
+        if (!_documentCache)
+            return _documentFactory->newDocumentInstance(docID);
+        Document *doc = _documentCache->get(docID);
+        if (doc)
+            return doc;
+        // Read the generation first, so a change committed while this is reading the record
+        // (by another Database instance) keeps the possibly-obsolete doc out of the cache:
+        uint64_t generation = _documentCache->generation();
+        Record rec = defaultKeyStore().get(docID);
+        doc = _documentFactory->newDocumentInstance(rec);
+        // Uncommitted changes aren't cached, since the transaction might be aborted:
+        if (rec.exists() && !inTransaction()) {
+            size_t size = rec.key().size + rec.version().size + rec.body().size;
+            _documentCache->insert(doc, size, generation);
+        }
+        return doc;
+    }
+
+
+    void Database::setDocumentCacheSize(size_t maxBytes) {
+        if (maxBytes > 0 && !_sequenceTracker)
+            error::_throw(error::UnsupportedOperation, "Document cache requires an observable db");
+        if (_documentCache && maxBytes > 0) {
+            _documentCache->setMaxBytes(maxBytes);
+            return;
+        }
+        unique_ptr<DocumentCache> cache;
+        if (maxBytes > 0)
+            cache.reset(new DocumentCache(maxBytes));
+        if (_sequenceTracker) {
+            // Other instances reach the cache under this lock (see externalDocumentsUncached),
+            // so it has to be swapped under it too; the old one is freed after it's released.
+            lock_guard<mutex> lock(_sequenceTracker->mutex());
+            _sequenceTracker->setDocumentCache(cache.get());
+            swap(cache, _documentCache);
+        } else {
+            swap(cache, _documentCache);
+        }
+    }
+
+
+    C4DocumentCacheStats Database::documentCacheStats() {
+        if (!_documentCache)
+            return { };
+        return _documentCache->stats();
+    }
+
+
+    void Database::uncacheDocument(slice docID) {
+        if (_documentCache) {
+            if (docID)
+                _documentCache->invalidate(docID);
+            else
+                _documentCache->clear();
+        }
+        // Other instances' caches are updated when the transaction commits:
+        if (inTransaction())
+            _uncachedDocIDs.emplace_back(docID);
+    }
+
+
+    // Called on another instance's thread, so it locks the tracker like setDocumentCacheSize.
+    void Database::externalDocumentsUncached(const vector<alloc_slice> &docIDs) {
+        if (!_sequenceTracker)
+            return;                 // (A document cache requires a tracker)
+        lock_guard<mutex> lock(_sequenceTracker->mutex());
+        if (!_documentCache)
+            return;
+        for (auto &docID : docIDs) {
+            if (docID)
+                _documentCache->invalidate(docID);
+            else
+                _documentCache->clear();
+        }
+    }
+
+
 #pragma mark - UUIDS:
 
 
@@ -455,7 +762,17 @@ namespace c4Internal {
         return uuid;
     }
     
+    alloc_slice Database::myPeerID() {
+        if (!_myPeerID) {
+            // 64 bits is plenty to tell apart the peers that have changed one document:
+            UUID uuid = getUUID(kPublicUUIDKey);
+            _myPeerID = alloc_slice(slice(uuid.bytes, 8).hexString());
+        }
+        return _myPeerID;
+    }
+    
     void Database::resetUUIDs() {
+        _myPeerID = nullslice;
         beginTransaction();
         try {
             UUID previousPrivate = getUUID(kPrivateUUIDKey);
@@ -515,6 +832,15 @@ namespace c4Internal {
 
     // The cleanup part of endTransaction
     void Database::_cleanupTransaction(bool committed) {
+        if (committed && !_uncachedDocIDs.empty()) {
+            // These changes didn't get sequences, so other instances' trackers won't see them:
+            _db->forOtherDataFiles([&](DataFile *other) {
+                auto otherDatabase = (Database*)other->owner();
+                if (otherDatabase)
+                    otherDatabase->externalDocumentsUncached(_uncachedDocIDs);
+            });
+        }
+        _uncachedDocIDs.clear();
         if (_sequenceTracker) {
             lock_guard<mutex> lock(_sequenceTracker->mutex());
             if (committed) {
@@ -557,7 +883,15 @@ namespace c4Internal {
 
     
     bool Database::purgeDocument(slice docID) {
-        return defaultKeyStore().del(docID, transaction());
+        uncacheDocument(docID);
+        if (config.versioning == kC4VersionVectors)
+            VectorDocumentFactory::purgeConflict(defaultKeyStore(), docID, transaction());
+        else
+            deleteRevisionBodies(docID);
+        if (!defaultKeyStore().del(docID, transaction()))
+            return false;
+        updateBlobReferences(docID);
+        return true;
     }
 
 
@@ -566,6 +900,13 @@ namespace c4Internal {
     }
 
 
+    void Database::getRawDocument(const string &storeName, slice key,
+                                  function_ref<void(const RecordLite&)> callback)
+    {
+        getKeyStore(storeName).get(key, kDefaultContent, callback);
+    }
+
+
     void Database::putRawDocument(const string &storeName, slice key, slice meta, slice body) {
         KeyStore &localDocs = getKeyStore(storeName);
         auto &t = transaction();
@@ -635,7 +976,9 @@ namespace c4Internal {
             _sequenceTracker->documentChanged(doc->_docIDBuf,
                                               doc->_selectedRevIDBuf,
                                               doc->selectedRev.sequence,
-                                              doc->selectedRev.body.size);
+                                              doc->selectedRev.body.size,
+                                              doc->selectedRev.flags,
+                                              doc->selectedRev.body);
         }
     }
 
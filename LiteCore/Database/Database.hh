@@ -27,6 +27,7 @@
 #include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace fleece { namespace impl {
     class Encoder;
@@ -35,11 +36,14 @@ namespace fleece { namespace impl {
 namespace litecore {
     class SequenceTracker;
     class BlobStore;
+    struct blobKey;
 }
 
 
 namespace c4Internal {
+    class BlobReferences;
     class Document;
+    class DocumentCache;
     class DocumentFactory;
 
 
@@ -52,6 +56,10 @@ namespace c4Internal {
         void deleteDatabase();
         static bool deleteDatabaseAtPath(const string &dbPath);
 
+        /** Converts the rev-tree database at the path to version vectors; see
+            c4db_upgradeToVersionVectors. */
+        static void upgradeToVersionVectors(const string &path, C4DatabaseConfig);
+
         DataFile* dataFile()                                {return _db.get();}
         FilePath path() const;
         uint64_t countDocuments();
@@ -69,10 +77,26 @@ namespace c4Internal {
         UUID getUUID(slice key);
         void resetUUIDs();
 
+        /** This database's peer ID in version vectors: the start of its public UUID, in hex. */
+        alloc_slice myPeerID();
+
         void rekey(const C4EncryptionKey *newKey);
 
         void compact();
 
+        /** Prunes the rev trees of the next batch of documents; see c4db_pruneRevisions.
+            Must be called in a transaction. */
+        void pruneRevisions(unsigned batchSize, C4PruneProgress&);
+
+        /** Resolves the next batch of conflicted documents; see c4db_resolveConflicts.
+            Must be called in a transaction. */
+        void resolveConflicts(unsigned batchSize, C4BulkConflictResolver, void *context,
+                              C4ResolveConflictsProgress&);
+
+        /** Deletes the next batch of unreferenced blobs; see c4db_collectBlobs.
+            Must be called in a transaction. */
+        void collectBlobs(unsigned batchSize, unsigned graceSeconds, C4BlobGCProgress&);
+
         const C4DatabaseConfig config;
 
         Transaction& transaction() const;
@@ -96,10 +120,39 @@ namespace c4Internal {
 #endif
 
         Record getRawDocument(const std::string &storeName, slice key);
+        /** Reads a raw document without copying it; the RecordLite is valid only during the
+            callback. */
+        void getRawDocument(const std::string &storeName, slice key,
+                            function_ref<void(const RecordLite&)> callback);
         void putRawDocument(const string &storeName, slice key, slice meta, slice body);
 
         DocumentFactory& documentFactory()                  {return *_documentFactory;}
 
+        /** Returns a new Document instance, copied from the document cache if possible. */
+        Document* getDocument(C4Slice docID);
+
+        /** Sets the size limit of the document cache, in bytes; 0 disables the cache.
+            Requires a SequenceTracker, i.e. the database can't be opened as non-observable. */
+        void setDocumentCacheSize(size_t maxBytes);
+        C4DocumentCacheStats documentCacheStats();
+
+        /** Removes a document (or with a null docID, all documents) from the cache, and from
+            other instances' caches when the transaction commits. Only needed when a document is
+            changed without getting a new sequence; otherwise the SequenceTracker does it. */
+        void uncacheDocument(slice docID);
+
+        /** Deletes the revision bodies a document stores outside its rev tree. Call before the
+            document is purged or expired. Must be called in a transaction. */
+        void deleteRevisionBodies(slice docID);
+
+        /** Updates the reference counts of the blobs used by a document, after it's been saved,
+            purged or otherwise changed. Must be called in a transaction. */
+        void updateBlobReferences(slice docID);
+
+        /** Same, for a document just saved by the caller, which has found the keys of the
+            blobs its stored revisions use in memory; this saves reading the record again. */
+        void updateBlobReferences(slice docID, std::vector<blobKey> blobs);
+
         fleece::impl::Encoder& sharedEncoder();
 
         fleece::impl::SharedKeys* documentKeys()                  {return _db->documentKeys();}
@@ -123,6 +176,7 @@ namespace c4Internal {
         virtual ~Database();
         void mustNotBeInTransaction();
         void externalTransactionCommitted(const SequenceTracker&);
+        void externalDocumentsUncached(const std::vector<alloc_slice> &docIDs);
 
     private:
         static FilePath findOrCreateBundle(const string &path, bool canCreate,
@@ -131,19 +185,24 @@ namespace c4Internal {
         void _cleanupTransaction(bool committed);
         bool getUUIDIfExists(slice key, UUID&);
         UUID generateUUID(slice key, Transaction&, bool overwrite =false);
+        void _upgradeToVersionVectors();
 
         std::unique_ptr<BlobStore> createBlobStore(const std::string &dirname, C4EncryptionKey);
-        std::unordered_set<std::string> collectBlobs();
-        void removeUnusedBlobs(const std::unordered_set<std::string> &used);
+        void rebuildBlobReferences(Transaction&);
+        std::vector<blobKey> findBlobReferences(const Record&);
 
         unique_ptr<DataFile>        _db;                    // Underlying DataFile
         Transaction*                _transaction {nullptr}; // Current Transaction, or null
         int                         _transactionLevel {0};  // Nesting level of transaction
         unique_ptr<DocumentFactory> _documentFactory;       // Instantiates C4Documents
         unique_ptr<fleece::impl::Encoder> _encoder;
+        unique_ptr<DocumentCache>   _documentCache;         // Cache of loaded docs, or null
         unique_ptr<SequenceTracker> _sequenceTracker;       // Doc change tracker/notifier
         unique_ptr<BlobStore>       _blobStore;
+        unique_ptr<BlobReferences>  _blobReferences;        // Persistent blob ref-counts
         uint32_t                    _maxRevTreeDepth {0};
+        alloc_slice                 _myPeerID;              // Cached result of myPeerID()
+        std::vector<alloc_slice>    _uncachedDocIDs;        // Passed to uncacheDocument in txn
         recursive_mutex             _clientMutex;
     };
 
@@ -179,6 +238,27 @@ namespace c4Internal {
         static DataFile::FleeceAccessor fleeceAccessor();
     };
 
+
+    /** DocumentFactory subclass for version-vector document schema. */
+    class VectorDocumentFactory : public DocumentFactory {
+    public:
+        VectorDocumentFactory(Database *db)   :DocumentFactory(db) { }
+        Document* newDocumentInstance(C4Slice docID) override;
+        Document* newDocumentInstance(const Record&) override;
+        alloc_slice revIDFromVersion(slice version) override;
+
+        /** Deletes a document's conflicting revision, if any, before it's purged. */
+        static void purgeConflict(KeyStore&, slice docID, Transaction&);
+
+        /** Deletes conflicting revisions whose documents no longer exist, e.g. because they
+            expired. Returns the number deleted. */
+        static unsigned deleteOrphanedConflicts(KeyStore&, Transaction&);
+
+        /** Converts every rev-tree document in the KeyStore to a version-vector document, keeping
+            only its current revision and one conflicting revision. Returns the number converted. */
+        static unsigned upgradeRevTrees(KeyStore&, Transaction&);
+    };
+
 }
 
 
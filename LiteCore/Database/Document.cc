@@ -21,12 +21,39 @@
 #include "LegacyAttachments.hh"
 #include "StringUtil.hh"
 #include "DeepIterator.hh"
+#include <algorithm>
 
 using namespace fleece;
 using namespace fleece::impl;
 
 namespace c4Internal {
 
+    // This implementation walks the selection back through the ancestors, then restores it.
+    alloc_slice Document::getSelectedRevHistory(unsigned maxRevs,
+                                                const slice backToRevs[],
+                                                unsigned backToRevsCount)
+    {
+        alloc_slice selectedRevID(selectedRev.revID);
+        if (!selectedRevID)
+            return {};
+        auto backToEnd = backToRevs + backToRevsCount;
+        string history;
+        for (unsigned n = 0; n < maxRevs; ++n) {
+            if (n > 0) {
+                if (!selectParentRevision())
+                    break;
+                history += ',';
+            }
+            slice revID = selectedRev.revID;
+            history.append((const char*)revID.buf, revID.size);
+            if (n > 0 && find(backToRevs, backToEnd, revID) != backToEnd)
+                break;
+        }
+        selectRevision(selectedRevID, false);
+        return alloc_slice(history);
+    }
+
+
     alloc_slice Document::bodyAsJSON(bool canonical) {
         if (!selectedRev.body.buf)
             error::_throw(error::NotFound);
@@ -69,6 +96,32 @@ namespace c4Internal {
     }
 
 
+    void Document::findBlobKeys(const Dict *body, vector<blobKey> &keys) {
+        // Iterate over blobs:
+        findBlobReferences(body, [&](const Dict *blob) {
+            blobKey key;
+            if (dictIsBlob(blob, key))    // get the key
+                keys.push_back(key);
+            return true;
+        });
+
+        // Now look for old-style _attachments:
+        auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
+        if (attachments) {
+            blobKey key;
+            for (Dict::iterator i(attachments->asDict()); i; ++i) {
+                auto att = i.value()->asDict();
+                if (att) {
+                    const Value* digest = att->get("digest"_sl);
+                    if (digest && key.readFromBase64(digest->asString())) {
+                        keys.push_back(key);
+                    }
+                }
+            }
+        }
+    }
+
+
     bool Document::isValidDocID(slice docID) {
         return docID.size >= 1 && docID.size <= 240 && docID[0] != '_'
             && isValidUTF8(docID) && hasNoControlCharacters(docID);
@@ -109,6 +109,11 @@ namespace c4Internal {
             error::_throw(error::UnsupportedOperation);
         }
         virtual alloc_slice remoteAncestorRevID(C4RemoteID) =0;
+
+        // Returns the selected rev's ID and its ancestors'; see c4doc_getRevisionHistory.
+        virtual alloc_slice getSelectedRevHistory(unsigned maxRevs,
+                                                  const slice backToRevs[],
+                                                  unsigned backToRevsCount);
         virtual void setRemoteAncestorRevID(C4RemoteID) =0;
 
         virtual bool hasRevisionBody() noexcept =0;
@@ -168,6 +173,10 @@ namespace c4Internal {
         static bool findBlobReferences(const fleece::impl::Dict*,
                                        const FindBlobCallback&);
 
+        /** Adds the keys of the blobs a revision body refers to, including old-style
+            `_attachments`, to the vector. */
+        static void findBlobKeys(const fleece::impl::Dict *body, std::vector<blobKey> &keys);
+
         static bool blobIsCompressible(const fleece::impl::Dict *meta);
 
     protected:
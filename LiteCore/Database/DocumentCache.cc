@@ -0,0 +1,136 @@
+//
+// DocumentCache.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "DocumentCache.hh"
+#include "Document.hh"
+
+namespace c4Internal {
+    using namespace std;
+
+
+    // Approximate memory overhead of an entry, besides the document's data:
+    static constexpr size_t kEntryOverhead = sizeof(Document) + 100;
+
+
+    DocumentCache::Entry::Entry(alloc_slice id, Document *d, size_t s)
+    :docID(id), doc(d), size(s)
+    { }
+
+    DocumentCache::Entry::~Entry() = default;
+
+
+    DocumentCache::DocumentCache(size_t maxBytes)
+    :_maxBytes(maxBytes)
+    { }
+
+    DocumentCache::~DocumentCache() = default;
+
+
+    size_t DocumentCache::maxBytes() const {
+        lock_guard<mutex> lock(_mutex);
+        return _maxBytes;
+    }
+
+
+    void DocumentCache::setMaxBytes(size_t maxBytes) {
+        lock_guard<mutex> lock(_mutex);
+        _maxBytes = maxBytes;
+        trim();
+    }
+
+
+    Document* DocumentCache::get(slice docID) {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _byDocID.find(docID);
+        if (i == _byDocID.end()) {
+            ++_stats.misses;
+            return nullptr;
+        }
+        ++_stats.hits;
+        _entries.splice(_entries.begin(), _entries, i->second);    // move to front
+        return i->second->doc->copy();
+    }
+
+
+    uint64_t DocumentCache::generation() const {
+        lock_guard<mutex> lock(_mutex);
+        return _generation;
+    }
+
+
+    void DocumentCache::insert(Document *doc, size_t size, uint64_t generation) {
+        size += kEntryOverhead;
+        lock_guard<mutex> lock(_mutex);
+        if (generation != _generation || size > _maxBytes)
+            return;
+        auto i = _byDocID.find(doc->docID);
+        if (i != _byDocID.end())
+            remove(i->second);
+        _entries.emplace_front(doc->_docIDBuf, doc->copy(), size);
+        _byDocID[_entries.front().docID] = _entries.begin();
+        _bytes += size;
+        trim();
+    }
+
+
+    void DocumentCache::invalidate(slice docID) {
+        lock_guard<mutex> lock(_mutex);
+        ++_generation;
+        auto i = _byDocID.find(docID);
+        if (i != _byDocID.end()) {
+            remove(i->second);
+            ++_stats.invalidations;
+        }
+    }
+
+
+    void DocumentCache::clear() {
+        lock_guard<mutex> lock(_mutex);
+        ++_generation;
+        _byDocID.clear();
+        _entries.clear();
+        _bytes = 0;
+    }
+
+
+    C4DocumentCacheStats DocumentCache::stats() const {
+        lock_guard<mutex> lock(_mutex);
+        C4DocumentCacheStats stats = _stats;
+        stats.count = _entries.size();
+        stats.bytes = _bytes;
+        stats.maxBytes = _maxBytes;
+        return stats;
+    }
+
+
+    void DocumentCache::remove(List::iterator i) {
+        _bytes -= i->size;
+        _byDocID.erase(i->docID);
+        _entries.erase(i);
+    }
+
+
+    // Evicts least-recently-used entries until the cache is within its size limit.
+    void DocumentCache::trim() {
+        while (_bytes > _maxBytes && !_entries.empty()) {
+            remove(prev(_entries.end()));
+            ++_stats.evictions;
+        }
+    }
+
+}
@@ -0,0 +1,89 @@
+//
+// DocumentCache.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "c4Database.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace c4Internal {
+    class Document;
+
+
+    /** An LRU cache of loaded Documents, keyed by docID, limited to a total size in bytes.
+        A hit returns a copy of the cached Document, which skips reading the record from SQLite
+        and decoding it.
+        The Database's SequenceTracker invalidates entries when documents change, including
+        changes committed by other Database instances on the same file; since those are reported
+        on other threads, the cache is thread-safe. */
+    class DocumentCache {
+    public:
+        explicit DocumentCache(size_t maxBytes);
+        ~DocumentCache();
+
+        size_t maxBytes() const;
+        void setMaxBytes(size_t maxBytes);
+
+        /** Returns a new copy of the cached Document with this ID, or nullptr. */
+        Document* get(slice docID);
+
+        /** Returns a counter that's incremented by every invalidation. Read it before reading a
+            document from the database, and pass it to `insert`. */
+        uint64_t generation() const;
+
+        /** Adds a copy of a Document to the cache. `size` is its (approximate) size in bytes.
+            `generation` is the value of generation() from before the document was read: if
+            anything has been invalidated since then, the document might be obsolete, so it's
+            not added. */
+        void insert(Document *doc NONNULL, size_t size, uint64_t generation);
+
+        /** Removes a document from the cache. Called when the document changes. */
+        void invalidate(slice docID);
+
+        /** Removes all documents. */
+        void clear();
+
+        C4DocumentCacheStats stats() const;
+
+    private:
+        struct Entry {
+            alloc_slice const docID;
+            std::unique_ptr<Document> doc;
+            size_t size;
+
+            Entry(alloc_slice id, Document *d, size_t s);
+            ~Entry();
+        };
+        using List = std::list<Entry>;
+
+        void remove(List::iterator);
+        void trim();
+
+        mutable std::mutex      _mutex;
+        List                    _entries;               // Most recently used first
+        std::unordered_map<slice, List::iterator, fleece::sliceHash> _byDocID;
+        size_t                  _maxBytes;
+        size_t                  _bytes {0};
+        uint64_t                _generation {0};
+        C4DocumentCacheStats    _stats { };
+    };
+
+}
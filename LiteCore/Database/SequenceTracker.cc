@@ -18,6 +18,7 @@
 
 #include "SequenceTracker.hh"
 #include "Document.hh"
+#include "DocumentCache.hh"
 #include "Logging.hh"
 #include <algorithm>
 #include <sstream>
@@ -41,6 +42,12 @@ Transactions:
  When a transaction begins, a placeholder is added at the end of the list.
  On commit: Generate a list of all changes since that placeholder, and broadcast to all other databases open on this file. They add those changes to their SequenceTrackers.
  On abort: Iterate over all changes since that placeholder and call documentChanged, with the old committed sequence number. This will notify all observers that the doc has reverted back.
+
+Entries removed from the front of the list are kept in a spare list and reused for new changes,
+so a steady stream of changes doesn't allocate a list node apiece.
+
+Document observers aren't in the list at all; they're in maps sharded by docID, each with its
+own mutex, so registering one only contends with changes to documents in the same shard.
 */
 
 
@@ -50,6 +57,8 @@ namespace litecore {
 
     static const size_t kMinChangesToKeep = 100;
 
+    static const size_t kMaxSpareEntries = 100;
+
     LogDomain ChangesLog("Changes", LogLevel::Warning);
 
 
@@ -84,19 +93,19 @@ namespace litecore {
             logInfo("abort: from seq #%llu back to #%llu", _lastSequence, _preTransactionLastSequence);
             _lastSequence = _preTransactionLastSequence;
 
-            // Revert their committedSequences:
-            const_iterator lastEntry = prev(_changes.end());
-            const_iterator nextEntry = _transaction->_placeholder;
-            const_iterator entry;
-            do {
-                entry = nextEntry;
-                nextEntry = next(entry);
-                if (!entry->isPlaceholder()) {
-                    // moves entry!
-                    _documentChanged(entry->docID, entry->revID,
-                                     entry->committedSequence, entry->bodySize);
-                }
-            } while (entry != lastEntry);
+            // Revert their committedSequences. (The entries are collected first, because
+            // _documentChanged moves them, and may move filtered notifiers' placeholders too.)
+            vector<const_iterator> entries;
+            for (auto entry = next(_transaction->_placeholder); entry != _changes.end(); ++entry) {
+                if (!entry->isPlaceholder())
+                    entries.push_back(entry);
+            }
+            for (auto entry : entries) {
+                // moves entry!
+                _documentChanged(entry->docID, entry->revID,
+                                 entry->committedSequence, entry->bodySize,
+                                 entry->flags, entry->body);
+            }
         }
 
         _transaction.reset();
@@ -107,47 +116,64 @@ namespace litecore {
     void SequenceTracker::documentChanged(const alloc_slice &docID,
                                           const alloc_slice &revID,
                                           sequence_t sequence,
-                                          uint64_t bodySize) {
+                                          uint64_t bodySize,
+                                          uint8_t flags,
+                                          slice body) {
         Assert(inTransaction());
         Assert(sequence > _lastSequence);
         _lastSequence = sequence;
-        _documentChanged(docID, revID, sequence, bodySize);
+        _documentChanged(docID, revID, sequence, bodySize, flags, body);
     }
 
 
     void SequenceTracker::_documentChanged(const alloc_slice &docID,
                                            const alloc_slice &revID,
                                            sequence_t sequence,
-                                           uint64_t bodySize)
+                                           uint64_t bodySize,
+                                           uint8_t flags,
+                                           slice body)
     {
+        if (_documentCache)
+            _documentCache->invalidate(docID);
         auto shortBodySize = (uint32_t)min(bodySize, (uint64_t)UINT32_MAX);
+        alloc_slice keptBody;
+        if (body && _bodyPredicates->count > 0)
+            keptBody = alloc_slice(body);
         bool listChanged = true;
         Entry *entry;
         auto i = _byDocID.find(docID);
         if (i != _byDocID.end()) {
             // Move existing entry to the end of the list:
             entry = &*i->second;
-            if (entry->isIdle() && !hasDBChangeNotifiers()) {
+            if (next(i->second) != _changes.end())
+                _changes.splice(_changes.end(), _changes, i->second);
+            else
                 listChanged = false;
-            } else {
-                if (entry->isIdle()) {
-                    _changes.splice(_changes.end(), _idle, i->second);
-                    entry->idle = false;
-                } else if (next(i->second) != _changes.end())
-                    _changes.splice(_changes.end(), _changes, i->second);
-                else
-                    listChanged = false;
-            }
             // Update its revID & sequence:
             entry->revID = revID;
             entry->sequence = sequence;
             entry->bodySize = shortBodySize;
+            entry->flags = flags;
+            entry->body = keptBody;
         } else {
-            // or create a new entry at the end:
-            _changes.emplace_back(docID, revID, sequence, shortBodySize);
+            // or add a new entry at the end, reusing a spare one if possible:
+            if (_spareEntries.empty()) {
+                _changes.emplace_back(docID, revID, sequence, shortBodySize);
+            } else {
+                _changes.splice(_changes.end(), _spareEntries, _spareEntries.begin());
+                Entry &spare = _changes.back();
+                spare.docID = docID;
+                spare.revID = revID;
+                spare.sequence = sequence;
+                spare.committedSequence = 0;
+                spare.bodySize = shortBodySize;
+                spare.external = false;
+            }
             iterator change = prev(_changes.end());
             _byDocID[change->docID] = change;
             entry = &*change;
+            entry->flags = flags;
+            entry->body = keptBody;
         }
 
         if (!inTransaction()) {
@@ -156,21 +182,33 @@ namespace litecore {
         }
 
         // Notify document notifiers:
-        for (auto docNotifier : entry->documentObservers)
-            docNotifier->notify(entry);
+        notifyDocObservers(entry->docID, entry->sequence);
 
         if (listChanged && _numPlaceholders > 0) {
-            // Any placeholders right before this change were up to date, should be notified:
+            // Any placeholders right before this change were up to date, should be notified;
+            // unless their filter rejects it, in which case they skip past it and stay up to date:
             bool notified = false;
-            auto ph = next(_changes.rbegin());      // iterating _backwards_, skipping latest
-            while (ph != _changes.rend() && ph->isPlaceholder()) {
-                auto nextph = ph;
-                ++nextph; // precompute next pos, in case 'ph' moves itself during the callback
-                if (ph->databaseObserver) {
-                    ph->databaseObserver->notify();
+            auto i = prev(_changes.end());          // iterating _backwards_ from the latest
+            while (i != _changes.begin()) {
+                auto ph = prev(i);
+                if (!ph->isPlaceholder())
+                    break;
+                auto observer = ph->databaseObserver;
+                if (observer && !observer->matches(*entry)) {
+                    _changes.splice(_changes.end(), _changes, ph);  // (now prev(i) is the next one)
                     notified = true;
+                } else {
+                    // precompute next pos, in case 'ph' moves itself during the callback:
+                    bool first = (ph == _changes.begin());
+                    auto before = first ? ph : prev(ph);
+                    if (observer) {
+                        observer->notify();
+                        notified = true;
+                    }
+                    if (first)
+                        break;
+                    i = next(before);
                 }
-                ph = nextph;
             }
             if (notified)
                 removeObsoleteEntries();
@@ -181,11 +219,18 @@ namespace litecore {
     void SequenceTracker::addExternalTransaction(const SequenceTracker &other) {
         Assert(!inTransaction());
         Assert(other.inTransaction());
+        if (_documentCache) {
+            // (This has to happen even if there's nothing to notify, below.)
+            for (auto e = next(other._transaction->_placeholder); e != other._changes.end(); ++e) {
+                if (!e->isPlaceholder())
+                    _documentCache->invalidate(e->docID);
+            }
+        }
         if (!_changes.empty() || _numDocObservers > 0) {
             logInfo("addExternalTransaction from %s", other.loggingIdentifier().c_str());
             for (auto e = next(other._transaction->_placeholder); e != other._changes.end(); ++e) {
                 _lastSequence = e->sequence;
-                _documentChanged(e->docID, e->revID, e->sequence, e->bodySize);
+                _documentChanged(e->docID, e->revID, e->sequence, e->bodySize, e->flags, e->body);
             }
             removeObsoleteEntries();
         }
@@ -221,8 +266,9 @@ namespace litecore {
 
 
     bool SequenceTracker::hasChangesAfterPlaceholder(const_iterator placeholder) const {
+        auto notifier = placeholder->databaseObserver;
         for (auto i = next(placeholder); i != _changes.end(); ++i) {
-            if (!i->isPlaceholder())
+            if (!i->isPlaceholder() && notifier->matches(*i))
                 return true;
         }
         return false;
@@ -230,23 +276,30 @@ namespace litecore {
 
 
     size_t SequenceTracker::readChanges(const_iterator placeholder,
-                                        Change changes[], size_t maxChanges,
-                                        bool &external)
+                                        size_t maxChanges, bool &external,
+                                        function_ref<void(const Entry&)> callback)
     {
         external = false;
+        auto notifier = placeholder->databaseObserver;
         size_t n = 0;
+        bool skipped = false;
         auto i = next(placeholder);
         while (i != _changes.end() && n < maxChanges) {
             if (!i->isPlaceholder()) {
-                if (n == 0)
-                    external = i->external;
-                else if (i->external != external)
-                    break;
-                changes[n++] = Change{i->docID, i->revID, i->sequence, i->bodySize};
+                if (!notifier->matches(*i)) {
+                    skipped = true;
+                } else {
+                    if (n == 0)
+                        external = i->external;
+                    else if (i->external != external)
+                        break;
+                    callback(*i);
+                    ++n;
+                }
             }
             ++i;
         }
-        if (n > 0) {
+        if (n > 0 || skipped) {
             _changes.splice(i, _changes, placeholder);
             removeObsoleteEntries();
         }
@@ -262,45 +315,77 @@ namespace litecore {
         while (_changes.size() > kMinChangesToKeep + _numPlaceholders
                     && !_changes.front().isPlaceholder()) {
             _byDocID.erase(_changes.front().docID);
-            _changes.erase(_changes.begin());
+            recycleEntry(_changes.begin());
             ++nRemoved;
-            //FIX: Shouldn't erase it if its documentObservers is non-empty
         }
-        logVerbose("Removed %zu old entries (%zu left; idle has %zd, byDocID has %zu)",
-                   nRemoved, _changes.size(), _idle.size(), _byDocID.size());
+        logVerbose("Removed %zu old entries (%zu left; spare has %zu, byDocID has %zu)",
+                   nRemoved, _changes.size(), _spareEntries.size(), _byDocID.size());
     }
 
 
-    SequenceTracker::const_iterator
-    SequenceTracker::addDocChangeNotifier(slice docID, DocChangeNotifier* notifier) {
-        iterator entry;
-        // Find the entry for the document:
-        auto i = _byDocID.find(docID);
-        if (i != _byDocID.end()) {
-            entry = i->second;
+    // Moves a document entry from _changes to _spareEntries, or deletes it if there are enough
+    // spares already. The caller must have removed it from _byDocID.
+    void SequenceTracker::recycleEntry(iterator entry) {
+        if (_spareEntries.size() < kMaxSpareEntries) {
+            entry->docID = nullslice;       // (frees memory, and keeps dump() working)
+            entry->revID = nullslice;
+            entry->body = nullslice;
+            _spareEntries.splice(_spareEntries.end(), _changes, entry);
         } else {
-            // Document isn't known yet; create an entry and put it in the _idle list
-            entry = _idle.emplace(_idle.end(), alloc_slice(docID), alloc_slice(), 0, 0);
-            entry->idle = true;
-            _byDocID[entry->docID] = entry;
+            _changes.erase(entry);
+        }
+    }
+
+
+#pragma mark - DOCUMENT OBSERVERS:
+
+
+    SequenceTracker::DocObserverShard& SequenceTracker::shardFor(slice docID) {
+        return _docObserverShards[fleece::sliceHash{}(docID) % kNumDocObserverShards];
+    }
+
+
+    // Called with the tracker's mutex held. The shard's mutex stays locked during the callbacks,
+    // so a notifier can't be removed while it's being called.
+    void SequenceTracker::notifyDocObservers(slice docID, sequence_t sequence) {
+        if (_numDocObservers == 0)
+            return;
+        auto &shard = shardFor(docID);
+        lock_guard<std::mutex> lock(shard.mutex);
+        auto i = shard.byDocID.find(docID);
+        if (i != shard.byDocID.end()) {
+            for (auto docNotifier : i->second.notifiers)
+                docNotifier->notify(docID, sequence);
         }
-        entry->documentObservers.push_back(notifier);
+    }
+
+
+    void SequenceTracker::addDocChangeNotifier(DocChangeNotifier* notifier) {
+        auto &shard = shardFor(notifier->docID());
+        lock_guard<std::mutex> lock(shard.mutex);
+        auto i = shard.byDocID.find(notifier->docID());
+        if (i == shard.byDocID.end()) {
+            DocObservers observers {notifier->_docID, {}};
+            slice key = observers.docID;
+            i = shard.byDocID.emplace(key, move(observers)).first;
+        }
+        i->second.notifiers.push_back(notifier);
         ++_numDocObservers;
-        return entry;
     }
 
 
-    void SequenceTracker::removeDocChangeNotifier(const_iterator entry, DocChangeNotifier* notifier) {
-        auto &observers = const_cast<vector<DocChangeNotifier*>&>(entry->documentObservers);
-        auto i = find(observers.begin(), observers.end(), notifier);
-        Assert(i != observers.end());
-        observers.erase(i);
+    void SequenceTracker::removeDocChangeNotifier(DocChangeNotifier* notifier) {
+        auto &shard = shardFor(notifier->docID());
+        lock_guard<std::mutex> lock(shard.mutex);
+        auto i = shard.byDocID.find(notifier->docID());
+        Assert(i != shard.byDocID.end());
+        auto &notifiers = i->second.notifiers;
+        auto n = find(notifiers.begin(), notifiers.end(), notifier);
+        Assert(n != notifiers.end());
+        notifiers.erase(n);
         --_numDocObservers;
-        if (observers.empty() && entry->isIdle()) {
-            _byDocID.erase(entry->docID);
-            Assert(!_idle.empty());
-            _idle.erase(entry);
-        }
+        if (notifiers.empty())
+            shard.byDocID.erase(i);
     }
 
 
@@ -339,23 +424,53 @@ namespace litecore {
 
 
     DatabaseChangeNotifier::DatabaseChangeNotifier(SequenceTracker &t, Callback cb, sequence_t afterSeq)
+    :DatabaseChangeNotifier(t, cb, ChangeFilter(), afterSeq)
+    { }
+
+
+    DatabaseChangeNotifier::DatabaseChangeNotifier(SequenceTracker &t, Callback cb,
+                                                   ChangeFilter filter, sequence_t afterSeq)
     :Logging(ChangesLog)
     ,tracker(t)
     ,callback(cb)
+    ,_filter(move(filter))
+    ,_filtered(_filter.docIDPrefix || !_filter.docIDs.empty()
+               || _filter.deletedMode != ChangeFilter::kAllRevisions || _filter.bodyPredicate)
     ,_placeholder(tracker.addPlaceholderAfter(this, afterSeq))
     {
+        if (_filter.bodyPredicate)
+            ++tracker._bodyPredicates->count;
         if (callback)
-            logInfo("Created, starting after #%lld", afterSeq);
+            logInfo("Created, starting after #%lld%s", afterSeq, (_filtered ? " (filtered)" : ""));
     }
 
 
     DatabaseChangeNotifier::~DatabaseChangeNotifier() {
         if (callback)
             logInfo("Deleting");
+        if (_filter.bodyPredicate)
+            --tracker._bodyPredicates->count;
         tracker.removePlaceholder(_placeholder);
     }
 
 
+    bool DatabaseChangeNotifier::matches(const SequenceTracker::Entry &entry) const {
+        if (!_filtered)
+            return true;
+        if (_filter.docIDPrefix && !entry.docID.hasPrefix(_filter.docIDPrefix))
+            return false;
+        if (!_filter.docIDs.empty() && _filter.docIDs.find(entry.docID) == _filter.docIDs.end())
+            return false;
+        bool deleted = (entry.flags & kRevDeleted) != 0;
+        if ((_filter.deletedMode == ChangeFilter::kLiveRevisions && deleted)
+                || (_filter.deletedMode == ChangeFilter::kDeletions && !deleted))
+            return false;
+        if (_filter.bodyPredicate && !_filter.bodyPredicate(entry.docID, entry.body))
+            return false;
+        return true;
+    }
+
+
     void DatabaseChangeNotifier::notify() {
         if (callback) {
             logInfo("posting notification");
@@ -367,7 +482,16 @@ namespace litecore {
     size_t DatabaseChangeNotifier::readChanges(SequenceTracker::Change changes[],
                                                size_t maxChanges,
                                                bool &external) {
-        size_t n = tracker.readChanges(_placeholder, changes, maxChanges, external);
+        return readChanges(maxChanges, external, [&](const SequenceTracker::Entry &entry) {
+            *changes++ = SequenceTracker::Change{entry.docID, entry.revID, entry.sequence,
+                                                 entry.bodySize, entry.flags};
+        });
+    }
+
+
+    size_t DatabaseChangeNotifier::readChanges(size_t maxChanges, bool &external,
+                                   function_ref<void(const SequenceTracker::Entry&)> callback) {
+        size_t n = tracker.readChanges(_placeholder, maxChanges, external, callback);
         logInfo("readChanges(%zu) -> %zu changes", maxChanges, n);
         return n;
     }
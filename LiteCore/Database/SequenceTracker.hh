@@ -19,14 +19,18 @@
 #pragma once
 #include "Base.hh"
 #include "Logging.hh"
+#include <atomic>
+#include <functional>
 #include <list>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace c4Internal {
     class Database;
     class Document;
+    class DocumentCache;
 }
 
 namespace litecore {
@@ -37,28 +41,51 @@ namespace litecore {
     
 
     /** Tracks database & document changes, and notifies listeners.
-        It's intended that this be a singleton per database _file_. */
+        It's intended that this be a singleton per database _file_.
+        Document observers are kept apart from the list of changes, in maps sharded by docID
+        with their own mutexes, so adding or removing one doesn't need the tracker's mutex. */
     class SequenceTracker : public Logging {
     public:
         struct Entry;
 
         SequenceTracker();
 
-        /** Multithreaded clients can use this to synchronize access to the tracker. */
+        /** Multithreaded clients can use this to synchronize access to the tracker.
+            (It isn't needed to create or destroy a DocChangeNotifier.) */
         std::mutex& mutex()                     {return _mutex;}
 
         void beginTransaction();
         void endTransaction(bool commit);
 
-        /** Document implementation calls this to register the change with the Notifier. */
+        /** Document implementation calls this to register the change with the Notifier.
+            `flags` are the revision's C4RevisionFlags. `body` is only used by notifiers with a
+            body predicate; it's copied if there are any, here or in another tracker sharing
+            this one's BodyPredicateCount. */
         void documentChanged(const alloc_slice &docID,
                              const alloc_slice &revID,
                              sequence_t sequence,
-                             uint64_t bodySize);
+                             uint64_t bodySize,
+                             uint8_t flags =0,
+                             slice body =nullslice);
 
         /** Copy the other tracker's transaction's changes into myself as committed & external */
         void addExternalTransaction(const SequenceTracker &from);
 
+        /** The number of notifiers with body predicates. Database instances on the same file
+            share one, since each change is recorded by the tracker of the instance that made it,
+            which then has to keep the body for the other trackers' notifiers. */
+        class BodyPredicateCount : public RefCounted {
+        public:
+            std::atomic<size_t> count {0};
+        };
+
+        /** Makes this tracker share a BodyPredicateCount with others. Must be called before
+            any notifiers are created. */
+        void shareBodyPredicateCount(BodyPredicateCount *count)    {_bodyPredicates = count;}
+
+        /** Sets a cache whose documents will be invalidated when they change. */
+        void setDocumentCache(c4Internal::DocumentCache *cache)    {_documentCache = cache;}
+
         sequence_t lastSequence() const         {return _lastSequence;}
 
         /** Tracks a document's current sequence. */
@@ -67,23 +94,22 @@ namespace litecore {
 
             // Document entry (when sequence != 0):
             sequence_t                      committedSequence {0};
-            alloc_slice const               docID;
+            alloc_slice                     docID;
             alloc_slice                     revID;
-            std::vector<DocChangeNotifier*> documentObservers;
+            alloc_slice                     body;   // Only kept if there are body predicates
             uint32_t                        bodySize;
-            bool                            idle     :1;
+            uint8_t                         flags {0};
             bool                            external :1;
 
             // Placeholder entry (when sequence == 0):
             DatabaseChangeNotifier* const   databaseObserver {nullptr};
 
             Entry(const alloc_slice &d, alloc_slice r, sequence_t s, uint32_t bs)
-            :docID(d), revID(r), sequence(s), bodySize(bs), idle(false), external(false) { }
+            :docID(d), revID(r), sequence(s), bodySize(bs), external(false) { }
             Entry(DatabaseChangeNotifier *o)
             :databaseObserver(o) { }    // placeholder
 
             bool isPlaceholder() const          {return docID.buf == nullptr;}
-            bool isIdle() const                 {return idle && !isPlaceholder();}
         };
 
         struct Change {
@@ -91,6 +117,7 @@ namespace litecore {
             alloc_slice revID;
             sequence_t sequence;
             uint32_t bodySize;
+            uint8_t flags;
         };
 
 #if DEBUG
@@ -107,10 +134,6 @@ namespace litecore {
 
         bool inTransaction() const              {return _transaction.get() != nullptr;}
 
-        bool hasDBChangeNotifiers() const {
-            return _numPlaceholders - (int)inTransaction() > 0;
-        }
-
         /** Returns the oldest Entry. */
         const_iterator begin() const            {return _changes.begin();}
 
@@ -120,11 +143,10 @@ namespace litecore {
         const_iterator addPlaceholderAfter(DatabaseChangeNotifier *obs, sequence_t);
         void removePlaceholder(const_iterator);
         bool hasChangesAfterPlaceholder(const_iterator) const;
-        size_t readChanges(const_iterator placeholder,
-                           Change changes[], size_t maxChanges,
-                           bool &external);
-        const_iterator addDocChangeNotifier(slice docID, DocChangeNotifier*);
-        void removeDocChangeNotifier(const_iterator, DocChangeNotifier*);
+        size_t readChanges(const_iterator placeholder, size_t maxChanges, bool &external,
+                           function_ref<void(const Entry&)> callback);
+        void addDocChangeNotifier(DocChangeNotifier*);
+        void removeDocChangeNotifier(DocChangeNotifier*);
         void removeObsoleteEntries();
 
     private:
@@ -135,20 +157,44 @@ namespace litecore {
         void _documentChanged(const alloc_slice &docID,
                               const alloc_slice &revID,
                               sequence_t sequence,
-                              uint64_t bodySize);
+                              uint64_t bodySize,
+                              uint8_t flags,
+                              slice body);
         const_iterator _since(sequence_t s) const;
 
         typedef std::list<Entry>::iterator iterator;
 
+        void recycleEntry(iterator);
+
+        // The observers of one document. (The map key points into `docID`.)
+        struct DocObservers {
+            alloc_slice                     docID;
+            std::vector<DocChangeNotifier*> notifiers;
+        };
+
+        // A subset of the document observers, chosen by hashing the docID.
+        struct DocObserverShard {
+            std::mutex                                              mutex;
+            std::unordered_map<slice, DocObservers, fleece::sliceHash> byDocID;
+        };
+
+        static constexpr size_t kNumDocObserverShards = 16;
+
+        DocObserverShard& shardFor(slice docID);
+        void notifyDocObservers(slice docID, sequence_t);
+
         std::list<Entry>                        _changes;
-        std::list<Entry>                        _idle;
+        std::list<Entry>                        _spareEntries;  // Removed entries, for reuse
         std::unordered_map<slice, iterator, fleece::sliceHash> _byDocID;
         sequence_t                              _lastSequence {0};
         size_t                                  _numPlaceholders {0};
-        size_t                                  _numDocObservers {0};
+        Retained<BodyPredicateCount>            _bodyPredicates {new BodyPredicateCount};
+        std::atomic<size_t>                     _numDocObservers {0};
+        DocObserverShard                        _docObserverShards[kNumDocObserverShards];
         std::unique_ptr<DatabaseChangeNotifier> _transaction;
         sequence_t                              _preTransactionLastSequence;
         std::mutex                              _mutex;
+        c4Internal::DocumentCache*              _documentCache {nullptr};
     };
 
 
@@ -159,28 +205,53 @@ namespace litecore {
 
         DocChangeNotifier(SequenceTracker &t, slice docID, Callback cb)
         :tracker(t),
-         _docEntry(tracker.addDocChangeNotifier(docID, this)),
-         callback(cb)
-        { }
+         callback(cb),
+         _docID(docID)
+        {
+            tracker.addDocChangeNotifier(this);
+        }
 
         ~DocChangeNotifier() {
-            tracker.removeDocChangeNotifier(_docEntry, this);
+            tracker.removeDocChangeNotifier(this);
         }
 
         SequenceTracker &tracker;
         Callback const callback;
 
-        slice docID() const             {return _docEntry->docID;}
-        sequence_t sequence() const     {return _docEntry->sequence;}
+        slice docID() const             {return _docID;}
 
     protected:
-        void notify(const SequenceTracker::Entry* entry) {
-            if (callback) callback(*this, entry->docID, entry->sequence);
+        void notify(slice docID, sequence_t sequence) {
+            if (callback) callback(*this, docID, sequence);
         }
 
     private:
         friend class SequenceTracker;
-        SequenceTracker::const_iterator const _docEntry;
+        alloc_slice const _docID;
+    };
+
+
+    /** Restricts the changes a DatabaseChangeNotifier sees. The default matches every change.
+        Changes that don't match are skipped inside the tracker, so they never trigger the
+        notifier's callback. */
+    struct ChangeFilter {
+        enum DeletedMode : uint8_t {
+            kAllRevisions,                          // Deletions and non-deletions
+            kLiveRevisions,                         // No deletions
+            kDeletions,                             // Only deletions
+        };
+
+        /** Tests a revision's docID and (Fleece) body. The body is null if the revision has
+            none, like a deletion, or if it was saved before any notifier had a body predicate.
+            Called with the tracker's mutex held, so it needs to be fast. */
+        typedef std::function<bool(slice docID, const alloc_slice &body)> BodyPredicate;
+
+        typedef std::unordered_set<alloc_slice, fleece::sliceHash> DocIDSet;
+
+        alloc_slice              docIDPrefix;       // If non-null, docIDs must start with this
+        DocIDSet                 docIDs;            // If non-empty, docIDs must be one of these
+        DeletedMode              deletedMode {kAllRevisions};
+        BodyPredicate            bodyPredicate;     // If non-null, the body must pass this
     };
 
 
@@ -193,6 +264,10 @@ namespace litecore {
 
         DatabaseChangeNotifier(SequenceTracker&, Callback, sequence_t afterSeq =UINT64_MAX);
 
+        /** Creates a notifier that only sees changes that match a filter. */
+        DatabaseChangeNotifier(SequenceTracker&, Callback, ChangeFilter,
+                               sequence_t afterSeq =UINT64_MAX);
+
         ~DatabaseChangeNotifier();
 
         SequenceTracker &tracker;
@@ -207,12 +282,22 @@ namespace litecore {
             construction.) Resets the callback state so it can be called again. */
         size_t readChanges(SequenceTracker::Change changes[], size_t maxChanges, bool &external);
 
+        /** Like the above, but passes each change's entry to the callback instead of copying it.
+            The entry is only valid during the call. */
+        size_t readChanges(size_t maxChanges, bool &external,
+                           function_ref<void(const SequenceTracker::Entry&)> callback);
+
+        /** Returns true if the change passes the notifier's filter. */
+        bool matches(const SequenceTracker::Entry&) const;
+
     protected:
         void notify();
 
     private:
         friend class SequenceTracker;
 
+        ChangeFilter const _filter;
+        bool const _filtered;
         SequenceTracker::const_iterator const _placeholder;
     };
 
@@ -38,11 +38,15 @@ namespace c4Internal {
     using namespace fleece;
     using namespace fleece::impl;
 
+    // The revision tree is decoded lazily: until something needs more than the current
+    // revision, `_versionedDoc.treePending()` is true and the current revision is selected
+    // straight from the encoded tree, with `_selectedRev` left null. Any method that needs the
+    // tree, or a Rev in it, has to call loadRevisions() first.
     class TreeDocument : public Document {
     public:
         TreeDocument(Database* database, C4Slice docID)
         :Document(database),
-         _versionedDoc(database->defaultKeyStore(), docID),
+         _versionedDoc(database->defaultKeyStore(), docID, VersionedDocument::kDecodeLazily),
          _selectedRev(nullptr)
         {
             init();
@@ -51,7 +55,7 @@ namespace c4Internal {
 
         TreeDocument(Database *database, const Record &doc)
         :Document(database),
-         _versionedDoc(database->defaultKeyStore(), doc),
+         _versionedDoc(database->defaultKeyStore(), doc, VersionedDocument::kDecodeLazily),
          _selectedRev(nullptr)
         {
             init();
@@ -65,6 +69,8 @@ namespace c4Internal {
         {
             if (other._selectedRev)
                 _selectedRev = _versionedDoc[other._selectedRev->revID];
+            else if (_versionedDoc.treePending() && selectedRev.revID.buf)
+                selectCurrentRevision();
         }
 
 
@@ -98,36 +104,75 @@ namespace c4Internal {
         }
 
         bool revisionsLoaded() const noexcept override {
-            return _versionedDoc.revsAvailable();
+            return _versionedDoc.revsAvailable() || _versionedDoc.treePending();
         }
 
+        // Makes the whole revision tree available, reading and/or decoding it if necessary.
         void loadRevisions() override {
             if (!_versionedDoc.revsAvailable()) {
+                // A pending tree's selection is either the current revision or nothing:
+                bool selectCurrent = !_versionedDoc.treePending() || selectedRev.revID.buf;
                 _versionedDoc.read();
-                selectRevision(_versionedDoc.currentRevision());
+                if (selectCurrent)
+                    selectRevision(_versionedDoc.currentRevision());
+            }
+        }
+
+        // Version of loadRevisions for noexcept methods; returns false if it fails.
+        bool loadRevisionsNoThrow() noexcept {
+            try {
+                loadRevisions();
+                return true;
+            } catch (const std::exception &x) {
+                Warn("Couldn't load revision tree of doc \"%.*s\": %s", SPLAT(docID), x.what());
+                return false;
             }
         }
 
         bool hasRevisionBody() noexcept override {
             if (!revisionsLoaded())
                 Warn("c4doc_hasRevisionBody called on doc loaded without kC4IncludeBodies");
-            return _selectedRev && _selectedRev->isBodyAvailable();
+            if (_versionedDoc.treePending())
+                return selectedRev.body.buf != nullptr;
+            return _selectedRev && (_selectedRev->isBodyAvailable()
+                                    || _selectedRev->isBodyExternal());
         }
 
         bool loadSelectedRevBody() override {
-            loadRevisions();
+            if (!_versionedDoc.treePending()) {   // (the pending current revision has its body)
+                loadRevisions();
+                // (Retry an external body that couldn't be read when it was selected:)
+                if (_selectedRev && !selectedRev.body.buf && _versionedDoc.loadBody(_selectedRev))
+                    selectedRev.body = _selectedRev->body();
+            }
             return selectedRev.body.buf != nullptr;
         }
 
+        // Expands a revID into _selectedRevIDBuf, reusing an existing buffer that already
+        // contains it instead of allocating a new one whenever possible.
+        void setSelectedRevID(revid rev) {
+            char buf[64];
+            slice expanded(buf, sizeof(buf));
+            if (!rev.expandInto(expanded)) {
+                _selectedRevIDBuf = rev.expanded();
+            } else if (expanded == _revIDBuf) {
+                _selectedRevIDBuf = _revIDBuf;
+            } else if (expanded != _selectedRevIDBuf) {
+                _selectedRevIDBuf = alloc_slice(expanded);
+            }
+            selectedRev.revID = _selectedRevIDBuf;
+        }
+
         bool selectRevision(const Rev *rev) noexcept {   // doesn't throw
             _selectedRev = rev;
             _loadedBody = nullslice;
             if (rev) {
-                _selectedRevIDBuf = rev->revID.expanded();
-                selectedRev.revID = _selectedRevIDBuf;
+                setSelectedRevID(rev->revID);
                 selectedRev.flags = (C4RevisionFlags)rev->flags;
                 selectedRev.sequence = rev->sequence;
                 selectedRev.body = rev->body();
+                if (!selectedRev.body.buf && rev->isBodyExternal())
+                    loadExternalBody(rev);
                 return true;
             } else {
                 clearSelectedRevision();
@@ -135,8 +180,22 @@ namespace c4Internal {
             }
         }
 
+        // A kept revision's body may be stored outside the tree; it's read when the revision
+        // is selected, so that selectedRev.body is available just as if it were inline.
+        void loadExternalBody(const Rev *rev) noexcept {
+            try {
+                if (_versionedDoc.loadBody(rev))
+                    selectedRev.body = rev->body();
+            } catch (const std::exception &x) {
+                Warn("Couldn't read body of revision of doc \"%.*s\": %s",
+                     SPLAT(docID), x.what());
+            }
+        }
+
         bool selectRevision(C4Slice revID, bool withBody) override {
-            if (revID.buf) {
+            if (revID.buf && _versionedDoc.treePending() && slice(revID) == slice(this->revID)) {
+                selectCurrentRevision();            // no need to decode the tree
+            } else if (revID.buf) {
                 loadRevisions();
                 const Rev *rev = _versionedDoc[revidBuffer(revID)];
                 if (!selectRevision(rev))
@@ -153,6 +212,11 @@ namespace c4Internal {
             if (_versionedDoc.revsAvailable()) {
                 selectRevision(_versionedDoc.currentRevision());
                 return true;
+            } else if (_versionedDoc.treePending()) {
+                // Select the current revision without decoding the tree:
+                selectRevision(_versionedDoc.pendingCurrentRevision());
+                _selectedRev = nullptr;
+                return true;
             } else {
                 _selectedRev = nullptr;
                 Document::selectCurrentRevision();
@@ -163,6 +227,8 @@ namespace c4Internal {
         bool selectParentRevision() noexcept override {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
+            else if (!loadRevisionsNoThrow())
+                return false;
             if (_selectedRev)
                 selectRevision(_selectedRev->parent);
             return _selectedRev != nullptr;
@@ -171,6 +237,8 @@ namespace c4Internal {
         bool selectNextRevision() noexcept override {    // does not throw
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
+            else if (!loadRevisionsNoThrow())
+                return false;
             if (_selectedRev)
                 selectRevision(_selectedRev->next());
             return _selectedRev != nullptr;
@@ -179,6 +247,8 @@ namespace c4Internal {
         bool selectNextLeafRevision(bool includeDeleted) noexcept override {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
+            else if (!loadRevisionsNoThrow())
+                return false;
             auto rev = _selectedRev;
             if (!rev)
                 return false;
@@ -192,6 +262,7 @@ namespace c4Internal {
         }
 
         bool selectCommonAncestorRevision(slice revID1, slice revID2) override {
+            loadRevisions();
             const Rev *rev1 = _versionedDoc[revidBuffer(revID1)];
             const Rev *rev2 = _versionedDoc[revidBuffer(revID2)];
             if (!rev1 || !rev2)
@@ -210,11 +281,37 @@ namespace c4Internal {
         }
 
         alloc_slice remoteAncestorRevID(C4RemoteID remote) override {
+            loadRevisions();
             auto rev = _versionedDoc.latestRevisionOnRemote(remote);
             return rev ? rev->revID.expanded() : alloc_slice();
         }
 
+        // Walks the Revs directly, expanding the revIDs without allocating or changing selection.
+        alloc_slice getSelectedRevHistory(unsigned maxRevs,
+                                          const slice backToRevs[],
+                                          unsigned backToRevsCount) override
+        {
+            loadRevisions();
+            auto backToEnd = backToRevs + backToRevsCount;
+            string history;
+            unsigned n = 0;
+            for (const Rev *rev = _selectedRev; rev && n < maxRevs; rev = rev->parent, ++n) {
+                if (n > 0)
+                    history += ',';
+                char buf[64];
+                slice revID(buf, sizeof(buf));
+                alloc_slice longRevID;
+                if (!rev->revID.expandInto(revID))
+                    revID = longRevID = rev->revID.expanded();
+                history.append((const char*)revID.buf, revID.size);
+                if (n > 0 && find(backToRevs, backToEnd, revID) != backToEnd)
+                    break;
+            }
+            return n > 0 ? alloc_slice(history) : alloc_slice();
+        }
+
         void setRemoteAncestorRevID(C4RemoteID remote) override {
+            loadRevisions();
             _versionedDoc.setLatestRevisionOnRemote(remote, _selectedRev);
         }
 
@@ -224,7 +321,7 @@ namespace c4Internal {
         }
 
         bool removeSelectedRevBody() noexcept override {
-            if (!_selectedRev)
+            if (!loadRevisionsNoThrow() || !_selectedRev)
                 return false;
             _versionedDoc.removeBody(_selectedRev);
             return true;
@@ -239,6 +336,8 @@ namespace c4Internal {
 
         bool save(unsigned maxRevTreeDepth) override {
             requireValidDocID();
+            if (_versionedDoc.treePending())
+                return true;                // the tree hasn't been touched, so it's unchanged
             if (maxRevTreeDepth == 0)
                 maxRevTreeDepth = _db->maxRevTreeDepth();
             _versionedDoc.prune(maxRevTreeDepth);
@@ -246,6 +345,8 @@ namespace c4Internal {
                 case litecore::VersionedDocument::kConflict:
                     return false;
                 case litecore::VersionedDocument::kNoNewSequence:
+                    _db->uncacheDocument(docID);    // (the SequenceTracker won't know about it)
+                    _db->updateBlobReferences(docID, storedBlobKeys());
                     return true;
                 case litecore::VersionedDocument::kNewSequence:
                     selectedRev.flags &= ~kRevNew;
@@ -254,12 +355,30 @@ namespace c4Internal {
                         if (selectedRev.sequence == 0)
                             selectedRev.sequence = sequence;
                         _db->saved(this);
+                        _db->updateBlobReferences(docID, storedBlobKeys());
                     }
                     return true;
             }
         }
 
+        // Returns the keys of the blobs used by the revisions the tree stores bodies of. Only the
+        // revisions flagged as having attachments are looked at.
+        vector<blobKey> storedBlobKeys() {
+            vector<blobKey> blobs;
+            if (!_versionedDoc.hasAttachments())
+                return blobs;
+            for (auto rev : _versionedDoc.allRevisions()) {
+                if (rev->hasAttachments() && _versionedDoc.loadBody(rev)) {
+                    slice body = rev->body();
+                    Retained<Doc> doc = new Doc(_versionedDoc.scopeFor(body), body, Doc::kTrusted);
+                    Document::findBlobKeys(doc->asDict(), blobs);
+                }
+            }
+            return blobs;
+        }
+
         int32_t purgeRevision(C4Slice revID) override {
+            loadRevisions();
             int32_t total;
             if (revID.buf)
                 total = _versionedDoc.purge(revidBuffer(revID));
@@ -277,6 +396,7 @@ namespace c4Internal {
         void resolveConflict(C4String winningRevID, C4String losingRevID,
                              C4Slice mergedBody, C4RevisionFlags mergedFlags) override
         {
+            loadRevisions();
             // Validate the revIDs:
             auto winningRev = _versionedDoc[revidBuffer(winningRevID)];
             auto losingRev = _versionedDoc[revidBuffer(losingRevID)];
@@ -374,6 +494,7 @@ namespace c4Internal {
         bool putNewRevision(const C4DocPutRequest &rq) override {
             if (rq.remoteDBID != 0)
                 error::_throw(error::InvalidParameter, "remoteDBID cannot be used when existing=false");
+            loadRevisions();
             bool deletion = (rq.revFlags & kRevDeleted) != 0;
             revidBuffer encodedNewRevID = generateDocRevID(rq.body, selectedRev.revID, deletion);
 
@@ -479,31 +600,12 @@ namespace c4Internal {
 } // end namespace c4Internal
 
 
-#pragma mark - REV-TREES-ONLY API:
-
-
-bool c4doc_save(C4Document *doc,
-                uint32_t maxRevTreeDepth,
-                C4Error *outError) noexcept
-{
-    auto idoc = asInternal(doc);
-    if (!idoc->mustUseVersioning(kC4RevisionTrees, outError))
-        return false;
-    if (!idoc->mustBeInTransaction(outError))
-        return false;
-    try {
-        if (maxRevTreeDepth == 0)
-            maxRevTreeDepth = asInternal(doc)->database()->maxRevTreeDepth();
-        ((TreeDocument*)idoc)->save(maxRevTreeDepth);
-        return true;
-    } catchError(outError)
-    return false;
-}
+#pragma mark - REVISION IDS:
 
 
 unsigned c4rev_getGeneration(C4Slice revID) noexcept {
     try {
-        return revidBuffer(revID).generation();
+        return revidBuffer(revID, true).generation();
     }catchExceptions()
     return 0;
 }
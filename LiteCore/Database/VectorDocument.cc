@@ -0,0 +1,882 @@
+//
+// VectorDocument.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Document.hh"
+#include "c4Database.h"
+#include "c4Private.h"
+
+#include "Database.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include "VersionVector.hh"
+#include "VersionedDocument.hh"
+#include "FleeceImpl.hh"
+#include "varint.hh"
+#include <algorithm>
+#include <deque>
+#include <map>
+
+
+namespace c4Internal {
+
+    using namespace fleece;
+    using namespace fleece::impl;
+
+    using RemoteVersionMap = std::map<C4RemoteID, VersionVector>;
+
+
+    // A Record's version is its current revision's vector, optionally followed by a zero byte
+    // and the vectors last known to be current on each remote database, each as
+    // [varint remote ID, varint size, vector].
+    static alloc_slice encodeVersion(const VersionVector &vector, const RemoteVersionMap &remotes) {
+        alloc_slice binary = vector.asBinary();
+        if (remotes.empty())
+            return binary;
+        string result((const char*)binary.buf, binary.size);
+        result += '\0';
+        for (auto &remote : remotes) {
+            alloc_slice remoteBinary = remote.second.asBinary();
+            uint8_t buf[2 * kMaxVarintLen64];
+            size_t size = PutUVarInt(buf, remote.first);
+            size += PutUVarInt(buf + size, remoteBinary.size);
+            result.append((const char*)buf, size);
+            result.append((const char*)remoteBinary.buf, remoteBinary.size);
+        }
+        return alloc_slice(result);
+    }
+
+
+    static void decodeVersion(const alloc_slice &version,
+                              VersionVector &outVector, RemoteVersionMap &outRemotes)
+    {
+        outRemotes.clear();
+        slice remotes = outVector.readBinary(version, version);
+        while (remotes.size > 0) {
+            uint64_t remoteID, size;
+            if (!ReadUVarInt(&remotes, &remoteID) || !ReadUVarInt(&remotes, &size)
+                    || size > remotes.size)
+                error::_throw(error::CorruptRevisionData);
+            outRemotes[C4RemoteID(remoteID)].readBinary(slice(remotes.buf, (size_t)size), version);
+            remotes.moveStart((size_t)size);
+        }
+    }
+
+
+    static DocumentFlags docFlagsFromRevFlags(C4RevisionFlags revFlags) {
+        DocumentFlags flags = DocumentFlags::kNone;
+        if (revFlags & kRevDeleted)
+            flags = flags | DocumentFlags::kDeleted;
+        if (revFlags & kRevHasAttachments)
+            flags = flags | DocumentFlags::kHasAttachments;
+        return flags;
+    }
+
+
+    static string conflictStoreName(const KeyStore &store) {
+        return store.name() + "_conflicts";
+    }
+
+
+    // Instead of a tree, a VectorDocument stores only the current revision, with its version
+    // vector, in the Record; so reading and comparing its metadata costs O(peers), not
+    // O(revisions). Non-leaf revisions aren't kept at all. A revision from a peer that
+    // conflicts with the current one is stored in a separate KeyStore until it's resolved;
+    // only the latest such revision is kept.
+    class VectorDocument : public Document {
+    public:
+        VectorDocument(Database* database, C4Slice docID)
+        :Document(database)
+        ,_store(database->defaultKeyStore())
+        ,_rec(docID)
+        {
+            _store.read(_rec);
+            init();
+        }
+
+
+        VectorDocument(Database *database, const Record &doc)
+        :Document(database)
+        ,_store(database->defaultKeyStore())
+        ,_rec(doc)
+        {
+            init();
+        }
+
+
+        VectorDocument(const VectorDocument &other)
+        :Document(other)
+        ,_store(other._store)
+        ,_rec(other._rec)
+        ,_vector(other._vector)
+        ,_remotes(other._remotes)
+        ,_conflictLoaded(other._conflictLoaded)
+        ,_conflict(other._conflict)
+        ,_conflictVector(other._conflictVector)
+        ,_conflictRevID(other._conflictRevID)
+        ,_conflictChanged(other._conflictChanged)
+        ,_selection(other._selection)
+        ,_changed(other._changed)
+        ,_newRevision(other._newRevision)
+        {
+            addScope(_rec.body());
+            addScope(_conflict.body());
+        }
+
+
+        ~VectorDocument() {
+            _fleeceScopes.clear(); // do this before the memory is freed (by _bodies)
+        }
+
+
+        Document* copy() override {
+            return new VectorDocument(*this);
+        }
+
+
+        void init() {
+            docID = _docIDBuf = _rec.key();
+            readVersion();
+            addScope(_rec.body());
+            updateDocFields();
+            selectCurrentRevision();
+        }
+
+        void readVersion() {
+            decodeVersion(_rec.version(), _vector, _remotes);
+            // The kSynced flag is set, instead of updating the record, when the current revision
+            // is pushed to the default remote (see c4db_markSynced.)
+            if ((_rec.flags() & DocumentFlags::kSynced) && !_vector.empty())
+                _remotes[RevTree::kDefaultRemoteID] = _vector;
+        }
+
+        void updateDocFields() {
+            flags = (C4DocumentFlags)_rec.flags();
+            if (_rec.exists())
+                flags = (C4DocumentFlags)(flags | kDocExists);
+            _revIDBuf = _vector.empty() ? alloc_slice() : _vector.current().asASCII();
+            revID = _revIDBuf;
+            sequence = _rec.sequence();
+        }
+
+        bool exists() override {
+            return _rec.exists();
+        }
+
+        bool revisionsLoaded() const noexcept override {
+            return !_rec.exists() || _rec.body().buf || _rec.bodySize() == 0;
+        }
+
+        // Reads the body, if the record was read as meta-only, and the conflicting revision.
+        void loadRevisions() override {
+            if (!revisionsLoaded()) {
+                _store.read(_rec);
+                readVersion();
+                addScope(_rec.body());
+                updateDocFields();
+                if (_selection == kCurrentRev)
+                    selectCurrentRevision();
+            }
+            if (!_conflictLoaded) {
+                _conflictLoaded = true;
+                if (_rec.flags() & DocumentFlags::kConflicted) {
+                    _conflict.setKey(_rec.key());
+                    if (conflictStore().read(_conflict)) {
+                        _conflictVector.readBinary(_conflict.version(), _conflict.version());
+                        _conflictRevID = _conflictVector.current().asASCII();
+                        addScope(_conflict.body());
+                    } else {
+                        Warn("Conflicting revision of doc \"%.*s\" is missing", SPLAT(docID));
+                    }
+                }
+            }
+        }
+
+        // Version of loadRevisions for noexcept methods; returns false if it fails.
+        bool loadRevisionsNoThrow() noexcept {
+            try {
+                loadRevisions();
+                return true;
+            } catch (const std::exception &x) {
+                Warn("Couldn't load revisions of doc \"%.*s\": %s", SPLAT(docID), x.what());
+                return false;
+            }
+        }
+
+        bool hasConflict() const {
+            return !_conflictVector.empty();
+        }
+
+
+#pragma mark - SELECTION:
+
+
+        enum Selection {kNoRev, kCurrentRev, kConflictRev};
+
+        bool select(Selection sel) noexcept {
+            _loadedBody = nullslice;
+            if (sel == kCurrentRev && _vector.empty())
+                sel = kNoRev;
+            else if (sel == kConflictRev && !hasConflict())
+                sel = kNoRev;
+            _selection = sel;
+            switch (sel) {
+                case kCurrentRev:
+                    _selectedRevIDBuf = _revIDBuf;
+                    selectedRev.flags = currentRevFlagsFromDocFlags(flags);
+                    if (_newRevision)
+                        selectedRev.flags |= kRevNew;
+                    selectedRev.sequence = _rec.sequence();
+                    selectedRev.body = _rec.body();
+                    break;
+                case kConflictRev:
+                    _selectedRevIDBuf = _conflictRevID;
+                    selectedRev.flags = kRevLeaf | kRevIsConflict;
+                    if (_conflict.flags() & DocumentFlags::kDeleted)
+                        selectedRev.flags |= kRevDeleted;
+                    if (_conflict.flags() & DocumentFlags::kHasAttachments)
+                        selectedRev.flags |= kRevHasAttachments;
+                    selectedRev.sequence = 0;       // (only the doc's sequence is persistent)
+                    selectedRev.body = _conflict.body();
+                    break;
+                case kNoRev:
+                    clearSelectedRevision();
+                    return false;
+            }
+            selectedRev.revID = _selectedRevIDBuf;
+            return true;
+        }
+
+        const VersionVector* selectedVector() const {
+            switch (_selection) {
+                case kCurrentRev:   return &_vector;
+                case kConflictRev:  return &_conflictVector;
+                default:            return nullptr;
+            }
+        }
+
+        // A revision may be identified by its current Version or by its entire vector.
+        static bool matches(slice revID, slice myRevID) {
+            auto comma = revID.findByte(',');
+            if (comma)
+                revID = slice(revID.buf, comma);
+            return myRevID.buf && revID == myRevID;
+        }
+
+        bool selectRevision(C4Slice revID, bool withBody) override {
+            if (!revID.buf) {
+                select(kNoRev);
+                return true;
+            }
+            if (!matches(revID, _revIDBuf) || !revisionsLoaded()) {
+                loadRevisions();
+                if (hasConflict() && matches(revID, _conflictRevID))
+                    return select(kConflictRev);
+                if (!matches(revID, _revIDBuf))
+                    return false;
+            }
+            select(kCurrentRev);
+            if (withBody)
+                loadSelectedRevBody();
+            return true;
+        }
+
+        bool selectCurrentRevision() noexcept override {
+            return select(kCurrentRev);
+        }
+
+        bool selectParentRevision() noexcept override {
+            // Ancestors aren't kept.
+            select(kNoRev);
+            return false;
+        }
+
+        bool selectNextRevision() noexcept override {
+            if (!loadRevisionsNoThrow())
+                return false;
+            return select(_selection == kCurrentRev ? kConflictRev : kNoRev);
+        }
+
+        bool selectNextLeafRevision(bool includeDeleted) noexcept override {
+            if (!selectNextRevision())
+                return false;
+            if (!includeDeleted && (selectedRev.flags & kRevDeleted))
+                return select(kNoRev);
+            return true;
+        }
+
+        bool hasRevisionBody() noexcept override {
+            return selectedRev.body.buf != nullptr;
+        }
+
+        bool loadSelectedRevBody() override {
+            if (!selectedRev.body.buf && _selection != kNoRev) {
+                loadRevisions();
+                select(_selection);
+            }
+            return selectedRev.body.buf != nullptr;
+        }
+
+        // The history of a revision is its version vector. It can't be truncated without losing
+        // information, so maxRevs is ignored (unless it's 0), as are backToRevs.
+        alloc_slice getSelectedRevHistory(unsigned maxRevs,
+                                          const slice backToRevs[],
+                                          unsigned backToRevsCount) override
+        {
+            auto vector = selectedVector();
+            if (!vector || maxRevs == 0)
+                return {};
+            return vector->asASCII();
+        }
+
+        alloc_slice remoteAncestorRevID(C4RemoteID remote) override {
+            auto i = _remotes.find(remote);
+            if (i == _remotes.end() || i->second.empty())
+                return alloc_slice();
+            return i->second.current().asASCII();
+        }
+
+        void setRemoteAncestorRevID(C4RemoteID remote) override {
+            auto vector = selectedVector();
+            if (vector)
+                _remotes[remote] = *vector;
+            else
+                _remotes.erase(remote);
+            _changed = true;
+        }
+
+        Retained<Doc> fleeceDoc() override {
+            slice body = selectedRev.body;
+            if (!body)
+                return nullptr;
+            return new Doc(scopeFor(body), body, Doc::kTrusted);
+        }
+
+
+#pragma mark - SAVING:
+
+
+        bool save(unsigned maxRevTreeDepth =0) override {
+            requireValidDocID();
+            if (!_changed)
+                return true;
+            loadRevisions();                // don't save a meta-only record without its body
+            Transaction &t = _db->transaction();
+            sequence_t seq = _rec.sequence();
+            if (_vector.empty()) {
+                // All revisions have been purged:
+                if (seq && !_store.del(_rec.key(), t, seq))
+                    return false;
+                saveConflict(t);
+                _db->uncacheDocument(_rec.key());
+                _db->updateBlobReferences(_rec.key(), {});
+                _changed = _newRevision = false;
+                return true;
+            }
+
+            // The kSynced flag is already accounted for in _remotes:
+            _rec.clearFlag(DocumentFlags::kSynced);
+            bool newSequence = (seq == 0 || _newRevision);
+            alloc_slice version = encodeVersion(_vector, _remotes);
+            seq = _store.set(_rec.key(), version, _rec.body(), _rec.flags(),
+                             t, &seq, newSequence);
+            if (!seq)
+                return false;               // Conflict
+            saveConflict(t);
+            // (_vector and _remotes retain the old version, so they don't need to be re-read)
+            _rec.setVersion(version);
+            _rec.updateSequence(seq);
+            _rec.setExists();
+            _changed = false;
+            updateDocFields();
+            if (newSequence) {
+                _newRevision = false;
+                selectedRev.flags &= ~kRevNew;
+            }
+            if (newSequence && _selection != kNoRev) {
+                selectedRev.sequence = seq;
+                _db->saved(this);
+            } else {
+                _db->uncacheDocument(_rec.key());   // (the SequenceTracker won't know about it)
+            }
+            _db->updateBlobReferences(_rec.key(), storedBlobKeys());
+            return true;
+        }
+
+        // Returns the keys of the blobs used by the current and conflicting revisions.
+        vector<blobKey> storedBlobKeys() {
+            vector<blobKey> blobs;
+            addBlobKeys(_rec, blobs);
+            if (hasConflict())
+                addBlobKeys(_conflict, blobs);
+            return blobs;
+        }
+
+        void addBlobKeys(const Record &rec, vector<blobKey> &blobs) {
+            slice body = rec.body();
+            if (!(rec.flags() & DocumentFlags::kHasAttachments) || !body)
+                return;
+            Retained<Doc> doc = new Doc(scopeFor(body), body, Doc::kTrusted);
+            Document::findBlobKeys(doc->asDict(), blobs);
+        }
+
+        void saveConflict(Transaction &t) {
+            if (!_conflictChanged)
+                return;
+            if (hasConflict())
+                conflictStore().set(_rec.key(), _conflict.version(), _conflict.body(),
+                                    _conflict.flags(), t);
+            else
+                conflictStore().del(_rec.key(), t);
+            _conflictChanged = false;
+        }
+
+        KeyStore& conflictStore() const {
+            return _store.dataFile().getKeyStore(conflictStoreName(_store),
+                                                 KeyStore::Capabilities::defaults);
+        }
+
+
+#pragma mark - INSERTING REVISIONS:
+
+
+        static alloc_slice requestBody(const C4DocPutRequest &rq) {
+            return (rq.allocedBody.buf)? rq.allocedBody : alloc_slice(rq.body);
+        }
+
+        void setCurrentRevision(const VersionVector &vector, const alloc_slice &body,
+                                C4RevisionFlags revFlags)
+        {
+            _vector = vector;
+            _rec.setBody(body);
+            addScope(body);
+            DocumentFlags docFlags = docFlagsFromRevFlags(revFlags);
+            if (hasConflict())
+                docFlags = docFlags | DocumentFlags::kConflicted;
+            _rec.setFlags(docFlags);
+            _changed = _newRevision = true;
+            updateDocFields();
+            select(kCurrentRev);
+        }
+
+        void setConflict(const VersionVector &vector, const alloc_slice &body,
+                         C4RevisionFlags revFlags)
+        {
+            _conflict.clear();
+            _conflict.setKey(_rec.key());
+            _conflict.setVersion(vector.asBinary());
+            _conflict.setBody(body);
+            _conflict.setFlags(docFlagsFromRevFlags(revFlags));
+            _conflictVector = vector;
+            _conflictRevID = vector.current().asASCII();
+            addScope(body);
+            _rec.setFlag(DocumentFlags::kConflicted);
+            _conflictChanged = _changed = _newRevision = true;
+            updateDocFields();
+            select(kConflictRev);
+        }
+
+        void clearConflict() {
+            if (!hasConflict())
+                return;
+            _conflict.clear();
+            _conflictVector = VersionVector();
+            _conflictRevID = nullslice;
+            _rec.clearFlag(DocumentFlags::kConflicted);
+            _conflictChanged = _changed = true;
+            updateDocFields();
+            if (_selection == kConflictRev)
+                select(kNoRev);
+        }
+
+        static VersionVector vectorFromHistory(const C4String history[], size_t count) {
+            if (count == 1)
+                return VersionVector(history[0]);
+            string ascii;
+            for (size_t i = 0; i < count; ++i) {
+                if (i > 0)
+                    ascii += ',';
+                ascii.append((const char*)history[i].buf, history[i].size);
+            }
+            return VersionVector(slice(ascii));
+        }
+
+
+        // The history is a version vector, either as one string or split into its Versions.
+        int32_t putExistingRevision(const C4DocPutRequest &rq) override {
+            Assert(rq.historyCount >= 1);
+            loadRevisions();
+            VersionVector newVector = vectorFromHistory(rq.history, rq.historyCount);
+            alloc_slice body = requestBody(rq);
+
+            int32_t added = 1;
+            versionOrder order = newVector.compareTo(_vector);
+            if (order == kSame || order == kOlder) {
+                // I already have this revision, or a newer one:
+                added = 0;
+                select(kCurrentRev);
+            } else if (order == kNewer) {
+                setCurrentRevision(newVector, body, rq.revFlags);
+                if (hasConflict() && newVector.compareTo(_conflictVector) == kNewer) {
+                    // It's newer than the conflicting revision too, so it resolves the conflict:
+                    clearConflict();
+                    select(kCurrentRev);
+                }
+            } else if (!hasConflict()) {
+                setConflict(newVector, body, rq.revFlags);
+            } else {
+                order = newVector.compareTo(_conflictVector);
+                if (order == kSame || order == kOlder) {
+                    added = 0;
+                    select(kConflictRev);
+                } else {
+                    if (order == kConflicting)
+                        LogTo(DBLog, "Doc \"%.*s\" has another conflicting revision %.*s; "
+                                     "replacing %.*s",
+                              SPLAT(docID), SPLAT(newVector.current().asASCII()),
+                              SPLAT(_conflictRevID));
+                    setConflict(newVector, body, rq.revFlags);
+                }
+            }
+
+            if (rq.remoteDBID) {
+                _remotes[rq.remoteDBID] = newVector;
+                _changed = true;
+            }
+
+            if (!saveNewRev(rq, (added > 0 || rq.remoteDBID)))
+                return -1;
+            return added;
+        }
+
+
+        bool putNewRevision(const C4DocPutRequest &rq) override {
+            if (rq.remoteDBID != 0)
+                error::_throw(error::InvalidParameter, "remoteDBID cannot be used when existing=false");
+            loadRevisions();
+            alloc_slice body = requestBody(rq);
+            if (!body)
+                body = alloc_slice{Dict::kEmpty, 2};
+            alloc_slice myPeerID = _db->myPeerID();
+
+            if (_selection == kConflictRev) {
+                // Updating the conflicting revision keeps it in conflict:
+                if (!rq.allowConflict)
+                    error::_throw(error::Conflict);
+                VersionVector newVector = _conflictVector;
+                newVector.incrementGen(myPeerID);
+                setConflict(newVector, body, rq.revFlags);
+            } else {
+                // (If nothing's selected, this replaces a deleted revision, or creates the doc.)
+                VersionVector newVector = _vector;
+                newVector.incrementGen(myPeerID);
+                setCurrentRevision(newVector, body, rq.revFlags);
+            }
+            return saveNewRev(rq);
+        }
+
+
+        bool saveNewRev(const C4DocPutRequest &rq, bool reallySave =true) {
+            if (rq.save && reallySave)
+                return save();
+            return true;
+        }
+
+
+        void resolveConflict(C4String winningRevID, C4String losingRevID,
+                             C4Slice mergedBody, C4RevisionFlags mergedFlags) override
+        {
+            loadRevisions();
+            bool currentWins;
+            if (!hasConflict())
+                error::_throw(error::NotFound);
+            else if (matches(winningRevID, _revIDBuf) && matches(losingRevID, _conflictRevID))
+                currentWins = true;
+            else if (matches(winningRevID, _conflictRevID) && matches(losingRevID, _revIDBuf))
+                currentWins = false;
+            else if (slice(winningRevID) == slice(losingRevID))
+                error::_throw(error::InvalidParameter);
+            else
+                error::_throw(error::NotFound);
+
+            alloc_slice body;
+            C4RevisionFlags revFlags;
+            if (mergedBody.buf) {
+                body = alloc_slice(mergedBody);
+                revFlags = mergedFlags & (kRevDeleted | kRevHasAttachments);
+            } else if (currentWins) {
+                body = _rec.body();
+                revFlags = currentRevFlagsFromDocFlags(flags) & (kRevDeleted | kRevHasAttachments);
+            } else {
+                body = _conflict.body();
+                revFlags = 0;
+                if (_conflict.flags() & DocumentFlags::kDeleted)
+                    revFlags |= kRevDeleted;
+                if (_conflict.flags() & DocumentFlags::kHasAttachments)
+                    revFlags |= kRevHasAttachments;
+            }
+
+            // The resolved revision has to be newer than both, so peers will accept it:
+            VersionVector merged = _vector;
+            merged.mergeWith(_conflictVector);
+            merged.incrementGen(_db->myPeerID());
+            clearConflict();
+            setCurrentRevision(merged, body, revFlags);
+        }
+
+
+        int32_t purgeRevision(C4Slice revID) override {
+            loadRevisions();
+            int32_t total = 0;
+            if (!revID.buf) {
+                total = (_vector.empty() ? 0 : 1) + (hasConflict() ? 1 : 0);
+                clearConflict();
+                _vector = VersionVector();
+                _remotes.clear();
+            } else if (hasConflict() && matches(revID, _conflictRevID)) {
+                clearConflict();
+                total = 1;
+            } else if (!_vector.empty() && matches(revID, _revIDBuf)) {
+                if (hasConflict()) {
+                    // The conflicting revision becomes current:
+                    VersionVector vector = _conflictVector;
+                    alloc_slice body = _conflict.body();
+                    C4RevisionFlags revFlags = 0;
+                    if (_conflict.flags() & DocumentFlags::kDeleted)
+                        revFlags |= kRevDeleted;
+                    if (_conflict.flags() & DocumentFlags::kHasAttachments)
+                        revFlags |= kRevHasAttachments;
+                    clearConflict();
+                    setCurrentRevision(vector, body, revFlags);
+                } else {
+                    _vector = VersionVector();
+                    _remotes.clear();
+                }
+                total = 1;
+            }
+            if (total > 0) {
+                _changed = true;
+                updateDocFields();
+                select(kCurrentRev);
+            }
+            return total;
+        }
+
+
+    private:
+        void addScope(const alloc_slice &body) {
+            // A Scope associates the SharedKeys with the Fleece data in the body, so Fleece Dict
+            // accessors can decode the int keys.
+            if (!body)
+                return;
+            for (auto &b : _bodies) {
+                if (b.buf == body.buf)
+                    return;
+            }
+            _bodies.push_back(body);
+            _fleeceScopes.emplace_back(body, _store.dataFile().documentKeys());
+        }
+
+        const Scope& scopeFor(slice s) const {
+            for (auto &scope : _fleeceScopes) {
+                if (scope.data().contains(s))
+                    return scope;
+            }
+            error::_throw(error::AssertionFailed, "VectorDocument has no scope for slice");
+        }
+
+        KeyStore&           _store;
+        Record              _rec;                       // Current revision
+        VersionVector       _vector;                    // Current revision's version vector
+        RemoteVersionMap    _remotes;                   // Versions current on remote DBs
+        bool                _conflictLoaded {false};    // Has the conflict store been checked?
+        Record              _conflict;                  // Conflicting revision, if any
+        VersionVector       _conflictVector;            // Conflicting revision's vector
+        alloc_slice         _conflictRevID;             // Conflicting revision's current Version
+        bool                _conflictChanged {false};   // Does the conflict store need updating?
+        Selection           _selection {kNoRev};
+        bool                _changed {false};           // Does the record need saving?
+        bool                _newRevision {false};       // Does it need a new sequence?
+        std::vector<alloc_slice> _bodies;               // Bodies the Scopes refer to
+        std::deque<Scope>   _fleeceScopes;
+    };
+
+
+#pragma mark - FACTORY:
+
+
+    Document* VectorDocumentFactory::newDocumentInstance(C4Slice docID) {
+        return new VectorDocument(database(), docID);
+    }
+
+    Document* VectorDocumentFactory::newDocumentInstance(const Record &doc) {
+        return new VectorDocument(database(), doc);
+    }
+
+    alloc_slice VectorDocumentFactory::revIDFromVersion(slice version) {
+        return VersionVector::readCurrentVersionFromBinary(version).asASCII();
+    }
+
+
+    // Reads just a document's flags, without copying its key or version into a Record.
+    static DocumentFlags storedFlags(KeyStore &store, slice docID) {
+        DocumentFlags flags = DocumentFlags::kNone;
+        store.get(docID, kMetaOnly, [&](const RecordLite &rec) {
+            flags = rec.flags;
+        });
+        return flags;
+    }
+
+
+    /*static*/ void VectorDocumentFactory::purgeConflict(KeyStore &store, slice docID,
+                                                         Transaction &t)
+    {
+        if (storedFlags(store, docID) & DocumentFlags::kConflicted)
+            store.dataFile().getKeyStore(conflictStoreName(store), KeyStore::Capabilities::defaults)
+                 .del(docID, t);
+    }
+
+
+    /*static*/ unsigned VectorDocumentFactory::deleteOrphanedConflicts(KeyStore &store,
+                                                                       Transaction &t)
+    {
+        string storeName = conflictStoreName(store);
+        if (!store.dataFile().keyStoreExists(storeName))
+            return 0;
+        KeyStore &conflicts = store.dataFile().getKeyStore(storeName,
+                                                            KeyStore::Capabilities::defaults);
+        vector<alloc_slice> orphans;
+        {
+            RecordEnumerator::Options options;
+            options.contentOptions = kMetaOnly;
+            RecordEnumerator e(conflicts, options);
+            while (e.next()) {
+                if (!(storedFlags(store, e->key()) & DocumentFlags::kConflicted))
+                    orphans.emplace_back(e->key());
+            }
+        }
+        for (auto &key : orphans)
+            conflicts.del(key, t);
+        return (unsigned)orphans.size();
+    }
+
+
+#pragma mark - UPGRADING REV-TREES:
+
+
+    // A rev-tree revision becomes a vector of legacy Versions "<gen>@-<digest>": its own,
+    // followed by its ancestors' as far back as the tree kept them. That's the same on every
+    // peer that upgrades, and comparing the vectors follows the rev tree's ancestry, so peers
+    // that upgraded at different revisions of a document don't see spurious conflicts.
+    static VersionVector vectorFromRev(const Rev *rev) {
+        string ascii;
+        vector<alloc_slice> digests;
+        for (; rev; rev = rev->parent) {
+            alloc_slice revID = rev->revID.expanded();
+            auto dash = (const char*)revID.findByte('-');
+            if (!dash)
+                error::_throw(error::BadRevisionID);
+            slice digest(dash, revID.end());
+            if (find(digests.begin(), digests.end(), digest) != digests.end())
+                continue;       // a peer can only appear once in a vector
+            digests.emplace_back(digest);
+            if (!ascii.empty())
+                ascii += ',';
+            ascii.append((const char*)revID.buf, dash - (const char*)revID.buf);
+            ascii += '@';
+            ascii.append((const char*)digest.buf, digest.size);
+        }
+        return VersionVector(slice(ascii));
+    }
+
+
+    /*static*/ unsigned VectorDocumentFactory::upgradeRevTrees(KeyStore &store, Transaction &t) {
+        static constexpr size_t kBatchSize = 1000;
+        unsigned count = 0;
+        sequence_t lastSequence = 0;
+        bool finished = false;
+        while (!finished) {
+            // Read a batch first, so that writing doesn't disturb the enumerator. Records keep
+            // their sequences, so the next batch starts where this one left off:
+            vector<Record> batch;
+            {
+                RecordEnumerator::Options options;
+                options.includeDeleted = true;
+                RecordEnumerator e(store, lastSequence, options);
+                while (batch.size() < kBatchSize && e.next())
+                    batch.push_back(e.record());
+            }
+            finished = (batch.size() < kBatchSize);
+
+            for (auto &rec : batch) {
+                lastSequence = rec.sequence();
+                VersionedDocument tree(store, rec);
+                const Rev *current = tree.currentRevision();
+                if (!current)
+                    continue;
+
+                RemoteVersionMap remotes;
+                for (auto &remote : tree.remoteRevisions())
+                    remotes[remote.first] = vectorFromRev(remote.second);
+
+                // Keep the best conflicting leaf revision, if its body is available:
+                DocumentFlags flags = rec.flags() & DocumentFlags::kHasAttachments
+                                        ? DocumentFlags::kHasAttachments : DocumentFlags::kNone;
+                if (current->isDeleted())
+                    flags = flags | DocumentFlags::kDeleted;
+                if (rec.flags() & DocumentFlags::kConflicted) {
+                    for (auto rev : tree.allRevisions()) {
+                        if (rev != current && rev->isActive() && tree.loadBody(rev)) {
+                            DocumentFlags revFlags = rev->hasAttachments()
+                                        ? DocumentFlags::kHasAttachments : DocumentFlags::kNone;
+                            store.dataFile().getKeyStore(conflictStoreName(store),
+                                                         KeyStore::Capabilities::defaults)
+                                 .set(rec.key(), vectorFromRev(rev).asBinary(),
+                                      rev->body(), revFlags, t);
+                            flags = flags | DocumentFlags::kConflicted;
+                            break;
+                        }
+                    }
+                }
+
+                sequence_t seq = rec.sequence();
+                store.set(rec.key(), encodeVersion(vectorFromRev(current), remotes),
+                          current->body(), flags, t, &seq, false);
+                ++count;
+            }
+        }
+
+        // Bodies of non-current tree revisions are no longer needed:
+        string bodyStoreName = VersionedDocument::externalBodyStoreName(store);
+        if (store.dataFile().keyStoreExists(bodyStoreName)) {
+            KeyStore &bodies = store.dataFile().getKeyStore(bodyStoreName,
+                                                            KeyStore::Capabilities::defaults);
+            vector<alloc_slice> keys;
+            {
+                RecordEnumerator::Options options;
+                options.contentOptions = kMetaOnly;
+                RecordEnumerator e(bodies, options);
+                while (e.next())
+                    keys.emplace_back(e->key());
+            }
+            for (auto &key : keys)
+                bodies.del(key, t);
+        }
+        return count;
+    }
+
+} // end namespace c4Internal
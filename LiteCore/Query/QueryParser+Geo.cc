@@ -0,0 +1,141 @@
+//
+// QueryParser+Geo.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "QueryParser.hh"
+#include "QueryParser+Private.hh"
+#include "FleeceImpl.hh"
+#include "StringUtil.hh"
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+using namespace litecore::qp;
+
+namespace litecore {
+
+
+    // Looks for WITHIN_BOX and WITHIN_RADIUS at the top level of a WHERE clause (or inside a
+    // top-level AND), and adds join tables for the ones whose coordinates are indexed.
+    // The join is an inner join, so it can't be used for a test nested in an OR or NOT; those
+    // are evaluated without the index, unless the same coordinates are also tested at top level.
+    void QueryParser::findGeoCalls(const Value *node) {
+        auto operation = node->asArray();
+        if (!operation || operation->count() == 0)
+            return;
+        slice op = operation->get(0)->asString();
+        if (op.caseEquivalent("AND"_sl)) {
+            Array::iterator i(operation);
+            for (++i; i; ++i)
+                findGeoCalls(i.value());
+        } else if (op.caseEquivalent(kWithinBoxOpName) || op.caseEquivalent(kWithinRadiusOpName)) {
+            Array::iterator latLon(operation);
+            ++latLon;
+            if (latLon.count() >= 2)
+                geoJoinTableAlias(latLon, true);
+        }
+    }
+
+
+    // Looks up or adds a join alias for the R*Tree table indexing a pair of lat/lon expressions.
+    const string& QueryParser::geoJoinTableAlias(Array::iterator latLon, bool canAdd) {
+        string table = geoTableName(latLon);
+        if (canAdd && !_delegate.tableExists(table))
+            canAdd = false; // not indexed
+        return indexJoinTableAlias(table, (canAdd ? "geo" : nullptr));
+    }
+
+
+    // Returns the name of the R*Tree table indexing the lat/lon expressions at the iterator.
+    string QueryParser::geoTableName(Array::iterator latLon) const {
+        require(latLon.count() >= 2, "Geospatial expression needs a latitude and a longitude");
+        return _delegate.geoTableName(expressionIdentifier(latLon, 2));
+    }
+
+
+    // Handles ["WITHIN_BOX", lat, lon, minLat, minLon, maxLat, maxLon]
+    void QueryParser::withinBoxOp(slice op, Array::iterator& operands) {
+        auto &alias = geoJoinTableAlias(operands);
+        if (!alias.empty()) {
+            // Let the R*Tree find the candidates. It stores 32-bit floats rounded outwards, so
+            // the exact comparisons below are still needed to reject points just outside the box.
+            _sql << alias << ".minLat <= ";
+            parseNode(operands[4]);
+            _sql << " AND " << alias << ".maxLat >= ";
+            parseNode(operands[2]);
+            _sql << " AND " << alias << ".minLon <= ";
+            parseNode(operands[5]);
+            _sql << " AND " << alias << ".maxLon >= ";
+            parseNode(operands[3]);
+            _sql << " AND ";
+        }
+        parseNode(operands[0]);
+        _sql << " BETWEEN ";
+        parseNode(operands[2]);
+        _sql << " AND ";
+        parseNode(operands[4]);
+        _sql << " AND ";
+        parseNode(operands[1]);
+        _sql << " BETWEEN ";
+        parseNode(operands[3]);
+        _sql << " AND ";
+        parseNode(operands[5]);
+    }
+
+
+    // Handles ["WITHIN_RADIUS", lat, lon, centerLat, centerLon, radiusInMeters]
+    void QueryParser::withinRadiusOp(slice op, Array::iterator& operands) {
+        auto &alias = geoJoinTableAlias(operands);
+        if (!alias.empty()) {
+            // Narrow the candidates to the circle's bounding box using the R*Tree:
+            writeGeoBoxBound(alias, "minLat", "<=", "maxLat", operands);
+            writeGeoBoxBound(alias, "maxLat", ">=", "minLat", operands);
+            writeGeoBoxBound(alias, "minLon", "<=", "maxLon", operands);
+            writeGeoBoxBound(alias, "maxLon", ">=", "minLon", operands);
+        }
+        _context.push_back(&kArgListOperation);     // prevents extra parens around operands
+        _sql << kGeoDistanceFnName << "(";
+        for (unsigned i = 0; i < 4; ++i) {
+            if (i > 0)
+                _sql << ", ";
+            parseNode(operands[i]);
+        }
+        _sql << ")";
+        _context.pop_back();
+        _sql << " <= ";
+        parseNode(operands[4]);
+    }
+
+
+    // Writes a comparison of an R*Tree column with one bound of a WITHIN_RADIUS circle's
+    // bounding box, followed by " AND ".
+    void QueryParser::writeGeoBoxBound(const string &alias, const char *column,
+                                       const char *comparison, const char *bound,
+                                       Array::iterator &operands)
+    {
+        _sql << alias << "." << column << " " << comparison << " " << kGeoBoxFnName << "(";
+        _context.push_back(&kArgListOperation);
+        parseNode(operands[2]);
+        _sql << ", ";
+        parseNode(operands[3]);
+        _sql << ", ";
+        parseNode(operands[4]);
+        _context.pop_back();
+        _sql << ", '" << bound << "') AND ";
+    }
+
+}
@@ -48,9 +48,23 @@ namespace litecore { namespace qp {
 
     constexpr slice kArrayCountFnName = "array_count"_sl;
 
+    // Sort keys of Unicode collations, in SQLiteCollationFunctions.cc:
+    constexpr slice kCollationKeyFnName = "collation_key"_sl;
+
     constexpr slice kPredictionFnName = "prediction"_sl;
     constexpr slice kPredictionFnNameWithParens = "prediction()"_sl;
 
+    // Geospatial operators, and the SQLite functions they use (in SQLiteGeoFunctions.cc):
+    constexpr slice kWithinBoxOpName = "WITHIN_BOX"_sl;
+    constexpr slice kWithinRadiusOpName = "WITHIN_RADIUS"_sl;
+    constexpr slice kGeoDistanceFnName = "geo_distance"_sl;
+    constexpr slice kGeoBoxFnName = "geo_box"_sl;
+
+    // Vector operator, and the SQLite functions it uses (in SQLiteVectorFunctions.cc):
+    constexpr slice kVectorMatchOpName = "VECTOR_MATCH"_sl;
+    constexpr slice kVectorDistanceFnName = "vector_distance"_sl;
+    constexpr slice kVectorIndexDistanceFnName = "vector_index_distance"_sl;
+
     const char* const kDefaultTableAlias = "_doc";
 
 
@@ -77,4 +91,6 @@ namespace litecore { namespace qp {
     unsigned findNodes(const Value *root, fleece::slice op, unsigned argCount,
                        function_ref<void(const Array*)> callback);
 
+    string quoteTableName(const string &name);
+
 } }
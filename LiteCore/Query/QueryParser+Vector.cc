@@ -0,0 +1,89 @@
+//
+// QueryParser+Vector.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "QueryParser.hh"
+#include "QueryParser+Private.hh"
+#include "FleeceImpl.hh"
+#include "StringUtil.hh"
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+using namespace litecore::qp;
+
+namespace litecore {
+
+
+    // Returns the name of the table indexing the vector expression at the iterator.
+    string QueryParser::vectorTableName(Array::iterator vectorExpr) const {
+        require(vectorExpr, "Missing vector expression");
+        return _delegate.vectorTableName(expressionIdentifier(vectorExpr, 1));
+    }
+
+
+    // Handles ["VECTOR_MATCH", vector, targetVector, maxResults, metric?]
+    // This is true of the `maxResults` documents whose vectors are nearest the target, by the
+    // metric 'cosine' (the default), 'euclidean' or 'dot'. It's written as a subquery that ranks
+    // the candidates; if the vector expression is indexed, that scans the index's packed vectors,
+    // otherwise it has to scan (and parse) every document.
+    // To order the results by distance, use `vector_distance()` in the ORDER BY clause.
+    // The `maxResults` nearest are chosen before any other WHERE terms are applied, so if it's
+    // ANDed with other conditions the query can return fewer than `maxResults` rows; the caller
+    // should over-fetch (raise `maxResults`) to compensate.
+    void QueryParser::vectorMatchOp(slice op, Array::iterator& operands) {
+        slice metric = "cosine"_sl;
+        if (operands.count() > 3) {
+            metric = requiredString(operands[3], "VECTOR_MATCH metric");
+            require(metric == "cosine"_sl || metric == "euclidean"_sl || metric == "dot"_sl,
+                    "Unknown VECTOR_MATCH metric '%.*s'", SPLAT(metric));
+        }
+
+        string prefix;
+        if (!_dbAlias.empty())
+            prefix = quoteTableName(_dbAlias) + ".";
+        _sql << prefix << "rowid IN (SELECT docid FROM (SELECT ";
+
+        _context.push_back(&kArgListOperation);     // prevents extra parens around operands
+        string vectorTable = vectorTableName(operands);
+        if (_delegate.tableExists(vectorTable)) {
+            _sql << "docid, " << kVectorIndexDistanceFnName << "(vector, ";
+            parseNode(operands[1]);
+            _sql << ", ";
+            writeSQLString(_sql, metric);
+            _sql << ") AS distance FROM \"" << vectorTable << "\"";
+        } else {
+            // The subquery reuses the main alias, so the vector expression refers to its table:
+            _sql << prefix << "rowid AS docid, " << kVectorDistanceFnName << "(";
+            parseNode(operands[0]);
+            _sql << ", ";
+            parseNode(operands[1]);
+            _sql << ", ";
+            writeSQLString(_sql, metric);
+            _sql << ") AS distance FROM " << _tableName;
+            if (!_dbAlias.empty())
+                _sql << " AS " << quoteTableName(_dbAlias);
+            _sql << " WHERE ";
+            writeDeletionTest(_dbAlias);
+        }
+        _sql << ") WHERE distance NOT NULL ORDER BY distance LIMIT ";
+        parseNode(operands[2]);
+        _context.pop_back();
+        _sql << ")";
+    }
+
+}
@@ -80,6 +80,13 @@ namespace litecore {
             }
             return n;
         }
+
+        string quoteTableName(const string &name) {
+            if (name == kDefaultTableAlias)
+                return name;
+            else
+                return string("\"") + name + "\"";
+        }
     }
     
     static bool isAlphanumericOrUnderscore(slice str) {
@@ -131,14 +138,6 @@ namespace litecore {
         out << quote;
     }
 
-
-    static string quoteTableName(const string &name) {
-        if (name == kDefaultTableAlias)
-            return name;
-        else
-            return string("\"") + name + "\"";
-    }
-
     
 #pragma mark - QUERY PARSER TOP LEVEL:
 
@@ -217,6 +216,9 @@ namespace litecore {
                     "Sorry, multiple MATCHes of the same property are not allowed");
             if (numMatches > 0)
                 _baseResultColumns.push_back(_dbAlias + ".rowid");
+
+            // Likewise, indexed geospatial tests need their R*Tree tables joined:
+            findGeoCalls(where);
         }
 
         _sql << "SELECT ";
@@ -557,6 +559,13 @@ namespace litecore {
     void QueryParser::parseCollatableNode(const Value *node) {
         if (_collationUsed) {
             parseNode(node);
+        } else if (_collationSortKey) {
+            // The operands of a comparison become sort keys, so comparing them applies the
+            // collation; other operations (like function calls) pass it on to their operands:
+            if (inComparison())
+                writeCollationKey(node);
+            else
+                parseNode(node);
         } else {
             _collationUsed = true;
             // enforce proper parenthesization; SQL COLLATE has super high precedence
@@ -573,6 +582,33 @@ namespace litecore {
     }
 
 
+    // Is the current operation a comparison? (The items of an `IN` list count too.)
+    bool QueryParser::inComparison() const {
+        auto ctx = _context.back();
+        if (ctx == &kArgListOperation && _context.size() >= 2)
+            ctx = _context[_context.size() - 2];
+        slice op = ctx->op;
+        return op == "="_sl || op == "!="_sl || op == "<"_sl || op == "<="_sl || op == ">"_sl
+            || op == ">="_sl || op == "IS"_sl || op == "IS NOT"_sl || op == "IN"_sl
+            || op == "NOT IN"_sl || op == "BETWEEN"_sl;
+    }
+
+
+    // Writes the expression's binary sort key under the current collation.
+    void QueryParser::writeCollationKey(const Value *node) {
+        _sql << kCollationKeyFnName << "(";
+        _collationUsed = true;                      // nothing nested needs the collation
+        _context.push_back(&kArgListOperation);
+        parseNode(node);
+        _context.pop_back();
+        _collationUsed = false;
+        _sql << ", ";
+        writeSQLString(_sql, slice(_collation.sqliteName()));
+        _sql << ")";
+        _collationKeyWritten = true;
+    }
+
+
     void QueryParser::parseOpNode(const Array *node) {
         Array::iterator array(node);
         require(array.count() > 0, "Empty JSON array");
@@ -765,12 +801,16 @@ namespace litecore {
     void QueryParser::collateOp(slice op, Array::iterator& operands) {
         auto outerCollation = _collation;
         auto outerCollationUsed = _collationUsed;
+        auto outerCollationSortKey = _collationSortKey;
+        auto outerCollationKeyWritten = _collationKeyWritten;
 
         // Apply the collation options, overriding the inherited ones:
         const Dict *options = requiredDict(operands[0], "COLLATE options");
         setFlagFromOption(_collation.unicodeAware,       options, "UNICODE"_sl);
         setFlagFromOption(_collation.caseSensitive,      options, "CASE"_sl);
         setFlagFromOption(_collation.diacriticSensitive, options, "DIAC"_sl);
+        bool sortKey = false;
+        setFlagFromOption(sortKey, options, "SORTKEY"_sl);
 
         auto localeName = getCaseInsensitive(options, "LOCALE"_sl);
         if (localeName)
@@ -781,19 +821,42 @@ namespace litecore {
         auto curContext = _context.back();
         _context.pop_back();
 
-        // Parse the expression:
-        parseNode(operands[1]);
+        _collationSortKey = sortKey && _collation.unicodeAware && SupportsCollationSortKeys();
+        if (_collationSortKey) {
+            // Values are replaced by their binary sort keys, so that sorting and comparing them
+            // (and indexing them) don't need to call the collator. The operands of a comparison
+            // (including BETWEEN and IN) are converted individually:
+            _collationKeyWritten = false;
+            auto start = _sql.tellp();
+            parseNode(operands[1]);
+            if (!_collationKeyWritten) {
+                // ...if there aren't any, as in an ORDER BY or an index, the entire expression is:
+                string sql = _sql.str();
+                string expr = sql.substr(size_t(start));
+                sql.resize(size_t(start));
+                _sql.str(sql);
+                _sql.seekp(0, ios_base::end);
+                _sql << kCollationKeyFnName << "(" << expr << ", ";
+                writeSQLString(_sql, slice(_collation.sqliteName()));
+                _sql << ")";
+            }
+        } else {
+            // Parse the expression:
+            parseNode(operands[1]);
 
-        // If nothing in the expression (like a comparison operator) used the collation to generate
-        // a SQL 'COLLATE', generate one now for the entire expression:
-        if (!_collationUsed)
-            writeCollation();
+            // If nothing in the expression (like a comparison operator) used the collation to
+            // generate a SQL 'COLLATE', generate one now for the entire expression:
+            if (!_collationUsed)
+                writeCollation();
+        }
 
         _context.push_back(curContext);
 
         // Pop the collation options:
         _collation = outerCollation;
         _collationUsed = outerCollationUsed;
+        _collationSortKey = outerCollationSortKey;
+        _collationKeyWritten = outerCollationKeyWritten;
     }
 
 
@@ -801,9 +864,9 @@ namespace litecore {
     void QueryParser::betweenOp(slice op, Array::iterator& operands) {
         parseCollatableNode(operands[0]);
         _sql << ' ' << op << ' ';
-        parseNode(operands[1]);
+        parseCollatableNode(operands[1]);
         _sql << " AND ";
-        parseNode(operands[2]);
+        parseCollatableNode(operands[2]);
     }
 
 
@@ -828,7 +891,10 @@ namespace litecore {
             _sql << "array_contains(";
             parseNode(operands[1]);     // yes, operands are in reverse order
             _sql << ", ";
-            parseCollatableNode(operands[0]);
+            if (_collationSortKey)
+                parseNode(operands[0]);     // array_contains() can't compare sort keys
+            else
+                parseCollatableNode(operands[0]);
             _sql << ")";
 
             if (notIn)
@@ -1436,11 +1502,17 @@ namespace litecore {
     // Constructs a unique identifier of an expression, from a digest of its JSON.
     string QueryParser::expressionIdentifier(const Array *expression, unsigned maxItems) const {
         require(expression, "Invalid expression to index");
+        return expressionIdentifier(Array::iterator(expression), maxItems);
+    }
+
+
+    // Same as above, but digests the items starting at the iterator's current position.
+    string QueryParser::expressionIdentifier(Array::iterator i, unsigned maxItems) const {
         uint8_t digest[20];
         sha1Context ctx;
         sha1_begin(&ctx);
         unsigned item = 0;
-        for (Array::iterator i(expression); i; ++i) {
+        for (; i; ++i) {
             if (maxItems > 0 && ++item > maxItems)
                 break;
             alloc_slice json = i.value()->toJSON(true);
@@ -45,6 +45,8 @@ namespace litecore {
             virtual std::string bodyColumnName() const        {return "body";}
             virtual std::string FTSTableName(const std::string &property) const =0;
             virtual std::string unnestedTableName(const std::string &property) const =0;
+            virtual std::string geoTableName(const std::string &identifier) const =0;
+            virtual std::string vectorTableName(const std::string &identifier) const =0;
 #ifdef COUCHBASE_ENTERPRISE
             virtual std::string predictiveTableName(const std::string &property) const =0;
 #endif
@@ -84,6 +86,8 @@ namespace litecore {
         std::string eachExpressionSQL(const fleece::impl::Value*);
         static std::string FTSColumnName(const fleece::impl::Value *expression);
         std::string unnestedTableName(const fleece::impl::Value *key) const;
+        std::string geoTableName(fleece::impl::Array::iterator latLon) const;
+        std::string vectorTableName(fleece::impl::Array::iterator vectorExpr) const;
         std::string predictiveIdentifier(const fleece::impl::Value *) const;
         std::string predictiveTableName(const fleece::impl::Value *) const;
 
@@ -148,6 +152,9 @@ namespace litecore {
         void inOp(slice, fleece::impl::Array::iterator&);
         void matchOp(slice, fleece::impl::Array::iterator&);
         void anyEveryOp(slice, fleece::impl::Array::iterator&);
+        void withinBoxOp(slice, fleece::impl::Array::iterator&);
+        void withinRadiusOp(slice, fleece::impl::Array::iterator&);
+        void vectorMatchOp(slice, fleece::impl::Array::iterator&);
         void parameterOp(slice, fleece::impl::Array::iterator&);
         void propertyOp(slice, fleece::impl::Array::iterator&);
         void objectPropertyOp(slice, fleece::impl::Array::iterator&);
@@ -175,6 +182,8 @@ namespace litecore {
         void writeColumnList(fleece::impl::Array::iterator& operands);
         void writeResultColumn(const fleece::impl::Value*);
         void writeCollation();
+        void writeCollationKey(const fleece::impl::Value*);
+        bool inComparison() const;
         void parseCollatableNode(const fleece::impl::Value*);
         void writeMetaProperty(slice fn, const std::string &tablePrefix, const char *property);
 
@@ -182,13 +191,18 @@ namespace litecore {
 
         unsigned findFTSProperties(const fleece::impl::Value *root);
         void findPredictionCalls(const fleece::impl::Value *root);
+        void findGeoCalls(const fleece::impl::Value *where);
         const std::string& indexJoinTableAlias(const std::string &key, const char *aliasPrefix =nullptr);
         const std::string&  FTSJoinTableAlias(const fleece::impl::Value *matchLHS, bool canAdd =false);
         const std::string&  predictiveJoinTableAlias(const fleece::impl::Value *expr, bool canAdd =false);
         std::string FTSTableName(const fleece::impl::Value *key) const;
         std::string expressionIdentifier(const fleece::impl::Array *expression, unsigned maxItems =0) const;
+        std::string expressionIdentifier(fleece::impl::Array::iterator items, unsigned maxItems) const;
         void findPredictiveJoins(const fleece::impl::Value *node, std::vector<std::string> &joins);
         bool writeIndexedPrediction(const fleece::impl::Array *node);
+        const std::string& geoJoinTableAlias(fleece::impl::Array::iterator latLon, bool canAdd =false);
+        void writeGeoBoxBound(const std::string &alias, const char *column, const char *comparison,
+                              const char *bound, fleece::impl::Array::iterator &operands);
 
         const delegate& _delegate;                  // delegate object (SQLiteKeyStore)
         std::string _tableName;                     // Name of the table containing documents
@@ -212,6 +226,8 @@ namespace litecore {
         bool _checkedExpiration {false};            // Has query accessed _expiration meta-property?
         Collation _collation;                       // Collation in use during parse
         bool _collationUsed {true};                 // Emitted SQL "COLLATION" yet?
+        bool _collationSortKey {false};             // Is the collation applied via sort keys?
+        bool _collationKeyWritten {false};          // Emitted a sort key yet?
     };
 
 }
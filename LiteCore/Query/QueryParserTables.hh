@@ -81,6 +81,10 @@ namespace litecore {
         {"EVERY"_sl,   3, 3,  1,  &QueryParser::anyEveryOp},
         {"ANY AND EVERY"_sl, 3, 3,  1,  &QueryParser::anyEveryOp},
 
+        {"WITHIN_BOX"_sl,    6, 6,  2,  &QueryParser::withinBoxOp},
+        {"WITHIN_RADIUS"_sl, 5, 5,  2,  &QueryParser::withinRadiusOp},
+        {"VECTOR_MATCH"_sl,  3, 4,  3,  &QueryParser::vectorMatchOp},
+
         {"SELECT"_sl,  1, 1,  1,  &QueryParser::selectOp},
 
         {"DESC"_sl,    1, 1,  2,  &QueryParser::postfixOp},
@@ -192,6 +196,12 @@ namespace litecore {
         // FTS (not standard N1QL):
         {"rank"_sl,             1, 1},
 
+        // Geospatial (not standard N1QL):
+        {"geo_distance"_sl,     4, 4},
+
+        // Vectors (not standard N1QL):
+        {"vector_distance"_sl,  2, 3},
+
         // Aggregate functions:
         {"avg"_sl,              1, 1, nullslice, true},
         {"count"_sl,            0, 1, nullslice, true},
@@ -0,0 +1,102 @@
+//
+// SQLiteCollationFunctions.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteFleeceUtil.hh"
+#include "UnicodeCollator.hh"
+#include <sqlite3.h>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+using namespace fleece;
+using namespace std;
+
+namespace litecore {
+
+    // Per-statement state of collation_key(): the collator, plus the keys of recently seen
+    // strings, since sorted or indexed columns often contain many repeats.
+    class CollationKeyCache {
+    public:
+        static constexpr size_t kMaxEntries = 1000;
+
+        CollationKeyCache(const Collation &collation)
+        :_context(NewCollationContext(collation))
+        { }
+
+        alloc_slice sortKey(slice str) {
+            auto i = _keys.find(str);
+            if (i != _keys.end())
+                return i->second.second;
+            alloc_slice key = CollationSortKey(*_context, str);
+            if (_keys.size() >= kMaxEntries)
+                _keys.clear();
+            // The map's key points into the copy of the string kept in its value:
+            alloc_slice strCopy(str);
+            _keys.emplace(slice(strCopy), make_pair(strCopy, key));
+            return key;
+        }
+
+    private:
+        unique_ptr<CollationContext> _context;
+        unordered_map<slice, pair<alloc_slice, alloc_slice>, sliceHash> _keys;  // str -> (str, key)
+    };
+
+
+    // collation_key(value, collationName) returns the binary sort key of a string under a
+    // Unicode collation (given by its SQLite name, like "LCUnicode_C__en"), so that sorting and
+    // comparing become plain memcmp. Values that aren't strings are returned unchanged.
+    static void collation_key(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        try {
+            // The collation name is constant, so SQLite keeps the cache as its auxdata until the
+            // statement is done with it:
+            auto cache = (CollationKeyCache*)sqlite3_get_auxdata(ctx, 1);
+            unique_ptr<CollationKeyCache> newCache;
+            if (!cache) {
+                Collation collation;
+                auto name = (const char*)sqlite3_value_text(argv[1]);
+                if (!name || !collation.readSQLiteName(name)) {
+                    sqlite3_result_error(ctx, "collation_key: invalid collation name", -1);
+                    return;
+                }
+                newCache.reset(new CollationKeyCache(collation));
+                cache = newCache.get();
+            }
+            alloc_slice key = cache->sortKey(valueAsStringSlice(argv[0]));
+            if (key)
+                setResultBlobFromData(ctx, key);
+            else
+                sqlite3_result_error(ctx, "collation_key: sort keys are unsupported", -1);
+            if (newCache)
+                sqlite3_set_auxdata(ctx, 1, newCache.release(),
+                                    [](void *c) {delete (CollationKeyCache*)c;});
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "collation_key: exception!", -1);
+        }
+    }
+
+
+    const SQLiteFunctionSpec kCollationFunctionsSpec[] = {
+        { "collation_key",     2, collation_key },
+        { }
+    };
+
+}
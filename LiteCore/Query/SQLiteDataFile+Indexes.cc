@@ -93,6 +93,8 @@ namespace litecore {
                 bool same;
                 if (spec.type == KeyStore::kFullTextIndex)
                     same = schemaExistsWithSQL(indexTableName, "table", indexTableName, indexSQL);
+                else if (spec.type == KeyStore::kGeoIndex || spec.type == KeyStore::kVectorIndex)
+                    same = (existingSpec.indexTableName == indexTableName);
                 else
                     same = schemaExistsWithSQL(spec.name, "index", indexTableName, indexSQL);
                 if (same)
@@ -103,7 +105,8 @@ namespace litecore {
         }
         LogTo(QueryLog, "Creating %s index \"%s\"",
               KeyStore::kIndexTypeName[spec.type], spec.name.c_str());
-        exec(indexSQL);
+        if (!indexSQL.empty())
+            exec(indexSQL);             // (a geo or vector index's table is the index itself)
         registerIndex(spec, keyStore->name(), indexTableName);
         return true;
     }
@@ -117,14 +120,16 @@ namespace litecore {
         LogTo(QueryLog, "Deleting %s index '%s'",
               KeyStore::kIndexTypeName[spec.type], spec.name.c_str());
         unregisterIndex(spec.name);
-        if (spec.type != KeyStore::kFullTextIndex)
+        if (spec.type != KeyStore::kFullTextIndex && spec.type != KeyStore::kGeoIndex
+                                                  && spec.type != KeyStore::kVectorIndex)
             exec(CONCAT("DROP INDEX IF EXISTS \"" << spec.name << "\""));
         if (!spec.indexTableName.empty())
             garbageCollectIndexTable(spec.indexTableName);
     }
 
 
-    // Drops unnested-array tables that no longer have any indexes on them.
+    // Drops index tables (unnested-array, predictive, geo, vector) that no longer have any
+    // indexes on them.
     void SQLiteDataFile::garbageCollectIndexTable(const string &tableName) {
         {
             SQLite::Statement stmt(*this, "SELECT name FROM indexes WHERE indexTableName=?");
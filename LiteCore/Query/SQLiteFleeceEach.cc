@@ -38,6 +38,8 @@
 #include "Path.hh"
 
 #include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 using namespace fleece;
@@ -67,6 +69,121 @@ enum {
 };
 
 
+// Maximum number of constraints on the 'value' column that bestIndex will push down to filter
+static constexpr int kMaxValueConstraints = 4;
+
+// Guess at the number of items in an array or dict, for query-plan cost estimates
+static constexpr double kEstimatedItemCount = 10;
+
+
+// A constraint on the 'value' column (like `_X.value > 3`), pushed down from the query so that
+// filter() and next() can skip items that fail it without handing them to SQLite at all.
+// SQLite still evaluates the constraint itself, so this check only has to be conservative: it
+// rejects an item only when it's sure SQLite would, and otherwise lets it through. That means
+// it only compares numbers with numbers, and strings with strings under the BINARY collation,
+// since then no type affinity or collation can change the result.
+// In 'idxStr' a constraint is encoded as two characters: the operator ('=', '<', 'l' for <=,
+// '>', 'g' for >=), followed by 'b' if the collation is BINARY, else 'x'.
+class ValueConstraint {
+public:
+    static char opCode(unsigned char sqliteOp) noexcept {
+        switch (sqliteOp) {
+            case SQLITE_INDEX_CONSTRAINT_EQ: return '=';
+            case SQLITE_INDEX_CONSTRAINT_LT: return '<';
+            case SQLITE_INDEX_CONSTRAINT_LE: return 'l';
+            case SQLITE_INDEX_CONSTRAINT_GT: return '>';
+            case SQLITE_INDEX_CONSTRAINT_GE: return 'g';
+            default:                         return 0;
+        }
+    }
+
+    ValueConstraint(char op, bool binaryCollation, sqlite3_value *operand)
+    :_op(op)
+    ,_binaryCollation(binaryCollation)
+    ,_type(sqlite3_value_type(operand))
+    {
+        switch (_type) {
+            case SQLITE_INTEGER: _int = sqlite3_value_int64(operand); break;
+            case SQLITE_FLOAT:   _double = sqlite3_value_double(operand); break;
+            case SQLITE_TEXT:    _text = alloc_slice(valueAsStringSlice(operand)); break;
+            default:             break;
+        }
+    }
+
+    // Returns false if SQLite would definitely reject the value.
+    bool mayMatch(const Value *value) const noexcept {
+        if (!value)
+            return true;
+        int cmp;
+        switch (value->type()) {
+            case kBoolean:
+            case kNumber:
+                if (!compareNumber(value, &cmp))
+                    return true;
+                break;
+            case kString:
+                if (_type != SQLITE_TEXT || !_binaryCollation)
+                    return true;
+                cmp = value->asString().compare(_text);
+                break;
+            default:
+                return true;
+        }
+        switch (_op) {
+            case '=':   return cmp == 0;
+            case '<':   return cmp < 0;
+            case 'l':   return cmp <= 0;
+            case '>':   return cmp > 0;
+            case 'g':   return cmp >= 0;
+            default:    return true;
+        }
+    }
+
+private:
+    // Compares a number the way SQLite would compare its column value (as set by
+    // setResultFromValue) to the operand. Returns false if it can't be sure of the result.
+    bool compareNumber(const Value *value, int *outCmp) const noexcept {
+        static constexpr int64_t kMaxExactDouble = 1ll << 53;
+        if (_type != SQLITE_INTEGER && _type != SQLITE_FLOAT)
+            return false;
+        bool isInt = value->isInteger() || value->type() == kBoolean;
+        if (isInt && _type == SQLITE_INTEGER) {
+            int64_t n = value->isUnsigned() ? (int64_t)value->asUnsigned() : value->asInt();
+            *outCmp = (n < _int) ? -1 : (n > _int);
+            return true;
+        }
+        // Mixed integer/float comparisons are only exact within the range of a double:
+        double n, operand;
+        if (isInt) {
+            int64_t i = value->isUnsigned() ? (int64_t)value->asUnsigned() : value->asInt();
+            if (i > kMaxExactDouble || i < -kMaxExactDouble)
+                return false;
+            n = (double)i;
+        } else {
+            n = value->asDouble();
+        }
+        if (_type == SQLITE_INTEGER) {
+            if (_int > kMaxExactDouble || _int < -kMaxExactDouble)
+                return false;
+            operand = (double)_int;
+        } else {
+            operand = _double;
+        }
+        if (std::isnan(n) || std::isnan(operand))
+            return false;
+        *outCmp = (n < operand) ? -1 : (n > operand);
+        return true;
+    }
+
+    char        _op;
+    bool        _binaryCollation;
+    int         _type;                  // SQLite type of the operand
+    int64_t     _int {0};
+    double      _double {0};
+    alloc_slice _text;
+};
+
+
 // Registered virtual-table instance that hangs onto the necessary per-database context info.
 struct FleeceVTab : public sqlite3_vtab {
     fleeceFuncContext context;
@@ -83,8 +200,11 @@ private:
     alloc_slice _rootPath;              // The path string within the data, if any
     const Value *_container;            // The object being iterated (target of the path)
     valueType _containerType;           // The value type of _container
+    unique_ptr<Dict::iterator> _dictIter; // Iterator at the current row, if _container is a Dict
+    const Value *_currentValue;         // The value at the current row
     uint32_t _rowid;                    // The current row number, starting at 0
     uint32_t _rowCount;                 // The number of rows
+    vector<ValueConstraint> _constraints; // Constraints on the value column (see bestIndex)
 
 
 #pragma mark - STATIC METHODS (DIRECT CALLBACKS):
@@ -154,15 +274,22 @@ private:
         /* From json1.c: "The query strategy is to look for an equality constraint on the
            [`root_data`] column.  Without such a constraint, the table cannot operate." */
         int rootDataIdx = -1, rootPathIdx = -1;
+        int valueIdx[kMaxValueConstraints];
+        int nValueConstraints = 0;
         auto constraint = info->aConstraint;
         for (int i = 0; i < info->nConstraint; i++, constraint++){
-            if (constraint->usable && constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            if (!constraint->usable)
+                continue;
+            if (constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
                 switch( constraint->iColumn ){
-                    case kRootFleeceDataColumn: rootDataIdx = i;    break;
-                    case kRootPathColumn:       rootPathIdx = i;    break;
+                    case kRootFleeceDataColumn: rootDataIdx = i;    continue;
+                    case kRootPathColumn:       rootPathIdx = i;    continue;
                     default:                    /* no-op */     break;
                 }
             }
+            if (constraint->iColumn == kValueColumn && ValueConstraint::opCode(constraint->op)
+                                                    && nValueConstraints < kMaxValueConstraints)
+                valueIdx[nValueConstraints++] = i;
         }
         // `info->idxNum` is used to communicate to the filter() function below; the value set here
         // will be passed to that function.
@@ -171,22 +298,59 @@ private:
         if( rootDataIdx < 0 ) {
             info->idxNum = kNoIndex;
             info->estimatedCost = 1e99;
+            info->estimatedRows = INT32_MAX;
+            return SQLITE_OK;
+        }
+
+        int argvIndex = 1;
+        info->aConstraintUsage[rootDataIdx].argvIndex = argvIndex++;
+        info->aConstraintUsage[rootDataIdx].omit = 1;
+        if (rootPathIdx < 0) {
+            info->idxNum = kFleeceDataIndex;
         } else {
-            info->estimatedCost = 1.0;
-            info->aConstraintUsage[rootDataIdx].argvIndex = 1;
-            info->aConstraintUsage[rootDataIdx].omit = 1;
-            if (rootPathIdx < 0) {
-                info->idxNum = kFleeceDataIndex;
-            } else {
-                info->aConstraintUsage[rootPathIdx].argvIndex = 2;
-                info->aConstraintUsage[rootPathIdx].omit = 1;
-                info->idxNum = kPathIndex;
+            info->aConstraintUsage[rootPathIdx].argvIndex = argvIndex++;
+            info->aConstraintUsage[rootPathIdx].omit = 1;
+            info->idxNum = kPathIndex;
+        }
+
+        // Pass constraints on the value column to filter(), described by `idxStr`. They're not
+        // omitted, since filter() only uses them to skip items SQLite would reject anyway.
+        double rows = kEstimatedItemCount;
+        if (nValueConstraints > 0) {
+            char *idxStr = (char*)sqlite3_malloc(2 * nValueConstraints + 1);
+            if (!idxStr)
+                return SQLITE_NOMEM;
+            for (int v = 0; v < nValueConstraints; ++v) {
+                int i = valueIdx[v];
+                char op = ValueConstraint::opCode(info->aConstraint[i].op);
+                idxStr[2*v]     = op;
+                idxStr[2*v + 1] = isBinaryCollation(info, i) ? 'b' : 'x';
+                info->aConstraintUsage[i].argvIndex = argvIndex++;
+                rows *= (op == '=') ? 0.1 : 0.5;
             }
+            idxStr[2 * nValueConstraints] = '\0';
+            info->idxStr = idxStr;
+            info->needToFreeIdxStr = 1;
         }
+        // Iterating is cheap compared to the document lookups that feed it; the cost is mostly
+        // proportional to the number of rows that have to be returned:
+        info->estimatedRows = max(1ll, (long long)rows);
+        info->estimatedCost = max(1.0, rows);
         return SQLITE_OK;
     }
 
 
+    // True if the constraint compares strings using the default (BINARY) collation.
+    static bool isBinaryCollation(sqlite3_index_info *info, int constraintIdx) noexcept {
+#if SQLITE_VERSION_NUMBER >= 3022000
+        const char *collation = sqlite3_vtab_collation(info, constraintIdx);
+        return !collation || sqlite3_stricmp(collation, "BINARY") == 0;
+#else
+        return false;           // can't tell, so don't assume
+#endif
+    }
+
+
 #pragma mark - INSTANCE METHODS:
 
 
@@ -200,8 +364,11 @@ private:
         _rootPath = nullslice;
         _container = nullptr;
         _containerType = kNull;
+        _dictIter.reset();
+        _currentValue = nullptr;
         _rowCount = 0;
         _rowid = 0;
+        _constraints.clear();
     }
 
 
@@ -230,26 +397,89 @@ private:
         }
 
         // Evaluate the path, if there is one:
+        int nextArg = 1;
         if (idxNum == kPathIndex) {
-            _rootPath = valueAsSlice(argv[1]);
+            _rootPath = valueAsSlice(argv[nextArg++]);
             int rc = evaluatePath(_rootPath, &_container);
             if (rc != SQLITE_OK)
                 return rc;
         }
 
-        // Determine the number of rows:
-        if (_container) {
-            _containerType = _container->type();
-            switch (_containerType) {
-                case kArray: _rowCount = _container->asArray()->count(); break;
-                case kDict:  _rowCount = _container->asDict()->count(); break;
-                default:     _rowCount = 1; break;
+        try {
+            // Collect the constraints on the value column:
+            if (idxStr) {
+                for (const char *c = idxStr; c[0] && c[1] && nextArg < argc; c += 2)
+                    _constraints.emplace_back(c[0], (c[1] == 'b'), argv[nextArg++]);
+            }
+
+            // Determine the number of rows:
+            if (_container) {
+                _containerType = _container->type();
+                switch (_containerType) {
+                    case kArray:
+                        _rowCount = _container->asArray()->count();
+                        break;
+                    case kDict:
+                        _rowCount = _container->asDict()->count();
+                        _dictIter.reset(new Dict::iterator(_container->asDict()));
+                        break;
+                    default:
+                        _rowCount = 1;
+                        break;
+                }
             }
+        } catch (const bad_alloc&) {
+            reset();
+            return SQLITE_NOMEM;
         }
+        loadRow();
+        skipRejectedRows();
         return SQLITE_OK;
     }
 
 
+    // Sets _currentValue to the item at _rowid.
+    void loadRow() noexcept {
+        if (atEOF()) {
+            _currentValue = nullptr;
+            return;
+        }
+        switch (_containerType) {
+            case kArray: _currentValue = _container->asArray()->get(_rowid); break;
+            case kDict:  _currentValue = _dictIter->value(); break;
+            default:     _currentValue = _container; break; // only one row, the root value
+        }
+    }
+
+
+    // Advances to the next row.
+    void step() noexcept {
+        ++_rowid;
+        if (_dictIter && !atEOF())
+            ++(*_dictIter);
+        loadRow();
+    }
+
+
+    // Advances past rows whose values can't satisfy the pushed-down constraints.
+    void skipRejectedRows() noexcept {
+        if (_constraints.empty())
+            return;
+        while (!atEOF()) {
+            bool mayMatch = true;
+            for (auto &constraint : _constraints) {
+                if (!constraint.mayMatch(_currentValue)) {
+                    mayMatch = false;
+                    break;
+                }
+            }
+            if (mayMatch)
+                return;
+            step();
+        }
+    }
+
+
     // Return true if the cursor has been moved off of the last row of output;
     bool atEOF() noexcept {
         return (_rowid >= _rowCount);
@@ -257,6 +487,10 @@ private:
 
 
     // Return values of columns for the row at which the FleeceCursor is currently pointing.
+    // Strings are copied (SQLITE_TRANSIENT), not handed to SQLite with SQLITE_STATIC: the Fleece
+    // data belongs to the outer row (or to a value computed from it), so it goes away when that
+    // row does, while SQLite may keep a static string for longer, e.g. in an aggregate like
+    // max(). Scalars that fail a pushed-down constraint are rejected before they're copied.
     int column(sqlite3_context *ctx, int column) noexcept {
         if (atEOF())
             return SQLITE_ERROR;
@@ -296,27 +530,12 @@ private:
 
 
     const slice currentKey() noexcept {
-        const Dict *dict = _container->asDict();
-        if (!dict)
-            return nullslice;
-        Dict::iterator iter(dict);
-        iter += _rowid;
-        return iter.keyString();
+        return _dictIter ? _dictIter->keyString() : nullslice;
     }
 
 
     const Value* currentValue() noexcept {
-        switch (_containerType) {
-            case kArray:
-                return _container->asArray()->get(_rowid);
-            case kDict: {
-                Dict::iterator iter(_container->asDict());
-                iter += _rowid;
-                return iter.value();
-            }
-            default:
-                return _container; // only one row, that's the root value
-        }
+        return _currentValue;
     }
 
 
@@ -329,7 +548,8 @@ private:
 
     // Advance a FleeceCursor to its next row of output.
     int next() noexcept {
-        ++_rowid;
+        step();
+        skipRejectedRows();
         return SQLITE_OK;
     }
 
@@ -274,6 +274,9 @@ namespace litecore {
         registerFunctionSpecs(db, context, kRankFunctionsSpec);
         registerFunctionSpecs(db, context, kN1QLFunctionsSpec);
         registerFunctionSpecs(db, context, kPredictFunctionsSpec);
+        registerFunctionSpecs(db, context, kGeoFunctionsSpec);
+        registerFunctionSpecs(db, context, kVectorFunctionsSpec);
+        registerFunctionSpecs(db, context, kCollationFunctionsSpec);
         RegisterFleeceEachFunctions(db, context);
 
         // The functions registered below operate on virtual tables, not on the actual db,
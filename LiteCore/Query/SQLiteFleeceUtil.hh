@@ -124,6 +124,9 @@ namespace litecore {
     extern const SQLiteFunctionSpec kRankFunctionsSpec[];
     extern const SQLiteFunctionSpec kN1QLFunctionsSpec[];
     extern const SQLiteFunctionSpec kPredictFunctionsSpec[];
+    extern const SQLiteFunctionSpec kGeoFunctionsSpec[];
+    extern const SQLiteFunctionSpec kVectorFunctionsSpec[];
+    extern const SQLiteFunctionSpec kCollationFunctionsSpec[];
 
     int RegisterFleeceEachFunctions(sqlite3 *db, const fleeceFuncContext&);
 
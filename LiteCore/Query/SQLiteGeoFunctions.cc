@@ -0,0 +1,114 @@
+//
+// SQLiteGeoFunctions.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Functions used by the geospatial query operators WITHIN_BOX and WITHIN_RADIUS.
+
+#include "SQLiteFleeceUtil.hh"
+#include <sqlite3.h>
+#include <cmath>
+
+#ifdef _MSC_VER
+#undef min
+#undef max
+#endif
+
+using namespace fleece;
+using namespace std;
+
+namespace litecore {
+
+    // Mean radius of the Earth, in meters
+    static constexpr double kEarthRadius = 6371008.8;
+
+    static inline double toRadians(double degrees)  {return degrees * M_PI / 180.0;}
+    static inline double toDegrees(double radians)  {return radians * 180.0 / M_PI;}
+
+
+    // Gets the first `n` arguments as doubles. Returns false if any of them isn't a number.
+    static bool numericArgs(sqlite3_value **argv, int n, double *outArgs) noexcept {
+        for (int i = 0; i < n; ++i) {
+            auto type = sqlite3_value_type(argv[i]);
+            if (type != SQLITE_INTEGER && type != SQLITE_FLOAT)
+                return false;
+            outArgs[i] = sqlite3_value_double(argv[i]);
+        }
+        return true;
+    }
+
+
+    // geo_distance(lat1, lon1, lat2, lon2) returns the great-circle distance in meters between
+    // two points given in degrees, using the haversine formula.
+    // https://en.wikipedia.org/wiki/Haversine_formula
+    static void geo_distance(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        double p[4];
+        if (!numericArgs(argv, 4, p)) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        double lat1 = toRadians(p[0]), lat2 = toRadians(p[2]);
+        double sinDLat = sin((lat2 - lat1) / 2), sinDLon = sin(toRadians(p[3] - p[1]) / 2);
+        double a = sinDLat * sinDLat + cos(lat1) * cos(lat2) * sinDLon * sinDLon;
+        sqlite3_result_double(ctx, 2 * kEarthRadius * asin(min(1.0, sqrt(a))));
+    }
+
+
+    // geo_box(lat, lon, radius, bound) returns one bound ('minLat', 'maxLat', 'minLon' or
+    // 'maxLon') of a lat/lon box enclosing the circle of `radius` meters around the point.
+    // If the circle covers a pole or crosses the antimeridian, the box spans all longitudes.
+    // http://janmatuschek.de/LatitudeLongitudeBoundingCoordinates
+    static void geo_box(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        double p[3];
+        if (!numericArgs(argv, 3, p)) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        double lat = p[0], lon = p[1], angle = p[2] / kEarthRadius;
+        double dLat = toDegrees(angle);
+        double minLat = lat - dLat, maxLat = lat + dLat;
+        double minLon = -180.0, maxLon = 180.0;
+        if (minLat <= -90.0 || maxLat >= 90.0) {
+            minLat = max(minLat, -90.0);
+            maxLat = min(maxLat, 90.0);
+        } else {
+            double dLon = toDegrees(asin(sin(angle) / cos(toRadians(lat))));
+            if (lon - dLon >= -180.0 && lon + dLon <= 180.0) {
+                minLon = lon - dLon;
+                maxLon = lon + dLon;
+            }
+        }
+
+        slice bound = valueAsStringSlice(argv[3]);
+        if (bound == "minLat"_sl)
+            sqlite3_result_double(ctx, minLat);
+        else if (bound == "maxLat"_sl)
+            sqlite3_result_double(ctx, maxLat);
+        else if (bound == "minLon"_sl)
+            sqlite3_result_double(ctx, minLon);
+        else if (bound == "maxLon"_sl)
+            sqlite3_result_double(ctx, maxLon);
+        else
+            sqlite3_result_error(ctx, "geo_box: invalid bound name", -1);
+    }
+
+
+    const SQLiteFunctionSpec kGeoFunctionsSpec[] = {
+        { "geo_distance",      4, geo_distance },
+        { "geo_box",           4, geo_box },
+        { }
+    };
+
+}
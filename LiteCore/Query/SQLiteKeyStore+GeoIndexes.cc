@@ -0,0 +1,114 @@
+//
+// SQLiteKeyStore+GeoIndexes.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteKeyStore.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser.hh"
+#include "Error.hh"
+#include "StringUtil.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    // A geospatial index is a SQLite R*Tree virtual table whose rows are the (degenerate)
+    // bounding boxes of each document's [latitude, longitude] point. It's the index itself, so
+    // unlike an array index there is no SQL index on top of it.
+    bool SQLiteKeyStore::createGeoIndex(const IndexSpec &spec,
+                                        const Array *params,
+                                        const IndexOptions *options)
+    {
+        if (params->count() != 2)
+            error::_throw(error::InvalidQuery,
+                          "Geospatial index requires exactly two expressions: latitude, longitude");
+        string geoTableName = createGeoTable(params);
+        return db().createIndex(spec, this, geoTableName, "");
+    }
+
+
+    string SQLiteKeyStore::createGeoTable(const Array *latLon) {
+        // Derive the table name from the expressions it indexes:
+        auto kvTableName = tableName();
+        auto geoTableName = QueryParser(*this).geoTableName(Array::iterator(latLon));
+
+        // Create the R*Tree table, unless an identical one already exists:
+        string sql = CONCAT("CREATE VIRTUAL TABLE \"" << geoTableName << "\" "
+                            "USING rtree(docid, minLat, maxLat, minLon, maxLon)");
+        if (!db().schemaExistsWithSQL(geoTableName, "table", geoTableName, sql)) {
+            LogTo(QueryLog, "Creating geo table '%s' on %s", geoTableName.c_str(),
+                  latLon->toJSONString().c_str());
+            db().exec(sql);
+
+            QueryParser qp(*this);
+            qp.setBodyColumnName("new.body");
+            string latExpr = qp.expressionSQL(latLon->get(0));
+            string lonExpr = qp.expressionSQL(latLon->get(1));
+
+            // Only documents whose latitude and longitude are both numbers get indexed:
+            auto pointSQL = [&](const string &from) {
+                return CONCAT("INSERT INTO \"" << geoTableName << "\" "
+                              "(docid, minLat, maxLat, minLon, maxLon) "
+                              "SELECT docid, lat, lat, lon, lon FROM "
+                              "(SELECT new.rowid AS docid, " << latExpr << " AS lat, "
+                                                             << lonExpr << " AS lon" << from << ") "
+                              "WHERE typeof(lat) IN ('integer', 'real') "
+                                "AND typeof(lon) IN ('integer', 'real')");
+            };
+
+            // Populate the index-table with data from existing documents:
+            db().exec(pointSQL(CONCAT(" FROM " << kvTableName << " AS new "
+                                      "WHERE (new.flags & 1) = 0")));
+
+            // Set up triggers to keep the index-table up to date
+            // ...on insertion:
+            string insertTriggerExpr = pointSQL("");
+            createTrigger(geoTableName, "ins",
+                          "AFTER INSERT",
+                          "WHEN (new.flags & 1) = 0",
+                          insertTriggerExpr);
+
+            // ...on delete:
+            string deleteTriggerExpr = CONCAT("DELETE FROM \"" << geoTableName << "\" "
+                                              "WHERE docid = old.rowid");
+            createTrigger(geoTableName, "del",
+                          "BEFORE DELETE",
+                          "WHEN (old.flags & 1) = 0",
+                          deleteTriggerExpr);
+
+            // ...on update:
+            createTrigger(geoTableName, "preupdate",
+                          "BEFORE UPDATE OF body, flags",
+                          "WHEN (old.flags & 1) = 0",
+                          deleteTriggerExpr);
+            createTrigger(geoTableName, "postupdate",
+                          "AFTER UPDATE OF body, flags",
+                          "WHEN (new.flags & 1) = 0",
+                          insertTriggerExpr);
+        }
+        return geoTableName;
+    }
+
+
+    string SQLiteKeyStore::geoTableName(const std::string &identifier) const {
+        return tableName() + ":geo:" + identifier;
+    }
+
+}
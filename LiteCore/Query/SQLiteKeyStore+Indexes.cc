@@ -39,6 +39,10 @@ namespace litecore {
      - An array index has two parts:
          * A SQL table named `kv_default:unnest:PATH`, where PATH is the property path
          * An index on that table named `NAME`
+     - A geospatial index is a SQLite R*Tree virtual table named `kv_default:geo:DIGEST`, where
+        DIGEST is a unique digest of the latitude and longitude expressions
+     - A vector index is a SQL table named `kv_default:vector:DIGEST`, where DIGEST is a unique
+        digest of the vector expression, mapping each docid to its vector as packed floats
      - A predictive index has two parts:
          * A SQL table named `kv_default:prediction:DIGEST`, where DIGEST is a unique digest
             of the prediction function name and the parameter dictionary
@@ -74,6 +78,8 @@ namespace litecore {
             }
             case kFullTextIndex:  created = createFTSIndex(spec, params, options); break;
             case kArrayIndex:     created = createArrayIndex(spec, params, options); break;
+            case kGeoIndex:       created = createGeoIndex(spec, params, options); break;
+            case kVectorIndex:    created = createVectorIndex(spec, params, options); break;
 #ifdef COUCHBASE_ENTERPRISE
             case kPredictiveIndex:created = createPredictiveIndex(spec, params, options); break;
 #endif
@@ -114,6 +120,19 @@ namespace litecore {
     }
 
 
+    // Creates the special partial index of conflicted records, by sequence. It only contains
+    // the (usually few) conflicted records, so it's small and cheap to maintain.
+    void SQLiteKeyStore::createConflictsIndex() {
+        if (!_createdConflictsIndex) {
+            Assert(_capabilities.sequences);
+            db().execWithLock(CONCAT("CREATE INDEX IF NOT EXISTS kv_" << name() << "_conflicted_seq"
+                                     " ON kv_" << name() << " (sequence)"
+                                     " WHERE (flags & 2) != 0"));
+            _createdConflictsIndex = true;
+        }
+    }
+
+
     vector<KeyStore::IndexSpec> SQLiteKeyStore::getIndexes() const {
         vector<KeyStore::IndexSpec> result;
         for (auto &spec : db().getIndexes(nullptr)) {
@@ -0,0 +1,110 @@
+//
+// SQLiteKeyStore+VectorIndexes.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteKeyStore.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser.hh"
+#include "Error.hh"
+#include "StringUtil.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    // A vector index is a flat table mapping each document's rowid to its vector, encoded as
+    // packed floats. A VECTOR_MATCH search scans this table instead of the documents, so it
+    // never has to read or parse a document body. Like a geo index, the table is the index.
+    bool SQLiteKeyStore::createVectorIndex(const IndexSpec &spec,
+                                           const Array *params,
+                                           const IndexOptions *options)
+    {
+        if (params->count() != 1)
+            error::_throw(error::InvalidQuery, "Vector index requires exactly one expression");
+        string vectorTableName = createVectorTable(params);
+        return db().createIndex(spec, this, vectorTableName, "");
+    }
+
+
+    string SQLiteKeyStore::createVectorTable(const Array *expressions) {
+        // Derive the table name from the expression it indexes:
+        auto kvTableName = tableName();
+        auto vectorTableName = QueryParser(*this).vectorTableName(Array::iterator(expressions));
+
+        // Create the vector table, unless an identical one already exists:
+        string sql = CONCAT("CREATE TABLE \"" << vectorTableName << "\" "
+                            "(docid INTEGER PRIMARY KEY, vector BLOB NOT NULL)");
+        if (!db().schemaExistsWithSQL(vectorTableName, "table", vectorTableName, sql)) {
+            LogTo(QueryLog, "Creating vector table '%s' on %s", vectorTableName.c_str(),
+                  expressions->toJSONString().c_str());
+            db().exec(sql);
+
+            QueryParser qp(*this);
+            qp.setBodyColumnName("new.body");
+            string vectorExpr = qp.expressionSQL(expressions->get(0));
+
+            // Only documents whose value is an array of numbers get indexed:
+            auto vectorSQL = [&](const string &from) {
+                return CONCAT("INSERT INTO \"" << vectorTableName << "\" (docid, vector) "
+                              "SELECT docid, vector FROM "
+                              "(SELECT new.rowid AS docid, vector_encode(" << vectorExpr << ") "
+                                                             "AS vector" << from << ") "
+                              "WHERE vector NOT NULL");
+            };
+
+            // Populate the index-table with data from existing documents:
+            db().exec(vectorSQL(CONCAT(" FROM " << kvTableName << " AS new "
+                                       "WHERE (new.flags & 1) = 0")));
+
+            // Set up triggers to keep the index-table up to date
+            // ...on insertion:
+            string insertTriggerExpr = vectorSQL("");
+            createTrigger(vectorTableName, "ins",
+                          "AFTER INSERT",
+                          "WHEN (new.flags & 1) = 0",
+                          insertTriggerExpr);
+
+            // ...on delete:
+            string deleteTriggerExpr = CONCAT("DELETE FROM \"" << vectorTableName << "\" "
+                                              "WHERE docid = old.rowid");
+            createTrigger(vectorTableName, "del",
+                          "BEFORE DELETE",
+                          "WHEN (old.flags & 1) = 0",
+                          deleteTriggerExpr);
+
+            // ...on update:
+            createTrigger(vectorTableName, "preupdate",
+                          "BEFORE UPDATE OF body, flags",
+                          "WHEN (old.flags & 1) = 0",
+                          deleteTriggerExpr);
+            createTrigger(vectorTableName, "postupdate",
+                          "AFTER UPDATE OF body, flags",
+                          "WHEN (new.flags & 1) = 0",
+                          insertTriggerExpr);
+        }
+        return vectorTableName;
+    }
+
+
+    string SQLiteKeyStore::vectorTableName(const std::string &identifier) const {
+        return tableName() + ":vector:" + identifier;
+    }
+
+}
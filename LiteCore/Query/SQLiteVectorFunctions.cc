@@ -0,0 +1,301 @@
+//
+// SQLiteVectorFunctions.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Functions used by the VECTOR_MATCH operator and vector indexes.
+
+#include "SQLiteFleeceUtil.hh"
+#include "Endian.hh"
+#include <sqlite3.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace fleece;
+using namespace fleece::impl;
+using namespace std;
+
+namespace litecore {
+
+    // In a vector index table, vectors are stored as blobs of packed little-endian 32-bit floats,
+    // so that the database file is portable between architectures.
+    using FloatVector = vector<float>;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    static constexpr bool kLittleEndian = false;
+#else
+    static constexpr bool kLittleEndian = true;
+#endif
+
+    enum class VectorMetric { cosine, euclidean, dot, invalid };
+
+
+#pragma mark - DISTANCE KERNELS:
+
+
+    // These loops keep four independent accumulators, which breaks the dependency between
+    // iterations and lets the compiler turn them into SIMD (SSE/AVX/NEON) instructions, without
+    // needing platform-specific intrinsics.
+
+    static float dotProduct(const float *a, const float *b, size_t n) noexcept {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            s0 += a[i]   * b[i];
+            s1 += a[i+1] * b[i+1];
+            s2 += a[i+2] * b[i+2];
+            s3 += a[i+3] * b[i+3];
+        }
+        for (; i < n; ++i)
+            s0 += a[i] * b[i];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+
+    static float squaredDistance(const float *a, const float *b, size_t n) noexcept {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            float d0 = a[i]   - b[i],   d1 = a[i+1] - b[i+1];
+            float d2 = a[i+2] - b[i+2], d3 = a[i+3] - b[i+3];
+            s0 += d0 * d0;
+            s1 += d1 * d1;
+            s2 += d2 * d2;
+            s3 += d3 * d3;
+        }
+        for (; i < n; ++i) {
+            float d = a[i] - b[i];
+            s0 += d * d;
+        }
+        return (s0 + s1) + (s2 + s3);
+    }
+
+
+    // Returns 1 - cos(θ), computing the dot product and both magnitudes in a single pass.
+    static float cosineDistance(const float *a, const float *b, size_t n) noexcept {
+        float ab0 = 0, ab1 = 0, aa0 = 0, aa1 = 0, bb0 = 0, bb1 = 0;
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            ab0 += a[i] * b[i];     ab1 += a[i+1] * b[i+1];
+            aa0 += a[i] * a[i];     aa1 += a[i+1] * a[i+1];
+            bb0 += b[i] * b[i];     bb1 += b[i+1] * b[i+1];
+        }
+        for (; i < n; ++i) {
+            ab0 += a[i] * b[i];
+            aa0 += a[i] * a[i];
+            bb0 += b[i] * b[i];
+        }
+        float magnitudes = sqrtf((aa0 + aa1) * (bb0 + bb1));
+        if (magnitudes == 0)
+            return 1.0f;        // a zero vector is orthogonal to everything
+        return 1.0f - (ab0 + ab1) / magnitudes;
+    }
+
+
+    // Distances are ordered so that smaller means nearer; for the dot product that means
+    // returning its negation.
+    static double vectorDistance(VectorMetric metric,
+                                 const float *a, const float *b, size_t n) noexcept
+    {
+        switch (metric) {
+            case VectorMetric::cosine:      return cosineDistance(a, b, n);
+            case VectorMetric::euclidean:   return sqrtf(squaredDistance(a, b, n));
+            case VectorMetric::dot:         return -dotProduct(a, b, n);
+            default:                        return NAN;
+        }
+    }
+
+
+#pragma mark - ARGUMENTS:
+
+
+    // Converts native floats to the little-endian byte order of a packed vector.
+    static void encodePacked(FloatVector &vec) noexcept {
+        if (kLittleEndian)
+            return;
+        for (float &f : vec) {
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            bits = _encLittle32(bits);
+            memcpy(&f, &bits, sizeof(bits));
+        }
+    }
+
+
+    // Copies a packed vector into native floats.
+    static void decodePacked(slice packed, FloatVector &outVector) noexcept {
+        memcpy(outVector.data(), packed.buf, packed.size);
+        if (kLittleEndian)
+            return;
+        for (float &f : outVector) {
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            bits = _decLittle32(bits);
+            memcpy(&f, &bits, sizeof(bits));
+        }
+    }
+
+
+    static VectorMetric metricArg(sqlite3_value *arg) noexcept {
+        slice name = valueAsStringSlice(arg);
+        if (name == "cosine"_sl)
+            return VectorMetric::cosine;
+        else if (name == "euclidean"_sl)
+            return VectorMetric::euclidean;
+        else if (name == "dot"_sl)
+            return VectorMetric::dot;
+        else
+            return VectorMetric::invalid;
+    }
+
+
+    // Decodes a Fleece array of numbers into floats. Returns false if it's anything else.
+    static bool decodeVector(const Value *value, FloatVector &outVector) {
+        const Array *array = value ? value->asArray() : nullptr;
+        if (!array || array->empty())
+            return false;
+        outVector.reserve(array->count());
+        for (Array::iterator i(array); i; ++i) {
+            if (i.value()->type() != kNumber)
+                return false;
+            outVector.push_back(i.value()->asFloat());
+        }
+        return true;
+    }
+
+
+    // Returns a Fleece-array argument as a float vector. A constant argument (like the target
+    // vector of a query) is cached by SQLite as auxdata, so it's only decoded once.
+    // If `*outNew` is set to true, the caller must pass the vector to `cacheVectorArg` when done.
+    static FloatVector* vectorArg(sqlite3_context *ctx, sqlite3_value **argv, int argNo,
+                                  bool *outNew) noexcept
+    {
+        *outNew = false;
+        auto vec = (FloatVector*)sqlite3_get_auxdata(ctx, argNo);
+        if (vec)
+            return vec;
+        try {
+            unique_ptr<FloatVector> newVec(new FloatVector);
+            if (!decodeVector(fleeceParam(ctx, argv[argNo], false), *newVec))
+                return nullptr;
+            *outNew = true;
+            return newVec.release();
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+            return nullptr;
+        }
+    }
+
+
+    // Hands a vector returned by `vectorArg` to SQLite. This has to be done last, since SQLite
+    // may free it immediately if the argument isn't a constant.
+    static void cacheVectorArg(sqlite3_context *ctx, int argNo, FloatVector *vec) noexcept {
+        sqlite3_set_auxdata(ctx, argNo, vec, [](void *v) {delete (FloatVector*)v;});
+    }
+
+
+#pragma mark - FUNCTIONS:
+
+
+    // vector_encode(array) converts a Fleece array of numbers to a packed-float blob, as stored
+    // in a vector index table. Returns NULL if the argument isn't a non-empty array of numbers.
+    static void vector_encode(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        try {
+            FloatVector vec;
+            if (!decodeVector(fleeceParam(ctx, argv[0], false), vec)) {
+                sqlite3_result_null(ctx);
+                return;
+            }
+            encodePacked(vec);
+            setResultBlobFromData(ctx, slice(vec.data(), vec.size() * sizeof(float)));
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+        }
+    }
+
+
+    // vector_distance(a, b [, metric]) returns the distance between two Fleece arrays of numbers,
+    // using the metric 'cosine' (the default), 'euclidean' or 'dot'. Returns NULL if either
+    // isn't a vector, or if their dimensions differ.
+    static void vector_distance(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto metric = (argc > 2) ? metricArg(argv[2]) : VectorMetric::cosine;
+        if (metric == VectorMetric::invalid) {
+            sqlite3_result_error(ctx, "vector_distance: invalid metric", -1);
+            return;
+        }
+        bool newA, newB;
+        FloatVector *a = vectorArg(ctx, argv, 0, &newA);
+        if (!a) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        FloatVector *b = vectorArg(ctx, argv, 1, &newB);
+        if (!b || a->size() != b->size())
+            sqlite3_result_null(ctx);
+        else
+            sqlite3_result_double(ctx, vectorDistance(metric, a->data(), b->data(), a->size()));
+        if (newA)
+            cacheVectorArg(ctx, 0, a);
+        if (newB)
+            cacheVectorArg(ctx, 1, b);
+    }
+
+
+    // vector_index_distance(packed, target, metric) is like vector_distance, except that the
+    // first argument is a packed-float blob from a vector index table.
+    static void vector_index_distance(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto metric = metricArg(argv[2]);
+        if (metric == VectorMetric::invalid) {
+            sqlite3_result_error(ctx, "vector_index_distance: invalid metric", -1);
+            return;
+        }
+        bool newTarget;
+        FloatVector *target = vectorArg(ctx, argv, 1, &newTarget);
+        if (!target) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+
+        slice packed = valueAsSlice(argv[0]);
+        size_t n = packed.size / sizeof(float);
+        if (n != target->size() || packed.size % sizeof(float) != 0) {
+            sqlite3_result_null(ctx);
+        } else if (kLittleEndian && ((uintptr_t)packed.buf % alignof(float)) == 0) {
+            auto vec = (const float*)packed.buf;
+            sqlite3_result_double(ctx, vectorDistance(metric, vec, target->data(), n));
+        } else {
+            // SQLite doesn't promise to align blobs, so copy it if necessary (or if its byte
+            // order isn't native):
+            FloatVector vec(n);
+            decodePacked(packed, vec);
+            sqlite3_result_double(ctx, vectorDistance(metric, vec.data(), target->data(), n));
+        }
+        if (newTarget)
+            cacheVectorArg(ctx, 1, target);
+    }
+
+
+    const SQLiteFunctionSpec kVectorFunctionsSpec[] = {
+        { "vector_encode",         1, vector_encode },
+        { "vector_distance",       2, vector_distance },
+        { "vector_distance",       3, vector_distance },
+        { "vector_index_distance", 3, vector_index_distance },
+        { }
+    };
+
+}
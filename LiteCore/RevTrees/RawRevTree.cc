@@ -20,6 +20,7 @@
 #include "RevTree.hh"
 #include "Error.hh"
 #include "varint.hh"
+#include <algorithm>
 
 using namespace std;
 using namespace fleece;
@@ -35,16 +36,17 @@ namespace litecore {
 #pragma pack()
 
 
-    std::deque<Rev> RawRevision::decodeTree(slice raw_tree,
-                                            RevTree::RemoteRevMap &remoteMap,
-                                            RevTree* owner,
-                                            sequence_t curSeq)
+    void RawRevision::decodeTree(slice raw_tree,
+                                 RevTree::RevStorage &revs,
+                                 RevTree::RemoteRevMap &remoteMap,
+                                 RevTree* owner,
+                                 sequence_t curSeq)
     {
         const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
         unsigned count = rawRev->count();
         if (count > UINT16_MAX)
             error::_throw(error::CorruptRevisionData);
-        deque<Rev> revs(count);
+        revs.resize(count);
         auto rev = revs.begin();
         for (; rawRev->isValid(); rawRev = rawRev->next()) {
             rawRev->copyTo(*rev, revs);
@@ -67,32 +69,93 @@ namespace litecore {
         if ((uint8_t*)entry != (uint8_t*)raw_tree.end()) {
             error::_throw(error::CorruptRevisionData);
         }
-        return revs;
     }
 
 
-    alloc_slice RawRevision::encodeTree(const vector<Rev*> &revs,
+    bool RawRevision::decodeCurrentRev(slice raw_tree,
+                                       Rev &outRev,
+                                       RevTree* owner,
+                                       sequence_t curSeq)
+    {
+        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+        if (raw_tree.size < sizeof(uint32_t) || !rawRev->isValid())
+            return false;
+        if (_dec32(rawRev->size_BE) > raw_tree.size)
+            error::_throw(error::CorruptRevisionData);
+        rawRev->copyTo(outRev);
+        if (outRev.sequence == 0)
+            outRev.sequence = curSeq;
+        outRev.owner = owner;
+        return true;
+    }
+
+
+    alloc_slice RawRevision::encodeTree(const RevTree::RevVector &revs,
                                         const RevTree::RemoteRevMap &remoteMap)
     {
+        // Index the revs by address, to look up parent indexes without a linear search:
+        vector<pair<const Rev*, uint16_t>> indexes;
+        indexes.reserve(revs.size());
+        for (size_t i = 0; i < revs.size(); ++i)
+            indexes.emplace_back(revs[i], uint16_t(i));
+        std::sort(indexes.begin(), indexes.end());
+        auto indexOf = [&](const Rev *rev) -> uint16_t {
+            if (!rev)
+                return kNoParent;
+            auto i = lower_bound(indexes.begin(), indexes.end(), make_pair(rev, uint16_t(0)));
+            Assert(i != indexes.end() && i->first == rev);
+            return i->second;
+        };
+
         // Allocate output buffer:
         size_t totalSize = sizeof(uint32_t);  // start with space for trailing 0 size
         for (Rev *rev : revs)
-            totalSize += sizeToWrite(*rev);
+            totalSize += rev->_raw && rev->_raw->isEncodingOf(*rev) ? rev->_raw->size()
+                                                                     : sizeToWrite(*rev);
         totalSize += remoteMap.size() * sizeof(RemoteEntry);
 
         alloc_slice result(totalSize);
 
-        // Write the raw revs:
+        // Write the raw revs. Revs that haven't changed since they were decoded are copied from
+        // the original tree, coalescing adjacent ones into a single run:
         RawRevision *dst = (RawRevision*)result.buf;
+        const RawRevision *runStart = nullptr, *runEnd = nullptr;
+        RawRevision *runDst = nullptr;
+        auto flushRun = [&]() {
+            if (runStart) {
+                memcpy(runDst, runStart, (uint8_t*)runEnd - (uint8_t*)runStart);
+                runStart = nullptr;
+            }
+        };
         for (Rev *src : revs) {
-            dst = dst->copyFrom(*src);
+            const RawRevision *raw = src->_raw;
+            if (raw && raw->isEncodingOf(*src)) {
+                if (!runStart || raw != runEnd) {
+                    flushRun();
+                    runStart = raw;
+                    runDst = dst;
+                }
+                runEnd = raw->next();
+                dst = (RawRevision*)offsetby(dst, raw->size());
+            } else {
+                flushRun();
+                dst = dst->copyFrom(*src);
+            }
         }
+        flushRun();
         dst->size_BE = _enc32(0);   // write trailing 0 size marker
 
+        // Now that every rev is in place, fill in (or fix up) the parent indexes:
+        auto rawRev = (RawRevision*)result.buf;
+        for (Rev *src : revs) {
+            rawRev->parentIndex_BE = (uint16_t)_enc16(indexOf(src->parent));
+            rawRev = (RawRevision*)rawRev->next();
+        }
+
         auto entry = (RemoteEntry*)offsetby(dst, sizeof(uint32_t));
         for (auto remote : remoteMap) {
             entry->remoteDBID_BE = (uint16_t)_enc16(remote.first);
-            entry->revIndex_BE = (uint16_t)_enc16(remote.second->index());
+            entry->revIndex_BE = (uint16_t)_enc16(indexOf(remote.second));
             ++entry;
         }
 
@@ -105,37 +168,62 @@ namespace litecore {
         return offsetof(RawRevision, revID)
              + rev.revID.size
              + SizeOfVarInt(rev.sequence)
-             + rev._body.size;
+             + (rev._externalBody ? 0 : rev._body.size);
+    }
+
+    uint8_t RawRevision::flagsToWrite(const Rev &rev) {
+        uint8_t dstFlags = rev.flags & ~kNonPersistentFlags;
+        if (rev._externalBody)
+            dstFlags |= RawRevision::kHasExternalData;
+        else if (rev._body)
+            dstFlags |= RawRevision::kHasData;
+        return dstFlags;
     }
 
+    // Would encoding `rev` produce this raw revision (except maybe for the parent index)?
+    bool RawRevision::isEncodingOf(const Rev &rev) const {
+        if (this->flags != flagsToWrite(rev) || slice(this->revID, this->revIDLen) != rev.revID)
+            return false;
+        const void *data = offsetby(&this->revID, this->revIDLen);
+        uint64_t sequence;
+        size_t seqSize = GetUVarInt(slice(data, this->next()), &sequence);
+        if (sequence != rev.sequence)
+            return false;
+        if (rev._externalBody || !rev._body)
+            return true;            // (the flags matched, so this has no data either)
+        // The body must still be the one in this raw revision, not a replacement:
+        slice body(offsetby(data, seqSize), this->next());
+        return rev._body.buf == body.buf && rev._body.size == body.size;
+    }
+
+    // Writes everything but the parent index, which encodeTree fills in afterwards.
     RawRevision* RawRevision::copyFrom(const Rev &rev) {
         size_t revSize = sizeToWrite(rev);
         this->size_BE = _enc32((uint32_t)revSize);
         this->revIDLen = (uint8_t)rev.revID.size;
         memcpy(this->revID, rev.revID.buf, rev.revID.size);
-        this->parentIndex_BE = (uint16_t)_enc16(rev.parent ? rev.parent->index() : kNoParent);
-
-        uint8_t dstFlags = rev.flags & ~kNonPersistentFlags;
-        if (rev._body)
-            dstFlags |= RawRevision::kHasData;
-        this->flags = (Rev::Flags)dstFlags;
+        this->flags = flagsToWrite(rev);
 
         void *dstData = offsetby(&this->revID[0], rev.revID.size);
         dstData = offsetby(dstData, PutUVarInt(dstData, rev.sequence));
-        memcpy(dstData, rev._body.buf, rev._body.size);
+        if (!rev._externalBody)
+            memcpy(dstData, rev._body.buf, rev._body.size);
 
         return (RawRevision*)offsetby(this, revSize);
     }
 
-    void RawRevision::copyTo(Rev &dst, const deque<Rev> &revs) const {
+    void RawRevision::copyTo(Rev &dst, const RevTree::RevStorage &revs) const {
+        copyTo(dst);
+        auto parentIndex = _dec16(this->parentIndex_BE);
+        if (parentIndex != kNoParent)
+            dst.parent = &revs[parentIndex];
+    }
+
+    void RawRevision::copyTo(Rev &dst) const {
         const void* end = this->next();
         dst.revID = {this->revID, this->revIDLen};
         dst.flags = (Rev::Flags)(this->flags & ~kPersistentOnlyFlags);
-        auto parentIndex = _dec16(this->parentIndex_BE);
-        if (parentIndex == kNoParent)
-            dst.parent = nullptr;
-        else
-            dst.parent = &revs[parentIndex];
+        dst.parent = nullptr;
         const void *data = offsetby(&this->revID, this->revIDLen);
         ptrdiff_t len = (uint8_t*)end-(uint8_t*)data;
         data = offsetby(data, GetUVarInt(slice(data, len), &dst.sequence));
@@ -143,6 +231,8 @@ namespace litecore {
             dst._body = slice(data, end);
         else
             dst._body = nullslice;
+        dst._externalBody = (this->flags & RawRevision::kHasExternalData) != 0;
+        dst._raw = this;
     }
 
 
@@ -21,7 +21,6 @@
 #include "RevTree.hh"
 #include "KeyStore.hh"
 #include "Endian.hh"
-#include <deque>
 #include <vector>
 
 
@@ -36,14 +35,22 @@ namespace litecore {
     // revision is the current one for every remote database.
     class RawRevision {
     public:
-        static std::deque<Rev> decodeTree(slice raw_tree,
-                                          RevTree::RemoteRevMap &remoteMap,
-                                          RevTree *owner NONNULL,
-                                          sequence_t curSeq);
+        static void decodeTree(slice raw_tree,
+                               RevTree::RevStorage &revs,
+                               RevTree::RemoteRevMap &remoteMap,
+                               RevTree *owner NONNULL,
+                               sequence_t curSeq);
 
-        static alloc_slice encodeTree(const std::vector<Rev*> &revs,
+        static alloc_slice encodeTree(const RevTree::RevVector &revs,
                                       const RevTree::RemoteRevMap &remoteMap);
 
+        /** Decodes only the current (first) revision of an encoded tree, for callers that don't
+            need the rest. The Rev's `parent` is left null. Returns false if the tree is empty. */
+        static bool decodeCurrentRev(slice raw_tree,
+                                     Rev &outRev,
+                                     RevTree *owner NONNULL,
+                                     sequence_t curSeq);
+
         static inline slice getCurrentRevBody(slice raw_tree) noexcept {
             const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
             return rawRev->body();
@@ -55,8 +62,12 @@ namespace litecore {
         // Private RevisionFlags bits used in encoded form:
         enum : uint8_t {
             kHasData = 0x80,  /**< Does this raw rev contain JSON/Fleece data? */
+            kHasExternalData = 0x04, /**< Is its body stored outside the tree? (Reuses the bit
+                                          of kNew, which is never saved to disk. It's only ever
+                                          set in files whose format allows external bodies; see
+                                          DataFile::canStoreExternalRevisionBodies.) */
             kNonPersistentFlags  = (Rev::kNew),         // Not saved to disk
-            kPersistentOnlyFlags = (kHasData),          // Only used on disk, not in memory
+            kPersistentOnlyFlags = (kHasData | kHasExternalData), // Only used on disk
         };
 
         uint32_t        size_BE;        // Total size of this tree rev (big-endian)
@@ -68,6 +79,7 @@ namespace litecore {
         // varint       sequence
         // if HasData flag:
         //    char      data[];         // Contains the revision body (JSON)
+        // (If HasExternalData flag, the body is stored elsewhere; see VersionedDocument.)
 
         bool isValid() const {
             return size_BE != 0;
@@ -75,6 +87,10 @@ namespace litecore {
 
         slice body() const;
 
+        size_t size() const {
+            return _dec32(size_BE);
+        }
+
         const RawRevision *next() const {
             return (const RawRevision*)fleece::offsetby(this, _dec32(size_BE));
         }
@@ -87,7 +103,10 @@ namespace litecore {
         }
 
         static size_t sizeToWrite(const Rev&);
-        void copyTo(Rev &dst, const std::deque<Rev>&) const;
+        static uint8_t flagsToWrite(const Rev&);
+        bool isEncodingOf(const Rev&) const;
+        void copyTo(Rev &dst, const RevTree::RevStorage&) const;
+        void copyTo(Rev &dst) const;
         RawRevision* copyFrom(const Rev &rev);
     };
 
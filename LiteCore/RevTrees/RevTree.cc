@@ -36,16 +36,26 @@ namespace litecore {
 
     static bool compareRevs(const Rev *rev1, const Rev *rev2);
 
-    RevTree::RevTree(slice raw_tree, sequence_t seq) {
+    RevTree::RevTree()
+    :_revs(RevVector::allocator_type(_arena))
+    ,_revsStorage(RevStorage::allocator_type(_arena))
+    ,_insertedData(InsertedData::allocator_type(_arena))
+    ,_remoteRevs(RemoteRevMap::allocator_type(_arena))
+    { }
+
+    RevTree::RevTree(slice raw_tree, sequence_t seq)
+    :RevTree()
+    {
         decode(raw_tree, seq);
     }
 
     RevTree::RevTree(const RevTree &other)
-    :_insertedData(other._insertedData)
-    ,_sorted(other._sorted)
-    ,_changed(other._changed)
-    ,_unknown(other._unknown)
+    :RevTree()
     {
+        _insertedData = other._insertedData;
+        _sorted = other._sorted;
+        _changed = other._changed;
+        _unknown = other._unknown;
         // It's important to have _revs in the same order as other._revs.
         // That means we can't just copy other._revsStorage to _revsStorage;
         // we have to copy _revs in order:
@@ -54,10 +64,14 @@ namespace litecore {
             _revsStorage.emplace_back(*otherRev);
             _revs.push_back(&_revsStorage.back());
         }
-        // Fix up the newly copied Revs so they point to me (and my other Revs), not other:
+        // Fix up the newly copied Revs so they point to me (and my other Revs), not other.
+        // (Inserted revs' revIDs live in other's arena, so copy the revIDs into mine too; and
+        // don't let encode() depend on other's raw tree.)
         for (Rev *rev : _revs) {
             if (rev->parent)
                 rev->parent = _revs[rev->parent->index()];
+            rev->revID = copyRevID(rev->revID);
+            rev->_raw = nullptr;
             rev->owner = this;
         }
         // Copy _remoteRevs:
@@ -67,7 +81,11 @@ namespace litecore {
     }
 
     void RevTree::decode(litecore::slice raw_tree, sequence_t seq) {
-        _revsStorage = RawRevision::decodeTree(raw_tree, _remoteRevs, this, seq);
+        // (The memory of the Revs being replaced stays in the arena until the tree is
+        // destructed; the arena only reclaims its latest allocation.)
+        _revsStorage.clear();
+        _remoteRevs.clear();
+        RawRevision::decodeTree(raw_tree, _revsStorage, _remoteRevs, this, seq);
         initRevs();
     }
 
@@ -189,7 +207,7 @@ namespace litecore {
     }
 
     bool RevTree::isBodyOfRevisionAvailable(const Rev* rev) const {
-        return rev->_body.buf != nullptr; // VersionedDocument overrides this
+        return rev->_body.buf != nullptr || rev->_externalBody;
     }
 
     alloc_slice RevTree::readBodyOfRevision(const Rev* rev) const {
@@ -224,6 +242,11 @@ namespace litecore {
     }
 
 
+    revid RevTree::copyRevID(revid revID) {
+        return revid(_arena.copy(revID.buf, revID.size), revID.size);
+    }
+
+
     // Lowest-level insert method. Does no sanity checking, always inserts.
     Rev* RevTree::_insert(revid unownedRevID,
                           alloc_slice body,
@@ -236,8 +259,7 @@ namespace litecore {
 
         Assert(!_unknown);
         // Allocate copies of the revID and data so they'll stay around:
-        _insertedData.emplace_back(unownedRevID);
-        revid revID = revid(_insertedData.back());
+        revid revID = copyRevID(unownedRevID);
 
         _revsStorage.emplace_back();
         Rev *newRev = &_revsStorage.back();
@@ -261,9 +283,14 @@ namespace litecore {
         }
 
         _changed = true;
-        if (!_revs.empty())
+        if (_sorted && !_revs.empty() && !staysSortedAtFront(newRev, parentRev))
             _sorted = false;
-        _revs.push_back(newRev);
+        if (_sorted) {
+            _revs.insert(_revs.begin(), newRev);
+            checkForResolvedConflict();
+        } else {
+            _revs.push_back(newRev);
+        }
         return newRev;
     }
 
@@ -385,7 +412,7 @@ namespace litecore {
     }
 
     void RevTree::removeBody(const Rev* rev) {
-        if (rev->body()) {
+        if (rev->body() || rev->_externalBody) {
             const_cast<Rev*>(rev)->removeBody();
             _changed = true;
         }
@@ -394,13 +421,46 @@ namespace litecore {
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
         for (Rev *rev : _revs) {
-            if (rev->_body.size > 0 && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
+            if ((rev->_body.size > 0 || rev->_externalBody)
+                    && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
                 rev->removeBody();
                 _changed = true;
             }
         }
     }
 
+    bool RevTree::loadBody(const Rev *rev) {
+        if (!rev->_body.buf && rev->_externalBody) {
+            alloc_slice body = readBodyOfRevision(rev);
+            if (body)
+                const_cast<Rev*>(rev)->_body = (slice)copyBody(body);
+        }
+        return rev->_body.buf != nullptr;
+    }
+
+    std::vector<const Rev*> RevTree::externalizeBodies() {
+        std::vector<const Rev*> added;
+        const Rev *current = currentRevision();
+        for (Rev *rev : _revs) {
+            if (rev == current) {
+                if (rev->_externalBody) {
+                    // The new current revision's body is going back inline:
+                    loadBody(rev);
+                    rev->_externalBody = false;
+                }
+            } else if (!rev->_externalBody && rev->_body.size > 0) {
+                rev->_externalBody = true;
+                added.push_back(rev);
+            }
+        }
+        return added;
+    }
+
+    void RevTree::keepBodiesInline(const std::vector<const Rev*> &revs) {
+        for (const Rev *rev : revs)
+            const_cast<Rev*>(rev)->_externalBody = false;
+    }
+
     unsigned RevTree::prune(unsigned maxDepth) {
         Assert(maxDepth > 0);
         if (_revs.size() <= maxDepth)
@@ -487,10 +547,11 @@ namespace litecore {
         _revs.resize(dst - _revs.begin());
 
         // Remove purged revs from _remoteRevs:
-        auto tempRemoteRevs = _remoteRevs;
-        for (auto &e : tempRemoteRevs) {
-            if (e.second->isMarkedForPurge())
-                _remoteRevs.erase(e.first);
+        for (auto i = _remoteRevs.begin(); i != _remoteRevs.end(); ) {
+            if (i->second->isMarkedForPurge())
+                i = _remoteRevs.erase(i);
+            else
+                ++i;
         }
 
         _changed = true;
@@ -522,6 +583,17 @@ namespace litecore {
         return rev2->revID < rev1->revID;
     }
 
+    // Would the (sorted) revs stay sorted if newRev were inserted at the front? This is the
+    // usual case of a new revision extending the current one, and it saves a sort.
+    bool RevTree::staysSortedAtFront(const Rev *newRev, const Rev *parentRev) const {
+        if (!compareRevs(newRev, _revs[0]))
+            return false;
+        if (!parentRev)
+            return true;
+        // The parent is no longer a leaf, so it may have to move down past other revs:
+        return parentRev == _revs[0] && (_revs.size() < 2 || !compareRevs(_revs[1], parentRev));
+    }
+
     void RevTree::sort() {
         if (_sorted)
             return;
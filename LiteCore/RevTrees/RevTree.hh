@@ -20,14 +20,16 @@
 #include "PlatformCompat.hh"
 #include "fleece/slice.hh"
 #include "RevID.hh"
+#include "Arena.hh"
 #include <deque>
-#include <unordered_map>
+#include <map>
 #include <vector>
 
 
 namespace litecore {
 
     class RevTree;
+    class RawRevision;
 
     /** In-memory representation of a single revision's metadata. */
     class Rev {
@@ -39,6 +41,8 @@ namespace litecore {
 
         slice body() const;
         bool isBodyAvailable() const{return _body.buf != nullptr;}
+        /** True if the body is stored outside the encoded tree; it may not be loaded yet. */
+        bool isBodyExternal() const {return _externalBody;}
 
         bool isLeaf() const         {return (flags & kLeaf) != 0;}
         bool isDeleted() const      {return (flags & kDeleted) != 0;}
@@ -71,11 +75,13 @@ namespace litecore {
 
     private:
         slice       _body;          /**< Revision body (JSON), or empty if not stored in this tree*/
+        bool        _externalBody {false}; /**< Is the body stored outside the tree? */
+        const RawRevision* _raw {nullptr}; /**< Encoded form this was decoded from, if any */
 
         void addFlag(Flags f)           {flags = (Flags)(flags | f);}
         void clearFlag(Flags f)         {flags = (Flags)(flags & ~f);}
         void removeBody()               {clearFlag((Flags)(kKeepBody | kHasAttachments));
-                                         _body = nullslice;}
+                                         _body = nullslice; _externalBody = false;}
         bool isMarkedForPurge() const   {return (flags & kPurge) != 0;}
 #if DEBUG
         void dump(std::ostream&);
@@ -85,10 +91,14 @@ namespace litecore {
     };
 
 
-    /** A serializable tree of Revisions. */
+    /** A serializable tree of Revisions.
+        All of its metadata -- the Revs, the arrays pointing to them, and the revIDs of inserted
+        revisions -- is allocated from a per-tree Arena, so destroying a tree is cheap. */
     class RevTree {
     public:
-        RevTree() { }
+        using RevVector = std::vector<Rev*, ArenaAllocator<Rev*>>;
+
+        RevTree();
         RevTree(slice raw_tree, sequence_t seq);
         RevTree(const RevTree&);
         virtual ~RevTree() { }
@@ -104,7 +114,7 @@ namespace litecore {
         const Rev* operator[](revid revID) const    {return get(revID);}
         const Rev* getBySequence(sequence_t) const;
 
-        const std::vector<Rev*>& allRevisions() const   {return _revs;}
+        const RevVector& allRevisions() const           {return _revs;}
         const Rev* currentRevision();
         bool hasConflict() const;
         bool hasNewRevisions() const;
@@ -142,6 +152,10 @@ namespace litecore {
         void keepBody(const Rev* NONNULL);
         void removeBody(const Rev* NONNULL);
 
+        /** Makes a revision's body available in memory, reading it if it's stored externally.
+            Returns false if the revision has no body. */
+        bool loadBody(const Rev* NONNULL);
+
         void removeNonLeafBodies();
 
         /** Removes a leaf revision and any of its ancestors that aren't shared with other leaves. */
@@ -158,8 +172,12 @@ namespace litecore {
         static constexpr RemoteID kNoRemoteID = 0;
         static constexpr RemoteID kDefaultRemoteID = 1;     // 1st (& usually only) remote server
 
+        using RemoteRevMap = std::map<RemoteID, const Rev*, std::less<RemoteID>,
+                                      ArenaAllocator<std::pair<const RemoteID, const Rev*>>>;
+
         const Rev* latestRevisionOnRemote(RemoteID);
         void setLatestRevisionOnRemote(RemoteID, const Rev*);
+        const RemoteRevMap& remoteRevisions() const     {return _remoteRevs;}
 
 #if DEBUG
         void dump();
@@ -174,6 +192,13 @@ namespace litecore {
         virtual void dump(std::ostream&);
 #endif
 
+        /** Marks the bodies of all revisions except the current one as stored externally, so
+            encode() will leave them out. (The current revision's body always stays inline.)
+            Returns the revisions whose bodies weren't already external; the caller has to store
+            them, or call keepBodiesInline on them if that fails. */
+        std::vector<const Rev*> externalizeBodies();
+        void keepBodiesInline(const std::vector<const Rev*>&);
+
         bool _changed {false};
         bool _unknown {false};
 
@@ -183,16 +208,21 @@ namespace litecore {
         void initRevs();
         Rev* _insert(revid, alloc_slice body, Rev *parentRev, Rev::Flags, bool markConflicts);
         bool confirmLeaf(Rev* testRev NONNULL);
+        bool staysSortedAtFront(const Rev *newRev NONNULL, const Rev *parentRev) const;
         void compact();
         void checkForResolvedConflict();
 
-        using RemoteRevMap = std::unordered_map<RemoteID, const Rev*>;
+        revid copyRevID(revid);
+
+        using RevStorage = std::deque<Rev, ArenaAllocator<Rev>>;
+        using InsertedData = std::vector<alloc_slice, ArenaAllocator<alloc_slice>>;
 
-        bool                     _sorted {true};        // Is _revs currently sorted?
-        std::vector<Rev*>        _revs;                 // Revs in sorted order
-        std::deque<Rev>          _revsStorage;          // Actual storage of the Rev objects
-        std::vector<alloc_slice> _insertedData;         // Storage for new revids
-        RemoteRevMap             _remoteRevs;           // Tracks current rev for a remote DB URL
+        Arena        _arena;                // Allocates the Revs, new revIDs, and the containers
+        bool         _sorted {true};        // Is _revs currently sorted?
+        RevVector    _revs;                 // Revs in sorted order
+        RevStorage   _revsStorage;          // Actual storage of the Rev objects
+        InsertedData _insertedData;         // Storage for new bodies
+        RemoteRevMap _remoteRevs;           // Tracks current rev for a remote DB URL
     };
 
 }
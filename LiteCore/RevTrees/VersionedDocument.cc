@@ -22,21 +22,30 @@
 #include "DataFile.hh"
 #include "Error.hh"
 #include "Doc.hh"
+#include "RawRevTree.hh"
+#include "Logging.hh"
 #include "varint.hh"
+#include <algorithm>
 #include <ostream>
 
 namespace litecore {
+    using namespace std;
     using namespace fleece;
     using namespace fleece::impl;
 
-    VersionedDocument::VersionedDocument(KeyStore& store, slice docID)
-    :_store(store), _rec(docID)
+    // Separates the docID from the revID in a key of the body store. DocIDs can't contain
+    // control characters, so this is unambiguous.
+    static const char kBodyKeySeparator = '\x1F';
+
+    VersionedDocument::VersionedDocument(KeyStore& store, slice docID, DecodeMode mode)
+    :_store(store), _rec(docID), _decodeMode(mode)
     {
-        read();
+        _store.read(_rec);
+        decode();
     }
 
-    VersionedDocument::VersionedDocument(KeyStore& store, const Record& rec)
-    :_store(store), _rec(std::move(rec))
+    VersionedDocument::VersionedDocument(KeyStore& store, const Record& rec, DecodeMode mode)
+    :_store(store), _rec(std::move(rec)), _decodeMode(mode)
     {
         decode();
     }
@@ -45,7 +54,12 @@ namespace litecore {
     :RevTree(other)
     ,_store(other._store)
     ,_rec(other._rec)
+    ,_decodeMode(other._decodeMode)
+    ,_treePending(other._treePending)
+    ,_pendingCurrentRev(other._pendingCurrentRev)
+    ,_externalBodies(other._externalBodies)
     {
+        _pendingCurrentRev.owner = this;
         updateScope();
     }
 
@@ -54,30 +68,66 @@ namespace litecore {
     }
 
     void VersionedDocument::read() {
-        _store.read(_rec);
-        decode();
+        if (!_treePending) {
+            _store.read(_rec);
+            decode();
+        }
+        if (_treePending)
+            decodeTree();
     }
 
     void VersionedDocument::decode() {
         _unknown = false;
+        _treePending = false;
+        _externalBodies.clear();
         updateScope();
         if (_rec.body().buf) {
-            RevTree::decode(_rec.body(), _rec.sequence());
-            // The kSynced flag is set when the document's current revision is pushed to a server.
-            // This is done instead of updating the doc body, for reasons of speed. So when loading
-            // the document, detect that flag and belatedly update the current revision's flags.
-            // Since the revision is now likely stored on the server, it may be the base of a merge
-            // in the future, so preserve its body:
-            if (_rec.flags() & DocumentFlags::kSynced) {
-                setLatestRevisionOnRemote(kDefaultRemoteID, currentRevision());
-                keepBody(currentRevision());
-                _changed = false;
+            if (_decodeMode == kDecodeLazily) {
+                // Just decode the current revision, which is all most callers want; the RevTree
+                // stays empty (and its accessors will assert) until decodeTree is called:
+                _treePending = _unknown = true;
+                if (RawRevision::decodeCurrentRev(_rec.body(), _pendingCurrentRev,
+                                                  this, _rec.sequence())) {
+                    if (_rec.flags() & DocumentFlags::kSynced)   // see decodeTree
+                        _pendingCurrentRev.flags = Rev::Flags(_pendingCurrentRev.flags
+                                                              | Rev::kKeepBody);
+                } else {
+                    _pendingCurrentRev.revID = revid();
+                }
+            } else {
+                decodeTree();
             }
         } else if (_rec.bodySize() > 0) {
             _unknown = true;        // i.e. rec was read as meta-only
         }
     }
 
+    void VersionedDocument::decodeTree() {
+        if (!_rec.body().buf)
+            return;
+        _treePending = _unknown = false;
+        RevTree::decode(_rec.body(), _rec.sequence());
+        for (auto rev : allRevisions()) {
+            if (rev->isBodyExternal())
+                _externalBodies.emplace_back(rev->revID);
+        }
+        // The kSynced flag is set when the document's current revision is pushed to a server.
+        // This is done instead of updating the doc body, for reasons of speed. So when loading
+        // the document, detect that flag and belatedly update the current revision's flags.
+        // Since the revision is now likely stored on the server, it may be the base of a merge
+        // in the future, so preserve its body:
+        if (_rec.flags() & DocumentFlags::kSynced) {
+            setLatestRevisionOnRemote(kDefaultRemoteID, currentRevision());
+            keepBody(currentRevision());
+            _changed = false;
+        }
+    }
+
+    const Rev* VersionedDocument::pendingCurrentRevision() const {
+        Assert(_treePending);
+        return _pendingCurrentRev.revID.buf ? &_pendingCurrentRev : nullptr;
+    }
+
     void VersionedDocument::updateScope() {
         Assert(_fleeceScopes.empty());
         addScope(_rec.body());
@@ -108,6 +158,70 @@ namespace litecore {
     }
 
 
+#pragma mark - EXTERNAL BODIES:
+
+
+    string VersionedDocument::externalBodyStoreName(const KeyStore &store) {
+        return store.name() + "_revbodies";
+    }
+
+    alloc_slice VersionedDocument::externalBodyKey(slice docID, revid revID) {
+        string key = string(docID);
+        key += kBodyKeySeparator;
+        key += string(revID.expanded());
+        return alloc_slice(key);
+    }
+
+    KeyStore& VersionedDocument::externalBodyStore() const {
+        return _store.dataFile().getKeyStore(externalBodyStoreName(_store),
+                                             KeyStore::Capabilities::defaults);
+    }
+
+    alloc_slice VersionedDocument::readBodyOfRevision(const Rev *rev) const {
+        if (rev->isBodyAvailable() || !rev->isBodyExternal())
+            return RevTree::readBodyOfRevision(rev);
+        Record rec = externalBodyStore().get(externalBodyKey(docID(), rev->revID));
+        if (!rec.exists())
+            Warn("Body of revision %s of doc \"%.*s\" is missing",
+                 string(rev->revID.expanded()).c_str(), SPLAT(docID()));
+        return rec.body();
+    }
+
+    // Writes the bodies that have just been moved out of the tree, and deletes the ones that
+    // are no longer needed.
+    void VersionedDocument::saveExternalBodies(const vector<const Rev*> &newBodies,
+                                               Transaction &t)
+    {
+        vector<alloc_slice> external;
+        for (auto rev : allRevisions()) {
+            if (rev->isBodyExternal())
+                external.emplace_back(rev->revID);
+        }
+        if (external.empty() && _externalBodies.empty())
+            return;
+        KeyStore &bodies = externalBodyStore();
+        for (auto rev : newBodies)
+            bodies.set(externalBodyKey(docID(), rev->revID), rev->body(), t);
+        for (auto &revID : _externalBodies) {
+            if (find(external.begin(), external.end(), revID) == external.end())
+                bodies.del(externalBodyKey(docID(), revid(revID)), t);
+        }
+        _externalBodies = move(external);
+    }
+
+    void VersionedDocument::deleteExternalBodies(Transaction &t) {
+        if (_externalBodies.empty())
+            return;
+        KeyStore &bodies = externalBodyStore();
+        for (auto &revID : _externalBodies)
+            bodies.del(externalBodyKey(docID(), revid(revID)), t);
+        _externalBodies.clear();
+    }
+
+
+#pragma mark - SAVING:
+
+
     bool VersionedDocument::updateMeta() {
         auto oldFlags = _rec.flags();
         alloc_slice oldRevID = _rec.version();
@@ -144,14 +258,20 @@ namespace litecore {
         bool createSequence;
         if (currentRevision()) {
             removeNonLeafBodies();
+            vector<const Rev*> newExternalBodies;
+            if (_store.dataFile().canStoreExternalRevisionBodies())
+                newExternalBodies = externalizeBodies();
             auto newBody = encode();
             createSequence = seq == 0 || hasNewRevisions();
             // (Don't call _rec.setBody(), because it'd invalidate all the inner pointers from
             // Revs into the existing body buffer.)
             seq = _store.set(_rec.key(), _rec.version(), newBody, _rec.flags(),
                           transaction, &seq, createSequence);
-            if (!seq)
+            if (!seq) {
+                keepBodiesInline(newExternalBodies);
                 return kConflict;               // Conflict
+            }
+            saveExternalBodies(newExternalBodies, transaction);
             _rec.updateSequence(seq);
             _rec.setExists();
             if (createSequence)
@@ -160,6 +280,7 @@ namespace litecore {
             createSequence = false;
             if (seq && !_store.del(_rec.key(), transaction, seq))
                 return kConflict;
+            saveExternalBodies({}, transaction);
         }
         _changed = false;
         return createSequence ? kNewSequence : kNoNewSequence;
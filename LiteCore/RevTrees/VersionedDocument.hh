@@ -22,6 +22,8 @@
 #include "Doc.hh"
 #include <memory>
 #include <deque>
+#include <string>
+#include <vector>
 
 namespace fleece { namespace impl {
     class Scope;
@@ -31,22 +33,38 @@ namespace litecore {
     class KeyStore;
     class Transaction;
 
-    /** Manages storage of a serialized RevTree in a Record. */
+    /** Manages storage of a serialized RevTree in a Record.
+        Only the current revision's body is stored inline in the tree. Bodies of other revisions
+        (conflicts, or ones kept for merging or deltas) are stored in a separate KeyStore, keyed
+        by docID and revID, and read only when they're asked for (see RevTree::loadBody.) */
     class VersionedDocument : public RevTree {
     public:
 
-        VersionedDocument(KeyStore&, slice docID);
-        VersionedDocument(KeyStore&, const Record&);
+        /** With kDecodeLazily, the revision tree isn't decoded when the record is loaded; only the
+            current revision is available, via `pendingCurrentRevision`, until `read` is called. */
+        enum DecodeMode {kDecodeNow, kDecodeLazily};
+
+        VersionedDocument(KeyStore&, slice docID, DecodeMode =kDecodeNow);
+        VersionedDocument(KeyStore&, const Record&, DecodeMode =kDecodeNow);
 
         VersionedDocument(const VersionedDocument&);
         ~VersionedDocument();
 
-        /** Reads and parses the body of the record. Useful if doc was read as meta-only. */
+        /** Reads and parses the body of the record. Useful if doc was read as meta-only, or if
+            decoding the revision tree was deferred. */
         void read();
 
-        /** Returns false if the record was loaded metadata-only. Revision accessors will fail. */
+        /** Returns false if the record was loaded metadata-only, or its revision tree hasn't been
+            decoded yet. Revision accessors will fail. */
         bool revsAvailable() const {return !_unknown;}
 
+        /** Returns true if the revision tree was loaded but not yet decoded (see kDecodeLazily.) */
+        bool treePending() const    {return _treePending;}
+
+        /** While the tree is pending, returns the current revision, decoded on its own. It has no
+            parent, and isn't part of the tree, so it can't be passed to RevTree methods. */
+        const Rev* pendingCurrentRevision() const;
+
         const alloc_slice& docID() const {return _rec.key();}
         revid revID() const         {return revid(_rec.version());}
         DocumentFlags flags() const {return _rec.flags();}
@@ -68,10 +86,18 @@ namespace litecore {
 
         const fleece::impl::Scope& scopeFor(slice) const;
 
+        /** Deletes the revision bodies stored outside the tree. Call this before the record
+            itself is deleted without going through save(), i.e. when it's purged or expired. */
+        void deleteExternalBodies(Transaction&);
+
+        /** The name of the KeyStore holding the revision bodies stored outside trees. */
+        static std::string externalBodyStoreName(const KeyStore&);
+
 #if DEBUG
         void dump()          {RevTree::dump();}
 #endif
     protected:
+        virtual alloc_slice readBodyOfRevision(const Rev* NONNULL) const override;
         virtual alloc_slice copyBody(slice body) override;
         virtual alloc_slice copyBody(const alloc_slice &body) override;
 #if DEBUG
@@ -80,11 +106,19 @@ namespace litecore {
 
     private:
         void decode();
+        void decodeTree();
         void updateScope();
         alloc_slice addScope(const alloc_slice &body);
+        static alloc_slice externalBodyKey(slice docID, revid);
+        KeyStore& externalBodyStore() const;
+        void saveExternalBodies(const std::vector<const Rev*> &newBodies, Transaction&);
 
         KeyStore&       _store;
         Record          _rec;
+        DecodeMode      _decodeMode;
+        bool            _treePending {false};
+        Rev             _pendingCurrentRev {};  // Current rev, if _treePending
+        std::vector<alloc_slice> _externalBodies;   // RevIDs whose bodies are in the body store
         std::deque<fleece::impl::Scope> _fleeceScopes;
     };
 }
@@ -99,6 +99,11 @@ namespace litecore {
         /** Private API to run a raw (e.g. SQL) query, for diagnostic purposes only */
         virtual fleece::alloc_slice rawQuery(const std::string &query) =0;
 
+        /** True if the file's format allows revision bodies to be stored outside their
+            documents' trees (see VersionedDocument.) Older files don't, so that older versions
+            of LiteCore can still read them. */
+        virtual bool canStoreExternalRevisionBodies() const noexcept  {return false;}
+
         //////// KEY-STORES:
 
         static const std::string kDefaultKeyStoreName;
@@ -111,6 +116,9 @@ namespace litecore {
         KeyStore& getKeyStore(const std::string &name) const;
         KeyStore& getKeyStore(const std::string &name, KeyStore::Capabilities) const;
 
+        /** Returns true if a KeyStore with this name exists in the file (opened yet or not.) */
+        virtual bool keyStoreExists(const std::string &name) =0;
+
 #if 0 //UNUSED:
         /** The names of all existing KeyStores (whether opened yet or not) */
         virtual std::vector<std::string> allKeyStoreNames() =0;
@@ -30,7 +30,8 @@ namespace litecore {
 
     const KeyStore::Capabilities KeyStore::Capabilities::defaults = {false};
 
-    const char* KeyStore::kIndexTypeName[] = {"value", "full-text", "array", "predictive"};
+    const char* KeyStore::kIndexTypeName[] = {"value", "full-text", "array", "predictive",
+                                              "geospatial", "vector"};
 
 
     Record KeyStore::get(slice key, ContentOptions options) const {
@@ -39,15 +40,15 @@ namespace litecore {
         return rec;
     }
 
-    void KeyStore::get(slice key, ContentOptions options, function_ref<void(const Record&)> fn) {
+    void KeyStore::get(slice key, ContentOptions options, function_ref<void(const RecordLite&)> fn) {
         // Subclasses can implement this differently for better memory management.
         Record rec(key);
         read(rec, options);
-        fn(rec);
+        fn(RecordLite(rec));
     }
 
-    void KeyStore::get(sequence_t seq, function_ref<void(const Record&)> fn) {
-        fn(get(seq));
+    void KeyStore::get(sequence_t seq, function_ref<void(const RecordLite&)> fn) {
+        fn(RecordLite(get(seq)));
     }
 
     void KeyStore::readBody(Record &rec) const {
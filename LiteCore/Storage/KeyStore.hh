@@ -21,6 +21,7 @@
 #include "RefCounted.hh"
 #include "RecordEnumerator.hh"
 #include "function_ref.hh"
+#include <functional>
 
 namespace litecore {
 
@@ -67,8 +68,11 @@ namespace litecore {
         Record get(slice key, ContentOptions = kDefaultContent) const;
         virtual Record get(sequence_t) const =0;
 
-        virtual void get(slice key, ContentOptions, function_ref<void(const Record&)>);
-        virtual void get(sequence_t, function_ref<void(const Record&)>);
+        /** Reads a record and passes it to the callback without copying its data; see
+            RecordLite. The callback must not call back into this KeyStore. If the record
+            doesn't exist, the RecordLite's `exists` is false. */
+        virtual void get(slice key, ContentOptions, function_ref<void(const RecordLite&)>);
+        virtual void get(sequence_t, function_ref<void(const RecordLite&)>);
 
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOptions options = kDefaultContent) const =0;
@@ -125,9 +129,12 @@ namespace litecore {
         /** Returns the nearest future time at which a record will expire, or 0 if none. */
         virtual expiration_t nextExpiration() =0;
 
+        using ExpirationCallback = std::function<void(slice key)>;
+
         /** Deletes all records whose expiration time is in the past.
+            If a callback is given, it's first called with the key of each record to be deleted.
             @return  The number of records deleted */
-        virtual unsigned expireRecords() =0;
+        virtual unsigned expireRecords(const ExpirationCallback& =nullptr) =0;
 
 
         //////// Indexing:
@@ -137,6 +144,8 @@ namespace litecore {
             kFullTextIndex,      ///< Full-text index, for MATCH queries
             kArrayIndex,         ///< Index of array values, for UNNEST queries
             kPredictiveIndex,    ///< Index of prediction results
+            kGeoIndex,           ///< R*Tree index of lat/lon points, for WITHIN_BOX/WITHIN_RADIUS
+            kVectorIndex,        ///< Index of numeric vectors, for VECTOR_MATCH queries
         };
 
         static const char* kIndexTypeName[];
@@ -82,5 +82,16 @@ namespace litecore {
     }
 
 
+    RecordLite::RecordLite(const Record &rec)
+    :key(rec.key())
+    ,version(rec.version())
+    ,body(rec.body())
+    ,bodySize(rec.bodySize())
+    ,sequence(rec.sequence())
+    ,flags(rec.flags())
+    ,exists(rec.exists())
+    { }
+
+
 
 }
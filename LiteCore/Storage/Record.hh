@@ -95,4 +95,20 @@ namespace litecore {
         bool            _exists {false};        // Does the record exist?
     };
 
+
+    /** A read-only view of a record, passed to the callbacks of the KeyStore::get methods that
+        take one. Its slices point to memory owned by the storage engine (for SQLite, often its
+        memory-mapped file), so no copies are made; they're only valid until the callback
+        returns. Copy them if they need to last longer. */
+    struct RecordLite {
+        slice           key, version, body;     // (body is null if only meta was requested)
+        size_t          bodySize {0};
+        sequence_t      sequence {0};
+        DocumentFlags   flags {DocumentFlags::kNone};
+        bool            exists {false};
+
+        RecordLite() { }
+        explicit RecordLite(const Record&);
+    };
+
 }
@@ -37,6 +37,7 @@ namespace litecore {
     :descending(false),
      includeDeleted(false),
      onlyBlobs(false),
+     onlyConflicts(false),
      contentOptions(kDefaultContent)
     { }
 
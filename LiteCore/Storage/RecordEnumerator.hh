@@ -46,6 +46,7 @@ namespace litecore {
             bool           descending     :1;   ///< Reverse order? (Start must be
             bool           includeDeleted :1;   ///< Include deleted records?
             bool           onlyBlobs      :1;   ///< Only include records which contain linked binary data
+            bool           onlyConflicts  :1;   ///< Only include records flagged as conflicted
             ContentOptions contentOptions :4;   ///< Load record bodies?
 
             /** Default options have all flags false, and kDefaultContent */
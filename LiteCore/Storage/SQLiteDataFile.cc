@@ -56,7 +56,13 @@ namespace litecore {
 
     // Min/max user_version of db files I can read
     static const int kMinUserVersion = 201;
-    static const int kMaxUserVersion = 399;
+    static const int kMaxUserVersion = 499;
+
+    // user_version of new db files. Files at 400 or above may store revision bodies outside
+    // their documents' trees, which builds that only understand 2xx/3xx can't read; so existing
+    // files stay at their version and keep all bodies inline.
+    static const int kExternalRevBodiesUserVersion = 400;
+    static const int kCurrentUserVersion = kExternalRevBodiesUserVersion;
 
     // SQLite page size
     static const int64_t kPageSize = 4096;
@@ -203,13 +209,15 @@ namespace litecore {
                      );
                 // Create the default KeyStore's table:
                 (void)defaultKeyStore();
-                _exec("PRAGMA user_version=201; "
-                      "END;");
+                _exec(format("PRAGMA user_version=%d; "
+                             "END;", kCurrentUserVersion));
+                userVersion = kCurrentUserVersion;
             } else if (userVersion < kMinUserVersion) {
                 error::_throw(error::DatabaseTooOld);
             } else if (userVersion > kMaxUserVersion) {
                 error::_throw(error::DatabaseTooNew);
             }
+            _externalRevBodies = (userVersion >= kExternalRevBodiesUserVersion);
         });
 
         _exec(format("PRAGMA cache_size=%d; "            // Memory cache
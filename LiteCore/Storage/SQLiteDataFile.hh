@@ -52,7 +52,7 @@ namespace litecore {
 #if 0 //UNUSED:
         std::vector<std::string> allKeyStoreNames() override;
 #endif
-        bool keyStoreExists(const std::string &name);
+        bool keyStoreExists(const std::string &name) override;
         bool tableExists(const std::string &name) const;
         bool getSchema(const std::string &name, const std::string &type,
                        const std::string &tableName, std::string &outSQL) const;
@@ -61,6 +61,8 @@ namespace litecore {
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
+        bool canStoreExternalRevisionBodies() const noexcept override {return _externalRevBodies;}
+
         class Factory : public DataFile::Factory {
         public:
             Factory();
@@ -141,6 +143,7 @@ namespace litecore {
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
         CollationContextVector _collationContexts;
+        bool                                 _externalRevBodies {false};
     };
 
 }
@@ -82,6 +82,8 @@ namespace litecore {
     {
         if (bySequence && _db.options().writeable)
             createSequenceIndex();
+        if (options.onlyConflicts && _db.options().writeable)
+            createConflictsIndex();
 
         stringstream sql;
         selectFrom(sql, options);
@@ -90,7 +92,7 @@ namespace litecore {
             sql << " WHERE sequence > ?";
             writeAnd = true;
         } else {
-            if (!options.includeDeleted || options.onlyBlobs)
+            if (!options.includeDeleted || options.onlyBlobs || options.onlyConflicts)
                 sql << " WHERE ";
         }
         if (!options.includeDeleted) {
@@ -98,9 +100,14 @@ namespace litecore {
             sql << "(flags & 1) != 1";
         }
         if (options.onlyBlobs) {
-            if(writeAnd) sql << " AND "; // else writeAnd = true;
+            if(writeAnd) sql << " AND "; else writeAnd = true;
             sql << "(flags & 4) != 0";
         }
+        if (options.onlyConflicts) {
+            // (This expression has to match the partial index's WHERE clause for SQLite to use it.)
+            if(writeAnd) sql << " AND "; else writeAnd = true;
+            sql << "(flags & 2) != 0";
+        }
         sql << (bySequence ? " ORDER BY sequence" : " ORDER BY key");
         writeSQLOptions(sql, options);
 
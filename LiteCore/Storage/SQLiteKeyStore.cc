@@ -89,6 +89,7 @@ namespace litecore {
         _setExpStmt.reset();
         _getExpStmt.reset();
         _nextExpStmt.reset();
+        _findExpStmt.reset();
         KeyStore::close();
     }
 
@@ -174,7 +175,8 @@ namespace litecore {
 
     // OPT: Would be nice to avoid copying key/vers/body here; this would require Record to
     // know that the pointers are ephemeral, and create copies if they're accessed as
-    // alloc_slice (not just slice).
+    // alloc_slice (not just slice). The get() methods taking callbacks do avoid copying, by
+    // using RecordLite instead.
 
 
     // Gets flags from col 1, version from col 3, and body (or its length) from col 4
@@ -230,6 +232,60 @@ namespace litecore {
     }
 
 
+    // Gets sequence from col 0 (unless it's 0), flags from col 1, version from col 3, and body
+    // (or its length) from col 4. The slices point into SQLite's copy of the row, which for a
+    // memory-mapped database is often the mapped file itself; they're valid until the statement
+    // is stepped or reset.
+    static RecordLite recordLiteFromRow(SQLite::Statement &stmt, ContentOptions options) {
+        RecordLite rec;
+        rec.exists = true;
+        rec.sequence = (int64_t)stmt.getColumn(0);
+        rec.flags = (DocumentFlags)(int)stmt.getColumn(1);
+        rec.version = SQLiteKeyStore::columnAsSlice(stmt.getColumn(3));
+        if (options & kMetaOnly) {
+            rec.bodySize = (int64_t)stmt.getColumn(4);
+        } else {
+            rec.body = SQLiteKeyStore::columnAsSlice(stmt.getColumn(4));
+            rec.bodySize = rec.body.size;
+        }
+        return rec;
+    }
+
+
+    void SQLiteKeyStore::get(slice key, ContentOptions options,
+                             function_ref<void(const RecordLite&)> fn)
+    {
+        auto &stmt = (options & kMetaOnly)
+            ? compile(_getMetaByKeyStmt,
+                      "SELECT sequence, flags, 0, version, length(body) FROM kv_@ WHERE key=?")
+            : compile(_getByKeyStmt,
+                      "SELECT sequence, flags, 0, version, body FROM kv_@ WHERE key=?");
+        stmt.bindNoCopy(1, (const char*)key.buf, (int)key.size);
+        UsingStatement u(stmt);         // (resets the statement after the callback returns)
+        RecordLite rec;
+        if (stmt.executeStep())
+            rec = recordLiteFromRow(stmt, options);
+        rec.key = key;
+        fn(rec);
+    }
+
+
+    void SQLiteKeyStore::get(sequence_t seq, function_ref<void(const RecordLite&)> fn) {
+        Assert(_capabilities.sequences);
+        auto &stmt = compile(_getBySeqStmt,
+                             "SELECT 0, flags, key, version, body FROM kv_@ WHERE sequence=?");
+        UsingStatement u(stmt);
+        stmt.bind(1, (long long)seq);
+        RecordLite rec;
+        if (stmt.executeStep()) {
+            rec = recordLiteFromRow(stmt, kDefaultContent);
+            rec.key = columnAsSlice(stmt.getColumn(2));
+            rec.sequence = seq;
+        }
+        fn(rec);
+    }
+
+
     sequence_t SQLiteKeyStore::set(slice key, slice vers, slice body, DocumentFlags flags,
                                    Transaction&,
                                    const sequence_t *replacingSequence,
@@ -410,11 +466,19 @@ namespace litecore {
     }
 
 
-    unsigned SQLiteKeyStore::expireRecords() {
+    unsigned SQLiteKeyStore::expireRecords(const ExpirationCallback &callback) {
         unsigned expired = 0;
         if (hasExpiration()) {
+            expiration_t t = now();
+            if (callback) {
+                compile(_findExpStmt, "SELECT key FROM kv_@ WHERE expiration <= ?");
+                UsingStatement u(*_findExpStmt);
+                _findExpStmt->bind(1, (long long)t);
+                while (_findExpStmt->executeStep())
+                    callback(columnAsSlice(_findExpStmt->getColumn(0)));
+            }
             expired = db().exec(format("DELETE FROM kv_%s WHERE expiration <= %lld",
-                                       name().c_str(), now()));
+                                       name().c_str(), (long long)t));
         }
         db()._logInfo("Purged %u expired documents", expired);
         return expired;
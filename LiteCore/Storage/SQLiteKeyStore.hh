@@ -40,6 +40,8 @@ namespace litecore {
 
         Record get(sequence_t) const override;
         bool read(Record &rec, ContentOptions options) const override;
+        void get(slice key, ContentOptions, function_ref<void(const RecordLite&)>) override;
+        void get(sequence_t, function_ref<void(const RecordLite&)>) override;
 
         sequence_t set(slice key, slice meta, slice value, DocumentFlags,
                        Transaction&,
@@ -55,7 +57,7 @@ namespace litecore {
         virtual bool setExpiration(slice key, expiration_t) override;
         virtual expiration_t getExpiration(slice key) override;
         virtual expiration_t nextExpiration() override;
-        virtual unsigned expireRecords() override;
+        virtual unsigned expireRecords(const ExpirationCallback& =nullptr) override;
 
         bool supportsIndexes(IndexType t) const override               {return true;}
         bool createIndex(const IndexSpec&, const IndexOptions* = nullptr) override;
@@ -64,11 +66,14 @@ namespace litecore {
         std::vector<IndexSpec> getIndexes() const override;
 
         void createSequenceIndex();
+        void createConflictsIndex();
 
         // QueryParser::delegate:
         virtual std::string tableName() const override  {return std::string("kv_") + name();}
         virtual std::string FTSTableName(const std::string &property) const override;
         virtual std::string unnestedTableName(const std::string &property) const override;
+        virtual std::string geoTableName(const std::string &identifier) const override;
+        virtual std::string vectorTableName(const std::string &identifier) const override;
 #ifdef COUCHBASE_ENTERPRISE
         virtual std::string predictiveTableName(const std::string &property) const override;
 #endif
@@ -117,6 +122,10 @@ namespace litecore {
         bool createFTSIndex(const IndexSpec&, const fleece::impl::Array *params, const IndexOptions*);
         bool createArrayIndex(const IndexSpec&, const fleece::impl::Array *params, const IndexOptions*);
         std::string createUnnestedTable(const fleece::impl::Value *arrayPath, const IndexOptions*);
+        bool createGeoIndex(const IndexSpec&, const fleece::impl::Array *params, const IndexOptions*);
+        std::string createGeoTable(const fleece::impl::Array *latLonExpressions);
+        bool createVectorIndex(const IndexSpec&, const fleece::impl::Array *params, const IndexOptions*);
+        std::string createVectorTable(const fleece::impl::Array *expressions);
         bool hasExpiration();
         void addExpiration();
 
@@ -135,8 +144,10 @@ namespace litecore {
         std::unique_ptr<SQLite::Statement> _delByKeyStmt, _delBySeqStmt, _delByBothStmt;
         std::unique_ptr<SQLite::Statement> _setFlagStmt;
         std::unique_ptr<SQLite::Statement> _setExpStmt, _getExpStmt, _nextExpStmt;
+        std::unique_ptr<SQLite::Statement> _findExpStmt;
 
         bool _createdSeqIndex {false};     // Created by-seq index yet?
+        bool _createdConflictsIndex {false}; // Created conflicted-docs index yet?
         bool _lastSequenceChanged {false};
         int64_t _lastSequence {-1};
         bool _hasExpirationColumn {false};
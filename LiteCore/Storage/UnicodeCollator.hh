@@ -85,6 +85,19 @@ namespace litecore {
     void RegisterSQLiteUnicodeCollations(sqlite3*, CollationContextVector&);
 
 
+    /** True if this platform's collator can generate sort keys (see CollationSortKey.) */
+    bool SupportsCollationSortKeys();
+
+    /** Creates a context for the collation, for use with CollationSortKey. */
+    std::unique_ptr<CollationContext> NewCollationContext(const Collation&);
+
+    /** Returns a binary sort key for a UTF8-encoded string. Comparing two keys with memcmp (i.e.
+        as SQLite blobs) gives the same ordering as comparing the strings with the collation.
+        Keys depend on the platform's collation data, so they're not meant to be portable.
+        Returns a null slice if SupportsCollationSortKeys() is false. */
+    fleece::alloc_slice CollationSortKey(CollationContext&, fleece::slice str);
+
+
     /** Simple comparison of two UTF8- or UTF16-encoded strings. Uses Unicode ordering, but gives
         up and returns kCompareASCIIGaveUp if it finds any non-ASCII characters. */
     template <class CHAR>       // uint8_t or uchar16_t
@@ -122,6 +122,22 @@ namespace litecore {
     }
 
 
+    // CoreFoundation has no public API for sort keys, so queries fall back to comparisons.
+    bool SupportsCollationSortKeys() {
+        return false;
+    }
+
+
+    unique_ptr<CollationContext> NewCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new CFCollationContext(coll));
+    }
+
+
+    alloc_slice CollationSortKey(CollationContext&, slice str) {
+        return nullslice;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new CFCollationContext(coll));
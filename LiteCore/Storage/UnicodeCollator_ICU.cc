@@ -47,6 +47,7 @@
 #pragma clang diagnostic ignored "-Wdocumentation"
 #include <unicode/uloc.h>
 #include <unicode/ucol.h>
+#include <unicode/uiter.h>
 #pragma clang diagnostic pop
 
 // http://userguide.icu-project.org/collation
@@ -137,6 +138,43 @@ namespace litecore {
     }
 
 
+    bool SupportsCollationSortKeys() {
+        return true;
+    }
+
+
+    unique_ptr<CollationContext> NewCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new ICUCollationContext(coll));
+    }
+
+
+    alloc_slice CollationSortKey(CollationContext &context, slice str) {
+        auto &ctx = (ICUCollationContext&)context;
+        // Unlike ucol_getSortKey, ucol_nextSortKeyPart reads UTF-8 directly (via an iterator),
+        // so there's no need to convert to UTF-16 first. It writes the key a chunk at a time.
+        UCharIterator iter;
+        uiter_setUTF8(&iter, (const char*)str.buf, (int32_t)str.size);
+        uint32_t state[2] = {0, 0};
+        alloc_slice key(2 * str.size + 16);
+        size_t length = 0;
+        for (;;) {
+            UErrorCode status = U_ZERO_ERROR;
+            auto space = (int32_t)(key.size - length);
+            int32_t n = ucol_nextSortKeyPart(ctx.ucoll, &iter, state,
+                                             (uint8_t*)key.buf + length, space, &status);
+            if (U_FAILURE(status))
+                error::_throw(error::UnexpectedError, "Failed to get sort key (ICU error %d)",
+                              (int)status);
+            length += n;
+            if (n < space)
+                break;
+            key.resize(2 * key.size);
+        }
+        key.shorten(length);
+        return key;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new ICUCollationContext(coll));
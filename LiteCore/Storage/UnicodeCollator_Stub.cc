@@ -33,6 +33,18 @@ namespace litecore {
                                                                 const Collation &coll) {
         return nullptr;
     }
+
+    bool SupportsCollationSortKeys() {
+        return false;
+    }
+
+    unique_ptr<CollationContext> NewCollationContext(const Collation &coll) {
+        error::_throw(error::Unimplemented);
+    }
+
+    alloc_slice CollationSortKey(CollationContext&, slice str) {
+        return nullslice;
+    }
 }
 
 #endif
@@ -139,6 +139,37 @@ namespace litecore {
     }
 
 
+    bool SupportsCollationSortKeys() {
+        return true;
+    }
+
+
+    unique_ptr<CollationContext> NewCollationContext(const Collation &coll) {
+        return unique_ptr<CollationContext>(new WinApiCollationContext(coll));
+    }
+
+
+    alloc_slice CollationSortKey(CollationContext &context, slice str) {
+        auto &ctx = (WinApiCollationContext&)context;
+        TempArray(wchars, WCHAR, str.size + 1);
+        int size = MultiByteToWideChar(CP_UTF8, 0, (const char*)str.buf, (int)str.size,
+                                       wchars, (int)str.size + 1);
+        wchars[size] = 0;
+
+        // With LCMAP_SORTKEY the destination is a byte array, and its size is in bytes:
+        DWORD flags = ctx.flags | LCMAP_SORTKEY;
+        int keySize = LCMapStringEx(ctx.localeName, flags, wchars, -1, nullptr, 0,
+                                    nullptr, nullptr, 0);
+        if (keySize == 0)
+            error::_throw(error::UnexpectedError, "Failed to get sort key (Error %d)",
+                          (int)GetLastError());
+        alloc_slice key(keySize);
+        LCMapStringEx(ctx.localeName, flags, wchars, -1, (LPWSTR)key.buf, keySize,
+                      nullptr, nullptr, 0);
+        return key;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
         const Collation &coll) {
         unique_ptr<CollationContext> context(new WinApiCollationContext(coll));
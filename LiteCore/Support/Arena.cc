@@ -0,0 +1,137 @@
+//
+// Arena.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Arena.hh"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace litecore {
+
+    namespace {
+        // Recycles standard-size blocks between the Arenas of a thread.
+        class BlockPool {
+        public:
+            static constexpr size_t kMaxBlocks = 16;
+
+            BlockPool()                 {sAlive = true;}
+
+            ~BlockPool() {
+                sAlive = false;
+                while (_count > 0)
+                    ::free(_blocks[--_count]);
+            }
+
+            void* pop() {
+                return _count > 0 ? _blocks[--_count] : nullptr;
+            }
+
+            bool push(void *block) {
+                if (_count == kMaxBlocks)
+                    return false;
+                _blocks[_count++] = block;
+                return true;
+            }
+
+            // Arenas destructed after the thread's pool (e.g. in static destructors) check this:
+            static thread_local bool sAlive;
+
+        private:
+            void*  _blocks[kMaxBlocks];
+            size_t _count {0};
+        };
+
+        thread_local bool BlockPool::sAlive = false;
+
+        // Returns the current thread's pool, creating it on first use; or nullptr if the thread
+        // is exiting and its pool has already been destructed.
+        BlockPool* blockPool() {
+            static thread_local BlockPool sPool;
+            return BlockPool::sAlive ? &sPool : nullptr;
+        }
+
+        thread_local size_t tHeapBlockCount = 0;
+
+        void* mallocBlock(size_t size) {
+            void *block = ::malloc(size);
+            if (!block)
+                throw std::bad_alloc();
+            ++tHeapBlockCount;
+            return block;
+        }
+    }
+
+
+    size_t Arena::heapBlockCount() noexcept {
+        return tHeapBlockCount;
+    }
+
+
+    Arena::~Arena() {
+        BlockPool *pool = _block ? blockPool() : nullptr;
+        Block *block = _block;
+        while (block) {
+            Block *prev = block->prev;
+            if (block->size != kBlockSize || !pool || !pool->push(block))
+                ::free(block);
+            block = prev;
+        }
+    }
+
+
+    void* Arena::allocateSlow(size_t size, size_t alignment) {
+        size_t needed = sizeof(Block) + size + alignment;
+        if (needed > kBlockSize / 2) {
+            // Large allocations get a block of their own, behind the current one, so the space
+            // left in the current block isn't wasted:
+            auto block = (Block*)mallocBlock(needed);
+            block->size = needed;
+            if (_block) {
+                block->prev = _block->prev;
+                _block->prev = block;
+            } else {
+                block->prev = nullptr;
+                _block = block;
+            }
+            ++_blockCount;
+            auto p = ((uintptr_t)(block + 1) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            return (void*)p;
+        }
+
+        Block *block = nullptr;
+        if (BlockPool *pool = blockPool())
+            block = (Block*)pool->pop();
+        if (!block)
+            block = (Block*)mallocBlock(kBlockSize);
+        block->size = kBlockSize;
+        block->prev = _block;
+        _block = block;
+        ++_blockCount;
+        _next = (uint8_t*)(block + 1);
+        _end = (uint8_t*)block + kBlockSize;
+        return allocate(size, alignment);
+    }
+
+
+    void* Arena::copy(const void *src, size_t size) {
+        void *dst = allocate(size, 1);
+        memcpy(dst, src, size);
+        return dst;
+    }
+
+}
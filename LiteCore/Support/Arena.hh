@@ -0,0 +1,122 @@
+//
+// Arena.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace litecore {
+
+    /** A "bump" allocator for many small objects that share a lifetime, like the Revs of a
+        RevTree. It carves memory out of large blocks, and frees it all at once when it's
+        destructed; deallocating a single object does nothing, unless it was the latest one.
+        Blocks of the standard size are recycled through a small per-thread pool, so a
+        short-lived Arena usually doesn't touch the heap at all.
+        An Arena is not thread-safe. */
+    class Arena {
+    public:
+        static constexpr size_t kBlockSize = 4096;
+
+        Arena() { }
+        ~Arena();
+
+        void* allocate(size_t size, size_t alignment =alignof(std::max_align_t)) {
+            auto p = ((uintptr_t)_next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            if (_next && p + size <= (uintptr_t)_end) {
+                _next = (uint8_t*)(p + size);
+                return (void*)p;
+            }
+            return allocateSlow(size, alignment);
+        }
+
+        /** Gives memory back. This only reclaims it if it was the latest allocation; anything
+            else stays allocated until the Arena is destructed. So a long-lived Arena whose
+            owner keeps replacing its contents (e.g. a RevTree that's decoded again) grows. */
+        void deallocate(void *ptr, size_t size) noexcept {
+            if ((uint8_t*)ptr + size == _next)
+                _next = (uint8_t*)ptr;
+        }
+
+        /** Allocates a copy of a byte range. */
+        void* copy(const void *src, size_t size);
+
+        /** The number of blocks the Arena owns. */
+        size_t blockCount() const           {return _blockCount;}
+
+        /** The number of blocks the current thread's Arenas have had to allocate from the heap,
+            instead of reusing them from the thread's pool. (For tests and profiling.) */
+        static size_t heapBlockCount() noexcept;
+
+    private:
+        struct Block {
+            Block* prev;
+            size_t size;
+        };
+
+        Arena(const Arena&) =delete;
+        Arena& operator=(const Arena&) =delete;
+        void* allocateSlow(size_t size, size_t alignment);
+
+        Block*   _block {nullptr};          // Current block; earlier ones are linked from it
+        uint8_t* _next {nullptr};           // Next free byte in _block
+        uint8_t* _end {nullptr};            // End of _block
+        size_t   _blockCount {0};
+    };
+
+
+    /** An STL allocator that allocates from an Arena. Containers using it must not outlive the
+        Arena; and since each container is bound to its Arena, they don't propagate allocators
+        when copied or assigned. */
+    template <class T>
+    class ArenaAllocator {
+    public:
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::false_type;
+        using propagate_on_container_swap = std::false_type;
+
+        template <class U> struct rebind {using other = ArenaAllocator<U>;};
+
+        explicit ArenaAllocator(Arena &arena) noexcept          :_arena(&arena) { }
+
+        template <class U>
+        ArenaAllocator(const ArenaAllocator<U> &other) noexcept :_arena(other._arena) { }
+
+        T* allocate(size_t n) {
+            return (T*)_arena->allocate(n * sizeof(T), alignof(T));
+        }
+
+        void deallocate(T *p, size_t n) noexcept {
+            _arena->deallocate(p, n * sizeof(T));
+        }
+
+        Arena& arena() const                                    {return *_arena;}
+
+        template <class U>
+        bool operator== (const ArenaAllocator<U> &other) const  {return _arena == other._arena;}
+        template <class U>
+        bool operator!= (const ArenaAllocator<U> &other) const  {return _arena != other._arena;}
+
+    private:
+        template <class U> friend class ArenaAllocator;
+
+        Arena* _arena;
+    };
+
+}
@@ -0,0 +1,220 @@
+//
+// CompressedStream.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "CompressedStream.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include "zlib.h"
+#include <algorithm>
+#include <string.h>
+
+namespace litecore {
+    using namespace std;
+    using namespace fleece;
+
+
+    static const size_t kBufferSize = 64 * 1024;
+    static const size_t kTrailerSize = 8;
+
+    // zlib counts bytes with `uInt`, so larger slices are passed to it in pieces of this size:
+    static const size_t kMaxChunk = 1u << 30;
+
+
+#pragma mark - SNIFFING:
+
+
+    // Signatures of file formats that are already compressed, with their offsets.
+    // See <https://en.wikipedia.org/wiki/List_of_file_signatures>
+    static const struct {size_t offset; slice signature;} kCompressedSignatures[] = {
+        {0, "\xFF\xD8\xFF"_sl},                        // JPEG
+        {0, "\x89PNG\r\n\x1A\n"_sl},                  // PNG
+        {0, "GIF8"_sl},                                // GIF
+        {8, "WEBP"_sl},                                // WebP (in a RIFF container)
+        {4, "ftyp"_sl},                                // MP4, MOV, HEIC, M4A...
+        {0, "\x1A\x45\xDF\xA3"_sl},                    // Matroska, WebM
+        {0, "ID3"_sl},                                 // MP3
+        {0, "OggS"_sl},                                // Ogg
+        {0, "fLaC"_sl},                                // FLAC
+        {0, "PK\x03\x04"_sl},                          // ZIP, and formats based on it
+        {0, "\x1F\x8B"_sl},                            // gzip
+        {0, "BZh"_sl},                                 // bzip2
+        {0, "\xFD" "7zXZ"_sl},                         // xz
+        {0, "7z\xBC\xAF\x27\x1C"_sl},                  // 7-Zip
+        {0, "\x28\xB5\x2F\xFD"_sl},                    // Zstandard
+        {0, "Rar!\x1A\x07"_sl},                        // RAR
+    };
+
+
+    /*static*/ bool CompressedWriteStream::looksCompressible(slice header) {
+        for (auto &sig : kCompressedSignatures) {
+            if (header.size >= sig.offset + sig.signature.size
+                    && memcmp((const uint8_t*)header.buf + sig.offset,
+                              sig.signature.buf, sig.signature.size) == 0)
+                return false;
+        }
+        return true;
+    }
+
+
+#pragma mark - WRITING:
+
+
+    CompressedWriteStream::CompressedWriteStream(shared_ptr<WriteStream> output)
+    :_output(output)
+    ,_z(new z_stream_s())
+    ,_outputBuffer(new uint8_t[kBufferSize])
+    {
+        if (deflateInit(_z.get(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            error::_throw(error::MemoryError);
+    }
+
+
+    CompressedWriteStream::~CompressedWriteStream() {
+        deflateEnd(_z.get());
+    }
+
+
+    void CompressedWriteStream::write(slice data) {
+        Assert(!_closed, "Attempted to write after closing");
+        _length += data.size;
+        while (data.size > 0) {
+            size_t n = min(data.size, kMaxChunk);
+            deflate(slice(data.buf, n), Z_NO_FLUSH);
+            data.moveStart(n);
+        }
+    }
+
+
+    void CompressedWriteStream::close() {
+        if (_closed)
+            return;
+        deflate(nullslice, Z_FINISH);
+        uint8_t trailer[kTrailerSize];
+        for (size_t i = 0; i < kTrailerSize; ++i)
+            trailer[i] = (uint8_t)(_length >> (8 * (kTrailerSize - 1 - i)));      // big-endian
+        _output->write(slice(trailer, kTrailerSize));
+        _output->close();
+        _closed = true;
+    }
+
+
+    void CompressedWriteStream::deflate(slice input, int flush) {
+        _z->next_in = (Bytef*)input.buf;
+        _z->avail_in = (uInt)input.size;
+        do {
+            _z->next_out = _outputBuffer.get();
+            _z->avail_out = (uInt)kBufferSize;
+            if (::deflate(_z.get(), flush) == Z_STREAM_ERROR)
+                error::_throw(error::UnexpectedError);
+            size_t written = kBufferSize - _z->avail_out;
+            if (written > 0)
+                _output->write(slice(_outputBuffer.get(), written));
+        } while (_z->avail_out == 0);
+    }
+
+
+#pragma mark - READING:
+
+
+    CompressedReadStream::CompressedReadStream(shared_ptr<SeekableReadStream> input)
+    :_input(input)
+    ,_z(new z_stream_s())
+    ,_inputBuffer(new uint8_t[kBufferSize])
+    {
+        uint64_t inputLength = _input->getLength();
+        if (inputLength < kTrailerSize)
+            error::_throw(error::CorruptData);
+        _compressedLength = inputLength - kTrailerSize;
+        uint8_t trailer[kTrailerSize];
+        _input->seek(_compressedLength);
+        if (_input->read(trailer, kTrailerSize) != kTrailerSize)
+            error::_throw(error::CorruptData);
+        _length = 0;
+        for (size_t i = 0; i < kTrailerSize; ++i)
+            _length = (_length << 8) | trailer[i];
+        _input->seek(0);
+        if (inflateInit(_z.get()) != Z_OK)
+            error::_throw(error::MemoryError);
+    }
+
+
+    CompressedReadStream::~CompressedReadStream() {
+        inflateEnd(_z.get());
+    }
+
+
+    size_t CompressedReadStream::read(void *dst, size_t count) {
+        count = (size_t)min((uint64_t)count, _length - _pos);
+        slice remaining(dst, count);
+        while (remaining.size > 0) {
+            if (_z->avail_in == 0) {
+                size_t n = (size_t)min((uint64_t)kBufferSize, _compressedLength - _compressedPos);
+                if (n > 0)
+                    n = _input->read(_inputBuffer.get(), n);
+                if (n == 0)
+                    error::_throw(error::CorruptData);      // Compressed data ended prematurely
+                _compressedPos += n;
+                _z->next_in = _inputBuffer.get();
+                _z->avail_in = (uInt)n;
+            }
+            size_t chunk = min(remaining.size, kMaxChunk);
+            _z->next_out = (Bytef*)remaining.buf;
+            _z->avail_out = (uInt)chunk;
+            int result = inflate(_z.get(), Z_NO_FLUSH);
+            remaining.moveStart(chunk - _z->avail_out);
+            if (result == Z_STREAM_END) {
+                if (remaining.size > 0)
+                    error::_throw(error::CorruptData);      // Shorter than the trailer says
+                break;
+            } else if (result != Z_OK) {
+                error::_throw(error::CorruptData);
+            }
+        }
+        _pos += count;
+        return count;
+    }
+
+
+    void CompressedReadStream::seek(uint64_t pos) {
+        pos = min(pos, _length);
+        if (pos < _pos)
+            rewind();
+        if (pos > _pos) {
+            unique_ptr<uint8_t[]> scratch(new uint8_t[kBufferSize]);
+            while (_pos < pos)
+                read(scratch.get(), (size_t)min((uint64_t)kBufferSize, pos - _pos));
+        }
+    }
+
+
+    void CompressedReadStream::rewind() {
+        if (inflateReset(_z.get()) != Z_OK)
+            error::_throw(error::UnexpectedError);
+        _z->avail_in = 0;
+        _input->seek(0);
+        _compressedPos = 0;
+        _pos = 0;
+    }
+
+
+    void CompressedReadStream::close() {
+        if (_input)
+            _input->close();
+    }
+
+}
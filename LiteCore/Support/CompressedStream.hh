@@ -0,0 +1,83 @@
+//
+// CompressedStream.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Stream.hh"
+#include <memory>
+
+struct z_stream_s;
+
+namespace litecore {
+
+    /** Compresses data written to it with zlib's deflate algorithm, and writes it to a wrapped
+        WriteStream. The compressed data is followed by an 8-byte trailer holding the
+        uncompressed length, so that CompressedReadStream can report it without decompressing. */
+    class CompressedWriteStream : public virtual WriteStream {
+    public:
+        explicit CompressedWriteStream(std::shared_ptr<WriteStream> output);
+        ~CompressedWriteStream();
+
+        void write(slice) override;
+        void close() override;
+
+        /** The minimum number of bytes that `looksCompressible` wants to see. */
+        static const size_t kSniffLength = 16;
+
+        /** Returns false if the data begins with the signature of a format that's already
+            compressed, like JPEG, PNG, MP4 or ZIP, so compressing it again would be wasted work.
+            `header` should be at least the first kSniffLength bytes of the data. */
+        static bool looksCompressible(slice header);
+
+    private:
+        void deflate(slice input, int flush);
+
+        std::shared_ptr<WriteStream> _output;       // Wrapped stream the compressed data goes to
+        std::unique_ptr<z_stream_s> _z;
+        std::unique_ptr<uint8_t[]> _outputBuffer;
+        uint64_t _length {0};                       // Uncompressed length so far
+        bool _closed {false};
+    };
+
+
+    /** Provides (random) access to a data stream compressed by CompressedWriteStream.
+        Seeking forwards decompresses and discards the data in between; seeking backwards has to
+        start over from the beginning, so it's much slower than reading sequentially. */
+    class CompressedReadStream : public virtual SeekableReadStream {
+    public:
+        explicit CompressedReadStream(std::shared_ptr<SeekableReadStream> input);
+        ~CompressedReadStream();
+
+        /** The uncompressed length, as read from the trailer. */
+        uint64_t getLength() const override         {return _length;}
+        size_t read(void *dst NONNULL, size_t count) override;
+        void seek(uint64_t pos) override;
+        void close() override;
+
+    private:
+        void rewind();
+
+        std::shared_ptr<SeekableReadStream> _input; // Wrapped stream the compressed data is read from
+        std::unique_ptr<z_stream_s> _z;
+        std::unique_ptr<uint8_t[]> _inputBuffer;
+        uint64_t _compressedLength;                 // Length of _input, minus the trailer
+        uint64_t _compressedPos {0};                // Number of bytes read from _input
+        uint64_t _length;                           // Uncompressed length
+        uint64_t _pos {0};                          // Current (uncompressed) position
+    };
+
+}
@@ -50,6 +50,9 @@
     the PKCS7 padding would increase its length, making it overflow.
  
     Finally, the nonce is appended to the end of the stream.
+
+    Since the blocks are independent, runs of them can be encrypted or decrypted together, with a
+    single read or write of the wrapped stream, reusing one cipher context.
  */
 
 
@@ -58,10 +61,13 @@ namespace litecore {
 
     extern LogDomain BlobLog;
 
+    const size_t EncryptedStream::kBulkBlocks;
+
 
     void EncryptedStream::initEncryptor(EncryptionAlgorithm alg,
                                         slice encryptionKey,
-                                        slice nonce)
+                                        slice nonce,
+                                        bool encrypt)
     {
         bool available = false;
         if (alg == kAES256) {
@@ -74,6 +80,9 @@ namespace litecore {
 
         memcpy(&_key, encryptionKey.buf, kAES256KeySize);
         memcpy(&_nonce, nonce.buf, kAES256KeySize);
+#if AES256_AVAILABLE
+        _cipher.reset(new AES256Context(encrypt, slice(_key, sizeof(_key))));
+#endif
     }
 
 
@@ -81,6 +90,29 @@ namespace litecore {
     }
 
 
+#if AES256_AVAILABLE
+    // Encrypts or decrypts consecutive full, non-final, blocks. (Their size doesn't change.)
+    void EncryptedStream::cryptBlocks(AES256Context &cipher, uint64_t blockID,
+                                      const uint8_t *src, uint8_t *dst, size_t nBlocks)
+    {
+        for (size_t i = 0; i < nBlocks; ++i, ++blockID) {
+            uint64_t iv[2] = {0, _endian_encode(blockID)};
+            cipher.crypt(slice(iv, sizeof(iv)), false,
+                         slice(dst, kFileBlockSize), slice(src, kFileBlockSize));
+            src += kFileBlockSize;
+            dst += kFileBlockSize;
+        }
+    }
+#endif
+
+
+    uint8_t* EncryptedStream::bulkBuffer() {
+        if (!_bulkBuffer)
+            _bulkBuffer.reset(new uint8_t[kBulkBlocks * kFileBlockSize]);
+        return _bulkBuffer.get();
+    }
+
+
 #pragma mark - WRITER:
 
 
@@ -93,7 +125,7 @@ namespace litecore {
         uint8_t buf[kAES256KeySize];
         slice nonce(buf, sizeof(buf));
         SecureRandomize(nonce);
-        initEncryptor(alg, encryptionKey, nonce);
+        initEncryptor(alg, encryptionKey, nonce, true);
     }
 
 
@@ -111,11 +143,10 @@ namespace litecore {
         ++_blockID;
         uint8_t cipherBuf[kFileBlockSize + kAESBlockSize];
         slice ciphertext(cipherBuf, sizeof(cipherBuf));
-        ciphertext.shorten(AES256(true,
-                                  slice(&_key, sizeof(_key)), slice(iv, sizeof(iv)),
-                                  finalBlock,
-                                  ciphertext,
-                                  plaintext));
+        ciphertext.shorten(_cipher->crypt(slice(iv, sizeof(iv)),
+                                          finalBlock,
+                                          ciphertext,
+                                          plaintext));
         _output->write(ciphertext);
         LogVerbose(BlobLog, "WRITE #%2llu: %llu bytes, final=%d --> %llu bytes ciphertext",
             (unsigned long long)(_blockID-1), (unsigned long long)plaintext.size, finalBlock, (unsigned long long)ciphertext.size);
@@ -125,6 +156,21 @@ namespace litecore {
     }
 
 
+    // Encrypts a run of full blocks and writes them with a single call.
+    void EncryptedWriteStream::writeBlocks(slice plaintext) {
+#if AES256_AVAILABLE
+        size_t nBlocks = plaintext.size / kFileBlockSize;
+        DebugAssert(plaintext.size == nBlocks * kFileBlockSize && nBlocks <= kBulkBlocks);
+        uint8_t *ciphertext = bulkBuffer();
+        cryptBlocks(*_cipher, _blockID, (const uint8_t*)plaintext.buf, ciphertext, nBlocks);
+        _blockID += nBlocks;
+        _output->write(slice(ciphertext, plaintext.size));
+#else
+        error::_throw(error::Unimplemented);
+#endif
+    }
+
+
     void EncryptedWriteStream::write(slice plaintext) {
         // Fill the current partial block buffer:
         auto capacity = min((size_t)kFileBlockSize - _bufferPos, plaintext.size);
@@ -137,9 +183,14 @@ namespace litecore {
         // Write the completed buffer:
         writeBlock(slice(_buffer, kFileBlockSize), false);
 
-        // Write entire blocks:
-        while (plaintext.size >= kFileBlockSize)
-            writeBlock(plaintext.read(kFileBlockSize), false);
+        // Write entire blocks, as many at a time as possible:
+        while (plaintext.size >= kFileBlockSize) {
+            size_t nBlocks = min(plaintext.size / kFileBlockSize, kBulkBlocks);
+            if (nBlocks == 1)
+                writeBlock(plaintext.read(kFileBlockSize), false);
+            else
+                writeBlocks(plaintext.read(nBlocks * kFileBlockSize));
+        }
 
         // Save remainder (if any) in the buffer.
         memcpy(_buffer, plaintext.buf, plaintext.size);
@@ -176,7 +227,7 @@ namespace litecore {
             error::_throw(error::CorruptData);
         _input->seek(0);
 
-        initEncryptor(alg, encryptionKey, slice(buf, sizeof(buf)));
+        initEncryptor(alg, encryptionKey, slice(buf, sizeof(buf)), false);
     }
 
 
@@ -202,11 +253,9 @@ namespace litecore {
 
         uint64_t iv[2] = {0, _endian_encode(_blockID)};
         ++_blockID;
-        size_t outputSize = AES256(false,
-                      slice(_key, sizeof(_key)),
-                      slice(iv, sizeof(iv)),
-                      finalBlock,
-                      output, slice(blockBuf, bytesRead));
+        size_t outputSize = _cipher->crypt(slice(iv, sizeof(iv)),
+                                           finalBlock,
+                                           output, slice(blockBuf, bytesRead));
         LogVerbose(BlobLog, "READ  #%2llu: %llu bytes, final=%d --> %llu bytes ciphertext",
             (unsigned long long)(_blockID-1), (unsigned long long)bytesRead, finalBlock, (unsigned long long)outputSize);
         return outputSize;
@@ -216,11 +265,31 @@ namespace litecore {
     }
 
 
+    // Reads and decrypts a run of full, non-final, blocks from the file into `remaining`, with a
+    // single read of the file.
+    void EncryptedReadStream::readBlocksFromFile(slice &remaining, size_t nBlocks) {
+        DebugAssert(nBlocks <= kBulkBlocks && _blockID + nBlocks <= _finalBlockID);
+        DebugAssert(remaining.size >= nBlocks * kFileBlockSize);
+        size_t size = nBlocks * kFileBlockSize;
+        uint8_t *ciphertext = bulkBuffer();
+        if (_input->read(ciphertext, size) < size)
+            error::_throw(error::CorruptData);
+#if AES256_AVAILABLE
+        cryptBlocks(*_cipher, _blockID, ciphertext, (uint8_t*)remaining.buf, nBlocks);
+#else
+        error::_throw(error::Unimplemented);
+#endif
+        _blockID += nBlocks;
+        remaining.moveStart(size);
+    }
+
+
     // Reads the next block from the file into _buffer
     void EncryptedReadStream::fillBuffer() {
         _bufferBlockID = _blockID;
         _bufferSize = readBlockFromFile(slice(_buffer, kFileBlockSize));
         _bufferPos = 0;
+        _bufferValid = true;
     }
 
 
@@ -239,9 +308,24 @@ namespace litecore {
         // If there's decrypted data in the buffer, copy it to the output:
         readFromBuffer(remaining);
         if (remaining.size > 0 && _blockID <= _finalBlockID) {
-            // Read & decrypt as many blocks as possible from the file to the output:
+            // Read & decrypt as many blocks as possible from the file to the output, in runs
+            // of up to kBulkBlocks (but the final block, which is padded, on its own):
+            size_t lastBlockSize = 0;
             while (remaining.size >= kFileBlockSize && _blockID <= _finalBlockID) {
-                remaining.moveStart(readBlockFromFile(remaining));
+                size_t nBlocks = min({remaining.size / kFileBlockSize, kBulkBlocks,
+                                      (size_t)(_finalBlockID - _blockID)});
+                if (nBlocks > 1) {
+                    readBlocksFromFile(remaining, nBlocks);
+                    lastBlockSize = kFileBlockSize;
+                } else {
+                    lastBlockSize = readBlockFromFile(remaining);
+                    remaining.moveStart(lastBlockSize);
+                }
+                // The buffer's now positioned at the end of the last block read, for the
+                // benefit of tell(), but it doesn't contain that block:
+                _bufferBlockID = _blockID - 1;
+                _bufferSize = _bufferPos = lastBlockSize;
+                _bufferValid = false;
             }
 
             if (remaining.size > 0) {
@@ -274,7 +358,7 @@ namespace litecore {
             pos = _inputLength;
         uint64_t blockID = min(pos / kFileBlockSize, _finalBlockID);
         uint64_t blockPos = blockID * kFileBlockSize;
-        if (blockID != _bufferBlockID) {
+        if (blockID != _bufferBlockID || !_bufferValid) {
             LogVerbose(BlobLog, "SEEK %llu (block %llu + %llu bytes)", (unsigned long long)pos, (unsigned long long)blockID, (unsigned long long)(pos - blockPos));
             _input->seek(blockPos);
             _blockID = blockID;
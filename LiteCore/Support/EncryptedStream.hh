@@ -18,6 +18,8 @@
 
 #pragma once
 #include "Stream.hh"
+#include "SecureSymmetricCrypto.hh"
+#include <memory>
 
 
 namespace litecore {
@@ -29,12 +31,21 @@ namespace litecore {
         static const unsigned kFileSizeOverhead = kKeySize;
         static const unsigned kFileBlockSize = 4096;
 
+        /** Max number of blocks read or written by a single call to the wrapped stream. */
+        static const size_t kBulkBlocks = 256;
+
     protected:
         EncryptedStream() { }
         void initEncryptor(EncryptionAlgorithm alg,
                            slice encryptionKey,
-                           slice nonce);
+                           slice nonce,
+                           bool encrypt);
         virtual ~EncryptedStream();
+#if AES256_AVAILABLE
+        static void cryptBlocks(AES256Context&, uint64_t firstBlockID,
+                                const uint8_t *src, uint8_t *dst, size_t nBlocks);
+#endif
+        uint8_t* bulkBuffer();
 
         EncryptionAlgorithm _alg;
         uint8_t _key[kKeySize];
@@ -42,6 +53,10 @@ namespace litecore {
         uint8_t _buffer[kFileBlockSize];    // stores partially read/written blocks across calls
         size_t _bufferPos {0};        // Indicates how much of buffer is used
         uint64_t _blockID   {0};        // Next block ID to be encrypted/decrypted (counter)
+#if AES256_AVAILABLE
+        std::unique_ptr<AES256Context> _cipher;     // Reusable key schedule
+#endif
+        std::unique_ptr<uint8_t[]> _bulkBuffer;     // Holds kBulkBlocks blocks; allocated lazily
     };
 
 
@@ -58,6 +73,7 @@ namespace litecore {
 
     private:
         void writeBlock(slice plaintext, bool finalBlock);
+        void writeBlocks(slice plaintext);
 
         std::shared_ptr<WriteStream> _output;    // Wrapped stream that will write the ciphertext
     };
@@ -77,6 +93,7 @@ namespace litecore {
 
     private:
         size_t readBlockFromFile(slice output);
+        void readBlocksFromFile(slice &remaining, size_t nBlocks);
         void readFromBuffer(slice &dst);
         void fillBuffer();
         void findLength();
@@ -87,6 +104,7 @@ namespace litecore {
         uint64_t _bufferBlockID {UINT64_MAX};
         uint64_t _finalBlockID;
         size_t _bufferSize {0};
+        bool _bufferValid {false};      // False if _buffer's block was read directly to the caller
     };
     
 }
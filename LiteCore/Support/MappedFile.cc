@@ -0,0 +1,115 @@
+//
+// MappedFile.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "MappedFile.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include "PlatformIO.hh"
+#include <errno.h>
+#include <algorithm>
+#include <string.h>
+
+#ifdef _MSC_VER
+    #include <io.h>
+    #include <Windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+namespace litecore {
+    using namespace std;
+
+
+    // The file is opened just long enough to map it; the mapping keeps its contents accessible.
+    MappedFile::MappedFile(const FilePath &path) {
+        FILE *file = fopen_u8(path.path().c_str(), "rb");
+        if (!file)
+            error::_throwErrno();
+        int fd = fileno(file);
+#ifdef _MSC_VER
+        HANDLE handle = (HANDLE)_get_osfhandle(fd);
+        LARGE_INTEGER size;
+        bool ok = GetFileSizeEx(handle, &size);
+        if (ok && size.QuadPart > 0) {
+            if (size.QuadPart > SIZE_MAX) {
+                fclose(file);
+                error::_throw(error::MemoryError);
+            }
+            _mapping = CreateFileMapping(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const void *addr = _mapping ? MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            ok = (addr != nullptr);
+            if (ok)
+                _contents = slice(addr, (size_t)size.QuadPart);
+            else if (_mapping)
+                CloseHandle(_mapping);
+        }
+        fclose(file);
+        if (!ok)
+            error::_throw(error::POSIX, EIO);
+#else
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            fclose(file);
+            error::_throw(error::POSIX, err);
+        }
+        if (st.st_size > 0) {
+            if ((uint64_t)st.st_size > SIZE_MAX) {
+                fclose(file);
+                error::_throw(error::MemoryError);
+            }
+            void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                int err = errno;
+                fclose(file);
+                error::_throw(error::POSIX, err);
+            }
+            _contents = slice(addr, (size_t)st.st_size);
+        }
+        fclose(file);
+#endif
+    }
+
+
+    MappedFile::~MappedFile() {
+        if (!_contents.buf)
+            return;                 // (an empty file isn't mapped)
+#ifdef _MSC_VER
+        UnmapViewOfFile(_contents.buf);
+        CloseHandle(_mapping);
+#else
+        if (munmap((void*)_contents.buf, _contents.size) != 0)
+            Warn("MappedFile: munmap failed, errno %d", errno);
+#endif
+    }
+
+
+    void MappedFileReadStream::seek(uint64_t pos) {
+        _pos = (size_t)min(pos, (uint64_t)_file->contents().size);
+    }
+
+
+    size_t MappedFileReadStream::read(void *dst, size_t count) {
+        slice contents = _file->contents();
+        count = min(count, contents.size - _pos);
+        memcpy(dst, (const uint8_t*)contents.buf + _pos, count);
+        _pos += count;
+        return count;
+    }
+
+}
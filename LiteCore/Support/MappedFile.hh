@@ -0,0 +1,62 @@
+//
+// MappedFile.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "FilePath.hh"
+#include "Stream.hh"
+
+namespace litecore {
+
+    /** A read-only memory mapping of an entire file. The file must not be modified while it's
+        mapped; truncating it would crash the process when the missing pages are accessed.
+        (On Windows, the file can't be deleted while it's mapped.) */
+    class MappedFile : public RefCounted {
+    public:
+        explicit MappedFile(const FilePath&);
+
+        /** The file's contents. Valid as long as this object is alive. */
+        slice contents() const                      {return _contents;}
+
+    protected:
+        ~MappedFile();
+
+    private:
+        slice _contents;
+#ifdef _MSC_VER
+        void* _mapping {nullptr};                   // HANDLE of the file mapping object
+#endif
+    };
+
+
+    /** Concrete ReadStream that reads a MappedFile, with no file I/O calls. */
+    class MappedFileReadStream : public virtual SeekableReadStream {
+    public:
+        explicit MappedFileReadStream(MappedFile *file NONNULL)  :_file(file) { }
+
+        virtual uint64_t getLength() const override     {return _file->contents().size;}
+        virtual void seek(uint64_t pos) override;
+        virtual size_t read(void *dst NONNULL, size_t count) override;
+        virtual void close() override                   { }
+
+    private:
+        Retained<MappedFile> _file;
+        size_t _pos {0};
+    };
+
+}
@@ -19,6 +19,7 @@
 #include "SecureSymmetricCrypto.hh"
 #include "Error.hh"
 #include "Logging.hh"
+#include <string.h>
 
 #if defined(_CRYPTO_CC)
     #include <CommonCrypto/CommonCryptor.h>
@@ -59,6 +60,38 @@ namespace litecore {
         return outSize;
     }
 
+
+    // The cryptor is created without padding, and reset with each message's IV. Padding is only
+    // used for the final block of a stream, so those messages just call AES256().
+
+    AES256Context::AES256Context(bool encrypt, slice key)
+    :_encrypt(encrypt)
+    {
+        DebugAssert(key.size == kCCKeySizeAES256);
+        memcpy(_key, key.buf, sizeof(_key));
+        CCCryptorRef cryptor;
+        if (CCCryptorCreate((encrypt ? kCCEncrypt : kCCDecrypt), kCCAlgorithmAES, 0,
+                            _key, sizeof(_key), nullptr, &cryptor) != kCCSuccess)
+            error::_throw(error::CryptoError);
+        _context = (void*)cryptor;
+    }
+
+    AES256Context::~AES256Context() {
+        CCCryptorRelease((CCCryptorRef)_context);
+    }
+
+    size_t AES256Context::crypt(slice iv, bool padding, slice dst, slice src) {
+        if (padding)
+            return AES256(_encrypt, slice(_key, sizeof(_key)), iv, true, dst, src);
+        auto cryptor = (CCCryptorRef)_context;
+        size_t outSize;
+        if (CCCryptorReset(cryptor, iv.buf) != kCCSuccess
+                || CCCryptorUpdate(cryptor, src.buf, src.size, (void*)dst.buf, dst.size,
+                                   &outSize) != kCCSuccess)
+            error::_throw(error::CryptoError);
+        return outSize;
+    }
+
 #elif defined(_CRYPTO_MBEDTLS)
 
 	size_t AES(size_t key_size,
@@ -107,6 +140,49 @@ namespace litecore {
         return AES(kAES256KeySize, MBEDTLS_CIPHER_AES_256_CBC, encrypt, key, iv, padding, dst, src);
     }
 
+
+    // The cipher context keeps the expanded key; mbedtls_cipher_crypt resets the rest of its
+    // state for each message.
+
+    AES256Context::AES256Context(bool encrypt, slice key)
+    :_encrypt(encrypt)
+    {
+        DebugAssert(key.size == kAES256KeySize);
+        memcpy(_key, key.buf, sizeof(_key));
+        const mbedtls_cipher_info_t *info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_256_CBC);
+        if (!info)
+            error::_throw(error::CryptoError);
+        auto ctx = new mbedtls_cipher_context_t;
+        mbedtls_cipher_init(ctx);
+        _context = ctx;
+        if (mbedtls_cipher_setup(ctx, info) != 0
+                || mbedtls_cipher_setkey(ctx, _key, kAES256KeySize * 8,
+                                         (encrypt ? MBEDTLS_ENCRYPT : MBEDTLS_DECRYPT)) != 0) {
+            mbedtls_cipher_free(ctx);
+            delete ctx;
+            error::_throw(error::CryptoError);
+        }
+    }
+
+    AES256Context::~AES256Context() {
+        auto ctx = (mbedtls_cipher_context_t*)_context;
+        mbedtls_cipher_free(ctx);
+        delete ctx;
+    }
+
+    size_t AES256Context::crypt(slice iv, bool padding, slice dst, slice src) {
+        DebugAssert(iv.size == kAESBlockSize, "IV is wrong size");
+        auto ctx = (mbedtls_cipher_context_t*)_context;
+        size_t outSize = dst.size;
+        if (mbedtls_cipher_set_padding_mode(ctx, (padding ? MBEDTLS_PADDING_PKCS7
+                                                          : MBEDTLS_PADDING_NONE)) != 0
+                || mbedtls_cipher_crypt(ctx, (const unsigned char*)iv.buf, iv.size,
+                                        (const unsigned char*)src.buf, src.size,
+                                        (unsigned char*)dst.buf, &outSize) != 0)
+            error::_throw(error::CryptoError);
+        return outSize;
+    }
+
 #endif
 
 }
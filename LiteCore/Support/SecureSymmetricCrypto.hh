@@ -41,6 +41,28 @@ namespace litecore {
 
     // TODO: Combine these into a single Encrypt() function that takes an algorithm parameter.
 
+
+    /** Like AES256(), but sets up the key once so it can be reused for many messages, which is
+        much faster when the messages are small. (The platform crypto libraries use the CPU's
+        AES instructions when it has them.)
+        An instance is not thread-safe; use one per thread. */
+    class AES256Context {
+    public:
+        AES256Context(bool encrypt, slice key);
+        ~AES256Context();
+
+        /** Encrypts or decrypts `src` into `dst`, like AES256(). */
+        size_t crypt(slice iv, bool padding, slice dst, slice src);
+
+    private:
+        AES256Context(const AES256Context&) =delete;
+        AES256Context& operator=(const AES256Context&) =delete;
+
+        bool const  _encrypt;
+        uint8_t     _key[kAES256KeySize];
+        void*       _context {nullptr};     // Platform-specific cipher state
+    };
+
 #else
 #define AES256_AVAILABLE 0
 #endif
@@ -20,6 +20,7 @@
 #include "Base.hh"
 #include "FilePath.hh"
 #include <stdio.h>
+#include <string>
 
 
 namespace litecore {
@@ -78,6 +79,33 @@ namespace litecore {
         FILE* _file {nullptr};
     };
 
+    /** Concrete ReadStream that reads from memory. */
+    class SliceReadStream : public virtual SeekableReadStream {
+    public:
+        explicit SliceReadStream(alloc_slice data)  :_data(data) { }
+
+        virtual uint64_t getLength() const override             {return _data.size;}
+        virtual void seek(uint64_t pos) override;
+        virtual size_t read(void *dst NONNULL, size_t count) override;
+        virtual void close() override                           { }
+
+    private:
+        alloc_slice _data;
+        size_t _pos {0};
+    };
+
+    /** Concrete WriteStream that appends to a string in memory. */
+    class StringWriteStream : public virtual WriteStream {
+    public:
+        virtual void write(slice data) override     {_data.append((const char*)data.buf, data.size);}
+        virtual void close() override               { }
+
+        const std::string& data() const             {return _data;}
+
+    private:
+        std::string _data;
+    };
+
 #ifdef _MSC_VER
 #pragma warning(disable: 4250)
 #endif
@@ -0,0 +1,329 @@
+//
+// VersionVector.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "VersionVector.hh"
+#include "Error.hh"
+#include "varint.hh"
+#include <ctype.h>
+
+namespace litecore {
+
+    using namespace fleece;
+
+
+    static size_t countDigits(uint64_t n) {
+        size_t digits = 1;
+        for (; n >= 10; n /= 10)
+            ++digits;
+        return digits;
+    }
+
+
+#pragma mark - VERSION:
+
+
+    Version::Version(uint64_t gen, slice peer)
+    :_gen(gen), _peer(peer)
+    {
+        if (gen == 0 || !isValidPeerID(peer))
+            error::_throw(error::BadRevisionID);
+    }
+
+
+    Version::Version(slice ascii) {
+        if (!readASCII(ascii))
+            error::_throw(error::BadRevisionID);
+    }
+
+
+    bool Version::isValidPeerID(slice peer) {
+        if (peer.size == 0)
+            return false;
+        for (size_t i = 0; i < peer.size; ++i) {
+            uint8_t c = peer[i];
+            if (c < ' ' || c == 0x7F || c == ',' || c == '@')
+                return false;
+        }
+        return true;
+    }
+
+
+    bool Version::readASCII(slice ascii) {
+        auto at = (const char*)ascii.findByte('@');
+        if (!at || at == ascii.buf || at - (const char*)ascii.buf > 19)
+            return false;       // missing separator, or generation missing or too long
+        uint64_t gen = 0;
+        for (auto c = (const char*)ascii.buf; c < at; ++c) {
+            if (!isdigit((unsigned char)*c))
+                return false;
+            gen = 10*gen + (*c - '0');
+        }
+        slice peer(at + 1, ascii.end());
+        if (gen == 0 || !isValidPeerID(peer))
+            return false;
+        _gen = gen;
+        _peer = peer;
+        return true;
+    }
+
+
+    size_t Version::ASCIISize() const {
+        return countDigits(_gen) + 1 + _peer.size;
+    }
+
+
+    void Version::writeASCII(char* &dst) const {
+        size_t digits = countDigits(_gen);
+        uint64_t n = _gen;
+        for (size_t i = digits; i > 0; --i, n /= 10)
+            dst[i-1] = char('0' + n % 10);
+        dst += digits;
+        *dst++ = '@';
+        memcpy(dst, _peer.buf, _peer.size);
+        dst += _peer.size;
+    }
+
+
+    alloc_slice Version::asASCII() const {
+        alloc_slice result(ASCIISize());
+        char *dst = (char*)result.buf;
+        writeASCII(dst);
+        return result;
+    }
+
+
+#pragma mark - VERSION VECTOR:
+
+
+    void VersionVector::readASCII(slice ascii) {
+        _vers.clear();
+        _addedPeers.clear();
+        _source = alloc_slice(ascii);
+        slice remaining = _source;
+        while (remaining.size > 0) {
+            auto comma = (const char*)remaining.findByte(',');
+            slice item(remaining.buf, comma ? comma : remaining.end());
+            remaining = comma ? slice(comma + 1, remaining.end()) : nullslice;
+            Version vers;
+            if (!vers.readASCII(item) || findPeer(vers.peer()) || (comma && remaining.size == 0))
+                error::_throw(error::BadRevisionID);
+            _vers.push_back(vers);
+        }
+    }
+
+
+    slice VersionVector::readBinary(slice data, const alloc_slice &owner) {
+        _vers.clear();
+        _addedPeers.clear();
+        if (owner) {
+            _source = owner;
+        } else {
+            _source = alloc_slice(data);
+            data = _source;
+        }
+        slice in = data;
+        while (in.size > 0) {
+            if (in[0] == 0) {
+                in.moveStart(1);
+                return in;
+            }
+            Version vers;
+            uint64_t peerSize;
+            if (!ReadUVarInt(&in, &vers._gen) || !ReadUVarInt(&in, &peerSize)
+                    || vers._gen == 0 || peerSize == 0 || peerSize > in.size)
+                error::_throw(error::CorruptRevisionData);
+            vers._peer = slice(in.buf, (size_t)peerSize);
+            in.moveStart((size_t)peerSize);
+            _vers.push_back(vers);
+        }
+        return nullslice;
+    }
+
+
+    /*static*/ Version VersionVector::readCurrentVersionFromBinary(slice data) {
+        Version vers;
+        uint64_t peerSize;
+        if (!ReadUVarInt(&data, &vers._gen) || !ReadUVarInt(&data, &peerSize)
+                || vers._gen == 0 || peerSize == 0 || peerSize > data.size)
+            error::_throw(error::CorruptRevisionData);
+        vers._peer = slice(data.buf, (size_t)peerSize);
+        return vers;
+    }
+
+
+    alloc_slice VersionVector::asASCII() const {
+        if (_vers.empty())
+            return alloc_slice();
+        size_t size = _vers.size() - 1;     // commas
+        for (auto &vers : _vers)
+            size += vers.ASCIISize();
+        alloc_slice result(size);
+        char *dst = (char*)result.buf;
+        for (auto &vers : _vers) {
+            if (dst != result.buf)
+                *dst++ = ',';
+            vers.writeASCII(dst);
+        }
+        DebugAssert(dst == result.end());
+        return result;
+    }
+
+
+    alloc_slice VersionVector::asBinary() const {
+        size_t size = 0;
+        for (auto &vers : _vers)
+            size += SizeOfVarInt(vers._gen) + SizeOfVarInt(vers._peer.size) + vers._peer.size;
+        alloc_slice result(size);
+        auto dst = (uint8_t*)result.buf;
+        for (auto &vers : _vers) {
+            dst += PutUVarInt(dst, vers._gen);
+            dst += PutUVarInt(dst, vers._peer.size);
+            memcpy(dst, vers._peer.buf, vers._peer.size);
+            dst += vers._peer.size;
+        }
+        return result;
+    }
+
+
+    const Version& VersionVector::current() const {
+        if (_vers.empty())
+            error::_throw(error::NotFound);
+        return _vers[0];
+    }
+
+
+    Version* VersionVector::findPeer(slice peer) {
+        for (auto &vers : _vers) {
+            if (vers._peer == peer)
+                return &vers;
+        }
+        return nullptr;
+    }
+
+
+    const Version* VersionVector::findPeer(slice peer) const {
+        return const_cast<VersionVector*>(this)->findPeer(peer);
+    }
+
+
+    uint64_t VersionVector::genOfPeer(slice peer) const {
+        auto vers = findPeer(peer);
+        return vers ? vers->_gen : 0;
+    }
+
+
+    // The generation of my oldest legacy Version, or 0 if I have none.
+    uint64_t VersionVector::oldestLegacyGen() const {
+        uint64_t oldest = 0;
+        for (auto &vers : _vers) {
+            if (vers.isLegacy() && (oldest == 0 || vers._gen < oldest))
+                oldest = vers._gen;
+        }
+        return oldest;
+    }
+
+
+    // True if I have this Version's peer, or it's a legacy ancestor pruned from my history.
+    bool VersionVector::includesOrPruned(const Version &vers) const {
+        return findPeer(vers._peer) || (vers.isLegacy() && vers._gen < oldestLegacyGen());
+    }
+
+
+    versionOrder VersionVector::compareTo(const Version &vers) const {
+        uint64_t gen = genOfPeer(vers.peer());
+        if (gen == 0 && includesOrPruned(vers))
+            return kNewer;              // it's a legacy ancestor pruned from my history
+        else if (gen < vers.gen())
+            return kOlder;
+        else if (gen == vers.gen() && _vers[0].peer() == vers.peer())
+            return kSame;
+        else
+            return kNewer;
+    }
+
+
+    versionOrder VersionVector::compareTo(const VersionVector &other) const {
+        int order = kSame;
+        size_t inBoth = 0;
+        for (auto &vers : _vers) {
+            uint64_t otherGen = other.genOfPeer(vers._peer);
+            if (otherGen > 0)
+                ++inBoth;
+            else if (other.includesOrPruned(vers))
+                continue;
+            if (vers._gen > otherGen)
+                order |= kNewer;
+            else if (vers._gen < otherGen)
+                order |= kOlder;
+            if (order == kConflicting)
+                return kConflicting;
+        }
+        if (inBoth < other.count()) {
+            // Other has changes from peers I haven't seen, unless they're pruned ancestors:
+            for (auto &otherVers : other._vers) {
+                if (!includesOrPruned(otherVers)) {
+                    order |= kOlder;
+                    break;
+                }
+            }
+        }
+        return versionOrder(order);
+    }
+
+
+    slice VersionVector::copyPeer(slice peer) {
+        _addedPeers.emplace_back(peer);
+        return _addedPeers.back();
+    }
+
+
+    void VersionVector::incrementGen(slice peer) {
+        auto vers = findPeer(peer);
+        Version updated;
+        if (vers) {
+            updated = *vers;
+            ++updated._gen;
+            _vers.erase(_vers.begin() + (vers - &_vers[0]));
+        } else {
+            updated = Version(1, peer);
+            updated._peer = copyPeer(peer);
+        }
+        _vers.insert(_vers.begin(), updated);
+    }
+
+
+    void VersionVector::mergeWith(const VersionVector &other) {
+        bool added = false;
+        for (auto &otherVers : other._vers) {
+            auto vers = findPeer(otherVers._peer);
+            if (!vers) {
+                _vers.push_back(otherVers);
+                added = true;
+            } else if (otherVers._gen > vers->_gen) {
+                vers->_gen = otherVers._gen;
+            }
+        }
+        if (added) {
+            // The added Versions' peer IDs point into the other vector's buffers:
+            _addedPeers.push_back(other._source);
+            _addedPeers.insert(_addedPeers.end(), other._addedPeers.begin(),
+                               other._addedPeers.end());
+        }
+    }
+
+}
@@ -0,0 +1,146 @@
+//
+// VersionVector.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include <vector>
+
+namespace litecore {
+
+    /** The result of comparing two versions or version vectors. The values are bit-flags:
+        a vector that's both older and newer than another is in conflict with it. */
+    enum versionOrder {
+        kSame        = 0,                   ///< Equal
+        kOlder       = 1,                   ///< Other has changes this one doesn't
+        kNewer       = 2,                   ///< This has changes the other one doesn't
+        kConflicting = kOlder | kNewer,     ///< Each has changes the other one doesn't
+    };
+
+
+    /** A single version: a peer's ID and the number of changes that peer has made to the
+        document ("generation".) Its ASCII form is "<gen>@<peerID>", e.g. "3@8c2f9a01d4e37b65".
+        A Version doesn't own the memory of its peer ID.
+
+        A Version converted from a rev-tree revision "<gen>-<digest>" has the peer ID "-<digest>",
+        and is called a legacy Version. Legacy generations are comparable across "peers", since
+        they're rev-tree generations. */
+    class Version {
+    public:
+        Version(uint64_t gen, slice peer);
+
+        /** Parses the ASCII form. Throws BadRevisionID if it's invalid. */
+        explicit Version(slice ascii);
+
+        uint64_t gen() const                        {return _gen;}
+        slice peer() const                          {return _peer;}
+
+        /** True if this Version was converted from a rev-tree revision. */
+        bool isLegacy() const                       {return _peer.size > 0 && _peer[0] == '-';}
+
+        alloc_slice asASCII() const;
+
+        bool operator== (const Version &v) const    {return _gen == v._gen && _peer == v._peer;}
+        bool operator!= (const Version &v) const    {return !(*this == v);}
+
+        /** A peer ID is non-empty and may not contain ',', '@', or control characters. */
+        static bool isValidPeerID(slice);
+
+    private:
+        friend class VersionVector;
+        Version() { }
+        bool readASCII(slice);
+        size_t ASCIISize() const;
+        void writeASCII(char* &dst) const;
+
+        uint64_t _gen {0};
+        slice    _peer;
+    };
+
+
+    /** A version vector: the latest Version of the document known from each peer that has
+        changed it. The first Version is the current one, i.e. the one that made this revision;
+        the order of the rest is unimportant. Its size is proportional to the number of peers,
+        not the number of revisions.
+
+        A vector converted from a rev-tree revision holds legacy Versions of that revision and
+        its ancestors, as far back as the tree kept them. So that peers whose trees were pruned
+        differently still agree, a legacy Version missing from another vector is ignored if it's
+        older than all of that vector's legacy Versions.
+
+        The ASCII form is the Versions' ASCII forms separated by commas, e.g.
+        "3@8c2f9a01d4e37b65,7@e04a11c9f2883d10". The binary form, used as the version of a
+        Record, is a series of [varint gen, varint peer ID length, peer ID]. */
+    class VersionVector {
+    public:
+        VersionVector() { }
+
+        /** Parses the ASCII form. Throws BadRevisionID if it's invalid. */
+        explicit VersionVector(slice ascii)         {readASCII(ascii);}
+
+        void readASCII(slice ascii);
+
+        /** Parses the binary form, which ends at the end of the data or at a zero byte. Returns
+            whatever follows the zero byte, if anything. If `owner` is given it must contain the
+            data, and is retained instead of copying the data. */
+        slice readBinary(slice data, const alloc_slice &owner =nullslice);
+
+        /** Reads just the current Version from binary data, without parsing the rest. */
+        static Version readCurrentVersionFromBinary(slice data);
+
+        alloc_slice asASCII() const;
+        alloc_slice asBinary() const;
+
+        size_t count() const                        {return _vers.size();}
+        bool empty() const                          {return _vers.empty();}
+        const Version& operator[] (size_t i) const  {return _vers[i];}
+        const Version& current() const;
+
+        /** The generation of the given peer's latest change, or 0 if it hasn't made any. */
+        uint64_t genOfPeer(slice peer) const;
+
+        /** Compares with a single Version. This is just a lookup of that Version's peer, so it's
+            much cheaper than comparing vectors: the result is kSame if the Version is current,
+            kNewer if this vector includes it, or kOlder if it doesn't. */
+        versionOrder compareTo(const Version&) const;
+
+        versionOrder compareTo(const VersionVector&) const;
+
+        bool operator== (const VersionVector &v) const  {return compareTo(v) == kSame;}
+        bool operator!= (const VersionVector &v) const  {return !(*this == v);}
+
+        /** Adds a change by the given peer: increments its generation and makes its Version
+            current. */
+        void incrementGen(slice peer);
+
+        /** Adds the Versions of another vector that are newer than mine. Used when merging
+            conflicting revisions; the result should be given a new Version of its own. */
+        void mergeWith(const VersionVector&);
+
+    private:
+        Version* findPeer(slice peer);
+        const Version* findPeer(slice peer) const;
+        uint64_t oldestLegacyGen() const;
+        bool includesOrPruned(const Version&) const;
+        slice copyPeer(slice peer);
+
+        std::vector<Version>     _vers;         // The Versions; current one first
+        alloc_slice              _source;       // Parsed data the Versions' peer IDs point into
+        std::vector<alloc_slice> _addedPeers;   // Other peer IDs the Versions point into
+    };
+
+}
@@ -74,6 +74,50 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile CreateDoc", "[DataFile]")
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile GetWithCallback", "[DataFile]") {
+    {
+        Transaction t(db);
+        store->set("key"_sl, "vers"_sl, "value"_sl, DocumentFlags::kHasAttachments, t);
+        t.commit();
+    }
+    int calls = 0;
+    store->get("key"_sl, kDefaultContent, [&](const RecordLite &rec) {
+        ++calls;
+        CHECK(rec.exists);
+        CHECK(rec.key == "key"_sl);
+        CHECK(rec.version == "vers"_sl);
+        CHECK(rec.body == "value"_sl);
+        CHECK(rec.bodySize == 5);
+        CHECK(rec.sequence == 1);
+        CHECK(rec.flags == DocumentFlags::kHasAttachments);
+    });
+    store->get("key"_sl, kMetaOnly, [&](const RecordLite &rec) {
+        ++calls;
+        CHECK(rec.exists);
+        CHECK(rec.body == nullslice);
+        CHECK(rec.bodySize == 5);
+    });
+    store->get(1, [&](const RecordLite &rec) {
+        ++calls;
+        CHECK(rec.exists);
+        CHECK(rec.key == "key"_sl);
+        CHECK(rec.body == "value"_sl);
+        CHECK(rec.sequence == 1);
+    });
+    store->get("nope"_sl, kDefaultContent, [&](const RecordLite &rec) {
+        ++calls;
+        CHECK(!rec.exists);
+        CHECK(rec.key == "nope"_sl);
+        CHECK(rec.body == nullslice);
+    });
+    store->get(2, [&](const RecordLite &rec) {
+        ++calls;
+        CHECK(!rec.exists);
+    });
+    CHECK(calls == 5);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SaveDocs", "[DataFile]") {
     {
         //WORKAROUND: Add a rec before the main transaction so it doesn't start at sequence 0
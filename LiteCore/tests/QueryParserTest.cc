@@ -41,6 +41,12 @@ public:
     virtual std::string unnestedTableName(const std::string &property) const override {
         return tableName() + ":unnest:" + property;
     }
+    virtual std::string geoTableName(const std::string &identifier) const override {
+        return tableName() + ":geo:" + identifier;
+    }
+    virtual std::string vectorTableName(const std::string &identifier) const override {
+        return tableName() + ":vector:" + identifier;
+    }
     virtual bool tableExists(const string &tableName) const override {
         return tablesExist;
     }
@@ -356,6 +362,48 @@ TEST_CASE_METHOD(QueryParserTest, "QueryParser SELECT UNNEST optimized", "[Query
 }
 
 
+TEST_CASE_METHOD(QueryParserTest, "QueryParser geospatial", "[Query][Geo]") {
+    string box = "['WITHIN_BOX', ['.lat'], ['.lon'], 10, 20, 30, 40]";
+    string radius = "['WITHIN_RADIUS', ['.lat'], ['.lon'], 37.5, -122.25, 1000]";
+    CHECK(parseWhere(box)
+          == "fl_value(body, 'lat') BETWEEN 10 AND 30 AND fl_value(body, 'lon') BETWEEN 20 AND 40");
+    CHECK(parseWhere(radius)
+          == "geo_distance(fl_value(body, 'lat'), fl_value(body, 'lon'), 37.5, -122.25) <= 1000");
+
+    tablesExist = false;
+    CHECK(parseWhere("['SELECT', {WHERE: " + box + "}]")
+          == "SELECT key, sequence FROM kv_default AS _doc WHERE (fl_value(_doc.body, 'lat') BETWEEN 10 AND 30 AND fl_value(_doc.body, 'lon') BETWEEN 20 AND 40) AND (_doc.flags & 1) = 0");
+
+    tablesExist = true;
+    CHECK(parseWhere("['SELECT', {WHERE: " + box + "}]")
+          == "SELECT key, sequence FROM kv_default AS _doc JOIN \"kv_default:geo:Y5+h5Yv1jhImp++n1AwaapBLrGk=\" AS geo1 ON geo1.docid = _doc.rowid WHERE (geo1.minLat <= 30 AND geo1.maxLat >= 10 AND geo1.minLon <= 40 AND geo1.maxLon >= 20 AND fl_value(_doc.body, 'lat') BETWEEN 10 AND 30 AND fl_value(_doc.body, 'lon') BETWEEN 20 AND 40) AND (_doc.flags & 1) = 0");
+    CHECK(parseWhere("['SELECT', {WHERE: " + radius + "}]")
+          == "SELECT key, sequence FROM kv_default AS _doc JOIN \"kv_default:geo:Y5+h5Yv1jhImp++n1AwaapBLrGk=\" AS geo1 ON geo1.docid = _doc.rowid WHERE (geo1.minLat <= geo_box(37.5, -122.25, 1000, 'maxLat') AND geo1.maxLat >= geo_box(37.5, -122.25, 1000, 'minLat') AND geo1.minLon <= geo_box(37.5, -122.25, 1000, 'maxLon') AND geo1.maxLon >= geo_box(37.5, -122.25, 1000, 'minLon') AND geo_distance(fl_value(_doc.body, 'lat'), fl_value(_doc.body, 'lon'), 37.5, -122.25) <= 1000) AND (_doc.flags & 1) = 0");
+
+    // The index can't be used inside an OR:
+    CHECK(parseWhere("['SELECT', {WHERE: ['OR', " + box + ", ['=', ['.x'], 1]]}]")
+          == "SELECT key, sequence FROM kv_default AS _doc WHERE ((fl_value(_doc.body, 'lat') BETWEEN 10 AND 30 AND fl_value(_doc.body, 'lon') BETWEEN 20 AND 40) OR fl_value(_doc.body, 'x') = 1) AND (_doc.flags & 1) = 0");
+}
+
+
+TEST_CASE_METHOD(QueryParserTest, "QueryParser VECTOR_MATCH", "[Query][Vector]") {
+    string match = "['VECTOR_MATCH', ['.vec'], ['$target'], 5]";
+    CHECK(parseWhere(match)
+          == "rowid IN (SELECT docid FROM (SELECT rowid AS docid, vector_distance(fl_value(body, 'vec'), $_target, 'cosine') AS distance FROM kv_default WHERE (flags & 1) = 0) WHERE distance NOT NULL ORDER BY distance LIMIT 5)");
+
+    tablesExist = false;
+    CHECK(parseWhere("['SELECT', {WHERE: ['AND', " + match + ", ['=', ['.x'], 1]]}]")
+          == "SELECT key, sequence FROM kv_default AS _doc WHERE (_doc.rowid IN (SELECT docid FROM (SELECT _doc.rowid AS docid, vector_distance(fl_value(_doc.body, 'vec'), $_target, 'cosine') AS distance FROM kv_default AS _doc WHERE (_doc.flags & 1) = 0) WHERE distance NOT NULL ORDER BY distance LIMIT 5) AND fl_value(_doc.body, 'x') = 1) AND (_doc.flags & 1) = 0");
+
+    tablesExist = true;
+    CHECK(parseWhere("['SELECT', {WHERE: ['VECTOR_MATCH', ['.vec'], ['$target'], 5, 'euclidean'],\
+                                  ORDER_BY: [['vector_distance()', ['.vec'], ['$target'], 'euclidean']]}]")
+          == "SELECT key, sequence FROM kv_default AS _doc WHERE (_doc.rowid IN (SELECT docid FROM (SELECT docid, vector_index_distance(vector, $_target, 'euclidean') AS distance FROM \"kv_default:vector:xkb1n8iVxOODP01TO7o33cGz2Sw=\") WHERE distance NOT NULL ORDER BY distance LIMIT 5)) AND (_doc.flags & 1) = 0 ORDER BY vector_distance(fl_value(_doc.body, 'vec'), $_target, 'euclidean')");
+
+    mustFail("['VECTOR_MATCH', ['.vec'], ['$target'], 5, 'manhattan']");
+}
+
+
 TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate", "[Query][Collation]") {
     CHECK(parseWhere("['AND',['COLLATE',{'UNICODE':true,'CASE':false,'DIAC':false},['=',['.Artist'],['$ARTIST']]],['IS',['.Compilation'],['MISSING']]]")
           == "fl_value(body, 'Artist') COLLATE \"LCUnicode_CD_\" = $_ARTIST AND fl_value(body, 'Compilation') IS NULL");
@@ -373,6 +421,34 @@ TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate", "[Query][Collation]") {
                "FROM kv_default AS \"book\" "
               "WHERE (fl_value(\"book\".body, 'author') = $_AUTHOR) AND (\"book\".flags & 1) = 0 "
            "ORDER BY fl_value(\"book\".body, 'title') COLLATE \"LCUnicode_C__\"");
+
+
+    // SORTKEY makes the expression's value a binary sort key, if the platform supports that:
+    string sortKeyQuery = "['SELECT', {WHAT: ['.name'], WHERE: ['>', ['.age'], 1], \
+                           ORDER_BY: [['COLLATE', {unicode: true, case: false, sortkey: true}, ['.name']]]}]";
+    if (SupportsCollationSortKeys())
+        CHECK(parseWhere(sortKeyQuery)
+              == "SELECT fl_result(fl_value(_doc.body, 'name')) FROM kv_default AS _doc WHERE (fl_value(_doc.body, 'age') > 1) AND (_doc.flags & 1) = 0 ORDER BY collation_key(fl_value(_doc.body, 'name'), 'LCUnicode_C__')");
+    else
+        CHECK(parseWhere(sortKeyQuery)
+              == "SELECT fl_result(fl_value(_doc.body, 'name')) FROM kv_default AS _doc WHERE (fl_value(_doc.body, 'age') > 1) AND (_doc.flags & 1) = 0 ORDER BY fl_value(_doc.body, 'name') COLLATE \"LCUnicode_C__\"");
+
+    // ...and in a comparison, each operand is converted, not the result:
+    string sortKeyCompare = "['COLLATE', {unicode: true, case: false, sortkey: true}, \
+                             ['=', ['.name'], 'fred']]";
+    string sortKeyBetween = "['COLLATE', {unicode: true, case: false, sortkey: true}, \
+                             ['BETWEEN', ['.name'], 'a', 'm']]";
+    if (SupportsCollationSortKeys()) {
+        CHECK(parseWhere(sortKeyCompare)
+              == "collation_key(fl_value(body, 'name'), 'LCUnicode_C__') = collation_key('fred', 'LCUnicode_C__')");
+        CHECK(parseWhere(sortKeyBetween)
+              == "collation_key(fl_value(body, 'name'), 'LCUnicode_C__') BETWEEN collation_key('a', 'LCUnicode_C__') AND collation_key('m', 'LCUnicode_C__')");
+    } else {
+        CHECK(parseWhere(sortKeyCompare)
+              == "fl_value(body, 'name') COLLATE \"LCUnicode_C__\" = 'fred'");
+        CHECK(parseWhere(sortKeyBetween)
+              == "fl_value(body, 'name') COLLATE \"LCUnicode_C__\" BETWEEN 'a' AND 'm'");
+    }
 }
 
 
@@ -17,7 +17,10 @@
 //
 
 #include "QueryTest.hh"
+#include "UnicodeCollator.hh"
 #include <time.h>
+#include <algorithm>
+#include <random>
 
 using namespace fleece::impl;
 
@@ -1240,6 +1243,352 @@ TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST expression", "[Query]") {
     checkQuery(22, 2);
 }
 
+
+TEST_CASE_METHOD(QueryTest, "Query geospatial", "[Query][Geo]") {
+    // Docs are on a 10x10 grid of whole degrees; rec-034 is at (3, 4).
+    auto writeGeoDoc = [&](const string &docID, int lat, double lon, Transaction &t) {
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("lat");
+        enc.writeInt(lat);
+        enc.writeKey("lon");
+        enc.writeDouble(lon);
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+    };
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 100; ++i)
+            writeGeoDoc(stringWithFormat("rec-%03d", i), i / 10, i % 10, t);
+        // This one has no usable coordinates, so it won't be indexed:
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("lat");
+        enc.writeString("north");
+        enc.writeKey("lon");
+        enc.writeInt(4);
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        store->set("nowhere"_sl, nullslice, body, DocumentFlags::kNone, t);
+        t.commit();
+    }
+
+    string boxQuery = json5("['SELECT', {WHERE: ['WITHIN_BOX', ['.lat'], ['.lon'], 2, 3, 4, 5]}]");
+    // 120km is a bit more than a degree at this latitude, so this doesn't reach the diagonals:
+    string radiusQuery = json5("['SELECT', {WHERE: ['WITHIN_RADIUS', ['.lat'], ['.lon'], 3, 4, 120000]}]");
+    CHECK(rowsInQuery(boxQuery) == 9);
+    CHECK(rowsInQuery(radiusQuery) == 5);
+
+    Log("-------- Creating index --------");
+    CHECK(store->createIndex("geo"_sl, json5("[['.lat'], ['.lon']]"), KeyStore::kGeoIndex));
+    CHECK(!store->createIndex("geo"_sl, json5("[['.lat'], ['.lon']]"), KeyStore::kGeoIndex));
+
+    Retained<Query> query = store->compileQuery(radiusQuery);
+    string explanation = query->explain();
+    Log("%s", explanation.c_str());
+    CHECK(explanation.find("VIRTUAL TABLE INDEX") != string::npos);
+    CHECK(rowsInQuery(boxQuery) == 9);
+    CHECK(rowsInQuery(radiusQuery) == 5);
+
+    Log("-------- Adding a doc --------");
+    {
+        Transaction t(store->dataFile());
+        writeGeoDoc("rec-100", 3, 4.25, t);     // inside both
+        writeGeoDoc("rec-099", 4, 5.0, t);      // moves into the box, but not the circle
+        t.commit();
+    }
+    CHECK(rowsInQuery(boxQuery) == 11);
+    CHECK(rowsInQuery(radiusQuery) == 6);
+
+    Log("-------- Purging a doc --------");
+    deleteDoc("rec-034"_sl, true);
+    CHECK(rowsInQuery(boxQuery) == 10);
+    CHECK(rowsInQuery(radiusQuery) == 5);
+
+    Log("-------- Soft-deleting a doc --------");
+    deleteDoc("rec-024"_sl, false);
+    CHECK(rowsInQuery(boxQuery) == 9);
+    CHECK(rowsInQuery(radiusQuery) == 4);
+
+    Log("-------- Un-deleting a doc --------");
+    undeleteDoc("rec-024"_sl);
+    CHECK(rowsInQuery(boxQuery) == 10);
+    CHECK(rowsInQuery(radiusQuery) == 5);
+
+    Log("-------- Deleting index --------");
+    store->deleteIndex("geo"_sl);
+    CHECK(rowsInQuery(boxQuery) == 10);
+    CHECK(rowsInQuery(radiusQuery) == 5);
+}
+
+
+class VectorQueryTest : public QueryTest {
+protected:
+    void writeVectorDoc(const string &docID, const vector<float> &vec, Transaction &t) {
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("vec");
+        enc.beginArray();
+        for (float f : vec)
+            enc.writeFloat(f);
+        enc.endArray();
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+    }
+
+    vector<string> queryDocIDs(Query *query, const Query::Options &options) {
+        vector<string> docIDs;
+        unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        while (e->next())
+            docIDs.push_back(e->columns()[0]->asString().asString());
+        return docIDs;
+    }
+};
+
+
+TEST_CASE_METHOD(VectorQueryTest, "Query VECTOR_MATCH", "[Query][Vector]") {
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 100; ++i)
+            writeVectorDoc(stringWithFormat("rec-%03d", i), {float(i), float(100 - i), 1}, t);
+        // This one has no vector, so it can't match:
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("vec");
+        enc.writeString("none");
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        store->set("novector"_sl, nullslice, body, DocumentFlags::kNone, t);
+        t.commit();
+    }
+
+    auto json = json5("['SELECT', {WHAT: ['._id'],\
+                                  WHERE: ['VECTOR_MATCH', ['.vec'], ['$target'], 3, 'euclidean'],\
+                               ORDER_BY: [['vector_distance()', ['.vec'], ['$target'], 'euclidean']]}]");
+    Query::Options options;
+    options.paramBindings = R"({"target": [30.2, 69.8, 1]})"_sl;
+    Retained<Query> query = store->compileQuery(json);
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-030", "rec-031", "rec-029"}));
+
+    Log("-------- Creating index --------");
+    CHECK(store->createIndex("vectors"_sl, json5("[['.vec']]"), KeyStore::kVectorIndex));
+    CHECK(!store->createIndex("vectors"_sl, json5("[['.vec']]"), KeyStore::kVectorIndex));
+    query = store->compileQuery(json);
+    string explanation = query->explain();
+    Log("%s", explanation.c_str());
+    CHECK(explanation.find("kv_default:vector:") != string::npos);
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-030", "rec-031", "rec-029"}));
+
+    Log("-------- Adding a doc --------");
+    {
+        Transaction t(store->dataFile());
+        writeVectorDoc("rec-100", {30.2f, 69.8f, 1}, t);
+        t.commit();
+    }
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-100", "rec-030", "rec-031"}));
+
+    Log("-------- Purging a doc --------");
+    deleteDoc("rec-100"_sl, true);
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-030", "rec-031", "rec-029"}));
+
+    Log("-------- Soft-deleting a doc --------");
+    deleteDoc("rec-030"_sl, false);
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-031", "rec-029", "rec-032"}));
+
+    Log("-------- Un-deleting a doc --------");
+    undeleteDoc("rec-030"_sl);
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-030", "rec-031", "rec-029"}));
+
+    Log("-------- Cosine distance --------");
+    // All vectors [i, 100-i, 1] point in different directions, so the nearest by angle to
+    // [1, 1, 0] are the ones nearest the diagonal:
+    options.paramBindings = R"({"target": [1, 1, 0]})"_sl;
+    query = store->compileQuery(json5("['SELECT', {WHAT: ['._id'],\
+                                  WHERE: ['VECTOR_MATCH', ['.vec'], ['$target'], 1]}]"));
+    CHECK(queryDocIDs(query, options) == (vector<string>{"rec-050"}));
+}
+
+
+TEST_CASE_METHOD(VectorQueryTest, "Query VECTOR_MATCH performance", "[Query][Vector][Perf][.slow]") {
+    static constexpr int kNumDocs = 20000, kDimensions = 128, kNumQueries = 20;
+    mt19937 random(1234);
+    uniform_real_distribution<float> component(-1.0f, 1.0f);
+    auto randomVector = [&]() {
+        vector<float> vec(kDimensions);
+        for (auto &f : vec)
+            f = component(random);
+        return vec;
+    };
+    {
+        Stopwatch st;
+        Transaction t(store->dataFile());
+        for (int i = 0; i < kNumDocs; ++i)
+            writeVectorDoc(stringWithFormat("rec-%05d", i), randomVector(), t);
+        t.commit();
+        st.printReport("Writing vectors", kNumDocs, "doc");
+    }
+
+    // Generate the target vectors' parameter bindings up front:
+    vector<Query::Options> targets;
+    for (int q = 0; q < kNumQueries; ++q) {
+        stringstream json;
+        json << "{\"target\": [";
+        auto vec = randomVector();
+        for (int i = 0; i < kDimensions; ++i)
+            json << (i ? "," : "") << vec[i];
+        json << "]}";
+        targets.push_back({alloc_slice(json.str())});
+    }
+
+    auto json = json5("['SELECT', {WHAT: ['._id'],\
+                                  WHERE: ['VECTOR_MATCH', ['.vec'], ['$target'], 10]}]");
+    vector<vector<string>> bruteForceResults;
+    {
+        Retained<Query> query = store->compileQuery(json);
+        Stopwatch st;
+        for (auto &target : targets)
+            bruteForceResults.push_back(queryDocIDs(query, target));
+        st.printReport("Brute-force VECTOR_MATCH", kNumQueries, "query");
+    }
+    {
+        Stopwatch st;
+        store->createIndex("vectors"_sl, json5("[['.vec']]"), KeyStore::kVectorIndex);
+        st.printReport("Indexing vectors", kNumDocs, "doc");
+    }
+    {
+        Retained<Query> query = store->compileQuery(json);
+        Stopwatch st;
+        for (int q = 0; q < kNumQueries; ++q) {
+            auto results = queryDocIDs(query, targets[q]);
+            CHECK(results.size() == 10);
+            // Ties aside, the index finds the same neighbors, since it's exhaustive:
+            sort(results.begin(), results.end());
+            sort(bruteForceResults[q].begin(), bruteForceResults[q].end());
+            CHECK(results == bruteForceResults[q]);
+        }
+        st.printReport("Indexed VECTOR_MATCH", kNumQueries, "query");
+    }
+}
+
+
+#if __APPLE__ || defined(_MSC_VER) || LITECORE_USES_ICU
+class CollationQueryTest : public QueryTest {
+protected:
+    void writeNameDoc(const string &docID, slice name, Transaction &t) {
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("name");
+        enc.writeString(name);
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+    }
+
+    vector<string> queryNames(Query *query) {
+        vector<string> names;
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            names.push_back(e->columns()[0]->asString().asString());
+        return names;
+    }
+};
+
+
+TEST_CASE_METHOD(CollationQueryTest, "Query collation sort keys", "[Query][Collation]") {
+    {
+        Transaction t(store->dataFile());
+        int i = 0;
+        for (const char *name : {"zoo", "Zoë", "apple", "Äpfel", "Éclair", "eclair", "mañana", "manana"})
+            writeNameDoc(stringWithFormat("rec-%03d", ++i), slice(name), t);
+        t.commit();
+    }
+    const vector<string> expected {"Äpfel", "apple", "eclair", "Éclair",
+                                   "manana", "mañana", "Zoë", "zoo"};
+
+    Retained<Query> query = store->compileQuery(json5(
+        "['SELECT', {WHAT: ['.name'], ORDER_BY: [['COLLATE', {unicode: true}, ['.name']]]}]"));
+    CHECK(queryNames(query) == expected);
+
+    // Sorting by sort keys gives the same order, with or without an index:
+    auto json = json5("['SELECT', {WHAT: ['.name'],\
+                               ORDER_BY: [['COLLATE', {unicode: true, sortkey: true}, ['.name']]]}]");
+    query = store->compileQuery(json);
+    CHECK(queryNames(query) == expected);
+
+    Log("-------- Creating index --------");
+    CHECK(store->createIndex("names"_sl,
+                             json5("[['COLLATE', {unicode: true, sortkey: true}, ['.name']]]")));
+    query = store->compileQuery(json);
+    string explanation = query->explain();
+    Log("%s", explanation.c_str());
+    if (SupportsCollationSortKeys())
+        CHECK(explanation.find("USE TEMP B-TREE FOR ORDER BY") == string::npos);
+    CHECK(queryNames(query) == expected);
+}
+
+
+TEST_CASE_METHOD(CollationQueryTest, "Query collation sort key comparison", "[Query][Collation]") {
+    {
+        Transaction t(store->dataFile());
+        int i = 0;
+        for (const char *name : {"zoo", "Éclair", "eclair", "ECLAIR", "Eclairs"})
+            writeNameDoc(stringWithFormat("rec-%03d", ++i), slice(name), t);
+        t.commit();
+    }
+    // The comparison has to use the collation, not compare the names' bytes:
+    Retained<Query> query = store->compileQuery(json5(
+        "['SELECT', {WHAT: ['.name'], \
+                    WHERE: ['COLLATE', {unicode: true, case: false, diac: false, sortkey: true}, \
+                            ['=', ['.name'], 'eclair']], \
+                 ORDER_BY: [['._id']]}]"));
+    CHECK(queryNames(query) == (vector<string>{"Éclair", "eclair", "ECLAIR"}));
+}
+
+
+TEST_CASE_METHOD(CollationQueryTest, "Query collated ORDER BY performance",
+                 "[Query][Collation][Perf][.slow]") {
+    static constexpr int kNumDocs = 100000, kNumQueries = 5;
+    static const char* const kSyllables[] = {"a", "Ä", "be", "Bé", "cö", "da", "É", "fü", "gi",
+                                             "hô", "la", "mañ", "na", "Ø", "pe", "ri", "så", "tu"};
+    constexpr size_t kNumSyllables = sizeof(kSyllables) / sizeof(kSyllables[0]);
+    {
+        // Names are drawn from a limited set, so many repeat, as they would in real data:
+        mt19937 random(1234);
+        uniform_int_distribution<size_t> syllable(0, kNumSyllables - 1);
+        Stopwatch st;
+        Transaction t(store->dataFile());
+        for (int i = 0; i < kNumDocs; ++i) {
+            string name;
+            for (int s = 0; s < 3; ++s)
+                name += kSyllables[syllable(random)];
+            writeNameDoc(stringWithFormat("rec-%06d", i), slice(name), t);
+        }
+        t.commit();
+        st.printReport("Writing docs", kNumDocs, "doc");
+    }
+
+    auto timeQuery = [&](const char *what, const char *collate) {
+        Retained<Query> query = store->compileQuery(json5(
+            string("['SELECT', {WHAT: ['.name'], ORDER_BY: [['COLLATE', ") + collate + ", ['.name']]]}]"));
+        Stopwatch st;
+        for (int q = 0; q < kNumQueries; ++q)
+            CHECK(queryNames(query).size() == kNumDocs);
+        st.printReport(what, kNumQueries, "query");
+    };
+    timeQuery("ORDER BY COLLATE", "{unicode: true}");
+    timeQuery("ORDER BY COLLATE + SORTKEY", "{unicode: true, sortkey: true}");
+    {
+        Stopwatch st;
+        store->createIndex("names"_sl, json5("[['COLLATE', {unicode: true, sortkey: true}, ['.name']]]"));
+        st.printReport("Indexing sort keys", kNumDocs, "doc");
+    }
+    timeQuery("Indexed ORDER BY COLLATE + SORTKEY", "{unicode: true, sortkey: true}");
+}
+#endif //__APPLE__ || defined(_MSC_VER) || LITECORE_USES_ICU
+
+
 TEST_CASE_METHOD(QueryTest, "Query NULL check", "[Query]") {
 	{
         Transaction t(store->dataFile());
@@ -19,11 +19,46 @@
 #include "RevTree.hh"
 
 #include "LiteCoreTest.hh"
+#include "Arena.hh"
 
 using namespace litecore;
 using namespace std;
 
 
+// Counts the heap blocks allocated by this thread's Arenas while it's in scope.
+class ArenaBlockCounter {
+public:
+    ArenaBlockCounter()         :_start(Arena::heapBlockCount()) { }
+    size_t count() const        {return Arena::heapBlockCount() - _start;}
+private:
+    size_t _start;
+};
+
+
+static revidBuffer makeRevID(unsigned gen, const char *digest) {
+    return revidBuffer(slice(to_string(gen) + "-" + digest));
+}
+
+
+// Builds a tree with a long history, a conflicting branch, and a remote revision.
+static void populateTree(RevTree &tree, unsigned depth) {
+    int httpStatus;
+    const Rev *parent = nullptr, *branchPoint = nullptr;
+    for (unsigned gen = 1; gen <= depth; ++gen) {
+        alloc_slice body(slice("{\"gen\":" + to_string(gen) + "}"));
+        parent = tree.insert(makeRevID(gen, "aaaaaaaa"), body, Rev::kNoFlags, parent,
+                             false, false, httpStatus);
+        REQUIRE(parent);
+        if (gen == depth / 2)
+            branchPoint = parent;
+    }
+    tree.setLatestRevisionOnRemote(RevTree::kDefaultRemoteID, parent);
+    const Rev *conflict = tree.insert(makeRevID(depth / 2 + 1, "bbbbbbbb"), alloc_slice("{}"_sl),
+                                      Rev::kNoFlags, branchPoint, true, true, httpStatus);
+    REQUIRE(conflict);
+}
+
+
 TEST_CASE("RevID Parsing") {
     revidBuffer r;
 
@@ -50,3 +85,73 @@ TEST_CASE("RevID Parsing") {
     CHECK(!r.tryParse("1-aa "_sl));
     CHECK(!r.tryParse(" 1-aa"_sl));
 }
+
+
+TEST_CASE("RevTree Decode Allocations", "[RevTree]") {
+    static constexpr unsigned kDepth = 100;
+    alloc_slice encoded;
+    {
+        RevTree tree;
+        populateTree(tree, kDepth);
+        encoded = tree.encode();
+    }
+    {
+        // The first trees' arenas allocate blocks, which go into the thread's pool when the
+        // trees are destructed:
+        RevTree tree(encoded, 1);
+        RevTree copy(tree);
+        CHECK(tree.size() == kDepth + 1);
+    }
+
+    // ...so decoding and copying a tree again reuse them, and don't touch the heap:
+    ArenaBlockCounter counter;
+    RevTree tree(encoded, 1);
+    RevTree copy(tree);
+    CHECK(counter.count() == 0);
+
+    CHECK(tree.size() == kDepth + 1);
+    CHECK(tree.currentRevision()->revID == makeRevID(kDepth, "aaaaaaaa"));
+    CHECK(tree.latestRevisionOnRemote(RevTree::kDefaultRemoteID) == tree.currentRevision());
+    CHECK(tree.hasConflict());
+
+    CHECK(copy.size() == kDepth + 1);
+    CHECK(copy.currentRevision() != tree.currentRevision());
+    CHECK(copy.currentRevision()->revID == tree.currentRevision()->revID);
+    CHECK(copy.latestRevisionOnRemote(RevTree::kDefaultRemoteID) == copy.currentRevision());
+}
+
+
+TEST_CASE("RevTree Insert Allocations", "[RevTree]") {
+    static constexpr unsigned kNumRevs = 50;
+    int httpStatus;
+    vector<revidBuffer> revIDs;
+    for (unsigned gen = 1; gen <= kNumRevs; ++gen)
+        revIDs.push_back(makeRevID(gen, "cafebabe"));
+    auto insertAll = [&](RevTree &tree) {
+        const Rev *parent = nullptr;
+        for (auto &revID : revIDs)
+            parent = tree.insert(revID, alloc_slice(), Rev::kNoFlags, parent, false, false,
+                                 httpStatus);
+        tree.sort();
+    };
+    {
+        RevTree warmup;             // fills the thread's block pool
+        insertAll(warmup);
+    }
+
+    // Revs without bodies (like the ancestors in a replicated history) come from the tree's
+    // arena, as do copies of their revIDs; its blocks come from the pool:
+    RevTree tree;
+    ArenaBlockCounter counter;
+    insertAll(tree);
+    CHECK(counter.count() == 0);
+    CHECK(tree.size() == kNumRevs);
+    CHECK(tree.currentRevision()->revID == revIDs.back());
+    CHECK(tree.currentRevision()->revID.buf != revIDs.back().buf);
+
+    // Purging doesn't need any more blocks:
+    int nPurged = tree.purge(revIDs.back());
+    CHECK(counter.count() == 0);
+    CHECK(nPurged == (int)kNumRevs);
+    CHECK(tree.size() == 0);
+}
@@ -257,6 +257,48 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_each with path", "[Query]
             == (vector<string>{"one"}));
 }
 
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_each constraints", "[Query][fl_each]") {
+    // Constraints on fl_each.value are pushed down into the virtual table; make sure that
+    // doesn't change which rows match.
+    insert("a",   "{\"hey\": [1, 2.5, 3, \"4\", true, 10, null]}");
+    insert("b",   "{\"hey\": [\"abc\", \"ABC\", \"abd\", 7]}");
+    insert("c",   "{\"hey\": {\"one\": 1, \"two\": 2, \"three\": 3}}");
+    insert("3",   "{\"hey\": [1, 3]}");
+
+    // Strings, and Fleece nulls (blobs) sort after numbers, so they match:
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'a' AND fl_each.value > 2")
+            == (vector<string>{"2.5", "3", "4", "10", "null"}));
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'a' AND fl_each.value BETWEEN 2 AND 3")
+            == (vector<string>{"2.5", "3"}));
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'a' AND fl_each.value <= 1")
+            == (vector<string>{"1", "1"}));
+    CHECK(query("SELECT DISTINCT kv.key FROM kv, fl_each(kv.body, 'hey') WHERE fl_each.value = 3")
+            == (vector<string>{"a", "c", "3"}));
+
+    // String comparisons obey the collation:
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'b' AND fl_each.value = 'abc'")
+            == (vector<string>{"abc"}));
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'b' AND fl_each.value = 'abc' COLLATE NOCASE")
+            == (vector<string>{"abc", "ABC"}));
+    CHECK(query("SELECT fl_each.value FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'b' AND fl_each.value > 'abc'")
+            == (vector<string>{"abd"}));
+
+    // Skipping dict items keeps keys and values in step:
+    CHECK(query("SELECT fl_each.key FROM kv, fl_each(kv.body, 'hey') "
+                "WHERE kv.key = 'c' AND fl_each.value >= 2")
+            == (vector<string>{"three", "two"}));
+
+    // Comparing with a TEXT column converts the number to text:
+    CHECK(query("SELECT kv.key FROM kv, fl_each(kv.body, 'hey') WHERE fl_each.value = kv.key")
+            == (vector<string>{"3"}));
+}
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite numeric ops", "[Query]") {
     insert("one",   "{\"hey\": 4.0}");
     insert("one",   "{\"hey\": 2.5}");
@@ -526,4 +568,31 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite collation", "[Query][Collati
           == (vector<string>{"Aardvark", "Ångström", "Apple", "äpple", "Zebra"}));
     }
 }
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite collation sort keys", "[Query][Collation]") {
+    if (!SupportsCollationSortKeys())
+        return;
+    insert("a",   "{\"hey\": \"Apple\"}");
+    insert("b",   "{\"hey\": \"Aardvark\"}");
+    insert("c",   "{\"hey\": \"Ångström\"}");
+    insert("d",   "{\"hey\": \"Zebra\"}");
+    insert("f",   "{\"hey\": \"äpple\"}");
+    insert("g",   "{\"hey\": 17}");
+
+    // Sorting by sort keys gives the same order as sorting with the collation:
+    auto sortedBy = [&](const Collation &coll) {
+        return query("SELECT fl_value(body, 'hey') FROM kv "
+                     "ORDER BY collation_key(fl_value(body, 'hey'), '" + coll.sqliteName() + "')");
+    };
+    CHECK(sortedBy(Collation(true, true, nullslice))
+          == (vector<string>{"17", "Aardvark", "Ångström", "Apple", "äpple", "Zebra"}));
+    CHECK(sortedBy(Collation(true, false, nullslice))
+          == (vector<string>{"17", "Aardvark", "Ångström", "äpple", "Apple", "Zebra"}));
+
+    // Equal strings under the collation have equal keys:
+    CHECK(query("SELECT collation_key('test á', 'LCUnicode_CD_') = collation_key('TEST A', 'LCUnicode_CD_')")
+          == (vector<string>{"1"}));
+    CHECK(query("SELECT collation_key('test á', 'LCUnicode____') = collation_key('TEST A', 'LCUnicode____')")
+          == (vector<string>{"0"}));
+}
 #endif //__APPLE__ || defined(_MSC_VER) || LITECORE_USES_ICU
@@ -18,7 +18,11 @@
 
 #include "LiteCoreTest.hh"
 #include "SequenceTracker.hh"
+#include "Benchmark.hh"
+#include "c4Document.h"
+#include <atomic>
 #include <sstream>
+#include <thread>
 
 using namespace std;
 using namespace litecore;
@@ -382,3 +386,219 @@ TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker ExternalChanges
     CHECK(changes[0].docID == "B"_sl);
     CHECK(changes[1].docID == "Z"_sl);
 }
+
+
+TEST_CASE("SequenceTracker DocChangeNotifier outlives entry", "[notification]") {
+    SequenceTracker tracker;
+    DatabaseChangeNotifier cn(tracker, nullptr);
+    int countA = 0;
+    DocChangeNotifier cnA(tracker, "A"_sl, [&](DocChangeNotifier&, slice docID, sequence_t) {
+        CHECK(docID == "A"_sl);
+        ++countA;
+    });
+
+    sequence_t seq = 0;
+    SequenceTracker::Change changes[10];
+    bool external;
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "1-aa"_asl, ++seq, 1111);
+    tracker.endTransaction(true);
+    CHECK(countA == 1);
+
+    // Enough changes to other docs that A's entry is removed from the tracker, and reused:
+    for (int i = 0; i < 300; ++i) {
+        tracker.beginTransaction();
+        tracker.documentChanged(alloc_slice("doc-" + to_string(i)), "1-xx"_asl, ++seq, 100);
+        tracker.endTransaction(true);
+        while (cn.readChanges(changes, 10, external) > 0)
+            ;
+    }
+    CHECK_IF_DEBUG(tracker.dump().find("A@") == string::npos);
+
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "2-aa"_asl, ++seq, 2222);
+    tracker.endTransaction(true);
+    CHECK(countA == 2);
+    REQUIRE(cn.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "A"_sl);
+    CHECK(changes[0].revID == "2-aa"_sl);
+}
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker filtered DatabaseChangeNotifier", "[notification]") {
+    int countPrefix = 0, countIDs = 0, countLive = 0, countBody = 0;
+    ChangeFilter prefixFilter;
+    prefixFilter.docIDPrefix = "user:"_asl;
+    DatabaseChangeNotifier cnPrefix(tracker, [&](DatabaseChangeNotifier&) {++countPrefix;},
+                                    prefixFilter);
+    ChangeFilter idsFilter;
+    idsFilter.docIDs = {"user:2"_asl, "B"_asl};
+    DatabaseChangeNotifier cnIDs(tracker, [&](DatabaseChangeNotifier&) {++countIDs;}, idsFilter);
+    ChangeFilter liveFilter;
+    liveFilter.deletedMode = ChangeFilter::kLiveRevisions;
+    DatabaseChangeNotifier cnLive(tracker, [&](DatabaseChangeNotifier&) {++countLive;},
+                                  liveFilter);
+    ChangeFilter bodyFilter;
+    bodyFilter.bodyPredicate = [](slice docID, const alloc_slice &body) {
+        return body == "interesting"_sl;
+    };
+    DatabaseChangeNotifier cnBody(tracker, [&](DatabaseChangeNotifier&) {++countBody;},
+                                  bodyFilter);
+
+    SequenceTracker::Change changes[10];
+    bool external;
+
+    // A change no filter matches doesn't wake anyone, and is skipped:
+    tracker.beginTransaction();
+    tracker.documentChanged("A"_asl, "1-aa"_asl, ++seq, 1111, kRevDeleted, "boring"_sl);
+    CHECK(countPrefix == 0);
+    CHECK(countIDs == 0);
+    CHECK(countLive == 0);
+    CHECK(countBody == 0);
+    CHECK(!cnPrefix.hasChanges());
+    CHECK(cnPrefix.readChanges(changes, 10, external) == 0);
+
+    tracker.documentChanged("user:1"_asl, "1-11"_asl, ++seq, 2222, 0, "boring"_sl);
+    CHECK(countPrefix == 1);
+    CHECK(countIDs == 0);
+    CHECK(countLive == 1);
+    CHECK(countBody == 0);
+
+    tracker.documentChanged("B"_asl, "1-bb"_asl, ++seq, 3333, 0, "interesting"_sl);
+    CHECK(countPrefix == 1);    // (already notified, and hasn't read the changes yet)
+    CHECK(countIDs == 1);
+    CHECK(countLive == 1);
+    CHECK(countBody == 1);
+    tracker.endTransaction(true);
+
+    // Notifiers that haven't read yet skip the changes their filters reject:
+    REQUIRE(cnPrefix.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "user:1"_sl);
+    REQUIRE(cnIDs.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "B"_sl);
+    REQUIRE(cnLive.readChanges(changes, 10, external) == 2);
+    CHECK(changes[0].docID == "user:1"_sl);
+    CHECK(changes[1].docID == "B"_sl);
+    CHECK(changes[1].flags == 0);
+    REQUIRE(cnBody.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "B"_sl);
+    CHECK(cnLive.readChanges(changes, 10, external) == 0);
+
+    // After an abort, the reverted docs are filtered the same way:
+    tracker.beginTransaction();
+    tracker.documentChanged("user:2"_asl, "1-22"_asl, ++seq, 4444, kRevDeleted, "boring"_sl);
+    CHECK(countPrefix == 2);
+    CHECK(countIDs == 2);
+    CHECK(countLive == 1);
+    CHECK(countBody == 1);
+    tracker.endTransaction(false);
+    REQUIRE(cnIDs.readChanges(changes, 10, external) == 1);
+    CHECK(changes[0].docID == "user:2"_sl);
+    CHECK(changes[0].flags == kRevDeleted);
+    CHECK(cnLive.readChanges(changes, 10, external) == 0);
+}
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker filters external bodies", "[notification]") {
+    // Trackers of the same file share a BodyPredicateCount, so the one that records a change
+    // keeps its body for the other's predicate:
+    SequenceTracker track2;
+    Retained<SequenceTracker::BodyPredicateCount> count = new SequenceTracker::BodyPredicateCount;
+    tracker.shareBodyPredicateCount(count);
+    track2.shareBodyPredicateCount(count);
+
+    int countBody = 0;
+    ChangeFilter bodyFilter;
+    bodyFilter.bodyPredicate = [](slice docID, const alloc_slice &body) {
+        return body == "interesting"_sl;
+    };
+    DatabaseChangeNotifier cnBody(tracker, [&](DatabaseChangeNotifier&) {++countBody;},
+                                  bodyFilter);
+    CHECK(count->count == 1);
+
+    track2.beginTransaction();
+    track2.documentChanged("A"_asl, "1-aa"_asl, ++seq, 1111, 0, "boring"_sl);
+    track2.documentChanged("B"_asl, "1-bb"_asl, ++seq, 2222, 0, "interesting"_sl);
+    tracker.addExternalTransaction(track2);
+    track2.endTransaction(true);
+    CHECK(countBody == 1);
+
+    SequenceTracker::Change changes[10];
+    bool external;
+    REQUIRE(cnBody.readChanges(changes, 10, external) == 1);
+    CHECK(external);
+    CHECK(changes[0].docID == "B"_sl);
+}
+
+
+// Measures a writer's throughput while other threads read changes and add/remove doc observers,
+// locking the way c4Observer.cc does.
+TEST_CASE("SequenceTracker contention", "[notification][Perf][.slow]") {
+    static constexpr int kNumTransactions = 5000, kChangesPerTransaction = 10;
+    static constexpr int kNumDocs = 1000, kNumObserverThreads = 4;
+    SequenceTracker tracker;
+    atomic<bool> done {false};
+    vector<thread> threads;
+
+    // Database observers read changes as they arrive, like c4dbobs_getChanges:
+    vector<sequence_t> lastSeen(kNumObserverThreads, 0);
+    for (int t = 0; t < kNumObserverThreads; ++t) {
+        threads.emplace_back([&, t] {
+            unique_ptr<DatabaseChangeNotifier> notifier;
+            {
+                lock_guard<mutex> lock(tracker.mutex());
+                notifier.reset(new DatabaseChangeNotifier(tracker, nullptr, 0));
+            }
+            SequenceTracker::Change changes[100];
+            bool external, finished;
+            do {
+                finished = done;        // (checked before reading, so the last changes are seen)
+                size_t n;
+                do {
+                    lock_guard<mutex> lock(tracker.mutex());
+                    n = notifier->readChanges(changes, 100, external);
+                    if (n > 0)
+                        lastSeen[t] = changes[n - 1].sequence;
+                } while (n > 0);
+                this_thread::yield();
+            } while (!finished);
+            lock_guard<mutex> lock(tracker.mutex());
+            notifier.reset();
+        });
+    }
+
+    // Document observers come and go, like c4docobs_create and c4docobs_free:
+    atomic<int> docNotifications {0};
+    for (int t = 0; t < kNumObserverThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = t; !done; i += kNumObserverThreads) {
+                string docID = "doc-" + to_string(i % kNumDocs);
+                DocChangeNotifier notifier(tracker, slice(docID),
+                                           [&](DocChangeNotifier&, slice, sequence_t) {
+                                               ++docNotifications;
+                                           });
+                this_thread::yield();
+            }
+        });
+    }
+
+    Stopwatch st;
+    sequence_t seq = 0;
+    for (int t = 0; t < kNumTransactions; ++t) {
+        lock_guard<mutex> lock(tracker.mutex());
+        tracker.beginTransaction();
+        for (int c = 0; c < kChangesPerTransaction; ++c) {
+            string docID = "doc-" + to_string((seq * 7) % kNumDocs);
+            tracker.documentChanged(alloc_slice(docID), "1-abcd"_asl, ++seq, 100);
+        }
+        tracker.endTransaction(true);
+    }
+    st.printReport("Changes with contending observers",
+                   kNumTransactions * kChangesPerTransaction, "change");
+    done = true;
+    for (auto &th : threads)
+        th.join();
+    Log("%d document notifications", (int)docNotifications);
+    for (auto s : lastSeen)
+        CHECK(s == seq);
+}
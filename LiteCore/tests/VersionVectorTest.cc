@@ -0,0 +1,142 @@
+//
+//  VersionVectorTest.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "VersionVector.hh"
+#include "Error.hh"
+
+#include "LiteCoreTest.hh"
+
+using namespace litecore;
+using namespace std;
+
+
+TEST_CASE("Version", "[VersionVector]") {
+    Version v("17@8c2f9a01d4e37b65"_sl);
+    CHECK(v.gen() == 17);
+    CHECK(v.peer() == "8c2f9a01d4e37b65"_sl);
+    CHECK(v.asASCII() == "17@8c2f9a01d4e37b65"_sl);
+    CHECK(v == Version(17, "8c2f9a01d4e37b65"_sl));
+    CHECK(v != Version(18, "8c2f9a01d4e37b65"_sl));
+
+    for (const char *bad : {"", "17", "@peer", "17@", "0@peer", "x7@peer", "1@pe,er",
+                            "1@pe@er", "12345678901234567890@peer"}) {
+        INFO("Parsing \"" << bad << "\"");
+        CHECK_THROWS_AS(Version(slice(bad)), error);
+    }
+}
+
+
+TEST_CASE("VersionVector ASCII and binary", "[VersionVector]") {
+    VersionVector vec("3@aaaa,7@bbbb,1@cccc"_sl);
+    REQUIRE(vec.count() == 3);
+    CHECK(vec.current() == Version(3, "aaaa"_sl));
+    CHECK(vec[1] == Version(7, "bbbb"_sl));
+    CHECK(vec.genOfPeer("bbbb"_sl) == 7);
+    CHECK(vec.genOfPeer("dddd"_sl) == 0);
+    CHECK(vec.asASCII() == "3@aaaa,7@bbbb,1@cccc"_sl);
+
+    alloc_slice binary = vec.asBinary();
+    VersionVector vec2;
+    CHECK(vec2.readBinary(binary) == nullslice);
+    CHECK(vec2 == vec);
+    CHECK(vec2.asASCII() == vec.asASCII());
+    CHECK(VersionVector::readCurrentVersionFromBinary(binary) == vec.current());
+
+    // Binary data can be followed by a zero byte and other data:
+    string withSuffix = binary.asString() + '\0' + "suffix";
+    CHECK(vec2.readBinary(slice(withSuffix)) == "suffix"_sl);
+    CHECK(vec2 == vec);
+
+    VersionVector empty;
+    CHECK(empty.empty());
+    CHECK(empty.asASCII() == nullslice);
+    CHECK_THROWS_AS(empty.current(), error);
+
+    for (const char *bad : {"3@aaaa,", ",3@aaaa", "3@aaaa,,1@bbbb", "3@aaaa,1@aaaa", "3@aaaa,x"}) {
+        INFO("Parsing \"" << bad << "\"");
+        CHECK_THROWS_AS(VersionVector(slice(bad)), error);
+    }
+}
+
+
+TEST_CASE("VersionVector comparison", "[VersionVector]") {
+    VersionVector vec("3@aaaa,7@bbbb"_sl);
+    CHECK(vec.compareTo(Version(3, "aaaa"_sl)) == kSame);
+    CHECK(vec.compareTo(Version(2, "aaaa"_sl)) == kNewer);
+    CHECK(vec.compareTo(Version(7, "bbbb"_sl)) == kNewer);
+    CHECK(vec.compareTo(Version(4, "aaaa"_sl)) == kOlder);
+    CHECK(vec.compareTo(Version(1, "cccc"_sl)) == kOlder);
+
+    CHECK(vec.compareTo(VersionVector("7@bbbb,3@aaaa"_sl)) == kSame);
+    CHECK(vec.compareTo(VersionVector("2@aaaa,7@bbbb"_sl)) == kNewer);
+    CHECK(vec.compareTo(VersionVector("7@bbbb"_sl)) == kNewer);
+    CHECK(vec.compareTo(VersionVector("8@bbbb,3@aaaa"_sl)) == kOlder);
+    CHECK(vec.compareTo(VersionVector("1@cccc,3@aaaa,7@bbbb"_sl)) == kOlder);
+    CHECK(vec.compareTo(VersionVector("4@aaaa,6@bbbb"_sl)) == kConflicting);
+    CHECK(vec.compareTo(VersionVector("1@cccc,3@aaaa"_sl)) == kConflicting);
+}
+
+
+TEST_CASE("VersionVector legacy versions", "[VersionVector]") {
+    CHECK(Version("3@-c001d00d"_sl).isLegacy());
+    CHECK(!Version("3@c001d00d"_sl).isLegacy());
+
+    // Vectors upgraded from rev trees at different revisions follow the tree's ancestry:
+    VersionVector vec("3@-cccc,2@-bbbb,1@-aaaa"_sl);
+    CHECK(vec.compareTo(VersionVector("4@-dddd,3@-cccc,2@-bbbb,1@-aaaa"_sl)) == kOlder);
+    CHECK(vec.compareTo(VersionVector("2@-bbbb,1@-aaaa"_sl)) == kNewer);
+    CHECK(vec.compareTo(VersionVector("3@-eeee,2@-bbbb,1@-aaaa"_sl)) == kConflicting);
+    CHECK(vec.compareTo(Version(1, "-aaaa"_sl)) == kNewer);
+    CHECK(vec.compareTo(Version(4, "-dddd"_sl)) == kOlder);
+
+    // Ancestors pruned from one tree don't count as changes the other vector lacks:
+    CHECK(vec.compareTo(VersionVector("4@-dddd,3@-cccc"_sl)) == kOlder);
+    CHECK(VersionVector("4@-dddd,3@-cccc"_sl).compareTo(vec) == kNewer);
+    CHECK(VersionVector("3@-cccc,2@-bbbb"_sl).compareTo(vec) == kSame);
+    CHECK(VersionVector("4@-dddd,3@-cccc"_sl).compareTo(Version(1, "-aaaa"_sl)) == kNewer);
+    CHECK(VersionVector("3@-eeee"_sl).compareTo(vec) == kConflicting);
+
+    // A change made after upgrading conflicts with a later legacy revision:
+    VersionVector changed("1@8c2f9a01d4e37b65,3@-cccc,2@-bbbb,1@-aaaa"_sl);
+    CHECK(changed.compareTo(vec) == kNewer);
+    CHECK(changed.compareTo(VersionVector("4@-dddd,3@-cccc"_sl)) == kConflicting);
+}
+
+
+TEST_CASE("VersionVector increment and merge", "[VersionVector]") {
+    VersionVector vec("3@aaaa,7@bbbb"_sl);
+    vec.incrementGen("bbbb"_sl);
+    CHECK(vec.asASCII() == "8@bbbb,3@aaaa"_sl);
+    {
+        string peer = "cccc";
+        vec.incrementGen(slice(peer));
+    }   // vector must have copied the peer ID
+    CHECK(vec.asASCII() == "1@cccc,8@bbbb,3@aaaa"_sl);
+
+    VersionVector other("5@aaaa,2@dddd,4@bbbb"_sl);
+    CHECK(vec.compareTo(other) == kConflicting);
+    {
+        VersionVector temp("9@eeee"_sl);
+        vec.mergeWith(other);
+        vec.mergeWith(temp);
+    }   // vector must retain the peer IDs it took from the other vectors
+    CHECK(vec.asASCII() == "1@cccc,8@bbbb,5@aaaa,2@dddd,9@eeee"_sl);
+    CHECK(vec.compareTo(other) == kNewer);
+    vec.incrementGen("aaaa"_sl);
+    CHECK(vec.current() == Version(6, "aaaa"_sl));
+}
@@ -0,0 +1,102 @@
+//
+// BenchmarkReport.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BenchmarkReport.hh"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore { namespace benchmark {
+
+    Report& Report::instance() {
+        static Report sReport;
+        return sReport;
+    }
+
+
+    void Report::add(const Result &r) {
+        _results.push_back(r);
+        auto flags = cerr.flags();
+        cerr << "BENCH  " << left << setw(44) << r.name << right
+             << fixed << setprecision(1) << setw(12) << r.nsPerOp() << " ns/op"
+             << setprecision(0) << setw(14) << r.opsPerSec() << " ops/sec"
+             << "   (" << r.runs << " runs of " << r.ops << "; range "
+             << setprecision(1) << r.minSecs * 1e3 << "-" << r.maxSecs * 1e3 << " ms)\n";
+        cerr.flags(flags);
+    }
+
+
+    static void writeJSONString(ostream &out, const string &str) {
+        out << '"';
+        for (char c : str) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if ((unsigned char)c < ' ')
+                out << ' ';
+            else
+                out << c;
+        }
+        out << '"';
+    }
+
+
+    bool Report::writeJSON(const string &path) const {
+        ofstream out(path, ios::trunc);
+        if (!out)
+            return false;
+        out << "{\"benchmarks\": [";
+        bool first = true;
+        for (auto &r : _results) {
+            out << (first ? "\n  {" : ",\n  {");
+            first = false;
+            out << "\"name\": ";
+            writeJSONString(out, r.name);
+            out << setprecision(6)
+                << ", \"ops\": " << r.ops
+                << ", \"runs\": " << r.runs
+                << ", \"median_sec\": " << r.medianSecs
+                << ", \"min_sec\": " << r.minSecs
+                << ", \"max_sec\": " << r.maxSecs
+                << ", \"ns_per_op\": " << r.nsPerOp()
+                << ", \"ops_per_sec\": " << r.opsPerSec() << "}";
+        }
+        out << "\n]}\n";
+        return bool(out);
+    }
+
+
+    Result measure(const string &name, size_t ops, const function<void()> &fn, unsigned runs) {
+        fn();       // warm up caches, and let lazily-initialized state get created
+        vector<double> times;
+        times.reserve(runs);
+        for (unsigned i = 0; i < runs; ++i) {
+            Stopwatch st;
+            fn();
+            times.push_back(st.elapsed());
+        }
+        sort(times.begin(), times.end());
+        Result result {name, ops, runs, times[runs / 2], times.front(), times.back()};
+        Report::instance().add(result);
+        return result;
+    }
+
+} }
@@ -0,0 +1,68 @@
+//
+// BenchmarkReport.hh
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Stopwatch.hh"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace litecore { namespace benchmark {
+
+    /** The timing of one benchmark: the median of several runs of `ops` operations each. */
+    struct Result {
+        std::string name;
+        size_t      ops;                // Operations per run
+        unsigned    runs;               // Number of timed runs
+        double      medianSecs;         // Median time of a run
+        double      minSecs, maxSecs;   // Fastest and slowest runs
+
+        double nsPerOp() const          {return medianSecs * 1e9 / ops;}
+        double opsPerSec() const        {return ops / medianSecs;}
+    };
+
+
+    /** Collects benchmark results, prints them as they come in, and can write them all to a
+        JSON file for tracking trends between builds. */
+    class Report {
+    public:
+        static Report& instance();
+
+        void add(const Result&);
+
+        const std::vector<Result>& results() const      {return _results;}
+
+        /** Writes the results as JSON: `{"benchmarks": [{"name": ..., "ns_per_op": ...}, ...]}`.
+            Returns false if the file can't be written. */
+        bool writeJSON(const std::string &path) const;
+
+    private:
+        std::vector<Result> _results;
+    };
+
+
+    /** Number of timed runs of each benchmark, after one untimed warm-up run. */
+    constexpr unsigned kDefaultRuns = 5;
+
+    /** Times `fn`, which should perform `ops` operations, and adds the result to the Report.
+        Reporting the median run makes results repeatable in the face of the occasional
+        outlier, like a page fault or a context switch. */
+    Result measure(const std::string &name, size_t ops, const std::function<void()> &fn,
+                   unsigned runs =kDefaultRuns);
+
+} }
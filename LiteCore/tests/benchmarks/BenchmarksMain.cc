@@ -0,0 +1,59 @@
+//
+// BenchmarksMain.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// This defines the main entry point of the LiteCoreBenchmarks target. The benchmarks are
+// 'Catch' test cases, so the usual Catch arguments select which ones run. In addition,
+// `--json PATH` writes the results to a JSON file, for tracking them over time.
+
+#define CATCH_CONFIG_CONSOLE_WIDTH 120
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include "CaseListReporter.hh"
+#include "BenchmarkReport.hh"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+int main(int argc, char *argv[]) {
+    // Take out the `--json PATH` argument before Catch sees it:
+    string jsonPath;
+    vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+            args.push_back(argv[i]);
+    }
+
+    int result = Catch::Session().run(int(args.size()), args.data());
+
+    if (!jsonPath.empty()) {
+        if (litecore::benchmark::Report::instance().writeJSON(jsonPath)) {
+            cerr << "Wrote benchmark results to " << jsonPath << "\n";
+        } else {
+            cerr << "Couldn't write benchmark results to " << jsonPath << "\n";
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,252 @@
+//
+// QueryBenchmarks.cc
+//
+// Copyright © 2019 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Microbenchmarks of query translation and of the SQLite functions that queries call.
+// Each SQL function benchmark runs a statement over a generated table of documents, so its
+// time per row includes SQLite's own per-row overhead; the "baseline" benchmark measures
+// that overhead by itself, to subtract when comparing kernels.
+
+#include "BenchmarkReport.hh"
+#include "QueryParser.hh"
+#include "SQLite_Internal.hh"
+#include "UnicodeCollator.hh"
+#include "FleeceImpl.hh"
+#include "StringUtil.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include "catch.hpp"
+#include <random>
+#include <sstream>
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+using namespace litecore;
+using namespace litecore::benchmark;
+
+
+#pragma mark - DATASET:
+
+
+// Generates the same documents every time, so that results are comparable between runs.
+class BenchmarkDataset {
+public:
+    static constexpr unsigned kNumDocs = 10000;
+
+    BenchmarkDataset() {
+        static const char* const kFirst[] = {"Ada", "Björn", "Chloé", "Dmitri", "Émile", "Fatima",
+                                             "Günther", "Hiroshi", "Inés", "José", "Kai", "Léa"};
+        static const char* const kLast[] = {"Anderson", "Bäcker", "Çelik", "Dubois", "Eriksson",
+                                            "Fernández", "García", "Hölzl", "Ivanov", "Jansen"};
+        static const char* const kCities[] = {"Zürich", "São Paulo", "Reykjavík", "Kraków",
+                                              "Montréal", "Malmö", "Bogotá", "Lyon", "Oslo"};
+        static const char* const kTags[] = {"red", "green", "blue", "cyan", "magenta", "yellow",
+                                            "black", "white", "orange", "purple", "brown", "gray"};
+        mt19937 random(20190101);
+        uniform_int_distribution<int> age(18, 90), numTags(0, 8);
+        uniform_real_distribution<double> score(0.0, 100.0);
+
+        _docs.reserve(kNumDocs);
+        for (unsigned i = 0; i < kNumDocs; ++i) {
+            stringstream json;
+            json << "{\"name\":{\"first\":\"" << pick(kFirst, random)
+                 << "\",\"last\":\"" << pick(kLast, random)
+                 << "\"},\"age\":" << age(random) << ",\"city\":\"" << pick(kCities, random)
+                 << "\",\"tags\":[";
+            for (int t = numTags(random); t > 0; --t)
+                json << "\"" << pick(kTags, random) << "\"" << (t > 1 ? "," : "");
+            json << "],\"scores\":[";
+            for (int s = 0; s < 10; ++s)
+                json << score(random) << (s < 9 ? "," : "");
+            json << "]}";
+            _docs.push_back(JSONConverter::convertJSON(slice(json.str())));
+        }
+    }
+
+    const vector<alloc_slice>& docs() const     {return _docs;}
+
+private:
+    template <size_t N>
+    static const char* pick(const char* const (&array)[N], mt19937 &random) {
+        return array[uniform_int_distribution<size_t>(0, N - 1)(random)];
+    }
+
+    vector<alloc_slice> _docs;
+};
+
+
+#pragma mark - QUERYPARSER:
+
+
+class QueryParserBench : public QueryParser::delegate {
+public:
+    virtual string tableName() const override {
+        return "kv_default";
+    }
+    virtual string FTSTableName(const string &property) const override {
+        return tableName() + "::" + property;
+    }
+    virtual string unnestedTableName(const string &property) const override {
+        return tableName() + ":unnest:" + property;
+    }
+    virtual string geoTableName(const string &identifier) const override {
+        return tableName() + ":geo:" + identifier;
+    }
+    virtual string vectorTableName(const string &identifier) const override {
+        return tableName() + ":vector:" + identifier;
+    }
+    virtual bool tableExists(const string &tableName) const override {
+        return false;
+    }
+#ifdef COUCHBASE_ENTERPRISE
+    virtual string predictiveTableName(const string &property) const override {
+        return tableName() + ":predict:" + property;
+    }
+#endif
+
+    void benchParse(const char *name, const char *json) {
+        static constexpr size_t kIterations = 5000;
+        alloc_slice jsonSlice(json);
+        measure(string("QueryParser ") + name, kIterations, [&] {
+            for (size_t i = 0; i < kIterations; ++i) {
+                QueryParser qp(*this);
+                qp.parseJSON(jsonSlice);
+            }
+        });
+    }
+};
+
+
+TEST_CASE_METHOD(QueryParserBench, "Bench QueryParser", "[Bench][Query]") {
+    benchParse("simple WHERE",
+               R"({"WHERE": ["=", [".name.last"], "Dubois"]})");
+    benchParse("SELECT with ORDER BY",
+               R"({"WHAT": [[".name.first"], [".age"]],
+                   "WHERE": ["AND", [">", [".age"], 30], ["<", [".age"], 60]],
+                   "ORDER_BY": [["DESC", [".age"]], [".name.first"]],
+                   "LIMIT": 100})");
+    benchParse("ANY",
+               R"({"WHERE": ["ANY", "tag", [".tags"], ["=", ["?tag"], "blue"]]})");
+    benchParse("collated ORDER BY",
+               R"({"WHAT": [[".name.last"]],
+                   "ORDER_BY": [["COLLATE", {"unicode": true, "case": false}, [".name.last"]]]})");
+    benchParse("aggregate GROUP BY",
+               R"({"WHAT": [[".city"], ["COUNT()", [".age"]], ["AVG()", [".age"]]],
+                   "GROUP_BY": [[".city"]],
+                   "HAVING": [">", ["COUNT()", [".age"]], 10]})");
+    benchParse("functions",
+               R"({"WHERE": ["AND", ["contains()", ["lower()", [".city"]], "o"],
+                                    [">", ["array_sum()", [".scores"]], 500],
+                                    ["regexp_like()", [".name.first"], "^[A-F]"]]})");
+}
+
+
+#pragma mark - SQLITE FUNCTIONS:
+
+
+class SQLiteFunctionsBench {
+public:
+    SQLiteFunctionsBench()
+    :db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)
+    {
+        RegisterSQLiteFunctions(db.getHandle(), {nullptr, nullptr, nullptr});
+        RegisterSQLiteUnicodeCollations(db.getHandle(), collationContexts);
+        db.exec("CREATE TABLE kv (key TEXT, body BLOB)");
+        SQLite::Transaction t(db);
+        SQLite::Statement insert(db, "INSERT INTO kv (key, body) VALUES (?, ?)");
+        unsigned i = 0;
+        for (auto &doc : dataset().docs()) {
+            insert.bind(1, stringWithFormat("doc-%05u", ++i));
+            insert.bind(2, doc.buf, (int)doc.size);
+            insert.exec();
+            insert.reset();
+        }
+        t.commit();
+    }
+
+    static const BenchmarkDataset& dataset() {
+        static BenchmarkDataset sDataset;
+        return sDataset;
+    }
+
+    // Times a query over the whole table, reporting the time per row it visits.
+    void benchQuery(const char *name, const char *sql) {
+        static constexpr unsigned kIterations = 10;
+        SQLite::Statement stmt(db, sql);
+        size_t ops = size_t(kIterations) * BenchmarkDataset::kNumDocs;
+        measure(name, ops, [&] {
+            for (unsigned i = 0; i < kIterations; ++i) {
+                while (stmt.executeStep())
+                    ;
+                stmt.reset();
+            }
+        });
+    }
+
+protected:
+    CollationContextVector collationContexts;   // must outlive the db
+    SQLite::Database db;
+};
+
+
+TEST_CASE_METHOD(SQLiteFunctionsBench, "Bench SQLite Fleece functions", "[Bench][Query]") {
+    benchQuery("baseline (row scan)",
+               "SELECT count(*) FROM kv WHERE length(body) > 0");
+    benchQuery("fl_value (top level)",
+               "SELECT count(*) FROM kv WHERE fl_value(body, 'age') > 50");
+    benchQuery("fl_value (nested path)",
+               "SELECT count(*) FROM kv WHERE fl_value(body, 'name.last') = 'Dubois'");
+    benchQuery("fl_contains",
+               "SELECT count(*) FROM kv WHERE fl_contains(body, 'tags', 'blue')");
+    benchQuery("fl_count",
+               "SELECT count(*) FROM kv WHERE fl_count(body, 'tags') > 3");
+    benchQuery("fl_each (per document)",
+               "SELECT count(*) FROM kv, fl_each(kv.body, 'tags') WHERE fl_each.value = 'blue'");
+    benchQuery("fl_each (ANY with range)",
+               "SELECT count(*) FROM kv WHERE EXISTS (SELECT 1 FROM fl_each(kv.body, 'scores') AS _X"
+               " WHERE _X.value > 99)");
+}
+
+
+TEST_CASE_METHOD(SQLiteFunctionsBench, "Bench SQLite N1QL functions", "[Bench][Query]") {
+    benchQuery("N1QL lower",
+               "SELECT count(*) FROM kv WHERE N1QL_lower(fl_value(body, 'city')) = 'lyon'");
+    benchQuery("N1QL contains",
+               "SELECT count(*) FROM kv WHERE contains(fl_value(body, 'city'), 'ó')");
+    benchQuery("N1QL regexp_like",
+               "SELECT count(*) FROM kv WHERE regexp_like(fl_value(body, 'name.first'), '^[A-F]')");
+    benchQuery("N1QL array_sum",
+               "SELECT count(*) FROM kv WHERE array_sum(fl_value(body, 'scores')) > 500");
+    benchQuery("N1QL round",
+               "SELECT sum(round(fl_value(body, 'scores[0]'), 1)) FROM kv");
+}
+
+
+TEST_CASE_METHOD(SQLiteFunctionsBench, "Bench SQLite collation", "[Bench][Query][Collation]") {
+    // A sort does O(n log n) comparisons, but this reports time per row sorted.
+    benchQuery("ORDER BY BINARY",
+               "SELECT fl_value(body, 'name.last') AS n FROM kv ORDER BY n");
+    Collation unicode(false, true, nullslice);
+    string sql = "SELECT fl_value(body, 'name.last') AS n FROM kv ORDER BY n COLLATE "
+                 + unicode.sqliteName();
+    benchQuery("ORDER BY Unicode collation", sql.c_str());
+    if (SupportsCollationSortKeys()) {
+        sql = "SELECT fl_value(body, 'name.last') AS n FROM kv ORDER BY collation_key(n, '"
+              + unicode.sqliteName() + "')";
+        benchQuery("ORDER BY Unicode sort key", sql.c_str());
+    }
+}
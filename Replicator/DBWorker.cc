@@ -32,7 +32,9 @@
 #include "c4Replicator.h"
 #include "BLIP.hh"
 #include "RevID.hh"
+#include "VersionVector.hh"
 #include <chrono>
+#include <climits>
 #ifndef __APPLE__
 #include "arc4random.h"
 #endif
@@ -49,6 +51,13 @@ namespace litecore { namespace repl {
         return err.domain == LiteCoreDomain && err.code == kC4ErrorNotFound;
     }
 
+    // Returns the version vector of a doc's current revision (in a version-vector database.)
+    static VersionVector currentVersionVector(C4Document *doc) {
+        c4doc_selectCurrentRevision(doc);
+        alloc_slice vector(c4doc_getRevisionHistory(doc, UINT_MAX, nullptr, 0));
+        return VersionVector(vector);
+    }
+
     DBWorker::DBWorker(Replicator *replicator,
                        C4Database *db,
                        const websocket::URL &remoteURL)
@@ -64,6 +73,7 @@ namespace litecore { namespace repl {
         registerHandler("setCheckpoint",    &DBWorker::handleSetCheckpoint);
         _disableBlobSupport = _options.properties["disable_blob_support"_sl].asBool();
         _disableDeltaSupport = _options.properties[kC4ReplicatorOptionDisableDeltas].asBool();
+        _usingVersionVectors = (c4db_getConfig(db)->versioning == kC4VersionVectors);
     }
 
 
@@ -384,12 +394,23 @@ namespace litecore { namespace repl {
 
         if (p.continuous && p.limit > 0 && !_changeObserver) {
             // Reached the end of history; now start observing for future changes
-            _changeObserver = c4dbobs_create(_db,
-                                             [](C4DatabaseObserver* observer, void *context) {
-                                                 auto self = (DBWorker*)context;
-                                                 self->enqueue(&DBWorker::dbChanged);
-                                             },
-                                             this);
+            auto callback = [](C4DatabaseObserver* observer, void *context) {
+                auto self = (DBWorker*)context;
+                self->enqueue(&DBWorker::dbChanged);
+            };
+            if (_pushDocIDs) {
+                // Let the observer skip changes to other docs, so they don't wake us up:
+                vector<C4String> docIDs;
+                docIDs.reserve(_pushDocIDs->size());
+                for (auto &docID : *_pushDocIDs)
+                    docIDs.push_back(slice(docID));
+                C4DatabaseObserverFilter filter = {};
+                filter.docIDs = docIDs.data();
+                filter.docIDCount = docIDs.size();
+                _changeObserver = c4dbobs_createFiltered(_db, &filter, callback, this);
+            } else {
+                _changeObserver = c4dbobs_create(_db, callback, this);
+            }
             logDebug("Started DB observer");
         }
     }
@@ -505,6 +526,23 @@ namespace litecore { namespace repl {
         if (!proposed)
             _markRevsSyncedNow();   // make sure foreign ancestors are up to date
 
+        if (!changes.empty()) {
+            // A peer that versions documents differently can't replicate with me; fail clearly
+            // instead of misreading its revIDs:
+            slice revID = changes[0].asArray()[proposed ? 1 : 2].asString();
+            if (revID && !isCompatibleRevID(revID)) {
+                slice message = _usingVersionVectors
+                    ? "Peer uses revision trees, but this database uses version vectors"_sl
+                    : "Peer uses version vectors, but this database uses revision trees"_sl;
+                C4Error err = c4error_make(LiteCoreDomain, kC4ErrorUnsupported, message);
+                req->respondWithError(c4ToBLIPError(err));
+                gotError(err);
+                if (callback)
+                    callback(vector<bool>());   // (don't mark the changes as handled)
+                return;
+            }
+        }
+
         MessageBuilder response(req);
         response.compressed = true;
         response["maxHistory"_sl] = c4db_getMaxRevTreeDepth(_db);
@@ -574,6 +612,12 @@ namespace litecore { namespace repl {
     }
 
 
+    // Version-vector versions look like "gen@peer", and rev-tree revIDs like "gen-digest".
+    bool DBWorker::isCompatibleRevID(slice revID) const {
+        return (revID.findByte('@') != nullptr) == _usingVersionVectors;
+    }
+
+
     // Returns true if revision exists; else returns false and sets ancestors to an array of
     // ancestor revisions I do have (empty if doc doesn't exist at all)
     bool DBWorker::findAncestors(slice docID, slice revID, vector<alloc_slice> &ancestors) {
@@ -590,7 +634,11 @@ namespace litecore { namespace repl {
         }
         
         ancestors.resize(0);
-        if (doc) {
+        if (doc && _usingVersionVectors) {
+            // A version that's included in my current version vector is one I already have;
+            // otherwise there are no ancestors to report, since the vector is the history:
+            return currentVersionVector(doc).compareTo(Version(revID)) != kOlder;
+        } else if (doc) {
             // Revision isn't found, but look for ancestors:
             if (c4doc_selectFirstPossibleAncestorOf(doc, revID)) {
                 do {
@@ -643,6 +691,8 @@ namespace litecore { namespace repl {
         if (slice(doc->revID) == revID) {
             // I already have this revision:
             status = 304;
+        } else if (_usingVersionVectors) {
+            status = findProposedVersion(doc, revID, parentRevID);
         } else if (!parentRevID) {
             // Peer is creating new doc; that's OK if doc is currently deleted:
             status = (doc->flags & kDocDeleted) ? 0 : 409;
@@ -659,6 +709,27 @@ namespace litecore { namespace repl {
     }
 
 
+    // findProposedChange for version vectors. Instead of walking revisions, this just compares
+    // the proposed version, and the parent if any, with my current revision's vector.
+    int DBWorker::findProposedVersion(C4Document *doc, slice revID, slice parentRevID) {
+        VersionVector myVector = currentVersionVector(doc);
+        if (myVector.compareTo(Version(revID)) != kOlder) {
+            // I already have this version, or a newer one:
+            return 304;
+        } else if (!parentRevID) {
+            // Peer is creating new doc; that's OK if doc is currently deleted:
+            return (doc->flags & kDocDeleted) ? 0 : 409;
+        } else {
+            // It's not a conflict if the peer's parent is (or includes) my current revision:
+            VersionVector parent(parentRevID);
+            if (parent.count() == 1)
+                return (parent.current() == myVector.current()) ? 0 : 409;
+            auto order = myVector.compareTo(parent);
+            return (order == kSame || order == kOlder) ? 0 : 409;
+        }
+    }
+
+
 #pragma mark - SENDING REVISIONS:
 
 
@@ -795,28 +866,41 @@ namespace litecore { namespace repl {
 
     string DBWorker::revHistoryString(C4Document *doc, const RevToSend &request) {
         Assert(c4doc_selectRevision(doc, request.revID, true, nullptr));
-        stringstream historyStream;
-        int nWritten = 0;
-        unsigned lastGen = c4rev_getGeneration(doc->selectedRev.revID);
-        for (int n = 0; n < request.maxHistory; ++n) {
-            if (!c4doc_selectParentRevision(doc))
-                break;
-            slice revID = doc->selectedRev.revID;
+        auto backTo = request.remoteAncestors();
+        alloc_slice revIDs(c4doc_getRevisionHistory(doc, request.maxHistory + 1,
+                                                    backTo.data(), unsigned(backTo.size())));
+        if (_usingVersionVectors) {
+            // The history is the rest of the revision's version vector; there are no gaps:
+            auto comma = (const char*)revIDs.findByte(',');
+            return comma ? string(comma + 1, (const char*)revIDs.end()) : string();
+        }
+        // The first revID is the revision's own; the rest are its ancestors':
+        string history;
+        history.reserve(revIDs.size);
+        unsigned lastGen = 0;
+        slice remaining = revIDs;
+        while (remaining.size > 0) {
+            auto comma = (const char*)memchr(remaining.buf, ',', remaining.size);
+            slice revID(remaining.buf, comma ? comma : remaining.end());
+            remaining = comma ? slice(comma + 1, remaining.end()) : nullslice;
             unsigned gen = c4rev_getGeneration(revID);
+            if (revID.buf == revIDs.buf) {
+                lastGen = gen;
+                continue;
+            }
+            // Fill any gap in the generations (left by pruning) with fake revIDs:
             while (gen < --lastGen) {
                 char fakeID[50];
                 sprintf(fakeID, "%u-faded000%.08x%.08x", lastGen, arc4random(), arc4random());
-                if (nWritten++ > 0)
-                    historyStream << ',';
-                historyStream << fakeID;
+                if (!history.empty())
+                    history += ',';
+                history += fakeID;
             }
-            if (nWritten++ > 0)
-                historyStream << ',';
-            historyStream << revID.asString();
-            if (request.hasRemoteAncestor(revID))
-                break;
+            if (!history.empty())
+                history += ',';
+            history.append((const char*)revID.buf, revID.size);
         }
-        return historyStream.str();
+        return history;
     }
 
 
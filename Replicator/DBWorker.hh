@@ -149,6 +149,8 @@ namespace litecore { namespace repl {
                            std::vector<alloc_slice> &ancestors);
         int findProposedChange(slice docID, slice revID, slice parentRevID,
                                alloc_slice &outCurrentRevID);
+        int findProposedVersion(C4Document* NONNULL, slice revID, slice parentRevID);
+        bool isCompatibleRevID(slice revID) const;
         void updateRemoteRev(C4Document* NONNULL);
         ActivityLevel computeActivityLevel() const override;
 
@@ -173,6 +175,7 @@ namespace litecore { namespace repl {
         std::mutex _insertionQueueMutex;                    // For safe access to the above
         bool _disableBlobSupport {false};                   // for testing only
         bool _disableDeltaSupport {false};                  // From "noDeltas" replicator option
+        bool _usingVersionVectors {false};                  // Does the db use version vectors?
     };
 
 } }
@@ -20,6 +20,7 @@
 #include "Replicator.hh"
 #include "StringUtil.hh"
 #include "MessageBuilder.hh"
+#include <algorithm>
 #include <atomic>
 
 using namespace fleece;
@@ -45,28 +46,49 @@ namespace litecore { namespace repl {
     }
     
 
+    // If an earlier download of the blob was interrupted, the data it saved is kept, and only
+    // the rest is requested.
     void IncomingBlob::_start(PendingBlob blob) {
         Assert(!_writer);
         _blob = blob;
-        logVerbose("Requesting blob (%llu bytes, compress=%d)", _blob.length, _blob.compressible);
+        _skipBytes = 0;
+        _checkedReply = false;
 
-        addProgress({0, _blob.length});
+        C4Error err;
+        _writer = c4blob_openResumableWriteStream(_blobStore, _blob.key, &_offset, &err);
+        if (!_writer)
+            return gotError(err);
+#if DEBUG
+        int n = ++sNumOpenWriters;
+        if (n > sMaxOpenWriters) {
+            sMaxOpenWriters = n;
+            logInfo("There are now %d blob writers open", n);
+        }
+        logVerbose("Opened writer  [%d open; max %d]", n, (int)sMaxOpenWriters);
+#endif
+        logVerbose("Requesting blob (%llu bytes, offset=%llu, compress=%d)",
+                   _blob.length, _offset, _blob.compressible);
+
+        addProgress({_offset, _blob.length});
 
         MessageBuilder req("getAttachment"_sl);
         alloc_slice digest = c4blob_keyToString(_blob.key);
         req["digest"_sl] = digest;
+        if (_offset > 0)
+            req["offset"_sl] = (int64_t)_offset;
         if (_blob.compressible)
             req["compress"_sl] = "true"_sl;
         sendRequest(req, [=](blip::MessageProgress progress) {
             //... After request is sent:
             if (_busy) {
                 if (progress.state == MessageProgress::kDisconnected) {
-                    closeWriter();
+                    closeWriter(true);
                 } else if (progress.reply) {
                     if (progress.reply->isError()) {
                         gotError(progress.reply);
                         notifyProgress(true);
                     } else {
+                        checkReply(progress.reply);
                         bool complete = progress.state == MessageProgress::kComplete;
                         auto data = progress.reply->extractBody();
                         writeToBlob(data);
@@ -82,24 +104,32 @@ namespace litecore { namespace repl {
     }
 
 
+    // A peer that doesn't support ranges ignores the "offset" property and sends the whole
+    // blob, so the part I already have has to be skipped.
+    void IncomingBlob::checkReply(MessageIn *reply) {
+        if (_checkedReply)
+            return;
+        _checkedReply = true;
+        if (_offset > 0 && reply->intProperty("offset"_sl) != (long)_offset) {
+            logVerbose("Peer ignored offset; skipping the first %llu bytes", _offset);
+            _skipBytes = _offset;
+        }
+    }
+
+
     void IncomingBlob::writeToBlob(alloc_slice data) {
+        if (!_writer)
+            return;
+        slice newData = data;
+        if (_skipBytes > 0) {
+            auto skip = (size_t)std::min((uint64_t)newData.size, _skipBytes);
+            newData.moveStart(skip);
+            _skipBytes -= skip;
+        }
         C4Error err;
-		if(_writer == nullptr) {
-            _writer = c4blob_openWriteStream(_blobStore, &err);
-            if (!_writer)
-                return gotError(err);
-#if DEBUG
-            int n = ++sNumOpenWriters;
-            if (n > sMaxOpenWriters) {
-                sMaxOpenWriters = n;
-                logInfo("There are now %d blob writers open", n);
-            }
-            logVerbose("Opened writer  [%d open; max %d]", n, (int)sMaxOpenWriters);
-#endif
-		}
-        if (!c4stream_write(_writer, data.buf, data.size, &err))
+        if (newData.size > 0 && !c4stream_write(_writer, newData.buf, newData.size, &err))
             return gotError(err);
-        addProgress({data.size, 0});
+        addProgress({newData.size, 0});
     }
 
 
@@ -131,13 +161,24 @@ namespace litecore { namespace repl {
     }
 
 
-    void IncomingBlob::closeWriter() {
-        _writer = nullptr;
-        _busy = false;
+    // If `saveData` is true, the data received so far is saved, so the next attempt to download
+    // the blob can resume after it.
+    void IncomingBlob::closeWriter(bool saveData) {
+        if (saveData && _writer) {
+            C4Error err;
+            if (c4stream_suspend(_writer, &err))
+                logVerbose("Saved partial blob for resuming later");
+            else
+                warn("Couldn't save partial blob: error %d/%d", err.domain, err.code);
+        }
 #if DEBUG
-        int n = --sNumOpenWriters;
-        logVerbose("Closing;  [%d open]", n);
+        if (_writer) {
+            int n = --sNumOpenWriters;
+            logVerbose("Closing;  [%d open]", n);
+        }
 #endif
+        _writer = nullptr;
+        _busy = false;
     }
 
 
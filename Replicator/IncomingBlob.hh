@@ -35,16 +35,20 @@ namespace litecore { namespace repl {
 
     private:
         void _start(PendingBlob);
+        void checkReply(blip::MessageIn*);
         void writeToBlob(fleece::alloc_slice);
         void finishBlob();
         void notifyProgress(bool always);
-        void closeWriter();
+        void closeWriter(bool saveData =false);
         virtual void onError(C4Error) override;
         virtual ActivityLevel computeActivityLevel() const override;
 
         C4BlobStore* const _blobStore;
         PendingBlob _blob;
         c4::ref<C4WriteStream> _writer;
+        uint64_t _offset {0};               // Bytes saved by an earlier, interrupted download
+        uint64_t _skipBytes {0};            // Bytes to ignore at the start of the reply
+        bool _checkedReply {false};
         bool _busy {false};
         actor::Timer::time _lastNotifyTime;
     };
@@ -23,6 +23,7 @@
 #include "StringUtil.hh"
 #include "c4Document+Fleece.h"
 #include "BLIP.hh"
+#include <algorithm>
 #include <deque>
 #include <set>
 
@@ -145,35 +146,56 @@ namespace litecore { namespace repl {
             }
         }
 
-        // Request the first blob, or if there are none, finish:
-        if (!fetchNextBlob())
+        // Request the first blobs, or if there are none, finish:
+        if (!fetchNextBlobs())
             insertRevision();
     }
 
 
-    bool IncomingRev::fetchNextBlob() {
+    // Starts fetching as many pending blobs as the `maxBlobFetches` option and the Puller's
+    // budget of blob bytes allow. Returns false if no blobs are left being fetched.
+    bool IncomingRev::fetchNextBlobs() {
         auto blobStore = _dbWorker->blobStore();
-        while (!_pendingBlobs.empty()) {
+        auto maxFetches = _options.maxBlobFetches();
+        while (!_pendingBlobs.empty() && _activeBlobs.size() < maxFetches) {
             PendingBlob firstPending = _pendingBlobs.front();
-            _pendingBlobs.erase(_pendingBlobs.begin());
             if (c4blob_getSize(blobStore, firstPending.key) < 0) {
-                if (!_currentBlob)
-                    _currentBlob = new IncomingBlob(this, blobStore);
-                _currentBlob->start(firstPending);
-                return true;
+                // The first blob is fetched regardless of the budget, so this rev can't stall:
+                if (!_puller->reserveBlobBytes(firstPending.length, _activeBlobs.empty()))
+                    break;
+                Retained<IncomingBlob> blob;
+                if (_spareBlobs.empty()) {
+                    blob = new IncomingBlob(this, blobStore);
+                } else {
+                    blob = _spareBlobs.back();
+                    _spareBlobs.pop_back();
+                }
+                blob->start(firstPending);
+                _activeBlobs.emplace_back(blob, firstPending.length);
             }
+            _pendingBlobs.erase(_pendingBlobs.begin());
         }
-        _currentBlob = nullptr;
-        return false;
+        if (_activeBlobs.empty())
+            _spareBlobs.clear();
+        return !_activeBlobs.empty();
     }
 
 
     void IncomingRev::_childChangedStatus(Worker *task, Status status) {
         addProgress(status.progressDelta);
         if (status.level == kC4Idle) {
+            auto i = find_if(_activeBlobs.begin(), _activeBlobs.end(),
+                             [&](const pair<Retained<IncomingBlob>,uint64_t> &active) {
+                                 return active.first.get() == task;
+                             });
+            if (i == _activeBlobs.end())
+                return;
+            _puller->releaseBlobBytes(i->second);
+            _spareBlobs.push_back(i->first);
+            _activeBlobs.erase(i);
             if (status.error.code && !_error.code)
                 _error = status.error;
-            if (!fetchNextBlob()) {
+            if (!fetchNextBlobs()) {
                 // All blobs completed, now finish:
                 if (_error.code == 0) {
                     logVerbose("All blobs received, now inserting revision");
@@ -188,7 +210,7 @@ namespace litecore { namespace repl {
 
     // Asks the DBAgent to insert the revision, then sends the reply and notifies the Puller.
     void IncomingRev::insertRevision() {
-        Assert(_pendingBlobs.empty() && !_currentBlob);
+        Assert(_pendingBlobs.empty() && _activeBlobs.empty());
         increment(_pendingCallbacks);
         _rev->onInserted = asynchronize([this](C4Error err) {
             // Callback that will run _after_ insertRevision() completes:
@@ -219,10 +241,10 @@ namespace litecore { namespace repl {
         }
 
         // Free up memory now that I'm done:
-        Assert(_pendingCallbacks == 0 && !_currentBlob && _pendingBlobs.empty());
+        Assert(_pendingCallbacks == 0 && _activeBlobs.empty() && _pendingBlobs.empty());
         _revMessage = nullptr;
         _rev = nullptr;
-        _currentBlob = nullptr;
+        _spareBlobs.clear();
         _pendingBlobs.clear();
 
         _puller->revWasHandled(this);
@@ -230,7 +252,8 @@ namespace litecore { namespace repl {
 
 
     Worker::ActivityLevel IncomingRev::computeActivityLevel() const {
-        if (Worker::computeActivityLevel() == kC4Busy || _pendingCallbacks > 0 || _currentBlob) {
+        if (Worker::computeActivityLevel() == kC4Busy || _pendingCallbacks > 0
+                || !_activeBlobs.empty()) {
             return kC4Busy;
         } else {
             return kC4Stopped;
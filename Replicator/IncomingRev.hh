@@ -20,6 +20,7 @@
 #include "Worker.hh"
 #include "ReplicatorTypes.hh"
 #include "function_ref.hh"
+#include <utility>
 #include <vector>
 
 namespace litecore { namespace repl {
@@ -52,7 +53,7 @@ namespace litecore { namespace repl {
         void _handleRev(Retained<blip::MessageIn>);
         void gotDeltaSrc(alloc_slice deltaSrcBody);
         void processBody(alloc_slice fleeceBody, C4Error);
-        bool fetchNextBlob();
+        bool fetchNextBlobs();
         void insertRevision();
         void finish();
         virtual void _childChangedStatus(Worker *task, Status status) override;
@@ -64,7 +65,8 @@ namespace litecore { namespace repl {
         Retained<RevToInsert> _rev;
         unsigned _pendingCallbacks {0};
         std::vector<PendingBlob> _pendingBlobs;
-        Retained<IncomingBlob> _currentBlob;
+        std::vector<std::pair<Retained<IncomingBlob>,uint64_t>> _activeBlobs; // with reserved bytes
+        std::vector<Retained<IncomingBlob>> _spareBlobs;
         C4Error _error {};
         int _peerError {0};
         alloc_slice _docID, _remoteSequence;
@@ -242,6 +242,17 @@ namespace litecore { namespace repl {
     }
 
 
+    // Called on IncomingRevs' threads, so it uses compare-and-swap instead of the actor queue.
+    bool Puller::reserveBlobBytes(uint64_t bytes, bool always) {
+        uint64_t current = _blobBytesInFlight;
+        do {
+            if (!always && current + bytes > tuning::kMaxBlobBytesInFlight)
+                return false;
+        } while (!_blobBytesInFlight.compare_exchange_weak(current, current + bytes));
+        return true;
+    }
+
+
     // Callback from an IncomingRev when it's finished (either added to db, or failed)
     void Puller::_revsFinished()
     {
@@ -21,6 +21,7 @@
 #include "Actor.hh"
 #include "RemoteSequenceSet.hh"
 #include "Batcher.hh"
+#include <atomic>
 #include <deque>
 
 namespace litecore { namespace repl {
@@ -39,6 +40,11 @@ namespace litecore { namespace repl {
         // Called only by IncomingRev
         void revWasHandled(IncomingRev *inc);
 
+        // Called only by IncomingRev, to share a budget of blob bytes being downloaded.
+        // Returns false if there isn't room for `bytes` more, unless `always` is true.
+        bool reserveBlobBytes(uint64_t bytes, bool always);
+        void releaseBlobBytes(uint64_t bytes)   {_blobBytesInFlight -= bytes;}
+
     protected:
         virtual std::string loggingClassName() const override       {return "Pull";}
 
@@ -74,6 +80,7 @@ namespace litecore { namespace repl {
         bool _waitingForChangesCallback {false};  // Waiting for DBAgent::findOrRequestRevs?
         unsigned _pendingRevMessages {0};   // # of 'rev' msgs expected but not yet being processed
         unsigned _activeIncomingRevs {0};   // # of IncomingRev workers running
+        std::atomic<uint64_t> _blobBytesInFlight {0}; // Length of blobs IncomingRevs are fetching
 
 #if __APPLE__
         // This helps limit the number of threads used by GCD:
@@ -433,18 +433,38 @@ namespace litecore { namespace repl {
     }
 
 
-    // Incoming request to send an attachment/blob
+    // Incoming request to send an attachment/blob, or a range of one. An "offset" property
+    // lets an interrupted download resume where it left off; "length" limits the range.
     void Pusher::handleGetAttachment(Retained<MessageIn> req) {
         slice digest;
         Replicator::BlobProgress progress;
         C4Error err;
         C4ReadStream* blob = readBlobFromRequest(req, digest, progress, &err);
         if (blob) {
+            int64_t blobLength = c4stream_getLength(blob, &err);
+            int64_t offset = max(req->intProperty("offset"_sl), 0l);
+            if (blobLength < 0 || offset > blobLength
+                               || (offset > 0 && !c4stream_seek(blob, offset, &err))) {
+                c4stream_close(blob);
+                if (blobLength >= 0 && offset > blobLength)
+                    req->respondWithError({"HTTP"_sl, 416, "Invalid blob range"_sl});
+                else
+                    req->respondWithError(c4ToBLIPError(err));
+                return;
+            }
+            uint64_t remaining = blobLength - offset;
+            int64_t maxLength = req->intProperty("length"_sl);
+            if (maxLength > 0)
+                remaining = min(remaining, (uint64_t)maxLength);
+            progress.bytesCompleted = offset;
+
             increment(_blobsInFlight);
             MessageBuilder reply(req);
             reply.compressed = req->boolProperty("compress"_sl);
-            logVerbose("Sending blob %.*s (length=%lld, compress=%d)",
-                       SPLAT(digest), c4stream_getLength(blob, nullptr), reply.compressed);
+            if (offset > 0)
+                reply["offset"_sl] = offset;        // (tells the requester the range was honored)
+            logVerbose("Sending blob %.*s (length=%lld, offset=%lld, compress=%d)",
+                       SPLAT(digest), blobLength, offset, reply.compressed);
             Retained<Replicator> repl = replicator();
             auto lastNotifyTime = actor::Timer::clock::now();
             if (progressNotificationLevel() >= 2)
@@ -455,8 +475,10 @@ namespace litecore { namespace repl {
                 // my state directly; instead it calls _attachmentSent() at the end.
                 C4Error err;
                 bool done = false;
-                ssize_t bytesRead = c4stream_read(blob, buf, capacity, &err);
+                size_t count = (size_t)min((uint64_t)capacity, remaining);
+                ssize_t bytesRead = c4stream_read(blob, buf, count, &err);
                 progress.bytesCompleted += bytesRead;
+                remaining -= bytesRead;
                 if (bytesRead < capacity) {
                     c4stream_close(blob);
                     this->enqueue(&Pusher::_attachmentSent);
@@ -62,6 +62,12 @@ namespace litecore { namespace repl {
             GCD dispatch queues results in lots of threads being created.) */
         constexpr unsigned kMaxActiveIncomingRevs = 100;
 
+        /* Maximum total length of the blobs being downloaded at once, by all IncomingRevs.
+            (The number of blobs a single revision downloads at once is set by the replicator
+            option `maxBlobFetches`.) A revision's first blob is fetched even if it goes over
+            this limit, so that a large blob can't stall its revision forever. */
+        constexpr uint64_t kMaxBlobBytesInFlight = 16*1024*1024;
+
         //// Pusher:
 
         /* If true, `changes` messages are sent in BLIP Urgent mode, which means they get
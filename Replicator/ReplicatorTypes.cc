@@ -56,6 +56,18 @@ namespace litecore { namespace repl {
     }
 
 
+    vector<C4String> RevToSend::remoteAncestors() const {
+        vector<C4String> result;
+        if (remoteAncestorRevID)
+            result.push_back(remoteAncestorRevID);
+        if (ancestorRevIDs) {
+            for (auto &revID : *ancestorRevIDs)
+                result.push_back(revID);
+        }
+        return result;
+    }
+
+
     RevToInsert::RevToInsert(slice docID_, slice revID_,
                              slice historyBuf_,
                              bool deleted_,
@@ -92,6 +92,9 @@ namespace litecore { namespace repl {
 
         void addRemoteAncestor(slice revID);
         bool hasRemoteAncestor(slice revID) const;
+
+        /** All the revIDs known to be ancestors that the peer already has. */
+        std::vector<C4String> remoteAncestors() const;
         
     protected:
         ~RevToSend() =default;
@@ -97,6 +97,15 @@ namespace litecore { namespace repl {
             bool noOutgoingConflicts() const  {return properties[kC4ReplicatorOptionNoIncomingConflicts].asBool();}
             int progressLevel() const  {return (int)properties[kC4ReplicatorOptionProgressLevel].asInt();}
 
+            static constexpr unsigned kDefaultMaxBlobFetches = 4;
+
+            unsigned maxBlobFetches() const {
+                auto n = properties[kC4ReplicatorOptionMaxBlobFetches].asInt();
+                if (n <= 0)
+                    n = kDefaultMaxBlobFetches;
+                return (unsigned)n;
+            }
+
             fleece::Array arrayProperty(const char *name) const {
                 return properties[name].asArray();
             }